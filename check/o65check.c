@@ -0,0 +1,373 @@
+/*
+ * Copyright (C) 2023 Southern Storm Software, Pty Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "o65validate.h"
+#include "o65pack.h"
+#include "o65prefetch.h"
+#include "o65stats.h"
+#include "o65tar.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#define short_options "f:qt:v"
+static struct option long_options[] = {
+    {"files-from",          required_argument,  0,  'f'},
+    {"quiet",               no_argument,        0,  'q'},
+    {"tar",                 required_argument,  0,  't'},
+    {"verbose",             no_argument,        0,  'v'},
+    {"stats",               optional_argument,  0,  'S'},
+    {"trace",               optional_argument,  0,  'T'},
+    {"trace-file",          required_argument,  0,  'F'},
+    {0,                     0,                  0,    0},
+};
+
+/** Source of the names of the files to check */
+typedef struct
+{
+    FILE *list;             /**< List file to read names from, or NULL */
+    char line[BUFSIZ];      /**< Current line from the list file */
+    char **argv;            /**< Names from the command-line */
+    int argc;               /**< Number of names from the command-line */
+
+} check_source_t;
+
+static int quiet = 0;
+static int verbose = 0;
+static o65_pack_t *packs = 0;
+
+static void usage(const char *progname);
+static const char *next_filename(void *ctx);
+static int check_file(o65_prefetch_file_t *input);
+static int check_data(const char *filename, const void *data, size_t size,
+                      uint64_t file_start);
+static int check_tar(const char *tar_file);
+
+int main(int argc, char *argv[])
+{
+    const char *progname = argv[0];
+    const char *list_file = 0;
+    const char *tar_file = 0;
+    check_source_t source;
+    o65_prefetch_t *prefetch;
+    o65_prefetch_file_t input;
+    int exit_val = 0;
+
+    /* Parse the command-line options */
+    for (;;) {
+        int opt = getopt_long(argc, argv, short_options, long_options, 0);
+        if (opt < 0)
+            break;
+        switch (opt) {
+        case 'f': list_file = optarg; break;
+        case 'q': quiet = 1; break;
+        case 't': tar_file = optarg; break;
+        case 'v': verbose = 1; break;
+
+        case 'S':
+        case 'T':
+            if (!o65_stats_option
+                    (optarg, opt == 'S' ? O65_STATS_SUMMARY : O65_STATS_TRACE)) {
+                fprintf(stderr, "%s: invalid statistics format '%s'\n",
+                        progname, optarg);
+                return 1;
+            }
+            break;
+
+        case 'F': o65_stats_trace_file(optarg); break;
+
+        default:
+            usage(progname);
+            return 1;
+        }
+    }
+
+    /* Need at least one file to check */
+    if (!list_file && !tar_file && (argc - optind) < 1) {
+        usage(progname);
+        return 1;
+    }
+
+    /* The files in the list file are checked first, then the files
+     * on the command-line */
+    memset(&source, 0, sizeof(source));
+    if (list_file && (source.list = fopen(list_file, "r")) == NULL) {
+        perror(list_file);
+        exit_val = 1;
+    }
+    source.argv = argv + optind;
+    source.argc = argc - optind;
+
+    /* Check all of the files.  The prefetcher keeps many files in flight
+     * so that the validator never has to wait for the disk. */
+    prefetch = o65_prefetch_new(0, next_filename, &source);
+    if (!prefetch) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    while (o65_prefetch_next(prefetch, &input)) {
+        if (!check_file(&input))
+            exit_val = 1;
+        o65_prefetch_release(&input);
+    }
+
+    /* Check the members of the tar archive */
+    if (tar_file && !check_tar(tar_file))
+        exit_val = 1;
+
+    /* Clean up and exit */
+    o65_prefetch_free(prefetch);
+    o65_pack_close(packs);
+    if (source.list)
+        fclose(source.list);
+    o65_stats_report(stderr);
+    return exit_val;
+}
+
+/**
+ * @brief Print usage information for the program.
+ *
+ * @param[in] progname Name of the program from argv[0].
+ */
+static void usage(const char *progname)
+{
+    fprintf(stderr, "Usage: %s [options] file1.o65 ...\n\n", progname);
+
+    fprintf(stderr, "Options:\n\n");
+
+    fprintf(stderr, "    --files-from LISTFILE, -f LISTFILE\n");
+    fprintf(stderr, "        File with a list of \".o65\" files to check, one per line.\n\n");
+
+    fprintf(stderr, "    --quiet, -q\n");
+    fprintf(stderr, "        Do not report why a file is invalid, only the exit status.\n\n");
+
+    fprintf(stderr, "    --tar ARCHIVE, -t ARCHIVE\n");
+    fprintf(stderr, "        Check all of the files in a tar archive, without extracting them.\n\n");
+
+    fprintf(stderr, "    --verbose, -v\n");
+    fprintf(stderr, "        Report the files that are valid as well as those that are not.\n\n");
+
+    fprintf(stderr, "    --stats[=json]\n");
+    fprintf(stderr, "        Report counters and timings on exit.\n\n");
+
+    fprintf(stderr, "    --trace[=json]\n");
+    fprintf(stderr, "        Report the time for each phase as it completes.\n\n");
+
+    fprintf(stderr, "    --trace-file TRACEFILE\n");
+    fprintf(stderr, "        Write a Chrome trace event file with the time for each phase.\n\n");
+}
+
+/**
+ * @brief Gets the name of the next file to check.
+ *
+ * @param[in,out] ctx Points to the check_source_t for the file names.
+ *
+ * @return The name of the next file, or NULL if there are no more files.
+ */
+static const char *next_filename(void *ctx)
+{
+    check_source_t *source = (check_source_t *)ctx;
+    size_t len;
+
+    /* Read names from the list file, ignoring blank lines */
+    while (source->list &&
+            fgets(source->line, sizeof(source->line), source->list)) {
+        len = strlen(source->line);
+        while (len > 0 && (source->line[len - 1] == '\n' ||
+                           source->line[len - 1] == '\r'))
+            --len;
+        source->line[len] = '\0';
+        if (len != 0)
+            return source->line;
+    }
+
+    /* Then use the names from the command-line */
+    if (source->argc > 0) {
+        --(source->argc);
+        return *(source->argv)++;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Checks a single ".o65" file.
+ *
+ * @param[in] input The file to check, after it was loaded by the prefetcher.
+ *
+ * @return Non-zero if the file is valid, zero if it is invalid or
+ * it could not be read.
+ */
+static int check_file(o65_prefetch_file_t *input)
+{
+    const char *filename = input->filename;
+    o65_pack_member_t member;
+    const void *data = input->data;
+    size_t size = input->size;
+    uint64_t file_start;
+    int result;
+
+    /* Names that don't exist may refer to members of a pack file */
+    file_start = O65_SPAN_BEGIN();
+    if (input->error == ENOENT && strchr(filename, ':')) {
+        result = o65_pack_lookup(filename, &packs, &member);
+        if (result > 0) {
+            if (!o65_pack_verify(&member)) {
+                if (!quiet)
+                    fprintf(stderr, "%s: fingerprint mismatch\n", filename);
+                return 0;
+            }
+            data = member.data;
+            size = member.size;
+            input->error = 0;
+        } else if (result < 0) {
+            input->error = errno;
+        }
+    }
+
+    if (input->error != 0) {
+        if (!quiet) {
+            errno = input->error;
+            perror(filename);
+        }
+        return 0;
+    }
+    return check_data(filename, data, size, file_start);
+}
+
+/**
+ * @brief Checks the contents of a single ".o65" file in memory.
+ *
+ * @param[in] filename Name of the file, for error reporting.
+ * @param[in] data Contents of the file.
+ * @param[in] size Size of the file contents.
+ * @param[in] file_start Time that processing of the file started.
+ *
+ * @return Non-zero if the file is valid, zero if it is invalid.
+ */
+static int check_data(const char *filename, const void *data, size_t size,
+                      uint64_t file_start)
+{
+    o65_validate_error_t error;
+    uint64_t start;
+    FILE *file;
+    int result;
+
+    /* Open an in-memory stream on the contents of the file */
+    start = O65_SPAN_BEGIN();
+    if ((file = fmemopen((void *)data, size, "rb")) == NULL) {
+        if (!quiet)
+            perror(filename);
+        return 0;
+    }
+    O65_SPAN_END(O65_SPAN_OPEN, start, filename);
+
+    /* Validate the contents */
+    start = O65_SPAN_BEGIN();
+    result = o65_validate(file, &error);
+    O65_SPAN_END(O65_SPAN_HEADER, start, filename);
+    if (result < 0) {
+        if (!quiet)
+            perror(filename);
+    } else if (result == 0) {
+        if (!quiet) {
+            fprintf(stderr, "%s:0x%lx: %s: %s\n", filename,
+                    error.offset, error.field, error.message);
+        }
+    } else if (verbose) {
+        printf("%s: OK\n", filename);
+    }
+    fclose(file);
+    O65_SPAN_END(O65_SPAN_FILE, file_start, filename);
+    return result > 0;
+}
+
+/**
+ * @brief Checks all of the files in a tar archive.
+ *
+ * @param[in] tar_file Name of the tar archive.
+ *
+ * @return Non-zero if all files are valid, zero if any are invalid or
+ * the archive could not be read.
+ *
+ * The archive is read once from start to finish and the members are
+ * checked in memory as they are read.  Members are reported as
+ * "ARCHIVE:NAME".
+ */
+static int check_tar(const char *tar_file)
+{
+    o65_tar_member_t member;
+    o65_tar_t tar;
+    char *name;
+    uint64_t file_start;
+    FILE *file;
+    int result;
+    int ok = 1;
+
+    /* Open the archive, which may be standard input */
+    if (!strcmp(tar_file, "-")) {
+        file = stdin;
+    } else if ((file = fopen(tar_file, "rb")) == NULL) {
+        perror(tar_file);
+        return 0;
+    }
+    name = malloc(strlen(tar_file) + O65_TAR_NAME_MAX + 2);
+    if (!name) {
+        fprintf(stderr, "out of memory\n");
+        if (file != stdin)
+            fclose(file);
+        return 0;
+    }
+
+    /* Check each of the members in turn */
+    o65_tar_init(&tar, file);
+    for (;;) {
+        file_start = O65_SPAN_BEGIN();
+        result = o65_tar_next(&tar, &member);
+        if (result < 0) {
+            if (feof(file))
+                fprintf(stderr, "%s: unexpected EOF\n", tar_file);
+            else
+                perror(tar_file);
+            ok = 0;
+            break;
+        } else if (result == 0) {
+            fprintf(stderr, "%s:0x%lx: %s\n", tar_file,
+                    (unsigned long)(member.offset), tar.error);
+            ok = 0;
+            break;
+        } else if (!member.name) {
+            break;
+        }
+        sprintf(name, "%s:%s", tar_file, member.name);
+        if (!check_data(name, member.data, member.size, file_start))
+            ok = 0;
+    }
+
+    /* Clean up */
+    o65_tar_free(&tar);
+    free(name);
+    if (file != stdin)
+        fclose(file);
+    return ok;
+}
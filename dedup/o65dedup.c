@@ -0,0 +1,855 @@
+/*
+ * Copyright (C) 2023 Southern Storm Software, Pty Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "o65hash.h"
+#include "o65stats.h"
+#include "o65visit.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define short_options "f:j:lnp"
+static struct option long_options[] = {
+    {"files-from",          required_argument,  0,  'f'},
+    {"jobs",                required_argument,  0,  'j'},
+    {"hardlink",            no_argument,        0,  'l'},
+    {"dry-run",             no_argument,        0,  'n'},
+    {"print",               no_argument,        0,  'p'},
+    {"stats",               optional_argument,  0,  'S'},
+    {"trace",               optional_argument,  0,  'T'},
+    {"trace-file",          required_argument,  0,  'F'},
+    {0,                     0,                  0,    0},
+};
+
+/** Maximum number of worker threads */
+#define MAX_JOBS 256
+
+/** Range of bytes in a file that contributes to the fingerprint */
+typedef struct
+{
+    size_t offset;          /**< Offset of the range in the file */
+    size_t len;             /**< Length of the range */
+
+} range_t;
+
+/** Canonical form of a file: its contents and the ranges that matter */
+typedef struct
+{
+    uint8_t *data;          /**< Contents of the file */
+    size_t size;            /**< Size of the file */
+    size_t max_size;        /**< Allocated size of the data buffer */
+    range_t *ranges;        /**< Ranges that contribute to the fingerprint */
+    size_t num_ranges;      /**< Number of ranges */
+    size_t max_ranges;      /**< Allocated size of the ranges array */
+
+} canonical_t;
+
+/** Information about an input file */
+typedef struct
+{
+    const char *filename;   /**< Name of the file */
+    char *copy;             /**< Copy of the name to free, or NULL */
+    size_t order;           /**< Position of the file in the input list */
+    uint64_t fingerprint;   /**< Fingerprint of the canonical contents */
+    uint64_t length;        /**< Length of the canonical contents */
+    uint64_t size;          /**< Size of the file on disk */
+    int valid;              /**< Non-zero if the file was fingerprinted */
+
+} file_info_t;
+
+/** State that is shared between the worker threads */
+typedef struct
+{
+    file_info_t *files;     /**< Files to be fingerprinted */
+    size_t num_files;       /**< Number of files */
+    size_t next_file;       /**< Index of the next file to process */
+
+} work_queue_t;
+
+/** State that is private to a worker thread */
+typedef struct
+{
+    work_queue_t *queue;    /**< Queue that is shared between the workers */
+    uint64_t counters[O65_STAT_COUNT]; /**< Statistics for this worker */
+
+} worker_t;
+
+static int load_canonical(canonical_t *canon, const char *filename);
+static void free_canonical(canonical_t *canon);
+static void *fingerprint_worker(void *arg);
+static int add_file(file_info_t **files, size_t *num_files,
+                    size_t *max_files, const char *filename, int copy);
+static void free_files(file_info_t *files, size_t num_files);
+static int add_files_from(file_info_t **files, size_t *num_files,
+                          size_t *max_files, const char *list_file);
+static int compare_files(const void *e1, const void *e2);
+static int same_canonical(const char *filename1, const char *filename2);
+static int same_file(const char *filename1, const char *filename2);
+static int hardlink_file(const char *master, const char *duplicate);
+static void usage(const char *progname);
+
+int main(int argc, char *argv[])
+{
+    const char *progname = argv[0];
+    const char *list_file = 0;
+    int jobs = 0;
+    int hardlink = 0;
+    int dry_run = 0;
+    int print = 0;
+    work_queue_t queue;
+    worker_t workers[MAX_JOBS];
+    file_info_t *files = NULL;
+    size_t num_files = 0;
+    size_t max_files = 0;
+    pthread_t threads[MAX_JOBS];
+    size_t index;
+    size_t group_start;
+    size_t num_groups = 0;
+    size_t num_duplicates = 0;
+    uint64_t saved = 0;
+    int exit_val = 0;
+    int thread;
+
+    /* Parse the command-line options */
+    for (;;) {
+        int opt = getopt_long(argc, argv, short_options, long_options, 0);
+        if (opt < 0)
+            break;
+        switch (opt) {
+        case 'f': list_file = optarg; break;
+
+        case 'j':
+            jobs = atoi(optarg);
+            if (jobs < 1 || jobs > MAX_JOBS) {
+                fprintf(stderr, "%s: invalid number of jobs '%s'\n",
+                        progname, optarg);
+                return 1;
+            }
+            break;
+
+        case 'l': hardlink = 1; break;
+        case 'n': dry_run = 1; break;
+        case 'p': print = 1; break;
+
+        case 'S':
+        case 'T':
+            if (!o65_stats_option
+                    (optarg, opt == 'S' ? O65_STATS_SUMMARY : O65_STATS_TRACE)) {
+                fprintf(stderr, "%s: invalid statistics format '%s'\n",
+                        progname, optarg);
+                return 1;
+            }
+            break;
+
+        case 'F': o65_stats_trace_file(optarg); break;
+
+        default:
+            usage(progname);
+            return 1;
+        }
+    }
+
+    /* Collect the list of files */
+    if (list_file &&
+            !add_files_from(&files, &num_files, &max_files, list_file)) {
+        free_files(files, num_files);
+        return 1;
+    }
+    for (; optind < argc; ++optind) {
+        if (!add_file(&files, &num_files, &max_files, argv[optind], 0)) {
+            free_files(files, num_files);
+            return 1;
+        }
+    }
+    if (num_files == 0) {
+        usage(progname);
+        free_files(files, num_files);
+        return 1;
+    }
+
+    /* Fingerprint the files in parallel */
+    if (jobs == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        jobs = cpus < 1 ? 1 : (cpus > MAX_JOBS ? MAX_JOBS : (int)cpus);
+    }
+    if ((size_t)jobs > num_files)
+        jobs = (int)num_files;
+    queue.files = files;
+    queue.num_files = num_files;
+    queue.next_file = 0;
+    for (thread = 0; thread < jobs; ++thread)
+        workers[thread].queue = &queue;
+    for (thread = 1; thread < jobs; ++thread) {
+        if (pthread_create(&(threads[thread]), NULL,
+                           fingerprint_worker, &(workers[thread])) != 0) {
+            jobs = thread;
+            break;
+        }
+    }
+    fingerprint_worker(&(workers[0]));
+    for (thread = 1; thread < jobs; ++thread)
+        pthread_join(threads[thread], NULL);
+
+    /* Each worker counted into its own array; add them up now that
+     * all of the workers have finished */
+    for (thread = 0; thread < jobs; ++thread)
+        o65_stats_merge(workers[thread].counters);
+
+    /* Report the fingerprints if requested */
+    for (index = 0; index < num_files; ++index) {
+        if (!(files[index].valid)) {
+            exit_val = 1;
+        } else if (print) {
+            printf("%016llx %s\n",
+                   (unsigned long long)(files[index].fingerprint),
+                   files[index].filename);
+        }
+    }
+
+    /* Sort the files so that duplicates are next to each other */
+    qsort(files, num_files, sizeof(file_info_t), compare_files);
+
+    /* Report or link the groups of duplicates */
+    group_start = 0;
+    while (group_start < num_files) {
+        file_info_t *master = &(files[group_start]);
+        size_t group_end = group_start + 1;
+        while (group_end < num_files && files[group_end].valid &&
+               master->valid &&
+               files[group_end].fingerprint == master->fingerprint &&
+               files[group_end].length == master->length) {
+            ++group_end;
+        }
+        if (master->valid && (group_end - group_start) > 1) {
+            ++num_groups;
+            if (!print && !hardlink) {
+                printf("# %llu files with fingerprint %016llx\n",
+                       (unsigned long long)(group_end - group_start),
+                       (unsigned long long)(master->fingerprint));
+                printf("%s\n", master->filename);
+            }
+            for (index = group_start + 1; index < group_end; ++index) {
+                const char *dup = files[index].filename;
+                if (!hardlink && !print)
+                    printf("%s\n", dup);
+                if (same_file(master->filename, dup))
+                    continue; /* Already linked, so nothing to reclaim */
+                ++num_duplicates;
+                saved += files[index].size;
+                if (!hardlink) {
+                    continue;
+                } else if (dry_run) {
+                    printf("%s => %s\n", dup, master->filename);
+                } else if (!same_canonical(master->filename, dup)) {
+                    fprintf(stderr, "%s: fingerprint collision with %s; "
+                                    "not linked\n", dup, master->filename);
+                    --num_duplicates;
+                    saved -= files[index].size;
+                } else if (!hardlink_file(master->filename, dup)) {
+                    exit_val = 1;
+                    --num_duplicates;
+                    saved -= files[index].size;
+                } else {
+                    printf("%s => %s\n", dup, master->filename);
+                }
+            }
+            if (!print && !hardlink && group_end < num_files)
+                printf("\n");
+        }
+        group_start = group_end;
+    }
+    fprintf(stderr, "%lu files, %lu groups of duplicates, "
+                    "%lu duplicates, %llu bytes %s\n",
+            (unsigned long)num_files, (unsigned long)num_groups,
+            (unsigned long)num_duplicates, (unsigned long long)saved,
+            (hardlink && !dry_run) ? "reclaimed" : "reclaimable");
+
+    /* Clean up and exit */
+    free_files(files, num_files);
+    o65_stats_report(stderr);
+    return exit_val;
+}
+
+/**
+ * @brief Print usage information for the program.
+ *
+ * @param[in] progname Name of the program from argv[0].
+ */
+static void usage(const char *progname)
+{
+    fprintf(stderr, "Usage: %s [options] file1.o65 ...\n\n", progname);
+
+    fprintf(stderr, "Options:\n\n");
+
+    fprintf(stderr, "    --files-from LISTFILE, -f LISTFILE\n");
+    fprintf(stderr, "        File with a list of \".o65\" files, one per line.\n\n");
+
+    fprintf(stderr, "    --jobs NUM, -j NUM\n");
+    fprintf(stderr, "        Number of threads to use; default is one per CPU.\n\n");
+
+    fprintf(stderr, "    --hardlink, -l\n");
+    fprintf(stderr, "        Replace duplicates with hard links to the first file in the group.\n\n");
+
+    fprintf(stderr, "    --dry-run, -n\n");
+    fprintf(stderr, "        Report the hard links that would be made without making them.\n\n");
+
+    fprintf(stderr, "    --print, -p\n");
+    fprintf(stderr, "        Print the fingerprint of every file.\n\n");
+
+    fprintf(stderr, "    --stats[=json]\n");
+    fprintf(stderr, "        Report counters and timings on exit.\n\n");
+
+    fprintf(stderr, "    --trace[=json]\n");
+    fprintf(stderr, "        Report the time for each phase as it completes.\n\n");
+
+    fprintf(stderr, "    --trace-file TRACEFILE\n");
+    fprintf(stderr, "        Write a Chrome trace event file with the time for each phase.\n\n");
+}
+
+/**
+ * @brief Adds a file to the list of files to process.
+ *
+ * @param[in,out] files The list of files.
+ * @param[in,out] num_files The number of files in the list.
+ * @param[in,out] max_files The maximum number of files before reallocating.
+ * @param[in] filename Name of the file to add.
+ * @param[in] copy Non-zero to add a copy of @a filename, which is freed
+ * by free_files().
+ *
+ * @return Non-zero if the file was added, or zero if out of memory.
+ */
+static int add_file(file_info_t **files, size_t *num_files,
+                    size_t *max_files, const char *filename, int copy)
+{
+    file_info_t *file;
+    char *name = NULL;
+    if (copy && (name = strdup(filename)) == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 0;
+    }
+    if (*num_files >= *max_files) {
+        size_t new_max = *max_files ? *max_files * 2 : 256;
+        file_info_t *new_files = realloc(*files, new_max * sizeof(file_info_t));
+        if (!new_files) {
+            fprintf(stderr, "out of memory\n");
+            free(name);
+            return 0;
+        }
+        *files = new_files;
+        *max_files = new_max;
+    }
+    file = &((*files)[*num_files]);
+    memset(file, 0, sizeof(file_info_t));
+    file->filename = name ? name : filename;
+    file->copy = name;
+    file->order = *num_files;
+    ++(*num_files);
+    return 1;
+}
+
+/**
+ * @brief Frees the list of files to process.
+ *
+ * @param[in] files The list of files.
+ * @param[in] num_files The number of files in the list.
+ */
+static void free_files(file_info_t *files, size_t num_files)
+{
+    size_t index;
+    for (index = 0; index < num_files; ++index)
+        free(files[index].copy);
+    free(files);
+}
+
+/**
+ * @brief Adds all of the files that are listed in a file.
+ *
+ * @param[in,out] files The list of files.
+ * @param[in,out] num_files The number of files in the list.
+ * @param[in,out] max_files The maximum number of files before reallocating.
+ * @param[in] list_file Name of the file that contains the list.
+ *
+ * @return Non-zero if the files were added, or zero on error.
+ */
+static int add_files_from(file_info_t **files, size_t *num_files,
+                          size_t *max_files, const char *list_file)
+{
+    char line[BUFSIZ];
+    size_t len;
+    FILE *file;
+
+    if ((file = fopen(list_file, "r")) == NULL) {
+        perror(list_file);
+        return 0;
+    }
+    while (fgets(line, sizeof(line), file)) {
+        len = strlen(line);
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+            --len;
+        line[len] = '\0';
+        if (len == 0)
+            continue;
+        if (!add_file(files, num_files, max_files, line, 1)) {
+            fclose(file);
+            return 0;
+        }
+    }
+    fclose(file);
+    return 1;
+}
+
+/**
+ * @brief Adds a range of bytes to the canonical form of a file.
+ *
+ * @param[in,out] canon The canonical form.
+ * @param[in] offset Offset of the range in the file.
+ * @param[in] len Length of the range.
+ *
+ * @return Non-zero on success, or zero if out of memory.
+ */
+static int add_range(canonical_t *canon, size_t offset, size_t len)
+{
+    if (len == 0)
+        return 1;
+    if (canon->num_ranges > 0) {
+        /* Merge with the previous range if they are adjacent */
+        range_t *last = &(canon->ranges[canon->num_ranges - 1]);
+        if ((last->offset + last->len) == offset) {
+            last->len += len;
+            return 1;
+        }
+    }
+    if (canon->num_ranges >= canon->max_ranges) {
+        size_t new_max = canon->max_ranges ? canon->max_ranges * 2 : 16;
+        range_t *new_ranges = realloc(canon->ranges, new_max * sizeof(range_t));
+        if (!new_ranges)
+            return 0;
+        canon->ranges = new_ranges;
+        canon->max_ranges = new_max;
+    }
+    canon->ranges[canon->num_ranges].offset = offset;
+    canon->ranges[canon->num_ranges].len = len;
+    ++(canon->num_ranges);
+    return 1;
+}
+
+/**
+ * @brief Determine if a header option is cosmetic and should be
+ * ignored when fingerprinting.
+ *
+ * @param[in] type The option type.
+ *
+ * @return Non-zero if the option is cosmetic.
+ */
+static int is_cosmetic_option(uint8_t type)
+{
+    switch (type) {
+    case O65_OPT_FILENAME:
+    case O65_OPT_OS:
+    case O65_OPT_PROGRAM:
+    case O65_OPT_AUTHOR:
+    case O65_OPT_CREATED:
+    case O65_OPT_CONTENT_HASH:
+    case O65_OPT_EXPORT_HASH:
+    case O65_OPT_PRELINKED:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/** State for finding the ranges of a file while it is being walked */
+typedef struct
+{
+    canonical_t *canon;     /**< Canonical form that is being built */
+    FILE *file;             /**< In-memory stream over the file data */
+    size_t image_start;     /**< Offset of the current image's header */
+    size_t body_start;      /**< Offset of the current image's body */
+    int ok;                 /**< Zero if we ran out of memory */
+
+} range_finder_t;
+
+/**
+ * @brief Gets the position of the range finder in the file data.
+ *
+ * @param[in] finder The range finder.
+ *
+ * @return The offset of the next byte to be read by the visitor.
+ */
+static size_t finder_posn(const range_finder_t *finder)
+{
+    return (size_t)ftell(finder->file);
+}
+
+/**
+ * @brief Adds a range to the canonical form from a visitor callback.
+ *
+ * @param[in,out] finder The range finder.
+ * @param[in] offset Offset of the range in the file.
+ * @param[in] len Length of the range.
+ *
+ * @return O65_VISIT_CONTINUE, or O65_VISIT_STOP if out of memory.
+ */
+static int finder_add_range(range_finder_t *finder, size_t offset, size_t len)
+{
+    if (!add_range(finder->canon, offset, len)) {
+        finder->ok = 0;
+        return O65_VISIT_STOP;
+    }
+    return O65_VISIT_CONTINUE;
+}
+
+static int find_header(void *ctx, const o65_header_t *header)
+{
+    range_finder_t *finder = (range_finder_t *)ctx;
+    (void)header;
+    return finder_add_range(finder, finder->image_start,
+                            finder_posn(finder) - finder->image_start);
+}
+
+static int find_option(void *ctx, const o65_header_t *header,
+                       const o65_option_t *option)
+{
+    range_finder_t *finder = (range_finder_t *)ctx;
+    (void)header;
+    if (is_cosmetic_option(option->type))
+        return O65_VISIT_CONTINUE;
+    return finder_add_range(finder, finder_posn(finder) - option->len,
+                            option->len);
+}
+
+static int find_begin_segment(void *ctx, const o65_header_t *header,
+                              uint8_t segid, o65_size_t size)
+{
+    range_finder_t *finder = (range_finder_t *)ctx;
+    (void)header;
+
+    /* The body starts with the terminator for the header options */
+    if (segid == O65_SEGID_TEXT)
+        finder->body_start = finder_posn(finder) - 1;
+
+    /* The segments are part of the body but we don't need to look at them */
+    O65_STATS_ADD(O65_STAT_BYTES_READ, size);
+    return O65_VISIT_SKIP;
+}
+
+static int find_end_image(void *ctx, const o65_header_t *header)
+{
+    range_finder_t *finder = (range_finder_t *)ctx;
+    (void)header;
+    finder->image_start = finder_posn(finder);
+    return finder_add_range(finder, finder->body_start,
+                            finder->image_start - finder->body_start);
+}
+
+/**
+ * @brief Finds the ranges of a file that contribute to its fingerprint.
+ *
+ * @param[in,out] canon The canonical form, with the file data loaded.
+ *
+ * @return Non-zero on success, or zero if the file is invalid.
+ *
+ * Everything except cosmetic header options is included.
+ */
+static int find_ranges(canonical_t *canon)
+{
+    static o65_visitor_t const visitor = {
+        .header = find_header,
+        .option = find_option,
+        .begin_segment = find_begin_segment,
+        .end_image = find_end_image
+    };
+    range_finder_t finder;
+    int result;
+
+    /* Walk the file with the same decoders as the other tools */
+    canon->num_ranges = 0;
+    if (canon->size == 0)
+        return 0;
+    memset(&finder, 0, sizeof(finder));
+    finder.canon = canon;
+    finder.ok = 1;
+    if ((finder.file = fmemopen(canon->data, canon->size, "rb")) == NULL)
+        return 0;
+    result = o65_visit(finder.file, &visitor, &finder);
+    fclose(finder.file);
+    if (result <= 0 || !finder.ok)
+        return 0;
+
+    /* Trailing data is not expected, but include it if present */
+    return add_range(canon, finder.image_start,
+                     canon->size - finder.image_start);
+}
+
+/**
+ * @brief Loads a file and determines its canonical form.
+ *
+ * @param[in,out] canon The canonical form to load into.  The buffers
+ * are reused between calls.
+ * @param[in] filename Name of the file to load.
+ *
+ * @return 1 on success, 0 if the file is not in ".o65" format,
+ * or -1 if the file could not be read.
+ */
+static int load_canonical(canonical_t *canon, const char *filename)
+{
+    struct stat st;
+    FILE *file;
+    uint64_t start;
+
+    /* Read the entire file into memory */
+    start = O65_SPAN_BEGIN();
+    if ((file = fopen(filename, "rb")) == NULL)
+        return -1;
+    if (fstat(fileno(file), &st) < 0) {
+        fclose(file);
+        return -1;
+    }
+    if ((size_t)(st.st_size) > canon->max_size || !(canon->data)) {
+        size_t new_max = st.st_size ? (size_t)(st.st_size) : 1;
+        uint8_t *new_data = realloc(canon->data, new_max);
+        if (!new_data) {
+            fclose(file);
+            return -1;
+        }
+        canon->data = new_data;
+        canon->max_size = new_max;
+    }
+    canon->size = fread(canon->data, 1, (size_t)(st.st_size), file);
+    if (canon->size != (size_t)(st.st_size)) {
+        fclose(file);
+        return -1;
+    }
+    fclose(file);
+    O65_SPAN_END(O65_SPAN_OPEN, start, filename);
+
+    /* Find the ranges that make up the canonical form */
+    start = O65_SPAN_BEGIN();
+    if (!find_ranges(canon))
+        return 0;
+    O65_SPAN_END(O65_SPAN_HEADER, start, filename);
+    return 1;
+}
+
+/**
+ * @brief Frees the buffers in a canonical form.
+ *
+ * @param[in] canon The canonical form.
+ */
+static void free_canonical(canonical_t *canon)
+{
+    free(canon->data);
+    free(canon->ranges);
+    memset(canon, 0, sizeof(canonical_t));
+}
+
+/**
+ * @brief Worker thread that fingerprints files from the queue until
+ * there are none left.
+ *
+ * @param[in,out] arg Points to the worker_t for this thread.
+ *
+ * @return Always NULL.
+ */
+static void *fingerprint_worker(void *arg)
+{
+    worker_t *worker = (worker_t *)arg;
+    work_queue_t *queue = worker->queue;
+    canonical_t canon;
+    o65_hash_state_t state;
+    file_info_t *file;
+    size_t index;
+    uint64_t file_start;
+    uint64_t start;
+    int result;
+
+    memset(&canon, 0, sizeof(canon));
+    o65_stats_redirect(worker->counters);
+    for (;;) {
+        /* Claim the next file in the queue */
+        index = __atomic_fetch_add(&(queue->next_file), 1, __ATOMIC_RELAXED);
+        if (index >= queue->num_files)
+            break;
+        file = &(queue->files[index]);
+
+        /* Load the file and find its canonical form */
+        file_start = O65_SPAN_BEGIN();
+        result = load_canonical(&canon, file->filename);
+        if (result < 0) {
+            perror(file->filename);
+            continue;
+        } else if (result == 0) {
+            fprintf(stderr, "%s: not in .o65 format\n", file->filename);
+            continue;
+        }
+
+        /* Hash the canonical form */
+        start = O65_SPAN_BEGIN();
+        o65_hash_init(&state, 0);
+        for (index = 0; index < canon.num_ranges; ++index) {
+            o65_hash_update(&state, canon.data + canon.ranges[index].offset,
+                            canon.ranges[index].len);
+        }
+        file->fingerprint = o65_hash_final(&state);
+        file->length = state.total_len;
+        file->size = canon.size;
+        file->valid = 1;
+        O65_SPAN_END(O65_SPAN_SEGMENTS, start, file->filename);
+        O65_SPAN_END(O65_SPAN_FILE, file_start, file->filename);
+    }
+    free_canonical(&canon);
+    o65_stats_redirect(NULL);
+    return NULL;
+}
+
+/**
+ * @brief Compares two files for sorting into groups of duplicates.
+ *
+ * @param[in] e1 The first file.
+ * @param[in] e2 The second file.
+ *
+ * @return -1, 0, or 1 depending upon the order of the files.
+ *
+ * Invalid files sort to the end.  Within a group of duplicates,
+ * the files are kept in the order they were supplied.
+ */
+static int compare_files(const void *e1, const void *e2)
+{
+    const file_info_t *f1 = (const file_info_t *)e1;
+    const file_info_t *f2 = (const file_info_t *)e2;
+    if (f1->valid != f2->valid)
+        return f1->valid ? -1 : 1;
+    if (f1->fingerprint != f2->fingerprint)
+        return f1->fingerprint < f2->fingerprint ? -1 : 1;
+    if (f1->length != f2->length)
+        return f1->length < f2->length ? -1 : 1;
+    if (f1->order != f2->order)
+        return f1->order < f2->order ? -1 : 1;
+    return 0;
+}
+
+/**
+ * @brief Determine if two files have the same canonical form byte for byte.
+ *
+ * @param[in] filename1 Name of the first file.
+ * @param[in] filename2 Name of the second file.
+ *
+ * @return Non-zero if the canonical forms are identical.
+ */
+static int same_canonical(const char *filename1, const char *filename2)
+{
+    canonical_t canon1, canon2;
+    size_t index1 = 0, index2 = 0;
+    size_t posn1 = 0, posn2 = 0;
+    size_t len;
+    int same = 1;
+
+    memset(&canon1, 0, sizeof(canon1));
+    memset(&canon2, 0, sizeof(canon2));
+    if (load_canonical(&canon1, filename1) <= 0 ||
+            load_canonical(&canon2, filename2) <= 0) {
+        same = 0;
+    }
+
+    /* Walk the two sets of ranges in parallel and compare the bytes */
+    while (same && index1 < canon1.num_ranges && index2 < canon2.num_ranges) {
+        const range_t *r1 = &(canon1.ranges[index1]);
+        const range_t *r2 = &(canon2.ranges[index2]);
+        len = r1->len - posn1;
+        if ((r2->len - posn2) < len)
+            len = r2->len - posn2;
+        if (memcmp(canon1.data + r1->offset + posn1,
+                   canon2.data + r2->offset + posn2, len) != 0) {
+            same = 0;
+        }
+        posn1 += len;
+        posn2 += len;
+        if (posn1 >= r1->len) {
+            ++index1;
+            posn1 = 0;
+        }
+        if (posn2 >= r2->len) {
+            ++index2;
+            posn2 = 0;
+        }
+    }
+    if (index1 < canon1.num_ranges || index2 < canon2.num_ranges)
+        same = 0;
+    free_canonical(&canon1);
+    free_canonical(&canon2);
+    return same;
+}
+
+/**
+ * @brief Determine if two names refer to the same file on disk.
+ *
+ * @param[in] filename1 Name of the first file.
+ * @param[in] filename2 Name of the second file.
+ *
+ * @return Non-zero if the names are hard links to the same file.
+ */
+static int same_file(const char *filename1, const char *filename2)
+{
+    struct stat st1, st2;
+    if (stat(filename1, &st1) < 0 || stat(filename2, &st2) < 0)
+        return 0;
+    return st1.st_dev == st2.st_dev && st1.st_ino == st2.st_ino;
+}
+
+/**
+ * @brief Replaces a duplicate file with a hard link to the master copy.
+ *
+ * @param[in] master Name of the master copy.
+ * @param[in] duplicate Name of the duplicate file to replace.
+ *
+ * @return Non-zero on success, or zero on error.
+ *
+ * The link is made under a temporary name and then renamed over the
+ * top of the duplicate, so the duplicate is never missing.
+ */
+static int hardlink_file(const char *master, const char *duplicate)
+{
+    char *temp_name;
+    int ok = 1;
+
+    /* Link under a temporary name and rename over the duplicate */
+    temp_name = malloc(strlen(duplicate) + 16);
+    if (!temp_name) {
+        fprintf(stderr, "out of memory\n");
+        return 0;
+    }
+    sprintf(temp_name, "%s.o65dedup", duplicate);
+    if (link(master, temp_name) < 0) {
+        perror(duplicate);
+        ok = 0;
+    } else if (rename(temp_name, duplicate) < 0) {
+        perror(duplicate);
+        unlink(temp_name);
+        ok = 0;
+    }
+    free(temp_name);
+    return ok;
+}
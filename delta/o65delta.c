@@ -0,0 +1,652 @@
+/*
+ * Copyright (C) 2023 Southern Storm Software, Pty Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "o65delta.h"
+#include "o65hash.h"
+#include "o65stats.h"
+#include "o65visit.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <sys/stat.h>
+
+#define short_options "o:v"
+static struct option long_options[] = {
+    {"output",              required_argument,  0,  'o'},
+    {"verbose",             no_argument,        0,  'v'},
+    {"stats",               optional_argument,  0,  'S'},
+    {"trace",               optional_argument,  0,  'T'},
+    {"trace-file",          required_argument,  0,  'F'},
+    {0,                     0,                  0,    0},
+};
+
+/** Minimum length of a run of matching bytes to copy from the old file */
+#define MIN_MATCH 8
+
+/** Maximum number of candidate positions to try for each match */
+#define MAX_CANDIDATES 32
+
+/** How far the score of a match can fall below its best before we stop */
+#define MAX_SCORE_DROP 16
+
+/** Contents of a file that is being differenced */
+typedef struct
+{
+    const char *filename;   /**< Name of the file */
+    uint8_t *data;          /**< Actual contents of the file */
+    uint8_t *norm;          /**< Contents with relocated bytes set to zero */
+    size_t size;            /**< Size of the file */
+
+} delta_file_t;
+
+/** State of the delta encoder */
+typedef struct
+{
+    const delta_file_t *old_file;   /**< The old file */
+    const delta_file_t *new_file;   /**< The new file */
+    int32_t *head;          /**< Hash table of positions in the old file */
+    int32_t *next;          /**< Chains of positions with the same hash */
+    uint32_t hash_mask;     /**< Mask for the size of the hash table */
+    FILE *out;              /**< Patch file being written */
+    size_t old_posn;        /**< Old file position after the last copy */
+    unsigned long copies;   /**< Number of copy operations */
+    unsigned long literals; /**< Number of literal bytes */
+    unsigned long fixups;   /**< Number of fixups */
+
+} delta_state_t;
+
+static void usage(const char *progname);
+static int load_file(delta_file_t *file, const char *filename);
+static void free_file(delta_file_t *file);
+static int write_patch(FILE *out, const delta_file_t *old_file,
+                       const delta_file_t *new_file, int verbose);
+
+int main(int argc, char *argv[])
+{
+    const char *progname = argv[0];
+    const char *output = 0;
+    int verbose = 0;
+    delta_file_t old_file;
+    delta_file_t new_file;
+    FILE *out;
+    int exit_val = 0;
+    int result;
+
+    /* Parse the command-line options */
+    for (;;) {
+        int opt = getopt_long(argc, argv, short_options, long_options, 0);
+        if (opt < 0)
+            break;
+        switch (opt) {
+        case 'o': output = optarg; break;
+        case 'v': verbose = 1; break;
+
+        case 'S':
+        case 'T':
+            if (!o65_stats_option
+                    (optarg, opt == 'S' ? O65_STATS_SUMMARY : O65_STATS_TRACE)) {
+                fprintf(stderr, "%s: invalid statistics format '%s'\n",
+                        progname, optarg);
+                return 1;
+            }
+            break;
+
+        case 'F': o65_stats_trace_file(optarg); break;
+
+        default:
+            usage(progname);
+            return 1;
+        }
+    }
+
+    /* Need exactly two input filenames and an output filename */
+    if ((argc - optind) != 2 || !output) {
+        usage(progname);
+        return 1;
+    }
+
+    /* Load the old and new files into memory */
+    memset(&old_file, 0, sizeof(old_file));
+    memset(&new_file, 0, sizeof(new_file));
+    if (!load_file(&old_file, argv[optind]) ||
+            !load_file(&new_file, argv[optind + 1])) {
+        free_file(&old_file);
+        free_file(&new_file);
+        return 1;
+    }
+
+    /* Write the patch */
+    if ((out = fopen(output, "wb")) == NULL) {
+        perror(output);
+        exit_val = 1;
+    } else {
+        result = write_patch(out, &old_file, &new_file, verbose);
+        if (result < 0)
+            perror(output);
+        if (result <= 0)
+            exit_val = 1;
+        if (fclose(out) != 0 && !exit_val) {
+            perror(output);
+            exit_val = 1;
+        }
+        if (exit_val)
+            remove(output);
+    }
+
+    /* Clean up and exit */
+    free_file(&old_file);
+    free_file(&new_file);
+    o65_stats_report(stderr);
+    return exit_val;
+}
+
+/**
+ * @brief Print usage information for the program.
+ *
+ * @param[in] progname Name of the program from argv[0].
+ */
+static void usage(const char *progname)
+{
+    fprintf(stderr, "Usage: %s [options] -o PATCHFILE old.o65 new.o65\n\n", progname);
+
+    fprintf(stderr, "Options:\n\n");
+
+    fprintf(stderr, "    --output PATCHFILE, -o PATCHFILE\n");
+    fprintf(stderr, "        Write the delta patch to PATCHFILE.\n\n");
+
+    fprintf(stderr, "    --verbose, -v\n");
+    fprintf(stderr, "        Report the size and make-up of the patch.\n\n");
+
+    fprintf(stderr, "    --stats[=json]\n");
+    fprintf(stderr, "        Report counters and timings on exit.\n\n");
+
+    fprintf(stderr, "    --trace[=json]\n");
+    fprintf(stderr, "        Report the time for each phase as it completes.\n\n");
+
+    fprintf(stderr, "    --trace-file TRACEFILE\n");
+    fprintf(stderr, "        Write a Chrome trace event file with the time for each phase.\n\n");
+
+    fprintf(stderr, "The patch can be applied with o65patch.\n");
+}
+
+/** State for normalizing a file while it is being walked */
+typedef struct
+{
+    delta_file_t *file;     /**< File that is being normalized */
+    FILE *stream;           /**< In-memory stream over the file data */
+    size_t text_start;      /**< Offset of the current .text segment */
+    size_t data_start;      /**< Offset of the current .data segment */
+
+} normalizer_t;
+
+static int normalize_begin_segment(void *ctx, const o65_header_t *header,
+                                   uint8_t segid, o65_size_t size)
+{
+    normalizer_t *norm = (normalizer_t *)ctx;
+    (void)header;
+    if (segid == O65_SEGID_TEXT)
+        norm->text_start = (size_t)ftell(norm->stream);
+    else
+        norm->data_start = (size_t)ftell(norm->stream);
+    O65_STATS_ADD(O65_STAT_BYTES_READ, size);
+    return O65_VISIT_SKIP;
+}
+
+static int normalize_reloc(void *ctx, const o65_header_t *header,
+                           uint8_t segid, o65_size_t addr,
+                           const o65_reloc_t *reloc)
+{
+    normalizer_t *norm = (normalizer_t *)ctx;
+    size_t seg_start;
+    o65_size_t seg_size;
+    o65_size_t width;
+
+    /* Find the offset of the relocated bytes within the segment */
+    if (segid == O65_SEGID_TEXT) {
+        seg_start = norm->text_start;
+        seg_size = header->tlen;
+        addr -= header->tbase;
+    } else {
+        seg_start = norm->data_start;
+        seg_size = header->dlen;
+        addr -= header->dbase;
+    }
+    switch (reloc->type & O65_RELOC_TYPE) {
+    case O65_RELOC_WORD:    width = 2; break;
+    case O65_RELOC_SEGADR:  width = 3; break;
+    default:                width = 1; break;
+    }
+
+    /* Zero the relocated bytes in the normalized copy */
+    if (addr < seg_size && (seg_size - addr) >= width)
+        memset(norm->file->norm + seg_start + addr, 0, width);
+    return O65_VISIT_CONTINUE;
+}
+
+/**
+ * @brief Normalizes the contents of a file by masking out every
+ * byte that is modified by a relocation.
+ *
+ * @param[in,out] file The file to normalize.
+ *
+ * When code moves, the addresses in relocated words change even though
+ * the instructions around them do not.  Masking them out allows the
+ * surrounding code to be matched up with the old file.  If the file is
+ * not a valid ".o65" file, masking stops at the point of the problem.
+ */
+static void normalize_file(delta_file_t *file)
+{
+    static o65_visitor_t const visitor = {
+        .begin_segment = normalize_begin_segment,
+        .reloc = normalize_reloc
+    };
+    normalizer_t norm;
+
+    memcpy(file->norm, file->data, file->size);
+    if (file->size == 0)
+        return;
+    memset(&norm, 0, sizeof(norm));
+    norm.file = file;
+    if ((norm.stream = fmemopen(file->data, file->size, "rb")) == NULL)
+        return;
+    o65_visit(norm.stream, &visitor, &norm);
+    fclose(norm.stream);
+}
+
+/**
+ * @brief Loads a file into memory and normalizes it.
+ *
+ * @param[out] file The file information to populate.
+ * @param[in] filename Name of the file to load.
+ *
+ * @return Non-zero on success, zero on failure.
+ */
+static int load_file(delta_file_t *file, const char *filename)
+{
+    struct stat st;
+    FILE *infile;
+    uint64_t start;
+
+    /* Read the entire file into memory */
+    start = O65_SPAN_BEGIN();
+    file->filename = filename;
+    if ((infile = fopen(filename, "rb")) == NULL) {
+        perror(filename);
+        return 0;
+    }
+    if (fstat(fileno(infile), &st) < 0) {
+        perror(filename);
+        fclose(infile);
+        return 0;
+    }
+    if ((uint64_t)(st.st_size) > 0x7FFFFFFFU) {
+        fprintf(stderr, "%s: file is too large\n", filename);
+        fclose(infile);
+        return 0;
+    }
+    file->size = (size_t)(st.st_size);
+    file->data = malloc(file->size + 1);
+    file->norm = malloc(file->size + 1);
+    if (!(file->data) || !(file->norm)) {
+        fprintf(stderr, "out of memory\n");
+        fclose(infile);
+        return 0;
+    }
+    if (fread(file->data, 1, file->size, infile) != file->size) {
+        perror(filename);
+        fclose(infile);
+        return 0;
+    }
+    fclose(infile);
+    O65_SPAN_END(O65_SPAN_OPEN, start, filename);
+
+    /* Mask out the relocated bytes */
+    start = O65_SPAN_BEGIN();
+    normalize_file(file);
+    O65_SPAN_END(O65_SPAN_RELOCS, start, filename);
+    return 1;
+}
+
+/**
+ * @brief Frees the buffers for a file.
+ *
+ * @param[in,out] file The file information to free.
+ */
+static void free_file(delta_file_t *file)
+{
+    free(file->data);
+    free(file->norm);
+    memset(file, 0, sizeof(delta_file_t));
+}
+
+/**
+ * @brief Hashes the first MIN_MATCH bytes at a position for the
+ * match-finding hash table.
+ *
+ * @param[in] data Points to the bytes to hash.
+ * @param[in] mask Mask for the size of the hash table.
+ *
+ * @return The hash table index.
+ */
+static uint32_t hash_window(const uint8_t *data, uint32_t mask)
+{
+    uint64_t value = ((uint64_t)o65_read_uint32(data)) |
+                     (((uint64_t)o65_read_uint32(data + 4)) << 32);
+    return (uint32_t)((value * 0x9E3779B185EBCA87ULL) >> 32) & mask;
+}
+
+/**
+ * @brief Measures how far a match can be extended.
+ *
+ * @param[in] state The delta encoder state.
+ * @param[in] old_posn Position of the match in the old file.
+ * @param[in] new_posn Position of the match in the new file.
+ * @param[out] score Returns the score for the match.
+ *
+ * @return The length of the match.
+ *
+ * The normalized contents are compared, and a few mismatched bytes are
+ * allowed if the match continues afterwards.  They become fixups in the
+ * patch, which is cheaper than ending the copy and starting another.
+ */
+static size_t extend_match(const delta_state_t *state, size_t old_posn,
+                           size_t new_posn, long *score)
+{
+    const uint8_t *old_norm = state->old_file->norm + old_posn;
+    const uint8_t *new_norm = state->new_file->norm + new_posn;
+    size_t limit = state->old_file->size - old_posn;
+    size_t best_len = 0;
+    long best_score = 0;
+    long current = 0;
+    size_t len;
+    if ((state->new_file->size - new_posn) < limit)
+        limit = state->new_file->size - new_posn;
+    for (len = 0; len < limit; ++len) {
+        if (old_norm[len] == new_norm[len]) {
+            ++current;
+            if (current > best_score) {
+                best_score = current;
+                best_len = len + 1;
+            }
+        } else {
+            current -= 2;
+            if (current < best_score - MAX_SCORE_DROP)
+                break;
+        }
+    }
+    *score = best_score;
+    return best_len;
+}
+
+/**
+ * @brief Writes an unsigned LEB128 value to the patch.
+ *
+ * @param[out] out The patch file.
+ * @param[in] value The value to write.
+ */
+static void write_varint(FILE *out, uint32_t value)
+{
+    while (value >= 0x80) {
+        putc((int)((value & 0x7F) | 0x80), out);
+        value >>= 7;
+    }
+    putc((int)value, out);
+}
+
+/**
+ * @brief Writes a literal operation to the patch.
+ *
+ * @param[in,out] state The delta encoder state.
+ * @param[in] start Start of the literal bytes in the new file.
+ * @param[in] len Number of literal bytes.
+ */
+static void write_literal(delta_state_t *state, size_t start, size_t len)
+{
+    if (len == 0)
+        return;
+    putc(O65_DELTA_LITERAL, state->out);
+    write_varint(state->out, (uint32_t)len);
+    fwrite(state->new_file->data + start, 1, len, state->out);
+    state->literals += len;
+}
+
+/**
+ * @brief Writes a copy operation to the patch.
+ *
+ * @param[in,out] state The delta encoder state.
+ * @param[in] old_posn Position of the bytes to copy in the old file.
+ * @param[in] new_posn Position of the bytes in the new file.
+ * @param[in] len Number of bytes to copy.
+ */
+static void write_copy(delta_state_t *state, size_t old_posn,
+                       size_t new_posn, size_t len)
+{
+    const uint8_t *old_data = state->old_file->data + old_posn;
+    const uint8_t *new_data = state->new_file->data + new_posn;
+    uint32_t num_fixups = 0;
+    size_t last;
+    size_t posn;
+
+    /* The old position is zigzag-encoded relative to the last copy */
+    putc(O65_DELTA_COPY, state->out);
+    if (old_posn >= state->old_posn)
+        write_varint(state->out, (uint32_t)(old_posn - state->old_posn) << 1);
+    else
+        write_varint(state->out,
+                     ((uint32_t)(state->old_posn - old_posn - 1) << 1) | 1);
+    write_varint(state->out, (uint32_t)len);
+
+    /* Write the bytes that differ from the old file as fixups */
+    for (posn = 0; posn < len; ++posn) {
+        if (old_data[posn] != new_data[posn])
+            ++num_fixups;
+    }
+    write_varint(state->out, num_fixups);
+    last = 0;
+    for (posn = 0; posn < len; ++posn) {
+        if (old_data[posn] != new_data[posn]) {
+            write_varint(state->out, (uint32_t)(posn - last));
+            putc(new_data[posn], state->out);
+            last = posn + 1;
+        }
+    }
+    state->old_posn = old_posn + len;
+    state->fixups += num_fixups;
+    ++(state->copies);
+}
+
+/**
+ * @brief Builds the hash table of positions in the old file.
+ *
+ * @param[in,out] state The delta encoder state.
+ *
+ * @return Non-zero on success, or zero if out of memory.
+ */
+static int build_hash_table(delta_state_t *state)
+{
+    const delta_file_t *old_file = state->old_file;
+    size_t table_size = 1024;
+    size_t posn;
+    uint32_t hash;
+    while (table_size < old_file->size)
+        table_size <<= 1;
+    state->hash_mask = (uint32_t)(table_size - 1);
+    state->head = malloc(table_size * sizeof(int32_t));
+    state->next = malloc((old_file->size + 1) * sizeof(int32_t));
+    if (!(state->head) || !(state->next))
+        return 0;
+    memset(state->head, 0xFF, table_size * sizeof(int32_t));
+
+    /* Insert in reverse so that each chain is in ascending order */
+    for (posn = old_file->size; posn >= MIN_MATCH; --posn) {
+        hash = hash_window(old_file->norm + posn - MIN_MATCH, state->hash_mask);
+        state->next[posn - MIN_MATCH] = state->head[hash];
+        state->head[hash] = (int32_t)(posn - MIN_MATCH);
+    }
+    return 1;
+}
+
+/**
+ * @brief Writes the operations that turn the old file into the new file.
+ *
+ * @param[in,out] state The delta encoder state.
+ *
+ * The new file is scanned from start to finish.  At each position, the
+ * continuation of the previous copy is tried first, followed by the
+ * positions in the old file with the same normalized bytes.  The longest
+ * match wins; if nothing is long enough, the byte becomes a literal.
+ */
+static void write_operations(delta_state_t *state)
+{
+    const delta_file_t *old_file = state->old_file;
+    const delta_file_t *new_file = state->new_file;
+    size_t posn = 0;
+    size_t literal_start = 0;
+    size_t new_copy_end = 0;
+    size_t best_posn;
+    size_t best_len;
+    size_t len;
+    size_t candidate;
+    long best_score;
+    long score;
+    int32_t chain;
+    int tries;
+
+    while ((posn + MIN_MATCH) <= new_file->size) {
+        /* Try continuing on from where the last copy left off */
+        best_posn = 0;
+        best_len = 0;
+        best_score = 0;
+        candidate = state->old_posn + (posn - new_copy_end);
+        if (candidate < old_file->size) {
+            len = extend_match(state, candidate, posn, &score);
+            if (score >= MIN_MATCH) {
+                best_posn = candidate;
+                best_len = len;
+                best_score = score;
+            }
+        }
+
+        /* Try the positions in the old file with the same hash */
+        if (old_file->size >= MIN_MATCH) {
+            chain = state->head[hash_window(new_file->norm + posn,
+                                            state->hash_mask)];
+            for (tries = 0; chain >= 0 && tries < MAX_CANDIDATES; ++tries) {
+                candidate = (size_t)chain;
+                chain = state->next[chain];
+                if (memcmp(old_file->norm + candidate,
+                           new_file->norm + posn, MIN_MATCH) != 0) {
+                    continue;
+                }
+                len = extend_match(state, candidate, posn, &score);
+                if (score > best_score) {
+                    best_posn = candidate;
+                    best_len = len;
+                    best_score = score;
+                }
+            }
+        }
+
+        /* Emit a copy if we found a good enough match */
+        if (best_score >= MIN_MATCH) {
+            write_literal(state, literal_start, posn - literal_start);
+            write_copy(state, best_posn, posn, best_len);
+            posn += best_len;
+            literal_start = posn;
+            new_copy_end = posn;
+        } else {
+            ++posn;
+        }
+    }
+    write_literal(state, literal_start, new_file->size - literal_start);
+}
+
+/**
+ * @brief Writes a 64-bit value in little-endian byte order.
+ *
+ * @param[out] buf Points to the eight bytes to write to.
+ * @param[in] value The value to write.
+ */
+static void write_uint64(uint8_t *buf, uint64_t value)
+{
+    o65_write_uint32(buf, (uint32_t)value);
+    o65_write_uint32(buf + 4, (uint32_t)(value >> 32));
+}
+
+/**
+ * @brief Writes a delta patch that turns the old file into the new file.
+ *
+ * @param[out] out The patch file.
+ * @param[in] old_file The old file.
+ * @param[in] new_file The new file.
+ * @param[in] verbose Non-zero to report the make-up of the patch.
+ *
+ * @return 1 on success, 0 if out of memory, or -1 for a filesystem error.
+ * Running out of memory is reported here; filesystem errors are left
+ * for the caller to report with perror().
+ */
+static int write_patch(FILE *out, const delta_file_t *old_file,
+                       const delta_file_t *new_file, int verbose)
+{
+    uint8_t header[O65_DELTA_HEADER_SIZE];
+    delta_state_t state;
+    uint64_t start;
+    int ok;
+
+    /* Write the header */
+    start = O65_SPAN_BEGIN();
+    memcpy(header, O65_DELTA_MAGIC, 4);
+    header[4] = O65_DELTA_VERSION;
+    o65_write_uint32(header + 5, (uint32_t)(old_file->size));
+    write_uint64(header + 9, o65_hash64(old_file->data, old_file->size, 0));
+    o65_write_uint32(header + 17, (uint32_t)(new_file->size));
+    write_uint64(header + 21, o65_hash64(new_file->data, new_file->size, 0));
+    fwrite(header, 1, sizeof(header), out);
+
+    /* Find the matches and write the operations */
+    memset(&state, 0, sizeof(state));
+    state.old_file = old_file;
+    state.new_file = new_file;
+    state.out = out;
+    if (!build_hash_table(&state)) {
+        fprintf(stderr, "out of memory\n");
+        free(state.head);
+        free(state.next);
+        return 0;
+    }
+    write_operations(&state);
+    putc(O65_DELTA_END, out);
+    free(state.head);
+    free(state.next);
+    ok = ferror(out) ? -1 : 1;
+    O65_STATS_ADD(O65_STAT_BYTES_WRITTEN, (uint64_t)ftell(out));
+    O65_SPAN_END(O65_SPAN_WRITE, start, new_file->filename);
+
+    /* Report the make-up of the patch */
+    if (ok > 0 && verbose) {
+        fprintf(stderr, "patch: %lu bytes, %lu copies, %lu fixups, "
+                        "%lu literal bytes\n", (unsigned long)ftell(out),
+                state.copies, state.fixups, state.literals);
+    }
+    return ok;
+}
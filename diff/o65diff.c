@@ -0,0 +1,712 @@
+/*
+ * Copyright (C) 2023 Southern Storm Software, Pty Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "o65model.h"
+#include "o65hash.h"
+#include "o65stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <getopt.h>
+
+#define short_options "q"
+static struct option long_options[] = {
+    {"brief",               no_argument,        0,  'q'},
+    {"stats",               optional_argument,  0,  'S'},
+    {"trace",               optional_argument,  0,  'T'},
+    {"trace-file",          required_argument,  0,  'F'},
+    {0,                     0,                  0,    0},
+};
+
+/** Size of the blocks to compare in the segment pre-pass */
+#define DIFF_BLOCK_SIZE 256
+
+/** All of the images in a ".o65" file, in chain order */
+typedef struct
+{
+    const char *filename;       /**< Name of the file */
+    o65_image_t **images;       /**< Images in the file */
+    size_t num_images;          /**< Number of images in the file */
+
+} diff_file_t;
+
+static const char * const segment_names[2] = {".text", ".data"};
+
+static int brief = 0;
+static int differences = 0;
+
+static void usage(const char *progname);
+static int load_file(diff_file_t *file, const char *filename);
+static void free_file(diff_file_t *file);
+static void diff_image
+    (const o65_image_t *image1, const o65_image_t *image2, size_t index);
+
+int main(int argc, char *argv[])
+{
+    const char *progname = argv[0];
+    diff_file_t file1;
+    diff_file_t file2;
+    size_t index;
+    uint64_t start;
+
+    /* Parse the command-line options */
+    for (;;) {
+        int opt = getopt_long(argc, argv, short_options, long_options, 0);
+        if (opt < 0)
+            break;
+        switch (opt) {
+        case 'q': brief = 1; break;
+
+        case 'S':
+        case 'T':
+            if (!o65_stats_option
+                    (optarg, opt == 'S' ? O65_STATS_SUMMARY : O65_STATS_TRACE)) {
+                fprintf(stderr, "%s: invalid statistics format '%s'\n",
+                        progname, optarg);
+                return 2;
+            }
+            break;
+
+        case 'F': o65_stats_trace_file(optarg); break;
+
+        default:
+            usage(progname);
+            return 2;
+        }
+    }
+
+    /* Need exactly two filenames */
+    if ((argc - optind) != 2) {
+        usage(progname);
+        return 2;
+    }
+
+    /* Load both files into memory */
+    memset(&file1, 0, sizeof(file1));
+    memset(&file2, 0, sizeof(file2));
+    if (!load_file(&file1, argv[optind]) ||
+            !load_file(&file2, argv[optind + 1])) {
+        free_file(&file1);
+        free_file(&file2);
+        return 2;
+    }
+
+    /* Compare the images in the two chains */
+    start = O65_SPAN_BEGIN();
+    for (index = 0; index < file1.num_images && index < file2.num_images;
+            ++index) {
+        diff_image(file1.images[index], file2.images[index], index);
+    }
+    if (file1.num_images != file2.num_images) {
+        ++differences;
+        if (!brief) {
+            printf("chain: %lu images -> %lu images\n",
+                   (unsigned long)(file1.num_images),
+                   (unsigned long)(file2.num_images));
+        }
+    }
+    O65_SPAN_END(O65_SPAN_FILE, start, NULL);
+    if (brief && differences)
+        printf("Files %s and %s differ\n", argv[optind], argv[optind + 1]);
+
+    /* Clean up and exit */
+    free_file(&file1);
+    free_file(&file2);
+    o65_stats_report(stderr);
+    return differences ? 1 : 0;
+}
+
+/**
+ * @brief Print usage information for the program.
+ *
+ * @param[in] progname Name of the program from argv[0].
+ */
+static void usage(const char *progname)
+{
+    fprintf(stderr, "Usage: %s [options] old.o65 new.o65\n\n", progname);
+
+    fprintf(stderr, "Options:\n\n");
+
+    fprintf(stderr, "    --brief, -q\n");
+    fprintf(stderr, "        Only report whether the files differ.\n\n");
+
+    fprintf(stderr, "    --stats[=json]\n");
+    fprintf(stderr, "        Report counters and timings on exit.\n\n");
+
+    fprintf(stderr, "    --trace[=json]\n");
+    fprintf(stderr, "        Report the time for each phase as it completes.\n\n");
+
+    fprintf(stderr, "    --trace-file TRACEFILE\n");
+    fprintf(stderr, "        Write a Chrome trace event file with the time for each phase.\n\n");
+
+    fprintf(stderr, "The exit status is 0 if the files are the same, 1 if they differ,\n");
+    fprintf(stderr, "or 2 if there was an error.\n");
+}
+
+/**
+ * @brief Loads all of the images in a ".o65" file.
+ *
+ * @param[out] file The file information to populate.
+ * @param[in] filename Name of the file to load.
+ *
+ * @return Non-zero on success, zero on failure.
+ */
+static int load_file(diff_file_t *file, const char *filename)
+{
+    o65_image_t **images;
+    o65_image_t *image;
+    uint64_t file_start;
+    uint64_t start;
+    FILE *infile;
+    int result;
+
+    /* Open the file */
+    file_start = O65_SPAN_BEGIN();
+    start = file_start;
+    file->filename = filename;
+    if ((infile = fopen(filename, "rb")) == NULL) {
+        perror(filename);
+        return 0;
+    }
+    O65_SPAN_END(O65_SPAN_OPEN, start, filename);
+
+    /* Load the images in the chain */
+    do {
+        images = realloc(file->images,
+                         (file->num_images + 1) * sizeof(o65_image_t *));
+        if (!images) {
+            fprintf(stderr, "out of memory\n");
+            fclose(infile);
+            return 0;
+        }
+        file->images = images;
+        result = o65_image_read(infile, &image);
+        if (result < 0) {
+            if (feof(infile))
+                fprintf(stderr, "%s: unexpected EOF\n", filename);
+            else
+                perror(filename);
+            fclose(infile);
+            return 0;
+        } else if (result == 0) {
+            fprintf(stderr, "%s: invalid format\n", filename);
+            fclose(infile);
+            return 0;
+        }
+        file->images[(file->num_images)++] = image;
+    } while ((image->header.mode & O65_MODE_CHAIN) != 0);
+
+    /* Done */
+    fclose(infile);
+    O65_SPAN_END(O65_SPAN_FILE, file_start, filename);
+    return 1;
+}
+
+/**
+ * @brief Frees all of the images that were loaded from a file.
+ *
+ * @param[in,out] file The file information to free.
+ */
+static void free_file(diff_file_t *file)
+{
+    size_t index;
+    for (index = 0; index < file->num_images; ++index)
+        o65_image_free(file->images[index]);
+    free(file->images);
+    memset(file, 0, sizeof(diff_file_t));
+}
+
+/**
+ * @brief Reports a difference between the two files.
+ *
+ * @param[in] index Index of the image in the chain.
+ * @param[in] format printf-style format for the rest of the line.
+ */
+static void report(size_t index, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+static void report(size_t index, const char *format, ...)
+{
+    va_list va;
+    ++differences;
+    if (brief)
+        return;
+    if (index > 0)
+        printf("[%lu] ", (unsigned long)index);
+    va_start(va, format);
+    vprintf(format, va);
+    va_end(va);
+    printf("\n");
+}
+
+/**
+ * @brief Compares the header fields of two images.
+ *
+ * @param[in] image1 The first image.
+ * @param[in] image2 The second image.
+ * @param[in] index Index of the image in the chain.
+ */
+static void diff_header
+    (const o65_image_t *image1, const o65_image_t *image2, size_t index)
+{
+    static const char * const names[9] = {
+        "tbase", "tlen", "dbase", "dlen", "bbase", "blen",
+        "zbase", "zlen", "stack"
+    };
+    const o65_header_t *h1 = &(image1->header);
+    const o65_header_t *h2 = &(image2->header);
+    const o65_size_t fields1[9] = {
+        h1->tbase, h1->tlen, h1->dbase, h1->dlen, h1->bbase, h1->blen,
+        h1->zbase, h1->zlen, h1->stack
+    };
+    const o65_size_t fields2[9] = {
+        h2->tbase, h2->tlen, h2->dbase, h2->dlen, h2->bbase, h2->blen,
+        h2->zbase, h2->zlen, h2->stack
+    };
+    int field;
+    if (h1->mode != h2->mode)
+        report(index, "header: mode 0x%04x -> 0x%04x", h1->mode, h2->mode);
+    for (field = 0; field < 9; ++field) {
+        if (fields1[field] != fields2[field]) {
+            report(index, "header: %s 0x%lx -> 0x%lx", names[field],
+                   (unsigned long)(fields1[field]),
+                   (unsigned long)(fields2[field]));
+        }
+    }
+}
+
+/**
+ * @brief Compares the header options of two images.
+ *
+ * @param[in] image1 The first image.
+ * @param[in] image2 The second image.
+ * @param[in] index Index of the image in the chain.
+ *
+ * Options are matched up by type, in the order they appear.
+ */
+static void diff_options
+    (const o65_image_t *image1, const o65_image_t *image2, size_t index)
+{
+    const o65_options_t *opts1 = &(image1->options);
+    const o65_options_t *opts2 = &(image2->options);
+    size_t count1 = o65_options_count(opts1);
+    size_t count2 = o65_options_count(opts2);
+    size_t posn1, posn2;
+    uint8_t type;
+    for (posn1 = 0; posn1 < count1; ++posn1) {
+        type = o65_options_type(opts1, posn1);
+        if (!o65_options_find(opts2, type, &posn2)) {
+            report(index, "- option %d", type);
+            continue;
+        }
+        if (o65_options_len(opts1, posn1) != o65_options_len(opts2, posn2) ||
+                memcmp(o65_options_data(opts1, posn1),
+                       o65_options_data(opts2, posn2),
+                       o65_options_len(opts1, posn1)) != 0) {
+            report(index, "~ option %d", type);
+        }
+    }
+    for (posn2 = 0; posn2 < count2; ++posn2) {
+        type = o65_options_type(opts2, posn2);
+        if (!o65_options_find(opts1, type, &posn1))
+            report(index, "+ option %d", type);
+    }
+}
+
+/**
+ * @brief Reports a range of bytes that differ between two segments.
+ *
+ * @param[in] index Index of the image in the chain.
+ * @param[in] seg Index of the segment.
+ * @param[in] start Start of the range.
+ * @param[in] end End of the range, exclusive.
+ */
+static void report_segment_range
+    (size_t index, int seg, o65_size_t start, o65_size_t end)
+{
+    report(index, "~ %s+0x%04lx..0x%04lx (%lu bytes)", segment_names[seg],
+           (unsigned long)start, (unsigned long)(end - 1),
+           (unsigned long)(end - start));
+}
+
+/**
+ * @brief Compares the contents of a segment in two images.
+ *
+ * @param[in] image1 The first image.
+ * @param[in] image2 The second image.
+ * @param[in] index Index of the image in the chain.
+ * @param[in] seg Index of the segment; 0 for .text, 1 for .data.
+ *
+ * The segments are compared a block at a time first, so that identical
+ * regions are skipped quickly.  Only blocks that differ are scanned byte
+ * by byte to find the exact extent of each changed region.  Adjacent
+ * changes are coalesced into a single region.
+ */
+static void diff_segment
+    (const o65_image_t *image1, const o65_image_t *image2,
+     size_t index, int seg)
+{
+    const uint8_t *data1 = image1->segments[seg];
+    const uint8_t *data2 = image2->segments[seg];
+    o65_size_t size1 = image1->sizes[seg];
+    o65_size_t size2 = image2->sizes[seg];
+    o65_size_t common = size1 < size2 ? size1 : size2;
+    o65_size_t posn = 0;
+    o65_size_t block;
+    o65_size_t start = 0;
+    o65_size_t end = 0;
+    int in_change = 0;
+
+    while (posn < common) {
+        /* Skip whole blocks that are identical */
+        block = common - posn;
+        if (block > DIFF_BLOCK_SIZE)
+            block = DIFF_BLOCK_SIZE;
+        if (memcmp(data1 + posn, data2 + posn, block) == 0) {
+            posn += block;
+            continue;
+        }
+
+        /* Find the exact bytes that differ within the block */
+        for (; block > 0; --block, ++posn) {
+            if (data1[posn] == data2[posn])
+                continue;
+            if (in_change && posn <= end) {
+                end = posn + 1;
+            } else {
+                if (in_change)
+                    report_segment_range(index, seg, start, end);
+                start = posn;
+                end = posn + 1;
+                in_change = 1;
+            }
+        }
+    }
+    if (in_change)
+        report_segment_range(index, seg, start, end);
+
+    /* Report bytes that were added to or removed from the end */
+    if (size1 > size2) {
+        report(index, "- %s+0x%04lx..0x%04lx (%lu bytes)", segment_names[seg],
+               (unsigned long)size2, (unsigned long)(size1 - 1),
+               (unsigned long)(size1 - size2));
+    } else if (size2 > size1) {
+        report(index, "+ %s+0x%04lx..0x%04lx (%lu bytes)", segment_names[seg],
+               (unsigned long)size1, (unsigned long)(size2 - 1),
+               (unsigned long)(size2 - size1));
+    }
+}
+
+/**
+ * @brief Formats a relocation for reporting.
+ *
+ * @param[in] image The image containing the relocation.
+ * @param[in] reloc The relocation.
+ *
+ * @return The description, which must be freed by the caller.  The buffer
+ * is sized for the name of the external symbol, so long names are never
+ * truncated.
+ */
+static char *format_reloc
+    (const o65_image_t *image, const o65_image_reloc_t *reloc)
+{
+    static const char * const types[8] = {
+        "RELOC-00", "LOW", "HIGH", "RELOC-60",
+        "WORD", "SEG", "SEGADR", "RELOC-E0"
+    };
+    const char *type = types[(reloc->type & O65_RELOC_TYPE) >> 5];
+    char segname[O65_NAME_MAX];
+    size_t size = O65_NAME_MAX + 32;
+    char *buf;
+    if ((reloc->type & O65_RELOC_SEGID) == O65_SEGID_UNDEF &&
+            reloc->undefid < image->num_externs) {
+        size += strlen(image->externs[reloc->undefid]);
+    }
+    if ((buf = malloc(size)) == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(2);
+    }
+    if ((reloc->type & O65_RELOC_SEGID) == O65_SEGID_UNDEF) {
+        snprintf(buf, size, "%s undef %s", type,
+                 reloc->undefid < image->num_externs ?
+                    image->externs[reloc->undefid] : "?");
+    } else {
+        o65_get_segment_name(reloc->type & O65_RELOC_SEGID, segname);
+        snprintf(buf, size, "%s %s", type, segname);
+    }
+    if ((reloc->type & O65_RELOC_TYPE) == O65_RELOC_SEG ||
+            (reloc->type & O65_RELOC_TYPE) == O65_RELOC_HIGH) {
+        size_t len = strlen(buf);
+        snprintf(buf + len, size - len, " %04x", reloc->extra);
+    }
+    return buf;
+}
+
+/**
+ * @brief Compares the relocations for a segment in two images.
+ *
+ * @param[in] image1 The first image.
+ * @param[in] image2 The second image.
+ * @param[in] index Index of the image in the chain.
+ * @param[in] seg Index of the segment; 0 for .text, 1 for .data.
+ *
+ * Both lists are in ascending offset order, so they are aligned with
+ * a single merge walk.  External references are compared by name,
+ * so that renumbering the externals does not show up as a change.
+ */
+static void diff_relocs
+    (const o65_image_t *image1, const o65_image_t *image2,
+     size_t index, int seg)
+{
+    const o65_image_reloc_t *r1 = image1->relocs[seg];
+    const o65_image_reloc_t *r2 = image2->relocs[seg];
+    size_t n1 = image1->num_relocs[seg];
+    size_t n2 = image2->num_relocs[seg];
+    char *desc1;
+    char *desc2;
+    while (n1 > 0 || n2 > 0) {
+        if (n2 == 0 || (n1 > 0 && r1->offset < r2->offset)) {
+            desc1 = format_reloc(image1, r1);
+            report(index, "- %s.relocs+0x%04lx %s", segment_names[seg],
+                   (unsigned long)(r1->offset), desc1);
+            free(desc1);
+            ++r1;
+            --n1;
+        } else if (n1 == 0 || r2->offset < r1->offset) {
+            desc2 = format_reloc(image2, r2);
+            report(index, "+ %s.relocs+0x%04lx %s", segment_names[seg],
+                   (unsigned long)(r2->offset), desc2);
+            free(desc2);
+            ++r2;
+            --n2;
+        } else {
+            desc1 = format_reloc(image1, r1);
+            desc2 = format_reloc(image2, r2);
+            if (strcmp(desc1, desc2) != 0) {
+                report(index, "~ %s.relocs+0x%04lx %s -> %s",
+                       segment_names[seg], (unsigned long)(r1->offset),
+                       desc1, desc2);
+            }
+            free(desc1);
+            free(desc2);
+            ++r1;
+            --n1;
+            ++r2;
+            --n2;
+        }
+    }
+}
+
+/** Hash table for matching names from the second image in linear time */
+typedef struct
+{
+    const char **names;     /**< Names from the second image */
+    size_t count;           /**< Number of names */
+    size_t *slots;          /**< Index of each name plus 1, or 0 if empty */
+    size_t mask;            /**< Mask for the number of slots */
+    uint8_t *matched;       /**< Non-zero if a name has been matched */
+
+} name_table_t;
+
+/**
+ * @brief Builds a hash table for a list of names.
+ *
+ * @param[out] table The table to build.
+ * @param[in] names The names to put in the table.  The table takes
+ * ownership of this array.
+ * @param[in] count Number of names.
+ */
+static void build_name_table
+    (name_table_t *table, const char **names, size_t count)
+{
+    size_t size = 16;
+    size_t index;
+    size_t slot;
+    while (size < (count * 2))
+        size *= 2;
+    table->names = names;
+    table->count = count;
+    table->slots = calloc(size, sizeof(size_t));
+    table->mask = size - 1;
+    table->matched = calloc(count + 1, 1);
+    if (!names || !(table->slots) || !(table->matched)) {
+        fprintf(stderr, "out of memory\n");
+        exit(2);
+    }
+    for (index = 0; index < count; ++index) {
+        slot = (size_t)o65_hash64(names[index], strlen(names[index]), 0);
+        while (table->slots[slot & table->mask] != 0)
+            ++slot;
+        table->slots[slot & table->mask] = index + 1;
+    }
+}
+
+/**
+ * @brief Finds an unmatched name in a hash table and marks it as matched.
+ *
+ * @param[in,out] table The table to search.
+ * @param[in] name The name to look for.
+ *
+ * @return The index of the name, or (size_t)-1 if it is not present.
+ */
+static size_t match_name(name_table_t *table, const char *name)
+{
+    size_t slot = (size_t)o65_hash64(name, strlen(name), 0);
+    size_t index;
+    while ((index = table->slots[slot & table->mask]) != 0) {
+        --index;
+        if (!(table->matched[index]) && !strcmp(table->names[index], name)) {
+            table->matched[index] = 1;
+            return index;
+        }
+        ++slot;
+    }
+    return (size_t)-1;
+}
+
+/**
+ * @brief Frees a hash table of names.
+ *
+ * @param[in,out] table The table to free.
+ */
+static void free_name_table(name_table_t *table)
+{
+    free(table->names);
+    free(table->slots);
+    free(table->matched);
+}
+
+/**
+ * @brief Compares the external references of two images by name.
+ *
+ * @param[in] image1 The first image.
+ * @param[in] image2 The second image.
+ * @param[in] index Index of the image in the chain.
+ *
+ * Removed names are reported in the order of the first image, and then
+ * added names in the order of the second image.
+ */
+static void diff_externs
+    (const o65_image_t *image1, const o65_image_t *image2, size_t index)
+{
+    name_table_t table;
+    const char **names;
+    o65_size_t n1 = image1->num_externs;
+    o65_size_t n2 = image2->num_externs;
+    o65_size_t posn;
+
+    /* Look up the names of the first image in a table of the second */
+    names = malloc((n2 + 1) * sizeof(char *));
+    if (names)
+        memcpy(names, image2->externs, n2 * sizeof(char *));
+    build_name_table(&table, names, n2);
+    for (posn = 0; posn < n1; ++posn) {
+        if (match_name(&table, image1->externs[posn]) == (size_t)-1)
+            report(index, "- extern %s", image1->externs[posn]);
+    }
+    for (posn = 0; posn < n2; ++posn) {
+        if (!(table.matched[posn]))
+            report(index, "+ extern %s", image2->externs[posn]);
+    }
+    free_name_table(&table);
+}
+
+/**
+ * @brief Compares the exported symbols of two images by name.
+ *
+ * @param[in] image1 The first image.
+ * @param[in] image2 The second image.
+ * @param[in] index Index of the image in the chain.
+ *
+ * Removed and changed symbols are reported in the order of the first
+ * image, and then added symbols in the order of the second image.
+ */
+static void diff_exports
+    (const o65_image_t *image1, const o65_image_t *image2, size_t index)
+{
+    const o65_image_export_t *export1;
+    const o65_image_export_t *export2;
+    name_table_t table;
+    const char **names;
+    o65_size_t n1 = image1->num_exports;
+    o65_size_t n2 = image2->num_exports;
+    o65_size_t posn;
+    size_t match;
+    char seg1[O65_NAME_MAX];
+    char seg2[O65_NAME_MAX];
+
+    /* Look up the names of the first image in a table of the second */
+    names = malloc((n2 + 1) * sizeof(char *));
+    if (names) {
+        for (posn = 0; posn < n2; ++posn)
+            names[posn] = image2->exports[posn].name;
+    }
+    build_name_table(&table, names, n2);
+    for (posn = 0; posn < n1; ++posn) {
+        export1 = &(image1->exports[posn]);
+        o65_get_segment_name(export1->segid, seg1);
+        match = match_name(&table, export1->name);
+        if (match == (size_t)-1) {
+            report(index, "- export %s %s 0x%04lx", export1->name,
+                   seg1, (unsigned long)(export1->value));
+            continue;
+        }
+        export2 = &(image2->exports[match]);
+        if (export1->segid != export2->segid ||
+                export1->value != export2->value) {
+            o65_get_segment_name(export2->segid, seg2);
+            report(index, "~ export %s %s 0x%04lx -> %s 0x%04lx",
+                   export1->name, seg1, (unsigned long)(export1->value),
+                   seg2, (unsigned long)(export2->value));
+        }
+    }
+    for (posn = 0; posn < n2; ++posn) {
+        if (table.matched[posn])
+            continue;
+        export2 = &(image2->exports[posn]);
+        o65_get_segment_name(export2->segid, seg2);
+        report(index, "+ export %s %s 0x%04lx", export2->name,
+               seg2, (unsigned long)(export2->value));
+    }
+    free_name_table(&table);
+}
+
+/**
+ * @brief Compares two images and reports the differences.
+ *
+ * @param[in] image1 The first image.
+ * @param[in] image2 The second image.
+ * @param[in] index Index of the image in the chain.
+ */
+static void diff_image
+    (const o65_image_t *image1, const o65_image_t *image2, size_t index)
+{
+    int seg;
+    diff_header(image1, image2, index);
+    diff_options(image1, image2, index);
+    for (seg = 0; seg < 2; ++seg)
+        diff_segment(image1, image2, index, seg);
+    diff_externs(image1, image2, index);
+    for (seg = 0; seg < 2; ++seg)
+        diff_relocs(image1, image2, index, seg);
+    diff_exports(image1, image2, index);
+}
@@ -20,15 +20,29 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
-#include "o65file.h"
+#include "o65options.h"
+#include "o65pack.h"
+#include "o65prefetch.h"
+#include "o65stats.h"
+#include "o65symmap.h"
+#include "o65tar.h"
+#include "o65validate.h"
 #include "elfmos.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 static int disassemble = 0;
+static int strict = 0;
+static int tar = 0;
+static o65_pack_t *packs = 0;
+static o65_symmap_t *symbols = 0;
+static unsigned image_index = 0;
 
 static int dump_file(const char *filename);
+static int dump_files(char **names, int count);
+static int dump_tar(const char *tar_file, int *first);
+static int open_symbols(const char *filename);
 
 int main(int argc, char *argv[])
 {
@@ -37,21 +51,65 @@ int main(int argc, char *argv[])
     int named;
     int exit_val = 0;
 
-    /* Need at least one command-line argument other than "-d" */
-    arg = 1;
-    if (arg < argc && (!strcmp(argv[1], "-d") || !strcmp(argv[1], "--disassemble"))) {
-        disassemble = 1;
-        ++arg;
+    /* Need at least one command-line argument other than the options */
+    for (arg = 1; arg < argc && argv[arg][0] == '-'; ++arg) {
+        if (!strcmp(argv[arg], "-d") || !strcmp(argv[arg], "--disassemble")) {
+            disassemble = 1;
+        } else if (!strcmp(argv[arg], "--strict")) {
+            strict = 1;
+        } else if (!strcmp(argv[arg], "--tar")) {
+            tar = 1;
+        } else if (!strncmp(argv[arg], "--symbols=", 10)) {
+            if (!open_symbols(argv[arg] + 10))
+                return 1;
+        } else if (!strcmp(argv[arg], "--symbols") && (arg + 1) < argc) {
+            if (!open_symbols(argv[++arg]))
+                return 1;
+        } else if (!strcmp(argv[arg], "--stats")) {
+            o65_stats_option(NULL, O65_STATS_SUMMARY);
+        } else if (!strncmp(argv[arg], "--stats=", 8)) {
+            if (!o65_stats_option(argv[arg] + 8, O65_STATS_SUMMARY)) {
+                fprintf(stderr, "%s: invalid statistics format '%s'\n",
+                        argv[0], argv[arg] + 8);
+                return 1;
+            }
+        } else if (!strcmp(argv[arg], "--trace")) {
+            o65_stats_option(NULL, O65_STATS_TRACE);
+        } else if (!strncmp(argv[arg], "--trace=", 8)) {
+            if (!o65_stats_option(argv[arg] + 8, O65_STATS_TRACE)) {
+                fprintf(stderr, "%s: invalid statistics format '%s'\n",
+                        argv[0], argv[arg] + 8);
+                return 1;
+            }
+        } else if (!strncmp(argv[arg], "--trace-file=", 13)) {
+            o65_stats_trace_file(argv[arg] + 13);
+        } else if (!strcmp(argv[arg], "--trace-file") && (arg + 1) < argc) {
+            o65_stats_trace_file(argv[++arg]);
+        } else {
+            break;
+        }
     }
     if (arg >= argc) {
-        fprintf(stderr, "Usage: %s [-d|--disassemble] file1 ...\n", argv[0]);
+        fprintf(stderr, "Usage: %s [-d|--disassemble] [--strict] [--tar] [--symbols=MAPFILE] [--stats[=json]] [--trace[=json]] [--trace-file=FILE] file1 ...\n", argv[0]);
         return 1;
     }
 
-    /* Process each of the files in turn */
+    /* Process each of the files in turn.  If there is more than one,
+     * then they are loaded ahead of time with the prefetcher. */
     first = 1;
     named = (argc - arg) > 1;
+    if (named && !tar) {
+        if (!dump_files(argv + arg, argc - arg))
+            exit_val = 1;
+        arg = argc;
+    }
     for (; arg < argc; ++arg) {
+        if (tar) {
+            /* Dump all of the members of a tar archive */
+            if (!dump_tar(argv[arg], &first))
+                exit_val = 1;
+            continue;
+        }
         if (first)
             first = 0;
         else
@@ -61,9 +119,27 @@ int main(int argc, char *argv[])
         if (!dump_file(argv[arg]))
             exit_val = 1;
     }
+    o65_pack_close(packs);
+    o65_symmap_close(symbols);
+    o65_stats_report(stderr);
     return exit_val;
 }
 
+static int open_symbols(const char *filename)
+{
+    int result;
+    o65_symmap_close(symbols);
+    result = o65_symmap_open(filename, &symbols);
+    if (result < 0) {
+        perror(filename);
+        return 0;
+    } else if (result == 0) {
+        fprintf(stderr, "%s: not a symbol map\n", filename);
+        return 0;
+    }
+    return 1;
+}
+
 static void file_error(FILE *file, const char *filename)
 {
     if (feof(file))
@@ -85,23 +161,6 @@ static void dump_string(const uint8_t *data, int len)
     }
 }
 
-static int dump_nul_string(FILE *file)
-{
-    int ch;
-    for (;;) {
-        ch = getc(file);
-        if (ch < 0)
-            return -1;
-        else if (ch == 0)
-            break;
-        else if (ch >= ' ' && ch <= 0x7E)
-            putc(ch, stdout);
-        else if (ch != 0)
-            printf("\\x%02x", ch);
-    }
-    return 1;
-}
-
 static void dump_hex(const uint8_t *data, int len)
 {
     while (len > 0) {
@@ -122,38 +181,41 @@ static void dump_hex_line
     printf("\n");
 }
 
-static void dump_option(const o65_option_t *option)
+static void dump_option(const o65_options_t *options, size_t index)
 {
+    uint8_t type = o65_options_type(options, index);
+    const uint8_t *data = o65_options_data(options, index);
+    int len = o65_options_len(options, index);
     printf("    ");
-    switch (option->type) {
+    switch (type) {
     case O65_OPT_FILENAME:
         printf("Filename: ");
-        dump_string(option->data, option->len - 2);
+        dump_string(data, len);
         break;
 
     case O65_OPT_OS:
         printf("Operating System Information:");
-        dump_hex(option->data, option->len - 2);
+        dump_hex(data, len);
         break;
 
     case O65_OPT_PROGRAM:
         printf("Assembler/Linker: ");
-        dump_string(option->data, option->len - 2);
+        dump_string(data, len);
         break;
 
     case O65_OPT_AUTHOR:
         printf("Author: ");
-        dump_string(option->data, option->len - 2);
+        dump_string(data, len);
         break;
 
     case O65_OPT_CREATED:
         printf("Created: ");
-        dump_string(option->data, option->len - 2);
+        dump_string(data, len);
         break;
 
     case O65_OPT_ELF_MACHINE:
-        if (option->len >= 8 && option->data[0] == 0x66 &&
-                option->data[1] == 0x19) {
+        if (len >= 6 && data[0] == 0x66 &&
+                data[1] == 0x19) {
             /* Dump the ELF MOS flags */
             struct elf_mos_flag
             {
@@ -176,15 +238,15 @@ static void dump_option(const o65_option_t *option)
                 {EM_MOS_45GS02,     "mos45gs02"},
                 {0,                 0}
             };
-            uint32_t elf_flags = o65_read_uint32(option->data + 2);
-            int index;
+            uint32_t elf_flags = o65_read_uint32(data + 2);
+            int flag;
             printf("ELF Machine: MOS Technologies\n");
             printf("    ELF Machine Flags: 0x%lx", (unsigned long)elf_flags);
-            for (index = 0; flags[index].flag != 0; ++index) {
+            for (flag = 0; flags[flag].flag != 0; ++flag) {
                 /* Print all of the flags that we recognize */
-                if (elf_flags & flags[index].flag) {
-                    printf(", %s", flags[index].name);
-                    elf_flags &= ~(flags[index].flag);
+                if (elf_flags & flags[flag].flag) {
+                    printf(", %s", flags[flag].name);
+                    elf_flags &= ~(flags[flag].flag);
                 }
             }
             if (elf_flags != 0) {
@@ -193,20 +255,52 @@ static void dump_option(const o65_option_t *option)
             }
         } else {
             /* Not a 6502, so dump the options in hexadecimal */
-            if (option->len == 8) {
-                printf("ELF Machine: 0x%x\n", o65_read_uint16(option->data));
+            if (len == 6) {
+                printf("ELF Machine: 0x%x\n", o65_read_uint16(data));
                 printf("    ELF Machine Flags: 0x%lx",
-                       (unsigned long)(o65_read_uint32(option->data + 2)));
+                       (unsigned long)(o65_read_uint32(data + 2)));
             } else {
                 printf("ELF Machine Option:");
-                dump_hex(option->data, option->len - 2);
+                dump_hex(data, len);
             }
         }
         break;
 
+    case O65_OPT_CONTENT_HASH:
+        if (len == 9 && data[0] == O65_HASH_XXH64) {
+            printf("Content Hash: xxh64 0x%08lx%08lx",
+                   (unsigned long)o65_read_uint32(data + 5),
+                   (unsigned long)o65_read_uint32(data + 1));
+        } else {
+            printf("Content Hash Option:");
+            dump_hex(data, len);
+        }
+        break;
+
+    case O65_OPT_EXPORT_HASH:
+        if (len >= 2 && data[0] == O65_EXPORT_HASH_MUL31) {
+            printf("Export Hash: h*31+c, %d slots:", len - 1);
+            dump_hex(data + 1, len - 1);
+        } else {
+            printf("Export Hash Option:");
+            dump_hex(data, len);
+        }
+        break;
+
+    case O65_OPT_PRELINKED:
+        if (len == O65_PRELINKED_OPT_LEN - 2) {
+            printf("Prelinked: relocs at +0x%lx, exports at +0x%lx",
+                   (unsigned long)o65_read_uint32(data),
+                   (unsigned long)o65_read_uint32(data + 4));
+        } else {
+            printf("Prelinked Option:");
+            dump_hex(data, len);
+        }
+        break;
+
     default:
-        printf("Option %d:", option->type);
-        dump_hex(option->data, option->len - 2);
+        printf("Option %d:", type);
+        dump_hex(data, len);
         break;
     }
     printf("\n");
@@ -214,6 +308,72 @@ static void dump_option(const o65_option_t *option)
 
 #include "instructions.h"
 
+static o65_size_t segment_base(const o65_header_t *header, uint8_t segid)
+{
+    switch (segid) {
+    case O65_SEGID_TEXT:        return header->tbase;
+    case O65_SEGID_DATA:        return header->dbase;
+    case O65_SEGID_BSS:         return header->bbase;
+    case O65_SEGID_ZEROPAGE:    return header->zbase;
+    default:                    return 0;
+    }
+}
+
+static int find_symbol
+    (const o65_header_t *header, o65_size_t addr, int zeropage,
+     o65_symbol_t *symbol)
+{
+    uint8_t segid;
+
+    /* Determine which segment of the current image the address is in.
+     * Zero page operands can only refer to the .zp segment. */
+    if (zeropage) {
+        if (addr >= header->zbase && (addr - header->zbase) < header->zlen)
+            segid = O65_SEGID_ZEROPAGE;
+        else
+            return 0;
+    } else if (addr >= header->tbase && (addr - header->tbase) < header->tlen)
+        segid = O65_SEGID_TEXT;
+    else if (addr >= header->dbase && (addr - header->dbase) < header->dlen)
+        segid = O65_SEGID_DATA;
+    else if (addr >= header->bbase && (addr - header->bbase) < header->blen)
+        segid = O65_SEGID_BSS;
+    else if (addr >= header->zbase && (addr - header->zbase) < header->zlen)
+        segid = O65_SEGID_ZEROPAGE;
+    else
+        return 0;
+
+    /* Look up the nearest symbol at or before the address */
+    return o65_symmap_lookup
+        (symbols, image_index, segid,
+         addr - segment_base(header, segid), symbol);
+}
+
+static void print_label(const o65_header_t *header, o65_size_t addr)
+{
+    o65_symbol_t symbol;
+    if (!symbols || !find_symbol(header, addr, 0, &symbol))
+        return;
+    if (symbol.segid == O65_SEGID_TEXT &&
+            symbol.offset == (addr - header->tbase)) {
+        printf("%s:\n", symbol.name);
+    }
+}
+
+static void print_operand_symbol
+    (const o65_header_t *header, o65_size_t addr, int zeropage)
+{
+    o65_symbol_t symbol;
+    o65_size_t offset;
+    if (!symbols || !find_symbol(header, addr, zeropage, &symbol))
+        return;
+    offset = addr - segment_base(header, symbol.segid) - symbol.offset;
+    if (offset != 0)
+        printf("  ; %s+0x%lx", symbol.name, (unsigned long)offset);
+    else
+        printf("  ; %s", symbol.name);
+}
+
 static void disasseble_segment
     (const o65_header_t *header, o65_size_t addr,
      const uint8_t *data, o65_size_t len)
@@ -223,6 +383,9 @@ static void disasseble_segment
     uint8_t oplen;
     uint8_t posn;
     uint16_t target;
+    uint16_t operand;
+    int has_operand;
+    int zeropage;
     const char *name;
     while (len > 0) {
         /* Fetch the next opcode */
@@ -240,6 +403,9 @@ static void disasseble_segment
             oplen = 1;
         }
 
+        /* Print a label if a symbol starts at this address */
+        print_label(header, addr);
+
         /* Print the address */
         if (header->mode & O65_MODE_32BIT)
             printf("    %08lx:", (unsigned long)addr);
@@ -262,89 +428,117 @@ static void disasseble_segment
             printf("%c%c%c ", name[0], name[1], name[2]);
 
         /* Print the operands */
+        operand = 0;
+        has_operand = 1;
+        zeropage = 0;
         switch (opmode) {
         case OP_imp:
             /* Implict operand - nothing to do */
+            has_operand = 0;
             break;
 
         case OP_imm:
             /* Immediate operand */
             printf("#$%02x", data[1]);
+            has_operand = 0;
             break;
 
         case OP_abs:
             /* Absolute addressing mode */
-            printf("$%04x", o65_read_uint16(data + 1));
+            operand = o65_read_uint16(data + 1);
+            printf("$%04x", operand);
             break;
 
         case OP_abs_X:
             /* Absolute addressing with X mode */
-            printf("$%04x,x", o65_read_uint16(data + 1));
+            operand = o65_read_uint16(data + 1);
+            printf("$%04x,x", operand);
             break;
 
         case OP_abs_Y:
             /* Absolute addressing with Y mode */
-            printf("$%04x,y", o65_read_uint16(data + 1));
+            operand = o65_read_uint16(data + 1);
+            printf("$%04x,y", operand);
             break;
 
         case OP_X_ind:
             /* Zero page indirect with X mode */
-            printf("($%02x,x)", data[1]);
+            operand = data[1];
+            zeropage = 1;
+            printf("($%02x,x)", operand);
             break;
 
         case OP_ind_Y:
             /* Zero page indirect with Y mode */
-            printf("($%02x),y", data[1]);
+            operand = data[1];
+            zeropage = 1;
+            printf("($%02x),y", operand);
             break;
 
         case OP_zpg:
         case OP_bit_zpg:
         case OP_ill:
             /* Zero page addressing mode */
-            printf("$%02x", data[1]);
+            operand = data[1];
+            zeropage = 1;
+            printf("$%02x", operand);
+            has_operand = (opmode != OP_ill);
             break;
 
         case OP_zpg_X:
             /* Zero page addressing with X mode */
-            printf("$%02x,x", data[1]);
+            operand = data[1];
+            zeropage = 1;
+            printf("$%02x,x", operand);
             break;
 
         case OP_zpg_Y:
             /* Zero page addressing with Y mode */
-            printf("$%02x,y", data[1]);
+            operand = data[1];
+            zeropage = 1;
+            printf("$%02x,y", operand);
             break;
 
         case OP_rel:
             /* Relative branch */
             target = (addr + 2) + (int16_t)(int8_t)(data[1]);
+            operand = target;
             printf("$%04x", target);
             break;
 
         case OP_ind:
             /* Absolute indirect addressing mode */
-            printf("($%04x)", o65_read_uint16(data + 1));
+            operand = o65_read_uint16(data + 1);
+            printf("($%04x)", operand);
             break;
 
         case OP_ind_zpg:
             /* Zero page indirect mode with no indexing */
-            printf("($%02x)", data[1]);
+            operand = data[1];
+            zeropage = 1;
+            printf("($%02x)", operand);
             break;
 
         case OP_ind_abs_X:
             /* Absolute indirect addressing with X mode */
-            printf("($%04x,x)", o65_read_uint16(data + 1));
+            operand = o65_read_uint16(data + 1);
+            printf("($%04x,x)", operand);
             break;
 
         case OP_zpg_rel:
             /* Zero page addressing plus a branch */
             target = (addr + 3) + (int16_t)(int8_t)(data[2]);
+            operand = target;
             printf("$%02x,$%04x", data[1], target);
             break;
 
         default:
             printf("???");
+            has_operand = 0;
             break;
         }
+        if (has_operand)
+            print_operand_symbol(header, operand, zeropage);
         printf("\n");
 
         /* Advance to the next opcode */
@@ -369,18 +563,25 @@ static int can_disassemble(const o65_header_t *header)
 }
 
 static int dump_segment
-    (FILE *file, const char *name, const o65_header_t *header,
-     o65_size_t base, o65_size_t len, int is_text)
+    (FILE *file, const char *filename, const char *name,
+     const o65_header_t *header, o65_size_t base, o65_size_t len, int is_text)
 {
     uint8_t *data = NULL;
     o65_size_t posn;
+    int result;
 
     /* Print the name and size of the segment */
     printf("\n%s: %lu bytes\n", name, (unsigned long)len);
 
     /* Read the segment data */
-    if (o65_read_segment(file, &data, len) < 0)
+    result = o65_read_segment(file, &data, len);
+    if (result < 0) {
         return -1;
+    } else if (result == 0) {
+        fprintf(stderr, "%s:0x%lx: %s: segment extends past the end of the file\n",
+                filename, (unsigned long)ftell(file), is_text ? "tlen" : "dlen");
+        return 0;
+    }
 
     /* Dump the contents of the segment */
     if (is_text && disassemble && can_disassemble(header)) {
@@ -402,6 +603,7 @@ static int dump_segment
 
 static int dump_undefined_symbols(FILE *file, const o65_header_t *header)
 {
+    o65_string_table_t names;
     o65_size_t index;
     o65_size_t count;
     int result;
@@ -416,22 +618,27 @@ static int dump_undefined_symbols(FILE *file, const o65_header_t *header)
         return 1;
     }
 
-    /* Dump the names of the undefined symbols */
-    printf("\nUndefined Symbols:\n");
-    for (index = 0; index < count; ++index) {
-        printf("    %lu: ", (unsigned long)index);
-        result = dump_nul_string(file);
-        if (result <= 0)
-            return result;
-        printf("\n");
+    /* Read the names in a single block and then dump them */
+    o65_string_table_init(&names);
+    result = o65_read_string_table(file, count, &names);
+    if (result > 0) {
+        printf("\nUndefined Symbols:\n");
+        for (index = 0; index < count; ++index) {
+            printf("    %lu: ", (unsigned long)index);
+            dump_string((const uint8_t *)(names.names[index].name),
+                        (int)(names.names[index].len));
+            printf("\n");
+        }
     }
-    return 1;
+    o65_string_table_free(&names);
+    return result;
 }
 
 static int dump_relocs
     (FILE *file, const char *name, const o65_header_t *header,
      o65_size_t addr)
 {
+    const o65_decoder_t *decoder = o65_get_decoder(header);
     o65_reloc_t reloc;
     int result;
 
@@ -442,7 +649,7 @@ static int dump_relocs
     printf("\n%s.relocs:\n", name);
     for (;;) {
         /* Read the next relocation entry */
-        result = o65_read_reloc(file, header, &reloc);
+        result = decoder->read_reloc(file, &reloc);
         if (result <= 0)
             return result;
         else if (reloc.offset == 0)
@@ -500,10 +707,11 @@ static int dump_relocs
 static int dump_exported_symbols(FILE *file, const o65_header_t *header)
 {
     char segname[O65_NAME_MAX];
+    o65_string_table_t names;
     o65_size_t index;
     o65_size_t count;
     o65_size_t value;
-    int result;
+    int result = 1;
     int ch;
 
     /* Read the number of exported symbols */
@@ -518,36 +726,47 @@ static int dump_exported_symbols(FILE *file, const o65_header_t *header)
 
     /* Dump the names of the undefined symbols */
     printf("\nExported Symbols:\n");
+    o65_string_table_init(&names);
     for (index = 0; index < count; ++index) {
         /* Dump the name of the symbol */
-        printf("    ");
-        result = dump_nul_string(file);
+        result = o65_read_string_table(file, 1, &names);
         if (result <= 0)
-            return result;
+            break;
+        printf("    ");
+        dump_string((const uint8_t *)(names.names[0].name),
+                    (int)(names.names[0].len));
 
         /* Dump the segment identifier for the symbol */
-        if ((ch = getc(file)) == EOF)
-            return -1;
+        if ((ch = getc(file)) == EOF) {
+            result = -1;
+            break;
+        }
+        O65_STATS_ADD(O65_STAT_BYTES_READ, 1);
         o65_get_segment_name(ch, segname);
         printf(", %s", segname);
 
         /* Dump the value for the symbol */
-        if (o65_read_count(file, header, &value) < 0)
-            return -1;
+        if (o65_read_count(file, header, &value) < 0) {
+            result = -1;
+            break;
+        }
         if ((header->mode & O65_MODE_32BIT) == 0)
             printf(", 0x%04lx\n", (unsigned long)value);
         else
             printf(", 0x%08lx\n", (unsigned long)value);
     }
-    return 1;
+    o65_string_table_free(&names);
+    return result;
 }
 
-static int dump_image(FILE *file, const o65_header_t *header)
+static int dump_image
+    (FILE *file, const char *filename, const o65_header_t *header)
 {
-    o65_option_t option;
+    o65_options_t options;
     char cpu[O65_NAME_MAX];
+    uint64_t start;
+    size_t index;
     int result;
-    int have_options;
 
     /* Dump the fields in the header */
     printf("Header:\n");
@@ -600,61 +819,87 @@ static int dump_image(FILE *file, const o65_header_t *header)
     }
 
     /* Read and dump the header options */
-    have_options = 0;
-    for (;;) {
-        result = o65_read_option(file, &option);
-        if (result <= 0)
-            return result;
-        if (option.len == 0)
-            break;
-        if (!have_options) {
-            printf("\nOptions:\n");
-            have_options = 1;
-        }
-        dump_option(&option);
+    start = O65_SPAN_BEGIN();
+    o65_options_init(&options);
+    result = o65_options_read(file, &options);
+    if (result <= 0) {
+        o65_options_free(&options);
+        return result;
     }
+    if (o65_options_count(&options) > 0)
+        printf("\nOptions:\n");
+    for (index = 0; index < o65_options_count(&options); ++index)
+        dump_option(&options, index);
+    o65_options_free(&options);
+    O65_SPAN_END(O65_SPAN_OPTIONS, start, filename);
 
     /* Dump the contents of the text and data segments */
-    result = dump_segment(file, ".text", header, header->tbase, header->tlen, 1);
+    start = O65_SPAN_BEGIN();
+    result = dump_segment
+        (file, filename, ".text", header, header->tbase, header->tlen, 1);
     if (result <= 0)
         return result;
-    result = dump_segment(file, ".data", header, header->dbase, header->dlen, 0);
+    result = dump_segment
+        (file, filename, ".data", header, header->dbase, header->dlen, 0);
     if (result <= 0)
         return result;
+    O65_SPAN_END(O65_SPAN_SEGMENTS, start, filename);
 
     /* Dump any undefined symbols */
+    start = O65_SPAN_BEGIN();
     result = dump_undefined_symbols(file, header);
     if (result <= 0)
         return result;
+    O65_SPAN_END(O65_SPAN_EXTERNS, start, filename);
 
     /* Dump the relocation tables for the text and data segments */
+    start = O65_SPAN_BEGIN();
     result = dump_relocs(file, ".text", header, header->tbase);
     if (result <= 0)
         return result;
     result = dump_relocs(file, ".data", header, header->dbase);
     if (result <= 0)
         return result;
+    O65_SPAN_END(O65_SPAN_RELOCS, start, filename);
 
     /* Dump the list of exported symbols */
-    return dump_exported_symbols(file, header);
+    start = O65_SPAN_BEGIN();
+    result = dump_exported_symbols(file, header);
+    O65_SPAN_END(O65_SPAN_EXPORTS, start, filename);
+    return result;
 }
 
-static int dump_file(const char *filename)
+static int dump_stream(FILE *file, const char *filename, uint64_t file_start)
 {
-    FILE *file;
     o65_header_t header;
+    uint64_t start;
     int result;
 
-    /* Try to open the file */
-    if ((file = fopen(filename, "rb")) == NULL) {
-        perror(filename);
-        return 0;
+    /* Validate the entire file before dumping it if we are being strict */
+    if (strict) {
+        o65_validate_error_t error;
+        result = o65_validate(file, &error);
+        if (result < 0) {
+            file_error(file, filename);
+            return 0;
+        } else if (result == 0) {
+            fprintf(stderr, "%s:0x%lx: %s: %s\n", filename,
+                    error.offset, error.field, error.message);
+            fclose(file);
+            return 0;
+        } else if (fseek(file, 0, SEEK_SET) < 0) {
+            file_error(file, filename);
+            return 0;
+        }
     }
 
     /* Dump the file's contents.  There may be multiple chained images. */
+    image_index = 0;
     do {
         /* Read and validate the ".o65" file header */
+        start = O65_SPAN_BEGIN();
         result = o65_read_header(file, &header);
+        O65_SPAN_END(O65_SPAN_HEADER, start, filename);
         if (result < 0) {
             file_error(file, filename);
             return 0;
@@ -665,7 +910,7 @@ static int dump_file(const char *filename)
         }
 
         /* Dump the contents of this image in the chain. */
-        result = dump_image(file, &header);
+        result = dump_image(file, filename, &header);
         if (result < 0) {
             file_error(file, filename);
             return 0;
@@ -679,9 +924,163 @@ static int dump_file(const char *filename)
         if ((header.mode & O65_MODE_CHAIN) != 0) {
             printf("\n");
         }
+        ++image_index;
     } while ((header.mode & O65_MODE_CHAIN) != 0);
 
     /* Done */
     fclose(file);
+    O65_SPAN_END(O65_SPAN_FILE, file_start, filename);
     return 1;
 }
+
+static int dump_file(const char *filename)
+{
+    FILE *file;
+    uint8_t *buffer = NULL;
+    uint64_t file_start;
+    uint64_t start;
+    int result;
+
+    /* Try to open the file, which may be standard input or a pack member */
+    file_start = O65_SPAN_BEGIN();
+    start = file_start;
+    if (!strcmp(filename, "-"))
+        file = o65_fopen_input(filename, &buffer);
+    else
+        file = o65_pack_fopen(filename, &packs);
+    if (!file) {
+        perror(filename);
+        return 0;
+    }
+    O65_SPAN_END(O65_SPAN_OPEN, start, filename);
+    result = dump_stream(file, filename, file_start);
+    free(buffer);
+    return result;
+}
+
+/** Names of the files to be prefetched */
+typedef struct
+{
+    char **names;
+    int count;
+
+} dump_source_t;
+
+static const char *next_filename(void *ctx)
+{
+    dump_source_t *source = (dump_source_t *)ctx;
+    if (source->count <= 0)
+        return NULL;
+    --(source->count);
+    return *(source->names)++;
+}
+
+static int dump_files(char **names, int count)
+{
+    dump_source_t source = { names, count };
+    o65_prefetch_t *prefetch;
+    o65_prefetch_file_t input;
+    uint64_t file_start;
+    FILE *file;
+    int first = 1;
+    int ok = 1;
+
+    prefetch = o65_prefetch_new(0, next_filename, &source);
+    if (!prefetch) {
+        fprintf(stderr, "out of memory\n");
+        return 0;
+    }
+    while (o65_prefetch_next(prefetch, &input)) {
+        if (first)
+            first = 0;
+        else
+            printf("\n");
+        printf("%s:\n\n", input.filename);
+
+        /* Standard input, pack members, and files that could not be
+         * prefetched are opened in the usual way instead */
+        file_start = O65_SPAN_BEGIN();
+        if (input.error != 0 || input.size == 0) {
+            if (!dump_file(input.filename))
+                ok = 0;
+        } else if ((file = fmemopen(input.data, input.size, "rb")) == NULL) {
+            perror(input.filename);
+            ok = 0;
+        } else if (!dump_stream(file, input.filename, file_start)) {
+            ok = 0;
+        }
+        o65_prefetch_release(&input);
+    }
+    o65_prefetch_free(prefetch);
+    return ok;
+}
+
+static int dump_tar(const char *tar_file, int *first)
+{
+    o65_tar_member_t member;
+    o65_tar_t tar;
+    char *name;
+    uint64_t file_start;
+    FILE *archive;
+    FILE *file;
+    int result;
+    int ok = 1;
+
+    /* Open the archive; it is read once from start to finish, so it
+     * can be read directly from standard input */
+    if (!strcmp(tar_file, "-")) {
+        archive = stdin;
+    } else if ((archive = fopen(tar_file, "rb")) == NULL) {
+        perror(tar_file);
+        return 0;
+    }
+    name = malloc(strlen(tar_file) + O65_TAR_NAME_MAX + 2);
+    if (!name) {
+        fprintf(stderr, "out of memory\n");
+        if (archive != stdin)
+            fclose(archive);
+        return 0;
+    }
+
+    /* Dump each of the members in memory, named as "ARCHIVE:NAME" */
+    o65_tar_init(&tar, archive);
+    for (;;) {
+        file_start = O65_SPAN_BEGIN();
+        result = o65_tar_next(&tar, &member);
+        if (result < 0) {
+            if (feof(archive))
+                fprintf(stderr, "%s: unexpected EOF\n", tar_file);
+            else
+                perror(tar_file);
+            ok = 0;
+            break;
+        } else if (result == 0) {
+            fprintf(stderr, "%s:0x%lx: %s\n", tar_file,
+                    (unsigned long)(member.offset), tar.error);
+            ok = 0;
+            break;
+        } else if (!member.name) {
+            break;
+        }
+        sprintf(name, "%s:%s", tar_file, member.name);
+        if (*first)
+            *first = 0;
+        else
+            printf("\n");
+        printf("%s:\n\n", name);
+        file = fmemopen((void *)(member.data), member.size, "rb");
+        if (!file) {
+            perror(name);
+            ok = 0;
+        } else if (!dump_stream(file, name, file_start)) {
+            ok = 0;
+        }
+    }
+
+    /* Clean up */
+    o65_tar_free(&tar);
+    free(name);
+    if (archive != stdin)
+        fclose(archive);
+    return ok;
+}
@@ -31,21 +31,128 @@
 #include <string.h>
 #include <time.h>
 #include <getopt.h>
-#include "o65file.h"
+#include "o65options.h"
+#include "o65stats.h"
+#include "o65hash.h"
+#include "o65symmap.h"
 #include "elfmos.h"
 
-#define short_options "a:bdhl:o:s:"
+#define short_options "a:bB:dfghl:m:o:Pps:xz"
 static struct option long_options[] = {
     {"author-name",         required_argument,  0,  'a'},
     {"bss-zero",            no_argument,        0,  'b'},
+    {"bank-size",           required_argument,  0,  'B'},
     {"creation-date",       no_argument,        0,  'd'},
+    {"export-globals",      no_argument,        0,  'g'},
+    {"export-hash",         no_argument,        0,  'x'},
+    {"fingerprint",         no_argument,        0,  'f'},
     {"hosted",              no_argument,        0,  'h'},
     {"linker-name",         required_argument,  0,  'l'},
+    {"symbol-map",          required_argument,  0,  'm'},
     {"os-info",             required_argument,  0,  'o'},
+    {"paged",               no_argument,        0,  'P'},
+    {"prelinked",           no_argument,        0,  'p'},
     {"stack-size",          required_argument,  0,  's'},
+    {"stats",               optional_argument,  0,  'S'},
+    {"trace",               optional_argument,  0,  'T'},
+    {"trace-file",          required_argument,  0,  'F'},
+    {"trim-zeros",          no_argument,        0,  'z'},
     {0,                     0,                  0,    0},
 };
 
+/**
+ * @brief Relocation that has been converted from ELF but which has not
+ * yet been encoded into the ".o65" relocation table format.
+ */
+typedef struct
+{
+    /** Address of the bytes to be relocated. */
+    o65_size_t address;
+
+    /** Address that the relocation refers to, including the addend. */
+    o65_size_t target;
+
+    /** Relocation type and segment identifier in ".o65" form. */
+    uint8_t type;
+
+    /** Extra value associated with HIGH and SEG relocations. */
+    uint16_t extra;
+
+    /** Identifier for an undefined reference. */
+    uint32_t undefid;
+
+} reloc_entry_t;
+
+/**
+ * @brief Symbol that is exported from an image in the ".o65" chain.
+ */
+typedef struct
+{
+    /** Name of the exported symbol. */
+    const char *name;
+
+    /** Segment identifier for the symbol. */
+    uint8_t segid;
+
+    /** Value of the symbol. */
+    o65_size_t value;
+
+    /** Order in which the symbol was added, to choose between duplicates. */
+    size_t order;
+
+} export_entry_t;
+
+/** Maximum length of a bank symbol name, including the terminating NUL. */
+#define BANK_NAME_MAX 16
+
+/**
+ * @brief Information about a bank, which is written as a separate
+ * image in a ".o65" chain.
+ */
+typedef struct
+{
+    /** Header information for this image in the chain. */
+    o65_header_t header;
+
+    /** Address of the part of the .text segment in this bank. */
+    o65_size_t text_address;
+
+    /** Size of the part of the .text segment in this bank. */
+    o65_size_t text_size;
+
+    /** Number of filler bytes before the .text segment that keep the
+     *  start of a paged bank on a page boundary. */
+    o65_size_t padding;
+
+    /** Relocations for this bank, with .text relocations first. */
+    reloc_entry_t *relocs;
+
+    /** Number of relocations for this bank. */
+    size_t num_relocs;
+
+    /** Number of relocations that apply to the .text segment. */
+    size_t num_text_relocs;
+
+    /** Names of the external references for this bank. */
+    const char **externs;
+
+    /** Number of external references for this bank. */
+    size_t num_externs;
+
+    /** Name of the symbol that is exported for the start of this bank. */
+    char name[BANK_NAME_MAX];
+
+    /** Non-zero if another bank refers to the start of this bank. */
+    int referenced;
+
+    /** Symbols that are exported from this bank, sorted by name. */
+    export_entry_t *exports;
+
+    /** Number of symbols that are exported from this bank. */
+    size_t num_exports;
+
+} bank_info_t;
+
 /**
  * @brief Information about an image that is being converted to ".o65".
  */
@@ -54,9 +161,13 @@ typedef struct
     /** ELF file descriptor */
     Elf *elf;
 
-    /** File descriptor for the underlying input file */
+    /** File descriptor for the underlying input file, or -1 if the
+     *  input was read into memory from a pipe */
     int fd;
 
+    /** Buffer holding the input file if it was read from a pipe */
+    uint8_t *input_buffer;
+
     /** General purpose flag for section callbacks */
     int flag;
 
@@ -69,23 +180,44 @@ typedef struct
     /** Header information for the final ".o65" file. */
     o65_header_t header;
 
-    /** ELF machine option to add to the final file. */
-    o65_option_t elf_machine;
+    /** Header options to add to the final file; the operating system,
+     *  linker, author, creation date, ELF machine, and content hash. */
+    o65_options_t options;
 
-    /** Identifier of the operating system as a header option. */
-    o65_option_t os;
+    /** Non-zero to add the creation date to the output file. */
+    int add_creation_date;
 
-    /** Name of the author as a header option. */
-    o65_option_t author;
+    /** Non-zero to add a hash of the image contents to the output file. */
+    int add_content_hash;
 
-    /** Name of the linker to add as a header option. */
-    o65_option_t linker;
+    /** Non-zero to export all of the global symbols in the ELF file. */
+    int export_globals;
 
-    /** Non-zero to add the creation date to the output file. */
-    int add_creation_date;
+    /** Non-zero to add a hash table for the exported symbols. */
+    int export_hash;
 
-    /** Creation date and time to add as a header option. */
-    o65_option_t created;
+    /** Non-zero to move trailing zero bytes from .data into .bss. */
+    int trim_zeros;
+
+    /** End of the last section that contains code. */
+    o65_size_t code_end;
+
+    /** Largest alignment of the sections that are loaded into memory. */
+    o65_size_t max_alignment;
+
+    /** Non-zero to use page alignment even if the sections do not need it. */
+    int paged;
+
+    /** Non-zero to mark images without external references as prelinked. */
+    int prelinked;
+
+    /** Offsets of the first image's header options in the output file,
+     *  which are excluded from the content hash. */
+    long options_start;
+    long options_end;
+
+    /** Offset of the content hash header option in the output file. */
+    long content_hash_offset;
 
     /** Entry point for the executable. */
     o65_size_t entry_point;
@@ -120,23 +252,14 @@ typedef struct
     /** Size of the .zp segment. */
     o65_size_t zeropage_size;
 
-    /** Buffer containing all relocations in ".o65" format. */
-    o65_reloc_t *reloc;
-
-    /** Current size of the relocation buffer. */
-    o65_size_t reloc_size;
-
-    /** Allocation size of the relocation buffer. */
-    o65_size_t reloc_alloc_size;
+    /** Relocations that have been converted from ELF, in address order. */
+    reloc_entry_t *relocs;
 
-    /** Number of bytes of .text relocation data.  The rest is for .data. */
-    o65_size_t text_reloc_size;
+    /** Number of relocations that have been converted. */
+    size_t num_relocs;
 
-    /** Address of the last relocation that was performed. */
-    o65_size_t last_reloc_address;
-
-    /** Current segment that is being relocated. */
-    uint8_t reloc_segment;
+    /** Maximum number of relocations before reallocating the table. */
+    size_t max_relocs;
 
     /** Index of the section that contains the section header string table. */
     size_t hstrtab;
@@ -167,6 +290,47 @@ typedef struct
      *  addresses of the llvm-mos imaginary registers. */
     int hosted;
 
+    /** Non-zero if the input is a relocatable ELF object file rather
+     *  than an executable. */
+    int relocatable;
+
+    /** Number of sections in a relocatable ELF object file. */
+    size_t num_sections;
+
+    /** Addresses that have been assigned to the sections of a
+     *  relocatable object file, indexed by section number. */
+    o65_size_t *section_addresses;
+
+    /** Segment identifiers for the sections of a relocatable object
+     *  file, or O65_SEGID_UNDEF for sections that are not loaded. */
+    uint8_t *section_segids;
+
+    /** Copy of the symbol table with the values relocated to the
+     *  addresses of the sections in a relocatable object file. */
+    Elf32_Sym *rebased_symbols;
+
+    /** Maximum size of each bank, or zero to write a single image. */
+    o65_size_t bank_size;
+
+    /** Addresses of the section boundaries within the .text segment. */
+    o65_size_t *boundaries;
+
+    /** Number of section boundaries within the .text segment. */
+    size_t num_boundaries;
+
+    /** Maximum number of section boundaries before reallocating. */
+    size_t max_boundaries;
+
+    /** Banks to be written as images in the output ".o65" chain. */
+    bank_info_t *banks;
+
+    /** Number of banks. */
+    size_t num_banks;
+
+    /** Non-zero if other banks refer to the .data, .bss, or .zp segments
+     *  in the first bank; indexed by segment identifier. */
+    int segment_referenced[O65_SEGID_ZEROPAGE + 1];
+
 } image_info_t;
 
 static void usage(const char *progname);
@@ -175,7 +339,10 @@ static void free_image(image_info_t *info);
 static int validate_elf(image_info_t *info);
 static int load_segments(image_info_t *info);
 static int convert_relocations(image_info_t *info);
+static void trim_trailing_zeros(image_info_t *info);
+static int split_banks(image_info_t *info);
 static int write_o65(image_info_t *info, const char *filename);
+static int write_symbol_map(image_info_t *info, const char *filename);
 
 int main(int argc, char *argv[])
 {
@@ -185,10 +352,15 @@ int main(int argc, char *argv[])
     };
     const char *input_file;
     const char *output_file;
+    const char *symbol_map_file = NULL;
     char output_file_buf[BUFSIZ];
+    uint8_t *input_buffer = NULL;
+    size_t input_size;
     int fd;
     int bsszero = 0;
     Elf *elf;
+    uint64_t file_start;
+    uint64_t start;
 
     /* Parse the command-line options */
     for (;;) {
@@ -197,19 +369,39 @@ int main(int argc, char *argv[])
             break;
         switch (opt) {
         case 'a':
-            o65_set_string_option
-                (&(info.author), O65_OPT_AUTHOR, optarg, strlen(optarg));
+            if (o65_options_set_string(&(info.options), O65_OPT_AUTHOR,
+                                       optarg, strlen(optarg)) < 0) {
+                fprintf(stderr, "%s: out of memory\n", progname);
+                return 1;
+            }
             break;
 
         case 'b': bsszero = 1; break;
+
+        case 'B':
+            info.bank_size = strtoul(optarg, NULL, 0);
+            if (info.bank_size == 0U) {
+                fprintf(stderr, "%s: invalid bank size '%s'\n",
+                        progname, optarg);
+                return 1;
+            }
+            break;
+
         case 'd': info.add_creation_date = 1; break;
+        case 'f': info.add_content_hash = 1; break;
+        case 'g': info.export_globals = 1; break;
         case 'h': info.hosted = 1; break;
 
         case 'l':
-            o65_set_string_option
-                (&(info.linker), O65_OPT_PROGRAM, optarg, strlen(optarg));
+            if (o65_options_set_string(&(info.options), O65_OPT_PROGRAM,
+                                       optarg, strlen(optarg)) < 0) {
+                fprintf(stderr, "%s: out of memory\n", progname);
+                return 1;
+            }
             break;
 
+        case 'm': symbol_map_file = optarg; break;
+
         case 'o':
             if (!set_os_option(&info, optarg)) {
                 fprintf(stderr, "%s: invalid os information '%s'\n",
@@ -218,10 +410,28 @@ int main(int argc, char *argv[])
             }
             break;
 
+        case 'P': info.paged = 1; break;
+        case 'p': info.prelinked = 1; break;
+
         case 's':
             info.header.stack = strtoul(optarg, NULL, 0);
             break;
 
+        case 'S':
+        case 'T':
+            if (!o65_stats_option
+                    (optarg, opt == 'S' ? O65_STATS_SUMMARY : O65_STATS_TRACE)) {
+                fprintf(stderr, "%s: invalid statistics format '%s'\n",
+                        progname, optarg);
+                return 1;
+            }
+            break;
+
+        case 'x': info.export_hash = 1; break;
+        case 'z': info.trim_zeros = 1; break;
+
+        case 'F': o65_stats_trace_file(optarg); break;
+
         default:
             usage(progname);
             return 1;
@@ -236,6 +446,9 @@ int main(int argc, char *argv[])
     input_file = argv[optind];
     if ((argc - optind) >= 2) {
         output_file = argv[optind + 1];
+    } else if (!strcmp(input_file, "-")) {
+        /* Standard input is converted to standard output by default */
+        output_file = "-";
     } else {
         /* Synthesise an output filename by removing .elf from the input name,
          * or by adding .o65 if the input filename doesn't end in .elf. */
@@ -257,52 +470,115 @@ int main(int argc, char *argv[])
     }
 
     /* Open the input ELF file and fetch the header */
-    fd = open(input_file, O_RDONLY, 0);
-    if (fd < 0) {
+    file_start = O65_SPAN_BEGIN();
+    start = file_start;
+    if (strcmp(input_file, "-") != 0) {
+        fd = open(input_file, O_RDONLY, 0);
+    } else if (lseek(STDIN_FILENO, 0, SEEK_CUR) >= 0) {
+        /* libelf can read a seekable standard input directly */
+        fd = dup(STDIN_FILENO);
+    } else {
+        /* Read the ELF file from the pipe into memory first */
+        fd = -1;
+        if (o65_read_all(stdin, &input_buffer, &input_size) < 0) {
+            perror(input_file);
+            return 1;
+        }
+    }
+    if (fd < 0 && !input_buffer) {
         perror(input_file);
         return 1;
     }
-    elf = elf_begin(fd, ELF_C_READ, NULL);
+    if (input_buffer)
+        elf = elf_memory((char *)input_buffer, input_size);
+    else
+        elf = elf_begin(fd, ELF_C_READ, NULL);
     if (!elf) {
         fprintf(stderr, "%s: %s\n", input_file, elf_errmsg(elf_errno()));
-        close(fd);
+        if (fd >= 0)
+            close(fd);
+        free(input_buffer);
         return 1;
     }
+    O65_SPAN_END(O65_SPAN_OPEN, start, input_file);
 
     /* Validate the ELF file for suitability to our purposes */
+    start = O65_SPAN_BEGIN();
     info.elf = elf;
     info.filename = input_file;
     info.fd = fd;
+    info.input_buffer = input_buffer;
     if (!validate_elf(&info)) {
         free_image(&info);
         return 1;
     }
+    O65_SPAN_END(O65_SPAN_HEADER, start, input_file);
+    if (info.relocatable) {
+        /* Object files are linked again later, so the options that
+         * only make sense for a final program cannot be used. */
+        if (info.hosted || info.bank_size) {
+            fprintf(stderr, "%s: --hosted and --bank-size cannot be used "
+                            "with relocatable objects\n", input_file);
+            free_image(&info);
+            return 1;
+        }
+        info.export_globals = 1;
+    }
     if (bsszero) {
         /* Force the .bss segment to be zero'ed */
         info.header.mode |= O65_MODE_BSSZERO;
     }
 
     /* Load the segments into memory and get their positions and sizes */
+    start = O65_SPAN_BEGIN();
     if (!load_segments(&info)) {
         free_image(&info);
         return 1;
     }
+    O65_SPAN_END(O65_SPAN_SEGMENTS, start, input_file);
 
     /* Convert the relocations into ".o65" form */
+    start = O65_SPAN_BEGIN();
     if (!convert_relocations(&info)) {
         free_image(&info);
         return 1;
     }
+    O65_SPAN_END(O65_SPAN_RELOCS, start, input_file);
+
+    /* Move the trailing zero bytes of .data into .bss */
+    if (info.trim_zeros)
+        trim_trailing_zeros(&info);
+
+    /* Split the image into banks */
+    if (!split_banks(&info)) {
+        free_image(&info);
+        return 1;
+    }
 
     /* Write the output ".o65" file */
+    start = O65_SPAN_BEGIN();
     if (!write_o65(&info, output_file)) {
         perror(output_file);
         free_image(&info);
         return 1;
     }
+    O65_SPAN_END(O65_SPAN_WRITE, start, output_file);
+
+    /* Write the symbol map for debuggers and disassemblers */
+    if (symbol_map_file) {
+        start = O65_SPAN_BEGIN();
+        if (!write_symbol_map(&info, symbol_map_file)) {
+            perror(symbol_map_file);
+            free_image(&info);
+            return 1;
+        }
+        O65_SPAN_END(O65_SPAN_WRITE, start, symbol_map_file);
+    }
 
     /* Clean up and exit */
     free_image(&info);
+    O65_SPAN_END(O65_SPAN_FILE, file_start, input_file);
+    o65_stats_report(stderr);
     return 0;
 }
 
@@ -315,15 +591,31 @@ static void usage(const char *progname)
 {
     fprintf(stderr, "Usage: %s [options] input.elf [output.o65]\n\n", progname);
 
+    fprintf(stderr, "Use \"-\" for standard input or standard output.\n");
+    fprintf(stderr, "Relocatable ELF objects are converted into \".o65\" object files.\n\n");
+
     fprintf(stderr, "    --author-name AUTHOR, -a AUTHOR\n");
     fprintf(stderr, "        Set the name of the author in the header options.\n\n");
 
     fprintf(stderr, "    --bss-zero, -b\n");
     fprintf(stderr, "        Force the bss segment to be zeroed by the OS.\n\n");
 
+    fprintf(stderr, "    --bank-size SIZE, -B SIZE\n");
+    fprintf(stderr, "        Split the program at section boundaries into a chain\n");
+    fprintf(stderr, "        of images, each of which is no larger than SIZE.\n\n");
+
     fprintf(stderr, "    --creation-date, -d\n");
     fprintf(stderr, "        Add the file creation date in the header options.\n\n");
 
+    fprintf(stderr, "    --export-globals, -g\n");
+    fprintf(stderr, "        Export all of the global symbols, sorted by name.\n\n");
+
+    fprintf(stderr, "    --export-hash, -x\n");
+    fprintf(stderr, "        Add a hash table for the exported symbols to the header.\n\n");
+
+    fprintf(stderr, "    --fingerprint, -f\n");
+    fprintf(stderr, "        Add a hash of the segments and relocations to the header.\n\n");
+
     fprintf(stderr, "    --hosted, -h\n");
     fprintf(stderr, "        Hosted mode, where the runtime loader provides the\n");
     fprintf(stderr, "        addresses of the llvm-mos imaginary registers.\n\n");
@@ -331,11 +623,35 @@ static void usage(const char *progname)
     fprintf(stderr, "    --linker-name LINKER, -l LINKER\n");
     fprintf(stderr, "        Set the name of the linker in the header options.\n\n");
 
+    fprintf(stderr, "    --symbol-map MAPFILE, -m MAPFILE\n");
+    fprintf(stderr, "        Write the addresses of the ELF symbols to a symbol map\n");
+    fprintf(stderr, "        that \"o65dump --symbols\" can use to label disassembly.\n\n");
+
     fprintf(stderr, "    --os-info 'HEXBYTES', -o 'HEXBYTES'\n");
     fprintf(stderr, "        Sets the operating system header option.\n\n");
 
+    fprintf(stderr, "    --paged, -P\n");
+    fprintf(stderr, "        Use page alignment, which makes HIGH relocations smaller\n");
+    fprintf(stderr, "        at the cost of up to 255 bytes of padding per segment.\n\n");
+
+    fprintf(stderr, "    --prelinked, -p\n");
+    fprintf(stderr, "        Record the offsets of the relocation and export tables\n");
+    fprintf(stderr, "        so that loaders can skip relocation at the preferred address.\n\n");
+
     fprintf(stderr, "    --stack-size NUM, -s NUM\n");
     fprintf(stderr, "        Declare the size of the stack to the operating system.\n\n");
+
+    fprintf(stderr, "    --stats[=json]\n");
+    fprintf(stderr, "        Report counters and timings on exit.\n\n");
+
+    fprintf(stderr, "    --trace[=json]\n");
+    fprintf(stderr, "        Report the time for each phase as it completes.\n\n");
+
+    fprintf(stderr, "    --trace-file TRACEFILE\n");
+    fprintf(stderr, "        Write a Chrome trace event file with the time for each phase.\n\n");
+
+    fprintf(stderr, "    --trim-zeros, -z\n");
+    fprintf(stderr, "        Move trailing zero bytes from .data into a zeroed .bss.\n\n");
 }
 
 /**
@@ -348,10 +664,10 @@ static void usage(const char *progname)
  */
 static int set_os_option(image_info_t *info, const char *str)
 {
+    uint8_t data[O65_MAX_OPT_SIZE - 2];
+    size_t len = 0;
     int value = 0;
     int nibble = 0;
-    info->os.len = 2;
-    info->os.type = O65_OPT_OS;
     while (*str != '\0') {
         int ch = *str++;
         if (ch >= '0' && ch <= '9') {
@@ -368,20 +684,18 @@ static int set_os_option(image_info_t *info, const char *str)
         }
         nibble = !nibble;
         if (!nibble) {
-            if (info->os.len >= O65_MAX_OPT_SIZE)
+            if (len >= sizeof(data))
                 return 0;
-            info->os.data[info->os.len - 2] = (uint8_t)value;
-            ++(info->os.len);
+            data[len++] = (uint8_t)value;
             value = 0;
         }
     }
     if (nibble) {
-        if (info->os.len >= O65_MAX_OPT_SIZE)
+        if (len >= sizeof(data))
             return 0;
-        info->os.data[info->os.len - 2] = (uint8_t)value;
-        ++(info->os.len);
+        data[len++] = (uint8_t)value;
     }
-    return 1;
+    return o65_options_set(&(info->options), O65_OPT_OS, data, len) == 0;
 }
 
 /**
@@ -392,17 +706,34 @@ static int set_os_option(image_info_t *info, const char *str)
 static void free_image(image_info_t *info)
 {
     if (info->outfile)
-        fclose(info->outfile);
+        o65_fclose_output(info->outfile);
     elf_end(info->elf);
-    close(info->fd);
+    if (info->fd >= 0)
+        close(info->fd);
+    free(info->input_buffer);
     if (info->text_segment)
         free(info->text_segment);
-    if (info->reloc)
-        free(info->reloc);
+    if (info->relocs)
+        free(info->relocs);
+    if (info->boundaries)
+        free(info->boundaries);
+    if (info->banks) {
+        size_t index;
+        for (index = 0; index < info->num_banks; ++index) {
+            free(info->banks[index].relocs);
+            free(info->banks[index].externs);
+            free(info->banks[index].exports);
+        }
+        free(info->banks);
+    }
+    free(info->section_addresses);
+    free(info->section_segids);
+    free(info->rebased_symbols);
     if (info->undef_name_ids)
         free(info->undef_name_ids);
     if (info->undef_names)
         free(info->undef_names);
+    o65_options_free(&(info->options));
 }
 
 /**
@@ -534,12 +865,68 @@ static void section_callback_symbol_table
     (image_info_t *info, Elf_Scn *scn, Elf32_Shdr *shdr, const char *name)
 {
     Elf_Data *data = elf_getdata(scn, NULL);
-    (void)shdr;
+    Elf_Scn *strscn;
     (void)name;
     if (!data || data->d_size < sizeof(Elf32_Sym))
         return;
     info->symbols = (Elf32_Sym *)(data->d_buf);
     info->num_symbols = data->d_size / sizeof(Elf32_Sym);
+
+    /* Use the string table that the symbol table links to.  It may not
+     * be the last one in the file if the section names are separate. */
+    strscn = elf_getscn(info->elf, shdr->sh_link);
+    if (strscn && shdr->sh_link != 0)
+        info->strtab = elf_getdata(strscn, NULL);
+}
+
+/**
+ * @brief Sets the alignment mode in the ".o65" header.
+ *
+ * @param[in,out] info Information about the image we are converting.
+ * @param[in] alignment The largest alignment that the segments need.
+ *
+ * The smallest ".o65" alignment that satisfies @a alignment is used,
+ * unless page alignment was requested with "--paged".  HIGH relocations
+ * carry the low byte of the address when page alignment is not in use,
+ * so they are correct at any alignment; paging only makes them smaller.
+ */
+static void set_alignment(image_info_t *info, o65_size_t alignment)
+{
+    /* Normalize the alignment to something allowed by ".o65".
+     * The only allowable values are 1, 2, 4, and 256. .*/
+    if (info->paged)
+        alignment = 256;
+    info->header.mode &= ~(O65_MODE_ALIGN | O65_MODE_PAGED);
+    if (alignment > 4) {
+        info->header.mode |= O65_MODE_ALIGN_256;
+        info->header.mode |= O65_MODE_PAGED;
+    } else if (alignment > 2) {
+        info->header.mode |= O65_MODE_ALIGN_4;
+    } else if (alignment > 1) {
+        info->header.mode |= O65_MODE_ALIGN_2;
+    } else {
+        info->header.mode |= O65_MODE_ALIGN_1;
+    }
+}
+
+/**
+ * @brief Callback for finding the largest alignment of the sections that
+ * are loaded into memory.
+ *
+ * @param[in,out] info Information about the image we are converting.
+ * @param[in] scn ELF section control structure.
+ * @param[in] shdr ELF section header structure.
+ * @param[in] name Name of the section, or NULL if unknown.
+ */
+static void section_callback_alignment
+    (image_info_t *info, Elf_Scn *scn, Elf32_Shdr *shdr, const char *name)
+{
+    (void)scn;
+    (void)name;
+    if ((shdr->sh_flags & SHF_ALLOC) != 0 &&
+            shdr->sh_addralign > info->max_alignment) {
+        info->max_alignment = shdr->sh_addralign;
+    }
 }
 
 /**
@@ -551,10 +938,8 @@ static void section_callback_symbol_table
  */
 static int validate_elf(image_info_t *info)
 {
+    uint8_t machine[6];
     Elf32_Ehdr *ehdr;
-    Elf32_Phdr *phdr;
-    size_t index, count;
-    o65_size_t alignment;
 
     /* Get the ELF header and verify that it is suitable for MOS */
     ehdr = elf32_getehdr(info->elf);
@@ -567,9 +952,12 @@ static int validate_elf(image_info_t *info)
         return 0;
     }
 
-    /* Must be an executable, not an object file */
-    if (ehdr->e_type != ET_EXEC) {
-        fprintf(stderr, "%s: ELF file is not an executable\n", info->filename);
+    /* Must be an executable or a relocatable object file */
+    if (ehdr->e_type == ET_REL) {
+        info->relocatable = 1;
+    } else if (ehdr->e_type != ET_EXEC) {
+        fprintf(stderr, "%s: ELF file is not an executable or object file\n",
+                info->filename);
         return 0;
     }
 
@@ -579,45 +967,32 @@ static int validate_elf(image_info_t *info)
         fprintf(stderr, "%s: ELF machine type is not binary-compatible with MOS6502\n", info->filename);
         return 0;
     }
+    if (info->relocatable)
+        info->header.mode |= O65_MODE_OBJ;
 
     /* Set the ELF machine option if we don't have an exact CPU match */
-    info->elf_machine.len = 8;
-    info->elf_machine.type = O65_OPT_ELF_MACHINE;
-    o65_write_uint16(info->elf_machine.data, ehdr->e_machine);
-    o65_write_uint32(info->elf_machine.data + 2, ehdr->e_flags);
+    o65_write_uint16(machine, ehdr->e_machine);
+    o65_write_uint32(machine + 2, ehdr->e_flags);
+    if (o65_options_set(&(info->options), O65_OPT_ELF_MACHINE,
+                        machine, sizeof(machine)) < 0) {
+        fprintf(stderr, "%s: out of memory\n", info->filename);
+        return 0;
+    }
 
     /* Record some information from the ehdr for later */
     info->entry_point = ehdr->e_entry;
 
-    /* Find the best alignment to use based on the loadable program headers */
-    elf_getphdrnum(info->elf, &count);
-    phdr = elf32_getphdr(info->elf);
-    alignment = 1;
-    for (index = 0; index < count; ++index) {
-        if (phdr[index].p_type != PT_LOAD) {
-            continue;
-        }
-        if (phdr[index].p_align > alignment) {
-            alignment = phdr[index].p_align;
-        }
-    }
-
-    /* Normalize the alignment to something allowed by ".o65".
-     * The only allowable values are 1, 2, 4, and 256. .*/
-    if (alignment > 4) {
-        info->header.mode |= O65_MODE_ALIGN_256;
-        info->header.mode |= O65_MODE_PAGED;
-    } else if (alignment > 2) {
-        info->header.mode |= O65_MODE_ALIGN_4;
-    } else if (alignment > 1) {
-        info->header.mode |= O65_MODE_ALIGN_2;
-    } else {
-        info->header.mode |= O65_MODE_ALIGN_1;
-    }
-
     /* Find the section header string table */
     elf_getshdrstrndx(info->elf, &(info->hstrtab));
 
+    /* Find the alignment that the sections actually need.  The alignment
+     * of the program headers is usually the linker's page size, which
+     * would force page alignment and up to 255 bytes of padding per
+     * segment on the target for no reason. */
+    info->max_alignment = 1;
+    section_iterator(info, SHT_NULL, section_callback_alignment);
+    set_alignment(info, info->max_alignment);
+
     /* Find the regular string table and the symbol table */
     section_iterator(info, SHT_STRTAB, section_callback_string_table);
     section_iterator(info, SHT_SYMTAB, section_callback_symbol_table);
@@ -693,114 +1068,337 @@ static void section_callback_text_size
 }
 
 /**
- * @brief Loads the .text, .data, .bss, and .zp segments.
+ * @brief Sets up the positions and sizes of the segments in the
+ * ".o65" header.
  *
  * @param[in,out] info Information about the image we are converting.
- *
- * @return Non-zero if the segments were loaded, or zero on error.
  */
-static int load_segments(image_info_t *info)
+static void set_segment_header(image_info_t *info)
 {
-    Elf32_Phdr *phdr;
-    Elf_Data *raw;
-    size_t index, count;
-    int first;
-
-    /* Concatenate all loadable program headers */
-    elf_getphdrnum(info->elf, &count);
-    phdr = elf32_getphdr(info->elf);
-    first = 1;
-    for (index = 0; index < count; ++index, ++phdr) {
-        if (phdr->p_type != PT_LOAD) {
-            continue;
-        }
-        raw = elf_getdata_rawchunk
-            (info->elf, phdr->p_offset, phdr->p_filesz, ELF_T_BYTE);
-        if (!raw) {
-            fprintf(stderr, "%s: cannot map program header %u\n",
-                    info->filename, (unsigned)index);
-            return 0;
-        }
-        if (first) {
-            /* This is the first loadable program header.  Assume that its
-             * base address is the same as the base of the .text segment */
-            info->text_address = phdr->p_vaddr;
-            info->text_size = phdr->p_memsz;
-            info->text_segment = calloc(phdr->p_memsz, 1);
-            memcpy(info->text_segment, raw->d_buf, phdr->p_filesz);
-            first = 0;
-        } else {
-            /* Concatencate this loadable segment to the previous one */
-            if (phdr->p_vaddr < (info->text_address + info->text_size)) {
-                /* Addresses went backwards.  Probably a load segment
-                 * for zero page definitions.  No more .text sections */
-                break;
-            } else if (phdr->p_vaddr > (info->text_address + info->text_size)) {
-                fprintf(stderr, "%s: program headers are not contiguous\n",
-                        info->filename);
-                return 0;
-            }
-            info->text_segment = realloc
-                (info->text_segment, info->text_size + phdr->p_memsz);
-            memset(info->text_segment + info->text_size, 0, phdr->p_memsz);
-            memcpy(info->text_segment + info->text_size,
-                   raw->d_buf, phdr->p_filesz);
-            info->text_size += phdr->p_memsz;
-        }
-    }
-
-    /* Count up the bytes in "NOBITS" sections to figure out how
-     * big the .bss segment will be. */
-    section_iterator(info, SHT_NOBITS, section_callback_bss_size);
-
-    /* Count up the bytes in all zero page sections to figure
-     * out how big the .o65 zero page will be.  This also finds
-     * the lowest address that is used in the zero page. */
-    info->zeropage_address = 0x100;
-    section_iterator(info, SHT_NULL, section_callback_zp_size);
-    if (info->zeropage_address >= 0x100) {
-        /* We didn't find any zeropage sections */
-        info->zeropage_address = 0;
-    }
-
-    /* Figure out where the boundary between .text and .data lies */
-    info->data_address = info->text_address + info->text_size;
-    info->data_size = 0;
-    info->flag = 0;
-    section_iterator(info, SHT_PROGBITS, section_callback_text_size);
-    info->data_segment = info->text_segment + info->text_size;
-
-    /* Set up the positions and sizes of the segments in the ".o65" header */
     info->header.tbase = info->text_address;
     info->header.tlen = info->text_size;
     info->header.dbase = info->data_address;
     info->header.dlen = info->data_size;
-    info->bss_address = info->data_address + info->data_size;
     info->header.bbase = info->bss_address;
     info->header.blen = info->bss_size;
     info->header.zbase = info->zeropage_address;
     info->header.zlen = info->zeropage_size;
-    return 1;
 }
 
 /**
- * @brief Adds a ".o65" relocation to the final image.
+ * @brief Address of the .text segment for relocatable objects.
+ *
+ * This is above the zero page and the stack so that the address ranges
+ * of the .text, .data, and .bss segments never overlap the .zp segment,
+ * which starts at zero.
+ */
+#define RELOCATABLE_TEXT_BASE 0x0200
+
+/**
+ * @brief Determines which ".o65" segment a section of a relocatable
+ * object file belongs in.
+ *
+ * @param[in] shdr ELF section header structure.
+ * @param[in] name Name of the section, or NULL if unknown.
+ *
+ * @return The segment identifier, or O65_SEGID_UNDEF if the section
+ * is not loaded into memory.
+ */
+static uint8_t classify_section(const Elf32_Shdr *shdr, const char *name)
+{
+    if (!(shdr->sh_flags & SHF_ALLOC))
+        return O65_SEGID_UNDEF;
+    else if (is_zp_section(shdr, name))
+        return O65_SEGID_ZEROPAGE;
+    else if (shdr->sh_type == SHT_NOBITS)
+        return O65_SEGID_BSS;
+    else if (shdr->sh_flags & SHF_WRITE)
+        return O65_SEGID_DATA;
+    else
+        return O65_SEGID_TEXT;
+}
+
+/**
+ * @brief Copies the symbol table and relocates the symbol values to
+ * the addresses of the sections in a relocatable object file.
+ *
+ * @param[in,out] info Information about the image we are converting.
+ *
+ * @return Non-zero if the symbols were relocated, or zero on error.
+ */
+static int rebase_symbols(image_info_t *info)
+{
+    Elf32_Sym *sym;
+    size_t index;
+
+    if (!(info->num_symbols))
+        return 1;
+    info->rebased_symbols = (Elf32_Sym *)malloc
+        (info->num_symbols * sizeof(Elf32_Sym));
+    if (!(info->rebased_symbols)) {
+        fprintf(stderr, "out of memory\n");
+        return 0;
+    }
+    memcpy(info->rebased_symbols, info->symbols,
+           info->num_symbols * sizeof(Elf32_Sym));
+    info->symbols = info->rebased_symbols;
+    for (index = 0; index < info->num_symbols; ++index) {
+        sym = info->symbols + index;
+        if (sym->st_shndx == SHN_COMMON) {
+            fprintf(stderr, "%s: common symbols are not supported; "
+                            "compile with -fno-common\n", info->filename);
+            return 0;
+        } else if (sym->st_shndx == SHN_UNDEF ||
+                   sym->st_shndx >= SHN_LORESERVE) {
+            continue;
+        } else if (sym->st_shndx < info->num_sections &&
+                   info->section_segids[sym->st_shndx] != O65_SEGID_UNDEF) {
+            sym->st_value += info->section_addresses[sym->st_shndx];
+        } else {
+            /* Symbol in a section that is not loaded, such as debugging
+             * information.  Nothing in memory can refer to it. */
+            sym->st_shndx = SHN_ABS;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Lays out the sections of a relocatable object file into the
+ * .text, .data, .bss, and .zp segments and loads their contents.
+ *
+ * @param[in,out] info Information about the image we are converting.
+ *
+ * @return Non-zero if the segments were loaded, or zero on error.
+ *
+ * Sections are placed in the order that they appear in the file, aligned
+ * relative to the start of their segment.  The .text, .data, and .bss
+ * segments are contiguous, like they are in an executable.
+ */
+static int load_sections(image_info_t *info)
+{
+    static uint8_t const segids[] = {
+        O65_SEGID_TEXT, O65_SEGID_DATA, O65_SEGID_BSS, O65_SEGID_ZEROPAGE
+    };
+    Elf_Scn *scn;
+    Elf32_Shdr *shdr;
+    Elf_Data *data;
+    const char *name;
+    o65_size_t start;
+    o65_size_t address;
+    o65_size_t offset;
+    o65_size_t alignment = 1;
+    size_t index;
+    size_t order;
+    size_t len;
+    uint8_t segid;
+
+    /* Allocate the section address table */
+    if (elf_getshdrnum(info->elf, &(info->num_sections)) < 0) {
+        fprintf(stderr, "%s: %s\n", info->filename, elf_errmsg(elf_errno()));
+        return 0;
+    }
+    info->section_addresses = (o65_size_t *)calloc
+        (info->num_sections ? info->num_sections : 1, sizeof(o65_size_t));
+    info->section_segids = (uint8_t *)calloc
+        (info->num_sections ? info->num_sections : 1, sizeof(uint8_t));
+    if (!(info->section_addresses) || !(info->section_segids)) {
+        fprintf(stderr, "out of memory\n");
+        return 0;
+    }
+
+    /* Assign addresses to the sections one segment at a time */
+    address = RELOCATABLE_TEXT_BASE;
+    for (order = 0; order < sizeof(segids); ++order) {
+        segid = segids[order];
+        if (segid == O65_SEGID_ZEROPAGE)
+            address = 0;
+        start = address;
+        for (scn = elf_nextscn(info->elf, NULL); scn != NULL;
+                scn = elf_nextscn(info->elf, scn)) {
+            shdr = elf32_getshdr(scn);
+            name = elf_strptr(info->elf, info->hstrtab, shdr->sh_name);
+            if (classify_section(shdr, name) != segid)
+                continue;
+            if (segid == O65_SEGID_ZEROPAGE && shdr->sh_type != SHT_NOBITS &&
+                    shdr->sh_size > 0) {
+                fprintf(stderr, "%s: initialized zero page section %s is not supported\n",
+                        info->filename, name ? name : "");
+                return 0;
+            }
+            offset = address - start;
+            if (shdr->sh_addralign > 1) {
+                offset = (offset + shdr->sh_addralign - 1) &
+                         ~(o65_size_t)(shdr->sh_addralign - 1);
+                if (shdr->sh_addralign > alignment)
+                    alignment = shdr->sh_addralign;
+            }
+            index = elf_ndxscn(scn);
+            info->section_addresses[index] = start + offset;
+            info->section_segids[index] = segid;
+            address = start + offset + shdr->sh_size;
+        }
+        switch (segid) {
+        case O65_SEGID_TEXT:
+            info->text_address = start;
+            info->text_size = address - start;
+            break;
+        case O65_SEGID_DATA:
+            info->data_address = start;
+            info->data_size = address - start;
+            break;
+        case O65_SEGID_BSS:
+            info->bss_address = start;
+            info->bss_size = address - start;
+            break;
+        default:
+            info->zeropage_address = start;
+            info->zeropage_size = address - start;
+            break;
+        }
+    }
+    if (info->zeropage_size > 0x100) {
+        fprintf(stderr, "%s: zero page sections are larger than 256 bytes\n",
+                info->filename);
+        return 0;
+    }
+    set_alignment(info, alignment);
+
+    /* Load the contents of the .text and .data sections */
+    info->text_segment = calloc(info->text_size + info->data_size + 1, 1);
+    if (!(info->text_segment)) {
+        fprintf(stderr, "out of memory\n");
+        return 0;
+    }
+    for (scn = elf_nextscn(info->elf, NULL); scn != NULL;
+            scn = elf_nextscn(info->elf, scn)) {
+        index = elf_ndxscn(scn);
+        segid = info->section_segids[index];
+        if (segid != O65_SEGID_TEXT && segid != O65_SEGID_DATA)
+            continue;
+        shdr = elf32_getshdr(scn);
+        data = elf_getdata(scn, NULL);
+        if (!data || !(data->d_buf))
+            continue;
+        len = data->d_size < shdr->sh_size ? data->d_size : shdr->sh_size;
+        memcpy(info->text_segment +
+                    (info->section_addresses[index] - info->text_address),
+               data->d_buf, len);
+        O65_STATS_ADD(O65_STAT_BYTES_READ, len);
+    }
+    info->data_segment = info->text_segment + info->text_size;
+
+    /* Object files do not have an entry point of their own */
+    info->entry_point = info->text_address;
+    set_segment_header(info);
+    return rebase_symbols(info);
+}
+
+/**
+ * @brief Loads the .text, .data, .bss, and .zp segments.
+ *
+ * @param[in,out] info Information about the image we are converting.
+ *
+ * @return Non-zero if the segments were loaded, or zero on error.
+ */
+static int load_segments(image_info_t *info)
+{
+    Elf32_Phdr *phdr;
+    Elf_Data *raw;
+    size_t index, count;
+    int first;
+
+    /* Relocatable objects are laid out from their sections instead */
+    if (info->relocatable)
+        return load_sections(info);
+
+    /* Concatenate all loadable program headers */
+    elf_getphdrnum(info->elf, &count);
+    phdr = elf32_getphdr(info->elf);
+    first = 1;
+    for (index = 0; index < count; ++index, ++phdr) {
+        if (phdr->p_type != PT_LOAD) {
+            continue;
+        }
+        raw = elf_getdata_rawchunk
+            (info->elf, phdr->p_offset, phdr->p_filesz, ELF_T_BYTE);
+        if (!raw) {
+            fprintf(stderr, "%s: cannot map program header %u\n",
+                    info->filename, (unsigned)index);
+            return 0;
+        }
+        O65_STATS_ADD(O65_STAT_BYTES_READ, phdr->p_filesz);
+        if (first) {
+            /* This is the first loadable program header.  Assume that its
+             * base address is the same as the base of the .text segment */
+            info->text_address = phdr->p_vaddr;
+            info->text_size = phdr->p_memsz;
+            info->text_segment = calloc(phdr->p_memsz, 1);
+            memcpy(info->text_segment, raw->d_buf, phdr->p_filesz);
+            first = 0;
+        } else {
+            /* Concatencate this loadable segment to the previous one */
+            if (phdr->p_vaddr < (info->text_address + info->text_size)) {
+                /* Addresses went backwards.  Probably a load segment
+                 * for zero page definitions.  No more .text sections */
+                break;
+            } else if (phdr->p_vaddr > (info->text_address + info->text_size)) {
+                fprintf(stderr, "%s: program headers are not contiguous\n",
+                        info->filename);
+                return 0;
+            }
+            info->text_segment = realloc
+                (info->text_segment, info->text_size + phdr->p_memsz);
+            memset(info->text_segment + info->text_size, 0, phdr->p_memsz);
+            memcpy(info->text_segment + info->text_size,
+                   raw->d_buf, phdr->p_filesz);
+            info->text_size += phdr->p_memsz;
+        }
+    }
+
+    /* Count up the bytes in "NOBITS" sections to figure out how
+     * big the .bss segment will be. */
+    section_iterator(info, SHT_NOBITS, section_callback_bss_size);
+
+    /* Count up the bytes in all zero page sections to figure
+     * out how big the .o65 zero page will be.  This also finds
+     * the lowest address that is used in the zero page. */
+    info->zeropage_address = 0x100;
+    section_iterator(info, SHT_NULL, section_callback_zp_size);
+    if (info->zeropage_address >= 0x100) {
+        /* We didn't find any zeropage sections */
+        info->zeropage_address = 0;
+    }
+
+    /* Figure out where the boundary between .text and .data lies */
+    info->data_address = info->text_address + info->text_size;
+    info->data_size = 0;
+    info->flag = 0;
+    section_iterator(info, SHT_PROGBITS, section_callback_text_size);
+    info->data_segment = info->text_segment + info->text_size;
+    info->bss_address = info->data_address + info->data_size;
+    set_segment_header(info);
+    return 1;
+}
+
+/**
+ * @brief Adds a converted relocation to the final image.
  *
  * @param[in,out] info Information about the image we are converting.
  * @param[in] reloc The relocation to be added.
  */
-static void add_o65_relocation(image_info_t *info, const o65_reloc_t *reloc)
+static void add_relocation(image_info_t *info, const reloc_entry_t *reloc)
 {
-    if (info->reloc_size >= info->reloc_alloc_size) {
-        info->reloc_alloc_size += 256;
-        info->reloc = (o65_reloc_t *)realloc
-            (info->reloc, sizeof(o65_reloc_t) * info->reloc_alloc_size);
-        if (!info->reloc) {
+    if (info->num_relocs >= info->max_relocs) {
+        info->max_relocs += 256;
+        info->relocs = (reloc_entry_t *)realloc
+            (info->relocs, sizeof(reloc_entry_t) * info->max_relocs);
+        if (!info->relocs) {
             fprintf(stderr, "out of memory\n");
             exit(1);
         }
     }
-    info->reloc[(info->reloc_size)++] = *reloc;
+    info->relocs[(info->num_relocs)++] = *reloc;
 }
 
 /**
@@ -851,6 +1449,7 @@ static int resolve_undefined(image_info_t *info, Elf32_Word name, uint32_t *id)
     }
     info->undef_name_ids[info->num_undef_names] = name;
     info->undef_names[info->num_undef_names] = symname;
+    O65_STATS_ADD(O65_STAT_EXTERNS_RESOLVED, 1);
     *id = (info->num_undef_names)++ + (info->hosted ? 1 : 0);
     return 1;
 }
@@ -875,6 +1474,112 @@ static int compare_rela(const void *r1, const void *r2)
         return 0;
 }
 
+/**
+ * @brief Compares two converted relocations on ascending order of address.
+ *
+ * @param[in] r1 Points to the first relocation.
+ * @param[in] r2 Points to the second relocation.
+ *
+ * @return -1, 0, or 1 depending upon the relationship between @a r1 and @a r2.
+ */
+static int compare_reloc_entry(const void *r1, const void *r2)
+{
+    const reloc_entry_t *rel1 = (const reloc_entry_t *)r1;
+    const reloc_entry_t *rel2 = (const reloc_entry_t *)r2;
+    if (rel1->address < rel2->address)
+        return -1;
+    else if (rel1->address > rel2->address)
+        return 1;
+    else
+        return 0;
+}
+
+/**
+ * @brief Stores the value of a relocation into the .text or .data segment
+ * of a relocatable object file.
+ *
+ * @param[in,out] info Information about the image we are converting.
+ * @param[in] address Address of the bytes to be relocated.
+ * @param[in] type ELF relocation type.
+ * @param[in] value Value to store, including the addend.
+ *
+ * @return Non-zero if the value was stored, or zero on error.
+ *
+ * The ELF linker does this for executables, but in an object file the
+ * bytes are left for the linker to fill in from the addend.  The ".o65"
+ * format expects the bytes to hold the value for the segment base
+ * addresses in the header, or the addend for undefined references.
+ */
+static int patch_relocation
+    (image_info_t *info, o65_size_t address, uint32_t type, o65_size_t value)
+{
+    uint8_t *ptr;
+    o65_size_t offset = address - info->text_address;
+    size_t size;
+    switch (type) {
+    case R_MOS_ADDR8:
+    case R_MOS_ADDR16_LO:
+    case R_MOS_ADDR24_SEGMENT_LO:
+    case R_MOS_IMM8:
+        size = 1;
+        break;
+
+    case R_MOS_PCREL_8:
+        if ((int32_t)value < -128 || (int32_t)value > 127) {
+            fprintf(stderr, "%s: branch at 0x%lx is out of range\n",
+                    info->filename, (unsigned long)address);
+            return 0;
+        }
+        size = 1;
+        break;
+
+    case R_MOS_ADDR16:
+    case R_MOS_ADDR24_SEGMENT:
+    case R_MOS_IMM16:
+    case R_MOS_PCREL_16:
+        size = 2;
+        break;
+
+    case R_MOS_ADDR13:
+        /* The top three bits belong to the instruction */
+        size = 2;
+        if (offset + size <= info->text_size + info->data_size) {
+            ptr = info->text_segment + offset;
+            value = (value & 0x1FFFU) | ((o65_size_t)(ptr[1] & 0xE0) << 8);
+        }
+        break;
+
+    case R_MOS_ADDR16_HI:
+    case R_MOS_ADDR24_SEGMENT_HI:
+        value >>= 8;
+        size = 1;
+        break;
+
+    case R_MOS_ADDR24:
+        size = 3;
+        break;
+
+    case R_MOS_ADDR24_BANK:
+        value >>= 16;
+        size = 1;
+        break;
+
+    default:
+        fprintf(stderr, "%s: unsupported relocation type %d\n",
+                info->filename, (int)type);
+        return 0;
+    }
+    if (offset + size > info->text_size + info->data_size) {
+        fprintf(stderr, "%s: relocation at 0x%lx extends past the end of .data\n",
+                info->filename, (unsigned long)address);
+        return 0;
+    }
+    ptr = info->text_segment + offset;
+    for (; size > 0; --size, value >>= 8)
+        *ptr++ = (uint8_t)value;
+    return 1;
+}
+
 /**
  * @brief Callback for processing the contents of a "RELA" section.
  *
@@ -893,11 +1598,24 @@ static void section_callback_reloc
     size_t count;
     o65_size_t address;
     o65_size_t symbol_address;
-    o65_reloc_t out_rel;
-    uint8_t from_segment;
-    (void)shdr;
+    o65_size_t section_base = 0;
+    reloc_entry_t out_rel;
+    uint32_t type;
+    uint8_t site_segid;
     (void)name;
 
+    /* In a relocatable object, the offsets are relative to the section
+     * that the relocations apply to.  Skip the relocations for sections
+     * that are not loaded into memory, such as debugging information. */
+    if (info->relocatable) {
+        if (shdr->sh_info >= info->num_sections)
+            return;
+        site_segid = info->section_segids[shdr->sh_info];
+        if (site_segid != O65_SEGID_TEXT && site_segid != O65_SEGID_DATA)
+            return;
+        section_base = info->section_addresses[shdr->sh_info];
+    }
+
     /* Get a pointer to the relocation entries in the section, plus a count */
     data = elf_getdata(scn, NULL);
     if (!data || data->d_size < sizeof(Elf32_Rela))
@@ -910,58 +1628,26 @@ static void section_callback_reloc
     }
     memcpy(rel_table, data->d_buf, count * sizeof(Elf32_Rela));
 
-    /* Sort the relocation table on ascending order of address because the
-     * ".o65" relocation system needs strict ordering to work properly. */
+    /* Sort the relocation table on ascending order of address so that
+     * external references are numbered in the order they are used. */
     qsort(rel_table, count, sizeof(Elf32_Rela), compare_rela);
 
     /* Process the relocations */
     for (rel = rel_table; count > 0; --count, ++rel) {
-        /* Find the next address to be relocated, and which segment it is in */
-        address = rel->r_offset;
-        if (address >= info->text_address &&
-                address < (info->text_address + info->text_size)) {
-            from_segment = O65_SEGID_TEXT;
-        } else if (address >= info->data_address &&
-                   address < (info->data_address + info->data_size)) {
-            from_segment = O65_SEGID_DATA;
-        } else {
+        /* Find the next address to be relocated.  It must be in .text or .data.
+         * The .text and .data segments are contiguous in the ELF image. */
+        address = rel->r_offset + section_base;
+        type = ELF32_R_TYPE(rel->r_info);
+        if (address < info->text_address ||
+                address >= (info->data_address + info->data_size)) {
             fprintf(stderr, "%s: address 0x%lx is not in .text or .data\n",
                     info->filename, (unsigned long)address);
             info->flag = 0;
             continue;
         }
-        if (from_segment != info->reloc_segment) {
-            /* We have switched from .text to .data */
-            if (from_segment != O65_SEGID_DATA) {
-                fprintf(stderr, "%s: cannot relocate .text after .data\n",
-                        info->filename);
-                info->flag = 0;
-                continue;
-            }
-            info->reloc_segment = from_segment;
-            info->last_reloc_address = info->data_address - 1;
-        }
-
-        /* Relocation addresses cannot be repeated */
-        if (address <= info->last_reloc_address) {
-            fprintf(stderr, "%s: warning: duplicate relocation at 0x%lx\n",
-                    info->filename, (unsigned long)address);
-            continue;
-        }
-
-        /* Output "skip" relocations if the distance from the last
-         * relocation is greater than 254 bytes. */
-        while ((address - info->last_reloc_address) > 254) {
-            out_rel.offset = 255; /* Special value that means "skip 254" */
-            out_rel.type = 0;
-            out_rel.extra = 0;
-            out_rel.undefid = 0;
-            add_o65_relocation(info, &out_rel);
-            info->last_reloc_address += 254;
-        }
 
         /* Clear the output relocation details, ready to fill them in */
-        out_rel.offset = (uint8_t)(address - info->last_reloc_address);
+        out_rel.address = address;
         out_rel.extra = 0;
         out_rel.undefid = 0;
 
@@ -979,12 +1665,17 @@ static void section_callback_reloc
         /* Get the address of the symbol, including the addend */
         symbol_address = sym->st_value;
         symbol_address += rel->r_addend;
+        out_rel.target = symbol_address;
 
         /* Determine which segment the symbol lives in */
         if (sym->st_shndx == SHN_ABS) {
             /* If the symbol is absolute, then there is nothing to do.
-             * We assume that the ELF linker already fixed up the value. */
-            info->last_reloc_address = address;
+             * We assume that the ELF linker already fixed up the value.
+             * There is no ELF linker for object files, so do it here. */
+            if (info->relocatable &&
+                    !patch_relocation(info, address, type, symbol_address)) {
+                info->flag = 0;
+            }
             continue;
         } else if (sym->st_shndx == SHN_UNDEF) {
             /* Undefined symbol */
@@ -996,7 +1687,6 @@ static void section_callback_reloc
                 }
             } else {
                 info->flag = 0;
-                info->last_reloc_address = address;
                 continue;
             }
         } else if (symbol_address >= info->zeropage_address &&
@@ -1024,12 +1714,29 @@ static void section_callback_reloc
             out_rel.type = O65_SEGID_TEXT;
         }
 
+        /* PC-relative references within a segment stay the same when the
+         * segment is relocated, so resolve them in object files now. */
+        if (info->relocatable &&
+                (type == R_MOS_PCREL_8 || type == R_MOS_PCREL_16)) {
+            site_segid = address < info->data_address
+                            ? O65_SEGID_TEXT : O65_SEGID_DATA;
+            if (out_rel.type != site_segid) {
+                fprintf(stderr, "%s: PC-relative relocation at 0x%lx refers to another segment\n",
+                        info->filename, (unsigned long)address);
+                info->flag = 0;
+            } else if (!patch_relocation(info, address, type,
+                                         symbol_address - address)) {
+                info->flag = 0;
+            }
+            continue;
+        }
+
         /* Convert the relocation to ".o65" format.  We assume that the
          * ELF linker has already written the bytes of the virtual symbol
          * address to the .text and .data segments.  All we need to do
          * is adjust the base offset of the segments according to the
          * type of relocation. */
-        switch (ELF32_R_TYPE(rel->r_info)) {
+        switch (type) {
         case R_MOS_ADDR8:
         case R_MOS_ADDR16_LO:
         case R_MOS_ADDR24_SEGMENT_LO:
@@ -1067,22 +1774,20 @@ static void section_callback_reloc
         case R_MOS_ADDR_ASCIZ:
         default:
             fprintf(stderr, "%s: unsupported relocation type %d\n",
-                    info->filename, (int)(ELF32_R_TYPE(rel->r_info)));
+                    info->filename, (int)type);
             info->flag = 0;
-            info->last_reloc_address = address;
             continue;
         }
 
-        /* Add the relocation to the image */
-        add_o65_relocation(info, &out_rel);
-
-        /* Update the length of the .text relocation table */
-        if (from_segment == O65_SEGID_TEXT) {
-            info->text_reloc_size = info->reloc_size;
+        /* Store the value in object files, where the linker has not */
+        if (info->relocatable &&
+                !patch_relocation(info, address, type, symbol_address)) {
+            info->flag = 0;
+            continue;
         }
 
-        /* Update the last address that was relocated */
-        info->last_reloc_address = address;
+        /* Add the relocation to the image */
+        add_relocation(info, &out_rel);
     }
     free(rel_table);
 }
@@ -1096,216 +1801,1233 @@ static void section_callback_reloc
  */
 static int convert_relocations(image_info_t *info)
 {
+    size_t index, count;
+
     /* Find all "RELA" sections and convert the contents */
     info->flag = 1;
-    info->last_reloc_address = info->text_address - 1;
-    info->reloc_segment = O65_SEGID_TEXT;
     section_iterator(info, SHT_RELA, section_callback_reloc);
+
+    /* Sort the relocations on ascending order of address because the
+     * ".o65" relocation system needs strict ordering to work properly.
+     * Relocation addresses cannot be repeated. */
+    if (info->num_relocs > 0) {
+        qsort(info->relocs, info->num_relocs, sizeof(reloc_entry_t),
+              compare_reloc_entry);
+        count = 1;
+        for (index = 1; index < info->num_relocs; ++index) {
+            if (info->relocs[index].address ==
+                    info->relocs[count - 1].address) {
+                fprintf(stderr, "%s: warning: duplicate relocation at 0x%lx\n",
+                        info->filename,
+                        (unsigned long)(info->relocs[index].address));
+                continue;
+            }
+            info->relocs[count++] = info->relocs[index];
+        }
+        info->num_relocs = count;
+    }
     return info->flag;
 }
 
 /**
- * @brief Populate the creation date header option in the ".o65" file.
+ * @brief Gets the number of bytes that a converted relocation modifies.
  *
- * @param[in,out] info Information about the image we are converting.
+ * @param[in] type The relocation type and segment identifier.
+ *
+ * @return The number of bytes.
  */
-static void set_creation_date(image_info_t *info)
+static o65_size_t reloc_width(uint8_t type)
 {
-    size_t len;
-    time_t t;
-    struct tm *tm;
-    struct stat st;
-    char *tstr;
-
-    /* Bail out if we don't actually want the date */
-    if (!(info->add_creation_date))
-        return;
-
-    /* Use the modification time on the .elf file, or the current time
-     * if we cannot get the modification time. */
-    if (fstat(info->fd, &st) >= 0)
-        t = st.st_mtime;
-    else
-        time(&t);
+    switch (type & O65_RELOC_TYPE) {
+    case O65_RELOC_WORD:    return 2;
+    case O65_RELOC_SEGADR:  return 3;
+    default:                return 1;
+    }
+}
 
-    /* Format the date and time into the header option */
-    tm = localtime(&t);
-    tstr = (char *)(info->created.data);
-    strftime(tstr, sizeof(info->created.data), "%a %b %d %H:%M:%S %Z %Y", tm);
-    len = strlen(tstr);
-    if (len >= sizeof(info->created.data))
-        len = sizeof(info->created.data) - 1;
+/**
+ * @brief Callback for finding the end of the last section that contains code.
+ *
+ * @param[in,out] info Information about the image we are converting.
+ * @param[in] scn ELF section control structure.
+ * @param[in] shdr ELF section header structure.
+ * @param[in] name Name of the section, or NULL if unknown.
+ */
+static void section_callback_code_end
+    (image_info_t *info, Elf_Scn *scn, Elf32_Shdr *shdr, const char *name)
+{
+    o65_size_t address = shdr->sh_addr;
+    size_t index;
+    (void)name;
+    if ((shdr->sh_flags & (SHF_ALLOC | SHF_EXECINSTR)) !=
+            (SHF_ALLOC | SHF_EXECINSTR)) {
+        return;
+    }
+    if (info->relocatable) {
+        index = elf_ndxscn(scn);
+        if (index >= info->num_sections)
+            return;
+        address = info->section_addresses[index];
+    }
+    if ((address + shdr->sh_size) > info->code_end)
+        info->code_end = address + shdr->sh_size;
+}
+
+/**
+ * @brief Moves the trailing zero bytes of .data into .bss.
+ *
+ * @param[in,out] info Information about the image we are converting.
+ *
+ * Zero-initialized variables that the linker places in PROGBITS sections
+ * often leave .data ending in a long run of zeros.  Those bytes can come
+ * from a .bss segment that the loader zeroes instead of from the file.
+ * The run stops at the last byte that is modified by a relocation.
+ * If .data is empty or is moved entirely, then trailing zeros in the
+ * read-only data after the last code section in .text are moved as well.
+ * The new start of .bss is rounded up to the image alignment, so that
+ * PAGED HIGH relocations that now refer to .bss still see the right page.
+ */
+static void trim_trailing_zeros(image_info_t *info)
+{
+    static o65_size_t const alignments[4] = {1, 2, 4, 256};
+    o65_size_t alignment = alignments[info->header.mode & O65_MODE_ALIGN];
+    o65_size_t end = info->data_address + info->data_size;
+    o65_size_t new_end;
+    o65_size_t limit;
+    o65_size_t reloc_end;
+    o65_size_t saved;
+    size_t index;
+    uint8_t segid;
+
+    /* Bytes that are modified by a relocation must stay in the file,
+     * and so must all of the code in .text */
+    info->code_end = info->text_address;
+    section_iterator(info, SHT_NULL, section_callback_code_end);
+    limit = info->code_end;
+    for (index = 0; index < info->num_relocs; ++index) {
+        reloc_end = info->relocs[index].address +
+                    reloc_width(info->relocs[index].type);
+        if (reloc_end > limit)
+            limit = reloc_end;
+    }
+
+    /* Find the start of the run of trailing zeros */
+    new_end = end;
+    while (new_end > limit &&
+           info->text_segment[new_end - 1 - info->text_address] == 0) {
+        --new_end;
+    }
+    new_end = (new_end + alignment - 1) & ~(alignment - 1);
+    if (new_end >= end)
+        return;
+
+    /* Shrink .data, and .text if .data is now empty, and grow .bss */
+    saved = end - new_end;
+    if (new_end < info->data_address) {
+        info->text_size = new_end - info->text_address;
+        info->data_address = new_end;
+        info->data_size = 0;
+    } else {
+        info->data_size = new_end - info->data_address;
+    }
+    info->data_segment = info->text_segment + info->text_size;
+    info->bss_address = new_end;
+    info->bss_size += saved;
+    info->header.mode |= O65_MODE_BSSZERO;
+    set_segment_header(info);
+
+    /* Relocations that refer to the moved bytes now refer to .bss */
+    for (index = 0; index < info->num_relocs; ++index) {
+        segid = info->relocs[index].type & O65_RELOC_SEGID;
+        if ((segid == O65_SEGID_TEXT || segid == O65_SEGID_DATA) &&
+                info->relocs[index].target >= new_end &&
+                info->relocs[index].target < end) {
+            info->relocs[index].type =
+                (info->relocs[index].type & O65_RELOC_TYPE) | O65_SEGID_BSS;
+        }
+    }
+    O65_STATS_ADD(O65_STAT_BYTES_TRIMMED, saved);
+    fprintf(stderr, "%s: moved %lu trailing zero bytes into .bss\n",
+            info->filename, (unsigned long)saved);
+}
+
+/**
+ * @brief Populate the creation date header option in the ".o65" file.
+ *
+ * @param[in,out] info Information about the image we are converting.
+ *
+ * @return Non-zero on success, or zero if out of memory.
+ */
+static int set_creation_date(image_info_t *info)
+{
+    size_t len;
+    time_t t;
+    struct tm *tm;
+    struct stat st;
+    char tstr[O65_MAX_OPT_SIZE - 2];
+    const char *epoch;
+    char *end;
+
+    /* Bail out if we don't actually want the date */
+    if (!(info->add_creation_date))
+        return 1;
+
+    /* Use SOURCE_DATE_EPOCH in UTC for reproducible builds if it is set.
+     * https://reproducible-builds.org/specs/source-date-epoch/
+     *
+     * Otherwise use the modification time on the .elf file, or the current
+     * time if we cannot get the modification time. */
+    epoch = getenv("SOURCE_DATE_EPOCH");
+    if (epoch && *epoch != '\0') {
+        t = (time_t)strtoll(epoch, &end, 10);
+        if (*end != '\0' || t < 0) {
+            fprintf(stderr, "%s: invalid SOURCE_DATE_EPOCH value '%s'\n",
+                    info->filename, epoch);
+            epoch = NULL;
+        }
+    } else {
+        epoch = NULL;
+    }
+    if (!epoch) {
+        if (fstat(info->fd, &st) >= 0)
+            t = st.st_mtime;
+        else
+            time(&t);
+    }
+
+    /* Format the date and time into the header option */
+    if (epoch) {
+        tm = gmtime(&t);
+        strftime(tstr, sizeof(tstr),
+                 "%a %b %d %H:%M:%S UTC %Y", tm);
+    } else {
+        tm = localtime(&t);
+        strftime(tstr, sizeof(tstr),
+                 "%a %b %d %H:%M:%S %Z %Y", tm);
+    }
+    len = strlen(tstr);
+    if (len >= sizeof(tstr))
+        len = sizeof(tstr) - 1;
     if (len > 0 && tstr[len - 1] == '\n')
         --len;
-    info->created.len = len + 3;
-    info->created.type = O65_OPT_CREATED;
-    info->created.data[len] = '\0';
+    return o65_options_set_string
+        (&(info->options), O65_OPT_CREATED, tstr, len) == 0;
+}
+
+/**
+ * @brief Callback for finding the section boundaries within .text.
+ *
+ * @param[in,out] info Information about the image we are converting.
+ * @param[in] scn ELF section control structure.
+ * @param[in] shdr ELF section header structure.
+ * @param[in] name Name of the section, or NULL if unknown.
+ */
+static void section_callback_boundaries
+    (image_info_t *info, Elf_Scn *scn, Elf32_Shdr *shdr, const char *name)
+{
+    (void)scn;
+    (void)name;
+    if ((shdr->sh_flags & SHF_ALLOC) == 0 ||
+            shdr->sh_addr <= info->text_address ||
+            shdr->sh_addr >= (info->text_address + info->text_size)) {
+        return;
+    }
+    if (info->num_boundaries >= info->max_boundaries) {
+        info->max_boundaries += 32;
+        info->boundaries = (o65_size_t *)realloc
+            (info->boundaries, info->max_boundaries * sizeof(o65_size_t));
+        if (!(info->boundaries)) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+    info->boundaries[(info->num_boundaries)++] = shdr->sh_addr;
+}
+
+/**
+ * @brief Compares two addresses for sorting.
+ *
+ * @param[in] a1 Points to the first address.
+ * @param[in] a2 Points to the second address.
+ *
+ * @return -1, 0, or 1 depending upon the relationship between @a a1 and @a a2.
+ */
+static int compare_address(const void *a1, const void *a2)
+{
+    o65_size_t addr1 = *((const o65_size_t *)a1);
+    o65_size_t addr2 = *((const o65_size_t *)a2);
+    if (addr1 < addr2)
+        return -1;
+    else if (addr1 > addr2)
+        return 1;
+    else
+        return 0;
+}
+
+/**
+ * @brief Adds a new bank to an image.
+ *
+ * @param[in,out] info Information about the image we are converting.
+ * @param[in] address Start address of the bank's part of .text.
+ * @param[in] size Size of the bank's part of .text.
+ * @param[in] padding Number of filler bytes before @a address.
+ */
+static void add_bank
+    (image_info_t *info, o65_size_t address, o65_size_t size,
+     o65_size_t padding)
+{
+    bank_info_t *bank;
+    info->banks = (bank_info_t *)realloc
+        (info->banks, (info->num_banks + 1) * sizeof(bank_info_t));
+    if (!(info->banks)) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    bank = &(info->banks[info->num_banks]);
+    memset(bank, 0, sizeof(bank_info_t));
+    bank->text_address = address;
+    bank->text_size = size;
+    bank->padding = padding;
+    snprintf(bank->name, sizeof(bank->name), "__BANK%u",
+             (unsigned)(info->num_banks));
+    ++(info->num_banks);
+}
+
+/**
+ * @brief Partitions the .text segment into banks at section boundaries.
+ *
+ * @param[in,out] info Information about the image we are converting.
+ *
+ * @return Non-zero if the .text segment was partitioned, zero on error.
+ *
+ * The first bank also holds the .data, .bss, and .zp segments, so the
+ * size of .data counts towards the limit for the first bank.
+ *
+ * Paged HIGH relocations have no low byte, so they are only correct if
+ * the relocation delta is a multiple of 256.  When page alignment is in
+ * use, later banks are padded back to the start of the page that they
+ * begin in, and the padding counts towards the limit for the bank.
+ */
+static int split_banks(image_info_t *info)
+{
+    o65_size_t start;
+    o65_size_t last;
+    o65_size_t limit;
+    o65_size_t boundary;
+    o65_size_t padding;
+    o65_size_t next_padding;
+    size_t index;
+
+    /* Without a bank size, the whole program is written as one image */
+    if (!(info->bank_size)) {
+        add_bank(info, info->text_address, info->text_size, 0);
+        return 1;
+    }
+    if (info->data_size > info->bank_size) {
+        fprintf(stderr, "%s: .data segment is larger than the bank size\n",
+                info->filename);
+        return 0;
+    }
+
+    /* Collect the start addresses of all sections within .text */
+    section_iterator(info, SHT_NULL, section_callback_boundaries);
+    if (info->num_boundaries > 0) {
+        qsort(info->boundaries, info->num_boundaries, sizeof(o65_size_t),
+              compare_address);
+    }
+
+    /* Pack as many whole sections into each bank as will fit */
+    start = info->text_address;
+    last = start;
+    limit = info->bank_size - info->data_size;
+    padding = 0;
+    for (index = 0; index <= info->num_boundaries; ++index) {
+        if (index < info->num_boundaries)
+            boundary = info->boundaries[index];
+        else
+            boundary = info->text_address + info->text_size;
+        if ((boundary - start) > limit) {
+            if ((info->header.mode & O65_MODE_ALIGN) == O65_MODE_ALIGN_256)
+                next_padding = last & 0xFFU;
+            else
+                next_padding = 0;
+            if (last == start ||
+                    (boundary - last) > (info->bank_size - next_padding) ||
+                    next_padding >= info->bank_size) {
+                fprintf(stderr, "%s: section at 0x%lx is larger than the bank size\n",
+                        info->filename, (unsigned long)last);
+                return 0;
+            }
+            add_bank(info, start, last - start, padding);
+            start = last;
+            padding = next_padding;
+            limit = info->bank_size - padding;
+        }
+        last = boundary;
+    }
+    add_bank(info, start, last - start, padding);
+    return 1;
+}
+
+/**
+ * @brief Finds the bank that contains a .text address.
+ *
+ * @param[in] info Information about the image we are converting.
+ * @param[in] address The address to look for.
+ *
+ * @return The index of the bank.  The end of .text is considered to be
+ * part of the last bank.
+ */
+static size_t find_bank(const image_info_t *info, o65_size_t address)
+{
+    size_t index;
+    for (index = 1; index < info->num_banks; ++index) {
+        if (address < info->banks[index].text_address)
+            break;
+    }
+    return index - 1;
+}
+
+/**
+ * @brief Names of the symbols that the first bank exports for other banks
+ * to refer to its .data, .bss, and .zp segments; indexed by segment ID.
+ */
+static const char * const segment_symbols[O65_SEGID_ZEROPAGE + 1] = {
+    NULL, NULL, NULL, "__DATA", "__BSS", "__ZP"
+};
+
+/**
+ * @brief Gets the base address of a segment in the final ".o65" file.
+ *
+ * @param[in] info Information about the image we are converting.
+ * @param[in] segid Identifier for the .data, .bss, or .zp segment.
+ *
+ * @return The base address of the segment.
+ */
+static o65_size_t segment_base(const image_info_t *info, uint8_t segid)
+{
+    switch (segid) {
+    case O65_SEGID_DATA:        return info->header.dbase;
+    case O65_SEGID_BSS:         return info->header.bbase;
+    case O65_SEGID_ZEROPAGE:    return info->header.zbase;
+    default:                    return 0;
+    }
+}
+
+/**
+ * @brief Finds the segment that contains a symbol in the final ".o65" file.
+ *
+ * @param[in] info Information about the image we are converting.
+ * @param[in] address Address of the symbol in the ELF file.
+ * @param[out] symbol Returns the image, segment, and offset of the symbol.
+ *
+ * @return Non-zero if the symbol is in a segment, or zero if it is not.
+ */
+static int locate_symbol
+    (const image_info_t *info, o65_size_t address, o65_symbol_t *symbol)
+{
+    o65_size_t base;
+    size_t bank_index;
+
+    /* Classify the address the same way as section_callback_reloc() */
+    symbol->image = 0;
+    if (address >= info->zeropage_address &&
+            address < (info->zeropage_address + info->zeropage_size)) {
+        symbol->segid = O65_SEGID_ZEROPAGE;
+    } else if (address >= info->text_address &&
+               address < (info->text_address + info->text_size)) {
+        bank_index = find_bank(info, address);
+        symbol->image = (uint16_t)bank_index;
+        symbol->segid = O65_SEGID_TEXT;
+        symbol->offset = address - info->banks[bank_index].text_address +
+                         info->banks[bank_index].padding;
+        return 1;
+    } else if (address >= info->data_address &&
+               address < (info->data_address + info->data_size)) {
+        symbol->segid = O65_SEGID_DATA;
+    } else if (address >= info->bss_address &&
+               address <= (info->bss_address + info->bss_size)) {
+        symbol->segid = O65_SEGID_BSS;
+    } else {
+        return 0;
+    }
+
+    /* The imaginary registers are not part of .zp in hosted mode */
+    base = segment_base(info, symbol->segid);
+    if (address < base)
+        return 0;
+    symbol->offset = address - base;
+    return 1;
+}
+
+/**
+ * @brief Adds an external reference to a bank.
+ *
+ * @param[in,out] bank The bank to add the external reference to.
+ * @param[in] name Name of the external reference.
+ *
+ * @return The index of the external reference within the bank.
+ */
+static uint32_t add_bank_extern(bank_info_t *bank, const char *name)
+{
+    bank->externs = (const char **)realloc
+        (bank->externs, (bank->num_externs + 1) * sizeof(const char *));
+    if (!(bank->externs)) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    bank->externs[bank->num_externs] = name;
+    return (bank->num_externs)++;
+}
+
+/**
+ * @brief Finds or adds an external reference in a bank.
+ *
+ * @param[in,out] bank The bank to add the external reference to.
+ * @param[in] name Name of the external reference.
+ *
+ * @return The index of the external reference within the bank.
+ */
+static uint32_t find_bank_extern(bank_info_t *bank, const char *name)
+{
+    size_t index;
+    for (index = 0; index < bank->num_externs; ++index) {
+        if (!strcmp(bank->externs[index], name))
+            return index;
+    }
+    return add_bank_extern(bank, name);
+}
+
+/**
+ * @brief Rewrites the bytes at a relocation site to a new value.
+ *
+ * @param[in,out] info Information about the image we are converting.
+ * @param[in,out] reloc The relocation to rewrite.
+ * @param[in] value The new value for the relocation.
+ *
+ * This is used when a reference to another bank is turned into an
+ * external reference, so that the value becomes an offset from the
+ * start of the other bank.
+ */
+static void rewrite_relocation
+    (image_info_t *info, reloc_entry_t *reloc, o65_size_t value)
+{
+    uint8_t *ptr = info->text_segment + (reloc->address - info->text_address);
+    switch (reloc->type & O65_RELOC_TYPE) {
+    case O65_RELOC_WORD:
+        o65_write_uint16(ptr, (uint16_t)value);
+        break;
+
+    case O65_RELOC_HIGH:
+        ptr[0] = (uint8_t)(value >> 8);
+        reloc->extra = (uint8_t)value;
+        break;
+
+    case O65_RELOC_LOW:
+        ptr[0] = (uint8_t)value;
+        break;
+
+    case O65_RELOC_SEGADR:
+        o65_write_uint24(ptr, value);
+        break;
+
+    case O65_RELOC_SEG:
+        ptr[0] = (uint8_t)(value >> 16);
+        reloc->extra = (uint16_t)value;
+        break;
+    }
+}
+
+/**
+ * @brief Builds the headers, external references, and relocations
+ * for all banks.
+ *
+ * @param[in,out] info Information about the image we are converting.
+ *
+ * References from one bank to another, or from a later bank to the
+ * .data, .bss, or .zp segments of the first bank, are converted into
+ * external references to symbols that are exported by the referenced bank.
+ */
+static void build_banks(image_info_t *info)
+{
+    bank_info_t *bank;
+    reloc_entry_t *reloc;
+    size_t bank_index;
+    size_t index;
+    size_t target_bank;
+    uint8_t segid;
+
+    for (bank_index = 0; bank_index < info->num_banks; ++bank_index) {
+        bank = &(info->banks[bank_index]);
+
+        /* Set up the header for the image */
+        bank->header = info->header;
+        bank->header.tbase = bank->text_address - bank->padding;
+        bank->header.tlen = bank->text_size + bank->padding;
+        if (bank_index != 0) {
+            /* Only the first bank has .data, .bss, and .zp segments */
+            bank->header.mode &= ~O65_MODE_BSSZERO;
+            bank->header.dbase = bank->text_address + bank->text_size;
+            bank->header.dlen = 0;
+            bank->header.bbase = bank->header.dbase;
+            bank->header.blen = 0;
+            bank->header.zbase = 0;
+            bank->header.zlen = 0;
+            bank->header.stack = 0;
+        }
+        if ((bank_index + 1) < info->num_banks)
+            bank->header.mode |= O65_MODE_CHAIN;
+
+        /* Copy the relocations that apply to this bank */
+        bank->relocs = (reloc_entry_t *)calloc
+            (info->num_relocs ? info->num_relocs : 1, sizeof(reloc_entry_t));
+        if (!(bank->relocs)) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+        for (index = 0; index < info->num_relocs; ++index) {
+            reloc = &(info->relocs[index]);
+            if (reloc->address >= bank->text_address &&
+                    reloc->address < (bank->text_address + bank->text_size)) {
+                bank->relocs[(bank->num_relocs)++] = *reloc;
+            }
+        }
+        bank->num_text_relocs = bank->num_relocs;
+        if (bank_index == 0) {
+            for (index = 0; index < info->num_relocs; ++index) {
+                reloc = &(info->relocs[index]);
+                if (reloc->address >= info->data_address)
+                    bank->relocs[(bank->num_relocs)++] = *reloc;
+            }
+        }
+
+        /* The shared imaginary registers are always external reference 0 */
+        if (info->hosted)
+            add_bank_extern(bank, "__IMAG_REGS");
+
+        /* A single image keeps the external reference numbering as-is */
+        if (info->num_banks == 1) {
+            for (index = 0; index < info->num_undef_names; ++index)
+                add_bank_extern(bank, info->undef_names[index]);
+            continue;
+        }
+
+        /* Renumber the external references and convert references that
+         * cross a bank boundary into external references. */
+        for (index = 0; index < bank->num_relocs; ++index) {
+            reloc = &(bank->relocs[index]);
+            segid = reloc->type & O65_RELOC_SEGID;
+            if (segid == O65_SEGID_UNDEF) {
+                if (info->hosted && reloc->undefid == 0)
+                    continue;
+                reloc->undefid = find_bank_extern
+                    (bank, info->undef_names
+                        [reloc->undefid - (info->hosted ? 1 : 0)]);
+            } else if (segid == O65_SEGID_TEXT) {
+                target_bank = find_bank(info, reloc->target);
+                if (target_bank == bank_index)
+                    continue;
+                rewrite_relocation
+                    (info, reloc,
+                     reloc->target - info->banks[target_bank].text_address +
+                     info->banks[target_bank].padding);
+                reloc->type &= O65_RELOC_TYPE;
+                reloc->undefid = find_bank_extern
+                    (bank, info->banks[target_bank].name);
+                info->banks[target_bank].referenced = 1;
+            } else if (bank_index != 0 && segment_symbols[segid]) {
+                rewrite_relocation
+                    (info, reloc, reloc->target - segment_base(info, segid));
+                reloc->type &= O65_RELOC_TYPE;
+                reloc->undefid = find_bank_extern
+                    (bank, segment_symbols[segid]);
+                info->segment_referenced[segid] = 1;
+            }
+        }
+    }
 }
 
 /**
  * @brief Writes a list of ".o65" relocations to the output file.
  *
  * @param[in,out] info Information about the image we are converting.
+ * @param[in] header Header for the image that is being written.
  * @param[in] relocs Points to the array of relocations to write.
  * @param[in] count Number of relocations to write.
+ * @param[in] base Base address of the segment that is being relocated.
  *
  * @return Non-zero if the relocations were written, zero on filesystem error.
  */
 static int write_relocations
-    (image_info_t *info, const o65_reloc_t *relocs, o65_size_t count)
+    (image_info_t *info, const o65_header_t *header,
+     const reloc_entry_t *relocs, size_t count, o65_size_t base)
 {
-    o65_reloc_t end = { .offset = 0 };
+    o65_reloc_t out_rel = { .offset = 0 };
+    o65_size_t last_address;
+
+    /* Relocations actually start at the segment base - 1 */
+    last_address = base - 1;
     for (; count > 0; --count, ++relocs) {
-        if (o65_write_reloc(info->outfile, &(info->header), relocs) < 0)
+        /* Output "skip" relocations if the distance from the last
+         * relocation is greater than 254 bytes. */
+        while ((relocs->address - last_address) > 254) {
+            out_rel.offset = 255; /* Special value that means "skip 254" */
+            if (o65_write_reloc(info->outfile, header, &out_rel) < 0)
+                return 0;
+            last_address += 254;
+        }
+
+        /* Output the relocation */
+        out_rel.offset = (uint8_t)(relocs->address - last_address);
+        out_rel.type = relocs->type;
+        out_rel.extra = relocs->extra;
+        out_rel.undefid = relocs->undefid;
+        if (o65_write_reloc(info->outfile, header, &out_rel) < 0)
             return 0;
+        last_address = relocs->address;
     }
-    if (o65_write_reloc(info->outfile, &(info->header), &end) < 0) {
+    out_rel.offset = 0;
+    if (o65_write_reloc(info->outfile, header, &out_rel) < 0) {
         return 0;
     }
     return 1;
 }
 
 /**
- * @brief Writes out the final ".o65" file.
+ * @brief Determines how many bytes write_relocations() will write.
  *
- * @param[in,out] info Information about the image we are converting.
- * @param[in] filename Name of the file to write to.
+ * @param[in] header Header for the image that is being written.
+ * @param[in] relocs Points to the array of relocations.
+ * @param[in] count Number of relocations.
+ * @param[in] base Base address of the segment that is being relocated.
  *
- * @return Non-zero if the image was written, zero on filesystem error.
+ * @return The size of the encoded relocation table, including the
+ * terminating zero byte.
  */
-static int write_o65(image_info_t *info, const char *filename)
+static uint32_t relocations_size
+    (const o65_header_t *header, const reloc_entry_t *relocs,
+     size_t count, o65_size_t base)
 {
-    int lib6502 = 0;
-    size_t index;
+    uint32_t count_size = (header->mode & O65_MODE_32BIT) ? 4 : 2;
+    uint32_t size = 1;
+    o65_size_t last_address = base - 1;
+    for (; count > 0; --count, ++relocs) {
+        size += (relocs->address - last_address - 1) / 254;
+        size += 2;
+        if ((relocs->type & O65_RELOC_SEGID) == O65_SEGID_UNDEF)
+            size += count_size;
+        switch (relocs->type & O65_RELOC_TYPE) {
+        case O65_RELOC_HIGH:
+            if ((header->mode & O65_MODE_PAGED) == 0)
+                size += 1;
+            break;
 
-    /* Open the output file */
-    if ((info->outfile = fopen(filename, "wb")) == NULL)
+        case O65_RELOC_SEG:
+            size += 2;
+            break;
+        }
+        last_address = relocs->address;
+    }
+    return size;
+}
+
+/**
+ * @brief Adds an exported symbol to a bank.
+ *
+ * @param[in,out] bank The bank to add the exported symbol to.
+ * @param[in] name Name of the exported symbol.
+ * @param[in] segid Segment identifier for the symbol.
+ * @param[in] value Value of the symbol.
+ */
+static void add_bank_export
+    (bank_info_t *bank, const char *name, uint8_t segid, o65_size_t value)
+{
+    export_entry_t *entry;
+    bank->exports = (export_entry_t *)realloc
+        (bank->exports, (bank->num_exports + 1) * sizeof(export_entry_t));
+    if (!(bank->exports)) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    entry = &(bank->exports[bank->num_exports]);
+    entry->name = name;
+    entry->segid = segid;
+    entry->value = value;
+    entry->order = bank->num_exports;
+    ++(bank->num_exports);
+}
+
+/**
+ * @brief Compares two exported symbols by name for sorting.
+ *
+ * @param[in] e1 Points to the first exported symbol.
+ * @param[in] e2 Points to the second exported symbol.
+ *
+ * @return Less than, equal to, or greater than zero.
+ */
+static int compare_export(const void *e1, const void *e2)
+{
+    const export_entry_t *entry1 = (const export_entry_t *)e1;
+    const export_entry_t *entry2 = (const export_entry_t *)e2;
+    int cmp = strcmp(entry1->name, entry2->name);
+    if (cmp != 0)
+        return cmp;
+    else if (entry1->order < entry2->order)
+        return -1;
+    else if (entry1->order > entry2->order)
+        return 1;
+    else
         return 0;
+}
 
-    /* Set the creation date header option */
-    set_creation_date(info);
+/**
+ * @brief Collects the symbols that are exported from a bank.
+ *
+ * @param[in,out] info Information about the image we are converting.
+ * @param[in] bank_index Index of the bank.
+ * @param[in] lib6502 Non-zero if the program uses lib6502 conventions.
+ *
+ * The exports are sorted by name so that loaders can binary-search them.
+ * If a global symbol in the ELF file has the same name as one of the
+ * symbols that elf2o65 generates itself, then the generated one wins.
+ */
+static void collect_exports(image_info_t *info, size_t bank_index, int lib6502)
+{
+    bank_info_t *bank = &(info->banks[bank_index]);
+    const char *entry_name = NULL;
+    const Elf32_Sym *sym;
+    o65_symbol_t symbol;
+    size_t index;
+    size_t count;
+    uint8_t segid;
+
+    /* Figure out how to name the entry point if it is in this bank */
+    if (find_bank(info, info->entry_point) == bank_index) {
+        if (lib6502) {
+            /* Entry point must be called "main" when using lib6502 */
+            entry_name = "main";
+        } else if (info->entry_point != info->text_address) {
+            /* Entry point is not at the start of the text segment,
+             * so output an exported global called "_start" */
+            entry_name = "_start";
+        }
+    }
 
-    /* If we are in hosted mode, then subtract the imaginary registers
-     * from the front of the zeropage segment.  They will be provided
-     * by the runtime loader instead. */
-    if (info->hosted && info->header.zlen >= 32) {
-        info->header.zbase += 32;
-        info->header.zlen -= 32;
+    /* Export the entry point, the start of the bank, and the segments
+     * that are referenced by other banks. */
+    if (entry_name)
+        add_bank_export(bank, entry_name, O65_SEGID_TEXT, info->entry_point);
+    if (bank->referenced)
+        add_bank_export(bank, bank->name, O65_SEGID_TEXT,
+                        bank->text_address - bank->padding);
+    if (bank_index == 0) {
+        for (segid = O65_SEGID_DATA; segid <= O65_SEGID_ZEROPAGE; ++segid) {
+            if (info->segment_referenced[segid]) {
+                add_bank_export(bank, segment_symbols[segid], segid,
+                                segment_base(info, segid));
+            }
+        }
     }
 
-    /* Write the header */
-    if (o65_write_header(info->outfile, &(info->header)) < 0)
-        return 0;
+    /* Export the defined global and weak symbols that live in this bank */
+    for (index = 1; info->export_globals && index < info->num_symbols;
+            ++index) {
+        sym = info->symbols + index;
+        if (ELF32_ST_BIND(sym->st_info) != STB_GLOBAL &&
+                ELF32_ST_BIND(sym->st_info) != STB_WEAK) {
+            continue;
+        }
+        if (sym->st_name == 0 || !(info->strtab) ||
+                sym->st_name >= info->strtab->d_size ||
+                sym->st_shndx == SHN_UNDEF ||
+                sym->st_shndx >= SHN_LORESERVE ||
+                ELF32_ST_TYPE(sym->st_info) == STT_SECTION ||
+                ELF32_ST_TYPE(sym->st_info) == STT_FILE) {
+            continue;
+        }
+        if (!locate_symbol(info, sym->st_value, &symbol) ||
+                symbol.image != bank_index) {
+            continue;
+        }
+        add_bank_export(bank, (const char *)(info->strtab->d_buf) + sym->st_name,
+                        symbol.segid, sym->st_value);
+    }
 
-    /* Write the header options */
-    if (info->os.len != 0) {
-        if (o65_write_option(info->outfile, &(info->os)) < 0)
-            return 0;
+    /* Sort the exports by name and remove duplicates */
+    if (bank->num_exports < 2)
+        return;
+    qsort(bank->exports, bank->num_exports, sizeof(export_entry_t),
+          compare_export);
+    count = 1;
+    for (index = 1; index < bank->num_exports; ++index) {
+        if (strcmp(bank->exports[index].name,
+                   bank->exports[count - 1].name) != 0) {
+            bank->exports[count++] = bank->exports[index];
+        }
     }
-    if (info->linker.len != 0) {
-        if (o65_write_option(info->outfile, &(info->linker)) < 0)
-            return 0;
+    bank->num_exports = count;
+}
+
+/**
+ * @brief Writes the hash table header option for the exports of a bank.
+ *
+ * @param[in,out] info Information about the image we are converting.
+ * @param[in] bank The bank to write the hash table for.
+ *
+ * @return Non-zero if the option was written, zero on filesystem error.
+ *
+ * The table has a power of two number of slots, with at most three
+ * quarters of them in use.  Each slot is zero if empty, or one plus
+ * the index of an export in the name-sorted export table.  Collisions
+ * are resolved with linear probing.
+ */
+static int write_export_hash(image_info_t *info, const bank_info_t *bank)
+{
+    o65_option_t option;
+    size_t num_slots;
+    size_t index;
+    size_t slot;
+
+    if (!(info->export_hash) || bank->num_exports == 0)
+        return 1;
+    num_slots = 4;
+    while ((bank->num_exports * 4) > (num_slots * 3))
+        num_slots *= 2;
+    if (num_slots > O65_EXPORT_HASH_MAX_SLOTS) {
+        fprintf(stderr, "%s: too many exports for a hash table; omitting it\n",
+                info->filename);
+        return 1;
     }
-    if (info->author.len != 0) {
-        if (o65_write_option(info->outfile, &(info->author)) < 0)
-            return 0;
+    memset(&option, 0, sizeof(option));
+    option.len = (uint8_t)(num_slots + 3);
+    option.type = O65_OPT_EXPORT_HASH;
+    option.data[0] = O65_EXPORT_HASH_MUL31;
+    for (index = 0; index < bank->num_exports; ++index) {
+        slot = o65_export_hash(bank->exports[index].name) & (num_slots - 1);
+        while (option.data[1 + slot] != 0)
+            slot = (slot + 1) & (num_slots - 1);
+        option.data[1 + slot] = (uint8_t)(index + 1);
     }
-    if (info->created.len != 0) {
-        if (o65_write_option(info->outfile, &(info->created)) < 0)
-            return 0;
+    return o65_write_option(info->outfile, &option) == 0;
+}
+
+/**
+ * @brief Writes the prelinked option for a bank, if it has one.
+ *
+ * @param[in,out] info Information about the image we are converting.
+ * @param[in] bank The bank to write the option for.
+ *
+ * @return Non-zero if the option was written, zero on filesystem error.
+ *
+ * The option gives the offsets of the relocation tables and the exported
+ * symbols from the start of the .text segment.  A loader that places
+ * every segment at its base address in the header can seek straight to
+ * the exports instead of decoding relocations that would not change
+ * anything.  Images with external references are never left alone by
+ * relocation, so they do not get the option.
+ */
+static int write_prelinked(image_info_t *info, const bank_info_t *bank)
+{
+    const o65_header_t *header = &(bank->header);
+    o65_option_t option;
+    uint32_t relocs_offset;
+    uint32_t exports_offset;
+
+    if (!(info->prelinked) || bank->num_externs != 0 ||
+            (header->mode & O65_MODE_OBJ) != 0) {
+        return 1;
     }
-    if (info->elf_machine.len != 0) {
-        if (o65_write_option(info->outfile, &(info->elf_machine)) < 0)
-            return 0;
+    relocs_offset = header->tlen + header->dlen +
+                    ((header->mode & O65_MODE_32BIT) ? 4 : 2);
+    exports_offset = relocs_offset +
+        relocations_size(header, bank->relocs,
+                         bank->num_text_relocs, header->tbase) +
+        relocations_size(header, bank->relocs + bank->num_text_relocs,
+                         bank->num_relocs - bank->num_text_relocs,
+                         header->dbase);
+    memset(&option, 0, sizeof(option));
+    option.len = O65_PRELINKED_OPT_LEN;
+    option.type = O65_OPT_PRELINKED;
+    o65_write_uint32(option.data, relocs_offset);
+    o65_write_uint32(option.data + 4, exports_offset);
+    return o65_write_option(info->outfile, &option) == 0;
+}
+
+/**
+ * @brief Writes one bank as an image in the ".o65" chain.
+ *
+ * @param[in,out] info Information about the image we are converting.
+ * @param[in] bank_index Index of the bank to write.
+ *
+ * @return Non-zero if the image was written, zero on filesystem error.
+ */
+static int write_bank(image_info_t *info, size_t bank_index)
+{
+    static uint8_t const option_order[] = {
+        O65_OPT_OS, O65_OPT_PROGRAM, O65_OPT_AUTHOR, O65_OPT_CREATED,
+        O65_OPT_ELF_MACHINE, O65_OPT_CONTENT_HASH
+    };
+    bank_info_t *bank = &(info->banks[bank_index]);
+    o65_header_t *header = &(bank->header);
+    size_t index;
+    size_t order;
+
+    /* Write the header */
+    if (o65_write_header(info->outfile, header) < 0)
+        return 0;
+
+    /* Write the header options.  Only the first image gets them,
+     * and they are always written in the same order.  The export hash
+     * table and the prelinked offsets describe each image separately,
+     * so every image gets its own copy. */
+    if (bank_index == 0) {
+        info->options_start = ftell(info->outfile);
+        for (order = 0; order < sizeof(option_order); ++order) {
+            if (!o65_options_find(&(info->options), option_order[order],
+                                  &index)) {
+                continue;
+            }
+            if (option_order[order] == O65_OPT_CONTENT_HASH) {
+                /* Written as a placeholder for now; see write_o65() */
+                info->content_hash_offset = ftell(info->outfile);
+            }
+            if (o65_options_write_entry
+                    (info->outfile, &(info->options), index) < 0) {
+                return 0;
+            }
+        }
     }
+    if (!write_export_hash(info, bank))
+        return 0;
+    if (!write_prelinked(info, bank))
+        return 0;
     if (o65_write_option(info->outfile, NULL) < 0) {
         return 0;
     }
+    if (bank_index == 0)
+        info->options_end = ftell(info->outfile);
 
-    /* Write the .text segment */
-    if (info->text_size > 0) {
-        if (fwrite(info->text_segment, 1, info->text_size, info->outfile)
-                != info->text_size) {
+    /* Write the .text segment, starting with any filler bytes */
+    for (index = 0; index < bank->padding; ++index) {
+        if (putc(0, info->outfile) == EOF)
+            return 0;
+    }
+    O65_STATS_ADD(O65_STAT_BYTES_WRITTEN, bank->padding);
+    if (bank->text_size > 0) {
+        if (fwrite(info->text_segment +
+                        (bank->text_address - info->text_address),
+                   1, bank->text_size, info->outfile) != bank->text_size) {
             return 0;
         }
+        O65_STATS_ADD(O65_STAT_BYTES_WRITTEN, bank->text_size);
     }
 
     /* Write the .data segment */
-    if (info->data_size > 0) {
+    if (header->dlen > 0) {
         if (fwrite(info->data_segment, 1, info->data_size, info->outfile)
                 != info->data_size) {
             return 0;
         }
+        O65_STATS_ADD(O65_STAT_BYTES_WRITTEN, info->data_size);
     }
 
     /* Write the external references list */
-    if (info->hosted) {
-        /* We need an extra external for the imaginary register table */
-        if (o65_write_count
-                (info->outfile, &(info->header), info->num_undef_names + 1) < 0) {
-            return 0;
-        }
-        if (o65_write_string(info->outfile, "__IMAG_REGS") < 0) {
-            return 0;
-        }
-    } else {
-        if (o65_write_count
-                (info->outfile, &(info->header), info->num_undef_names) < 0) {
-            return 0;
-        }
+    if (o65_write_count(info->outfile, header, bank->num_externs) < 0) {
+        return 0;
     }
-    for (index = 0; index < info->num_undef_names; ++index) {
-        if (o65_write_string(info->outfile, info->undef_names[index]) < 0) {
+    for (index = 0; index < bank->num_externs; ++index) {
+        if (o65_write_string(info->outfile, bank->externs[index]) < 0) {
             return 0;
         }
-        if (!strcmp(info->undef_names[index], "LIB6502")) {
-            /* This appears to be a program that uses lib6502.  Make sure
-             * that we add a lib6502-compatible "main" entry point below. */
-            lib6502 = 1;
-        }
     }
 
     /* Write the relocation tables */
-    if (!write_relocations(info, info->reloc, info->text_reloc_size)) {
+    if (!write_relocations(info, header, bank->relocs,
+                           bank->num_text_relocs, header->tbase)) {
         return 0;
     }
-    if (!write_relocations(info, info->reloc + info->text_reloc_size,
-                           info->reloc_size - info->text_reloc_size)) {
+    if (!write_relocations(info, header, bank->relocs + bank->num_text_relocs,
+                           bank->num_relocs - bank->num_text_relocs,
+                           header->dbase)) {
         return 0;
     }
 
-    /* Write the exported globals.  Only one so far for the main entry point. */
-    if (lib6502) {
-        /* Entry point must be called "main" when using lib6502 */
-        if (o65_write_count(info->outfile, &(info->header), 1) < 0) {
-            return 0;
-        }
+    /* Write the exported globals */
+    if (o65_write_count(info->outfile, header, bank->num_exports) < 0) {
+        return 0;
+    }
+    for (index = 0; index < bank->num_exports; ++index) {
+        const export_entry_t *entry = &(bank->exports[index]);
         if (o65_write_exported_symbol
-                (info->outfile, &(info->header), "main",
-                 O65_SEGID_TEXT, info->entry_point) < 0) {
+                (info->outfile, header, entry->name,
+                 entry->segid, entry->value) < 0) {
             return 0;
         }
-    } else if (info->entry_point != info->text_address) {
-        /* Entry point is not at the start of the text segment,
-         * so output an exported global called "_start" */
-        if (o65_write_count(info->outfile, &(info->header), 1) < 0) {
-            return 0;
-        }
-        if (o65_write_exported_symbol
-                (info->outfile, &(info->header), "_start",
-                 O65_SEGID_TEXT, info->entry_point) < 0) {
+    }
+    return 1;
+}
+
+/**
+ * @brief Computes the content hash and patches it into the output.
+ *
+ * @param[in,out] info Information about the image we are converting.
+ * @param[in,out] buffer Buffer containing the entire output file.
+ * @param[in] size Size of the output file.
+ *
+ * The hash covers every byte of the output except the header options of
+ * the first image, so that the creation date, author, and other metadata
+ * do not affect it.  The 64-bit hash is stored in little-endian order.
+ */
+static void set_content_hash(image_info_t *info, uint8_t *buffer, size_t size)
+{
+    o65_hash_state_t state;
+    uint64_t hash;
+    int index;
+    o65_hash_init(&state, 0);
+    o65_hash_update(&state, buffer, info->options_start);
+    o65_hash_update(&state, buffer + info->options_end,
+                    size - info->options_end);
+    hash = o65_hash_final(&state);
+    for (index = 0; index < 8; ++index) {
+        buffer[info->content_hash_offset + 3 + index] =
+            (uint8_t)(hash >> (index * 8));
+    }
+}
+
+/**
+ * @brief Writes out the final ".o65" file.
+ *
+ * @param[in,out] info Information about the image we are converting.
+ * @param[in] filename Name of the file to write to.
+ *
+ * @return Non-zero if the image was written, zero on filesystem error.
+ */
+static int write_o65(image_info_t *info, const char *filename)
+{
+    static uint8_t const hash_placeholder[9] = {O65_HASH_XXH64};
+    int lib6502 = 0;
+    size_t index;
+    char *buffer = NULL;
+    size_t size = 0;
+    int ok;
+
+    /* Open the output file.  If we need a content hash, then write to
+     * memory first so that we can fill in the hash once it is known. */
+    if (info->add_content_hash) {
+        if (o65_options_set(&(info->options), O65_OPT_CONTENT_HASH,
+                            hash_placeholder, sizeof(hash_placeholder)) < 0) {
             return 0;
         }
+        info->outfile = open_memstream(&buffer, &size);
     } else {
-        /* Entry point is at the start of the text segment,
-         * so there is no need to name it explicitly. */
-        if (o65_write_count(info->outfile, &(info->header), 0) < 0) {
+        info->outfile = o65_fopen_output(filename);
+    }
+    if (!(info->outfile))
+        return 0;
+
+    /* Set the creation date header option */
+    if (!set_creation_date(info))
+        return 0;
+
+    /* If we are in hosted mode, then subtract the imaginary registers
+     * from the front of the zeropage segment.  They will be provided
+     * by the runtime loader instead. */
+    if (info->hosted && info->header.zlen >= 32) {
+        info->header.zbase += 32;
+        info->header.zlen -= 32;
+    }
+
+    /* Does this appear to be a program that uses lib6502?  If so, make
+     * sure that we add a lib6502-compatible "main" entry point. */
+    for (index = 0; index < info->num_undef_names; ++index) {
+        if (!strcmp(info->undef_names[index], "LIB6502"))
+            lib6502 = 1;
+    }
+
+    /* Build and write the images for the banks in order */
+    build_banks(info);
+    for (index = 0; index < info->num_banks; ++index) {
+        collect_exports(info, index, lib6502);
+        if (!write_bank(info, index))
+            return 0;
+    }
+
+    /* Fill in the content hash and write the buffered image to the file */
+    if (info->add_content_hash) {
+        fclose(info->outfile);
+        info->outfile = NULL;
+        set_content_hash(info, (uint8_t *)buffer, size);
+        if ((info->outfile = o65_fopen_output(filename)) == NULL) {
+            free(buffer);
             return 0;
         }
+        ok = fwrite(buffer, 1, size, info->outfile) == size;
+        free(buffer);
+        if (!ok)
+            return 0;
     }
 
     /* Clean up and exit */
-    fclose(info->outfile);
+    ok = o65_fclose_output(info->outfile) == 0;
     info->outfile = NULL;
-    return 1;
+    return ok;
+}
+
+/**
+ * @brief Writes a symbol map for the ELF symbols in the output ".o65" file.
+ *
+ * @param[in,out] info Information about the image we are converting.
+ * @param[in] filename Name of the symbol map file to write.
+ *
+ * @return Non-zero if the symbol map was written, zero on error.
+ *
+ * This must be called after write_o65() so that the banks and the
+ * final segment base addresses are known.
+ */
+static int write_symbol_map(image_info_t *info, const char *filename)
+{
+    const Elf32_Sym *sym;
+    o65_symbol_t *symbols;
+    size_t num_symbols = 0;
+    size_t index;
+    FILE *file;
+    int ok;
+
+    symbols = (o65_symbol_t *)calloc
+        (info->num_symbols ? info->num_symbols : 1, sizeof(o65_symbol_t));
+    if (!symbols)
+        return 0;
+    for (index = 1; index < info->num_symbols; ++index) {
+        /* Skip symbols that do not name a location in the image */
+        sym = info->symbols + index;
+        if (sym->st_name == 0 || !(info->strtab) ||
+                sym->st_name >= info->strtab->d_size ||
+                sym->st_shndx == SHN_UNDEF ||
+                sym->st_shndx >= SHN_LORESERVE ||
+                ELF32_ST_TYPE(sym->st_info) == STT_SECTION ||
+                ELF32_ST_TYPE(sym->st_info) == STT_FILE) {
+            continue;
+        }
+        if (!locate_symbol(info, sym->st_value, &(symbols[num_symbols])))
+            continue;
+        symbols[num_symbols].name =
+            (const char *)(info->strtab->d_buf) + sym->st_name;
+        symbols[num_symbols].flags = 0;
+        if (ELF32_ST_BIND(sym->st_info) == STB_GLOBAL)
+            symbols[num_symbols].flags |= O65_SYMMAP_GLOBAL;
+        if (ELF32_ST_TYPE(sym->st_info) == STT_FUNC)
+            symbols[num_symbols].flags |= O65_SYMMAP_FUNC;
+        ++num_symbols;
+    }
+
+    /* Write the symbol map */
+    if ((file = o65_fopen_output(filename)) == NULL) {
+        free(symbols);
+        return 0;
+    }
+    ok = o65_symmap_write(file, symbols, num_symbols) == 0;
+    if (o65_fclose_output(file) != 0)
+        ok = 0;
+    free(symbols);
+    return ok;
 }
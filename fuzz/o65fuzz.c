@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) 2023 Southern Storm Software, Pty Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Fuzzing harness for the ".o65" decoders.  Each input is run through
+ * o65_validate(), decoded in full with the o65_read_*() functions, and then
+ * walked with o65_visit().  Any input that the validator accepts must also
+ * decode and walk successfully.
+ */
+
+#include "o65validate.h"
+#include "o65visit.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Decodes the relocation table for a segment.
+ *
+ * @param[in] file File to read from.
+ * @param[in] header Header for the image.
+ *
+ * @return 1 on success, 0 if the data is invalid, -1 on EOF.
+ */
+static int decode_relocs(FILE *file, const o65_header_t *header)
+{
+    const o65_decoder_t *decoder = o65_get_decoder(header);
+    o65_reloc_t reloc;
+    int result;
+    for (;;) {
+        result = decoder->read_reloc(file, &reloc);
+        if (result <= 0)
+            return result;
+        if (reloc.offset == 0)
+            return 1;
+    }
+}
+
+/**
+ * @brief Decodes a ".o65" file in full, including all chained images.
+ *
+ * @param[in] file File to read from.
+ *
+ * @return 1 on success, 0 if the data is invalid, -1 on EOF.
+ */
+static int decode_file(FILE *file)
+{
+    o65_header_t header;
+    o65_option_t option;
+    o65_size_t count;
+    o65_size_t value;
+    o65_string_table_t names;
+    uint8_t *data;
+    int result;
+
+    do {
+        /* Header and options */
+        if ((result = o65_read_header(file, &header)) <= 0)
+            return result;
+        do {
+            if ((result = o65_read_option(file, &option)) <= 0)
+                return result;
+        } while (option.len != 0);
+
+        /* Segments */
+        if ((result = o65_read_segment(file, &data, header.tlen)) <= 0)
+            return result;
+        free(data);
+        if ((result = o65_read_segment(file, &data, header.dlen)) <= 0)
+            return result;
+        free(data);
+
+        /* Externals */
+        if ((result = o65_read_count(file, &header, &count)) <= 0)
+            return result;
+        o65_string_table_init(&names);
+        result = o65_read_string_table(file, count, &names);
+        o65_string_table_free(&names);
+        if (result <= 0)
+            return result;
+
+        /* Relocations */
+        if ((result = decode_relocs(file, &header)) <= 0)
+            return result;
+        if ((result = decode_relocs(file, &header)) <= 0)
+            return result;
+
+        /* Exports */
+        if ((result = o65_read_count(file, &header, &count)) <= 0)
+            return result;
+        o65_string_table_init(&names);
+        for (result = 1; result > 0 && count > 0; --count) {
+            result = o65_read_string_table(file, 1, &names);
+            if (result > 0 && getc(file) == EOF)
+                result = -1;
+            if (result > 0 && o65_read_count(file, &header, &value) <= 0)
+                result = -1;
+        }
+        o65_string_table_free(&names);
+        if (result <= 0)
+            return result;
+    } while ((header.mode & O65_MODE_CHAIN) != 0);
+    return 1;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    o65_validate_error_t error;
+    o65_visitor_t visitor;
+    FILE *file;
+    int valid;
+    int decoded;
+    int visited;
+
+    /* fmemopen() doesn't like zero-length buffers */
+    if (size == 0)
+        return 0;
+
+    /* Validate the input */
+    file = fmemopen((void *)data, size, "rb");
+    if (!file)
+        return 0;
+    valid = o65_validate(file, &error);
+    if (valid == 0 && (error.field == NULL || error.offset > size)) {
+        fprintf(stderr, "invalid error report at offset 0x%lx\n", error.offset);
+        abort();
+    }
+
+    /* Decode the input from the start */
+    rewind(file);
+    decoded = decode_file(file);
+
+    /* Walk the input again with a visitor that skips everything */
+    rewind(file);
+    memset(&visitor, 0, sizeof(visitor));
+    visited = o65_visit(file, &visitor, NULL);
+    fclose(file);
+
+    /* The decoders must agree with the validator on valid files */
+    if (valid > 0 && decoded <= 0) {
+        fprintf(stderr, "validated file failed to decode\n");
+        abort();
+    }
+    if (valid > 0 && visited <= 0) {
+        fprintf(stderr, "validated file failed to visit\n");
+        abort();
+    }
+    return 0;
+}
+
+#if defined(O65_FUZZ_MAIN)
+
+int main(int argc, char *argv[])
+{
+    uint8_t *data = NULL;
+    size_t size = 0;
+    size_t max_size = 0;
+    size_t len;
+    FILE *file;
+
+    /* Read the input from the named file or standard input */
+    if (argc > 1) {
+        if ((file = fopen(argv[1], "rb")) == NULL) {
+            perror(argv[1]);
+            return 1;
+        }
+    } else {
+        file = stdin;
+    }
+    for (;;) {
+        if (size >= max_size) {
+            max_size = max_size ? max_size * 2 : 4096;
+            data = realloc(data, max_size);
+            if (!data) {
+                fprintf(stderr, "out of memory\n");
+                return 1;
+            }
+        }
+        len = fread(data + size, 1, max_size - size, file);
+        if (len == 0)
+            break;
+        size += len;
+    }
+    if (file != stdin)
+        fclose(file);
+
+    /* Run the harness on the input */
+    LLVMFuzzerTestOneInput(data, size);
+    free(data);
+    return 0;
+}
+
+#endif
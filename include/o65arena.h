@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2023 Southern Storm Software, Pty Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef O65ARENA_H
+#define O65ARENA_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Default size of the blocks that are allocated by an arena */
+#define O65_ARENA_BLOCK_SIZE 4096
+
+/**
+ * @brief Block of memory within an arena.
+ */
+typedef struct o65_arena_block_s o65_arena_block_t;
+
+/**
+ * @brief Arena allocator that frees all of its memory in a single call.
+ *
+ * Allocations are carved out of large blocks and cannot be freed
+ * individually.  This suits data that is loaded once and then released
+ * all at the same time, such as the contents of an image.
+ */
+typedef struct
+{
+    o65_arena_block_t *blocks;  /**< List of blocks, most recent first */
+    size_t posn;                /**< Position of the next free byte */
+    size_t size;                /**< Size of the current block */
+
+} o65_arena_t;
+
+/**
+ * @brief Initializes an arena.
+ *
+ * @param[out] arena The arena to initialize.
+ */
+void o65_arena_init(o65_arena_t *arena);
+
+/**
+ * @brief Frees all of the memory that was allocated from an arena.
+ *
+ * @param[in,out] arena The arena to free.  It is left in the initialized
+ * state and can be reused.
+ */
+void o65_arena_free(o65_arena_t *arena);
+
+/**
+ * @brief Allocates memory from an arena.
+ *
+ * @param[in,out] arena The arena to allocate from.
+ * @param[in] size Number of bytes to allocate.
+ *
+ * @return A pointer to the memory, suitably aligned for any type, or NULL
+ * if out of memory.  The memory is initialized to zero.
+ */
+void *o65_arena_alloc(o65_arena_t *arena, size_t size);
+
+/**
+ * @brief Copies a block of memory into an arena.
+ *
+ * @param[in,out] arena The arena to allocate from.
+ * @param[in] data Points to the data to copy.
+ * @param[in] size Number of bytes to copy.
+ *
+ * @return A pointer to the copy, or NULL if out of memory.
+ */
+void *o65_arena_memdup(o65_arena_t *arena, const void *data, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2023 Southern Storm Software, Pty Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef O65DELTA_H
+#define O65DELTA_H
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A delta patch rebuilds a new ".o65" file from an old one.  It starts
+ * with a fixed header:
+ *
+ *      4 bytes     Magic number "o65d"
+ *      1 byte      Format version, currently 1
+ *      4 bytes     Size of the old file
+ *      8 bytes     XXH64 hash of the old file
+ *      4 bytes     Size of the new file
+ *      8 bytes     XXH64 hash of the new file
+ *
+ * All multi-byte values are little-endian.  The header is followed by
+ * a stream of operations that produce the new file from start to finish.
+ * Each operation starts with an opcode byte and the remaining fields are
+ * unsigned LEB128 variable-length integers unless noted otherwise:
+ *
+ *      O65_DELTA_END       End of the patch.
+ *      O65_DELTA_COPY      Copy bytes from the old file: offset from the
+ *                          end of the previous copy (zigzag-encoded),
+ *                          length, number of fixups, and then each fixup
+ *                          as the gap since the previous fixup followed
+ *                          by the single replacement byte.
+ *      O65_DELTA_LITERAL   Insert new bytes: length, then the bytes.
+ *
+ * Fixups are mostly for relocated words whose values moved because the
+ * code around them moved, which lets a single copy span them.
+ */
+
+/** Magic number at the start of a delta patch */
+#define O65_DELTA_MAGIC         "o65d"
+
+/** Current version of the delta patch format */
+#define O65_DELTA_VERSION       1
+
+/** Size of the fixed header at the start of a delta patch */
+#define O65_DELTA_HEADER_SIZE   29
+
+/** End of the delta patch */
+#define O65_DELTA_END           0x00
+
+/** Copy bytes from the old file, with fixups */
+#define O65_DELTA_COPY          0x01
+
+/** Insert literal bytes from the patch */
+#define O65_DELTA_LITERAL       0x02
+
+/** Size of the working buffer that is used to apply a delta patch */
+#define O65_DELTA_BUFFER_SIZE   256
+
+/**
+ * @brief Applies a delta patch to an old file to produce a new file.
+ *
+ * @param[in] old The old file, which must be seekable.
+ * @param[in] patch The delta patch, which is read sequentially.
+ * @param[out] out The new file, which is written sequentially.
+ *
+ * @return 1 if the patch was applied, 0 if the patch is invalid or does
+ * not apply to the old file, or -1 for unexpected EOF or a filesystem
+ * error.
+ *
+ * The old file is hashed before anything is written, so that a patch
+ * is never applied to the wrong file.  The hash of the new file is
+ * checked after the last byte has been written.  Only a small fixed
+ * buffer of O65_DELTA_BUFFER_SIZE bytes is used, regardless of the
+ * size of the files.
+ */
+int o65_delta_apply(FILE *old, FILE *patch, FILE *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
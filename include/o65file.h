@@ -25,6 +25,7 @@
 
 #include "o65image.h"
 #include <stdio.h>
+#include <string.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -88,6 +89,17 @@ typedef struct
 /** Recommended maximum buffer length for the names of externals. */
 #define O65_STRING_MAX      256
 
+/*
+ * The byte-order helpers are inline so that they can be folded into the
+ * hot decoding loops.  On little-endian GCC and Clang targets they load
+ * and store through memcpy(), which compiles down to a single unaligned
+ * move; everywhere else the value is assembled a byte at a time.
+ */
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && \
+        __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define O65_UNALIGNED_LE 1
+#endif
+
 /**
  * @brief Reads a 16-bit value in little-endian byte order.
  *
@@ -95,7 +107,16 @@ typedef struct
  *
  * @return The 16-bit value.
  */
-uint16_t o65_read_uint16(const uint8_t *buf);
+static inline uint16_t o65_read_uint16(const uint8_t *buf)
+{
+#if defined(O65_UNALIGNED_LE)
+    uint16_t value;
+    memcpy(&value, buf, sizeof(value));
+    return value;
+#else
+    return buf[0] | (((uint16_t)(buf[1])) << 8);
+#endif
+}
 
 /**
  * @brief Reads a 24-bit value in little-endian byte order.
@@ -104,7 +125,10 @@ uint16_t o65_read_uint16(const uint8_t *buf);
  *
  * @return The 24-bit value.
  */
-uint32_t o65_read_uint24(const uint8_t *buf);
+static inline uint32_t o65_read_uint24(const uint8_t *buf)
+{
+    return o65_read_uint16(buf) | (((uint32_t)(buf[2])) << 16);
+}
 
 /**
  * @brief Reads a 32-bit value in little-endian byte order.
@@ -113,7 +137,17 @@ uint32_t o65_read_uint24(const uint8_t *buf);
  *
  * @return The 32-bit value.
  */
-uint32_t o65_read_uint32(const uint8_t *buf);
+static inline uint32_t o65_read_uint32(const uint8_t *buf)
+{
+#if defined(O65_UNALIGNED_LE)
+    uint32_t value;
+    memcpy(&value, buf, sizeof(value));
+    return value;
+#else
+    return buf[0] | (((uint32_t)(buf[1])) << 8) |
+           (((uint32_t)(buf[2])) << 16) | (((uint32_t)(buf[3])) << 24);
+#endif
+}
 
 /**
  * @brief Writes a 16-bit value in little-endian byte order.
@@ -121,7 +155,15 @@ uint32_t o65_read_uint32(const uint8_t *buf);
  * @param[in] buf Points to the buffer to write to.
  * @param[in] value The 16-bit value to write.
  */
-void o65_write_uint16(uint8_t *buf, uint16_t value);
+static inline void o65_write_uint16(uint8_t *buf, uint16_t value)
+{
+#if defined(O65_UNALIGNED_LE)
+    memcpy(buf, &value, sizeof(value));
+#else
+    buf[0] = (uint8_t)value;
+    buf[1] = (uint8_t)(value >> 8);
+#endif
+}
 
 /**
  * @brief Writes a 24-bit value in little-endian byte order.
@@ -129,7 +171,11 @@ void o65_write_uint16(uint8_t *buf, uint16_t value);
  * @param[in] buf Points to the buffer to write to.
  * @param[in] value The 24-bit value to write.
  */
-void o65_write_uint24(uint8_t *buf, uint32_t value);
+static inline void o65_write_uint24(uint8_t *buf, uint32_t value)
+{
+    o65_write_uint16(buf, (uint16_t)value);
+    buf[2] = (uint8_t)(value >> 16);
+}
 
 /**
  * @brief Writes a 32-bit value in little-endian byte order.
@@ -137,7 +183,17 @@ void o65_write_uint24(uint8_t *buf, uint32_t value);
  * @param[in] buf Points to the buffer to write to.
  * @param[in] value The 32-bit value to write.
  */
-void o65_write_uint32(uint8_t *buf, uint32_t value);
+static inline void o65_write_uint32(uint8_t *buf, uint32_t value)
+{
+#if defined(O65_UNALIGNED_LE)
+    memcpy(buf, &value, sizeof(value));
+#else
+    buf[0] = (uint8_t)value;
+    buf[1] = (uint8_t)(value >> 8);
+    buf[2] = (uint8_t)(value >> 16);
+    buf[3] = (uint8_t)(value >> 24);
+#endif
+}
 
 /**
  * @brief Reads the header from a ".o65" file.
@@ -166,6 +222,19 @@ int o65_read_header(FILE *file, o65_header_t *header);
  */
 int o65_write_header(FILE *file, o65_header_t *header);
 
+/**
+ * @brief Writes a header to a ".o65" file without modifying the mode.
+ *
+ * @param[in] file File pointer.
+ * @param[in] header The header details.
+ *
+ * @return 0 if the header was written, or -1 for a filesystem error.
+ *
+ * This is used to reproduce a header that was read from an existing file.
+ * The O65_MODE_32BIT bit in the mode determines the size of the fields.
+ */
+int o65_write_raw_header(FILE *file, const o65_header_t *header);
+
 /**
  * @brief Reads a header option from a ".o65" file.
  *
@@ -200,6 +269,34 @@ int o65_write_option(FILE *file, const o65_option_t *option);
 void o65_set_string_option
     (o65_option_t *option, uint8_t type, const char *value, size_t len);
 
+/**
+ * @brief Decoders that are specialized for a particular header mode.
+ *
+ * The width of counts and external symbol indexes, and the presence of
+ * the low byte in HIGH relocations, depend upon the header mode.  Looking
+ * up the decoder once per image with o65_get_decoder() avoids re-testing
+ * the mode for every relocation in the hot loops.
+ */
+typedef struct
+{
+    /** Reads a relocation declaration; see o65_read_reloc() */
+    int (*read_reloc)(FILE *file, o65_reloc_t *reloc);
+
+    /** Reads a 16-bit or 32-bit count value; see o65_read_count() */
+    int (*read_count)(FILE *file, o65_size_t *count);
+
+} o65_decoder_t;
+
+/**
+ * @brief Gets the specialized decoder for the mode in a ".o65" header.
+ *
+ * @param[in] header File header, containing global relocation options.
+ *
+ * @return A pointer to the decoder, which is never NULL and remains
+ * valid for the lifetime of the program.
+ */
+const o65_decoder_t *o65_get_decoder(const o65_header_t *header);
+
 /**
  * @brief Reads a relocation declaration from a ".o65" file.
  *
@@ -233,11 +330,29 @@ int o65_write_reloc
  * with free() when no longer required.
  * @param[in] size Number of bytes in the segment.
  *
- * @return 1 if the segment was read, or -1 for unexpected EOF or a
- * filesystem error.
+ * @return 1 if the segment was read, 0 if @a size is larger than the
+ * rest of the file, or -1 for unexpected EOF or a filesystem error.
+ *
+ * The size is checked against the length of the file before any memory
+ * is allocated, so a corrupt header cannot cause a huge allocation.
  */
 int o65_read_segment(FILE *file, uint8_t **data, o65_size_t size);
 
+/**
+ * @brief Checks that there are at least a certain number of bytes
+ * left in a ".o65" file.
+ *
+ * @param[in] file File pointer.
+ * @param[in] size The number of bytes that are expected.
+ *
+ * @return 1 if there are at least @a size bytes left, or if the file is
+ * not seekable and so cannot be checked; 0 if the file is too short.
+ *
+ * This should be used to sanity-check sizes and counts from the file
+ * before allocating memory based on them.
+ */
+int o65_check_remaining(FILE *file, uint64_t size);
+
 /**
  * @brief Reads a 16-bit or 32-bit count value from a ".o65" file.
  *
@@ -272,6 +387,96 @@ int o65_write_count(FILE *file, const o65_header_t *header, o65_size_t count);
  */
 int o65_read_string(FILE *file, char *str, size_t max_size);
 
+/**
+ * @brief View of a NUL-terminated name within a string table.
+ */
+typedef struct
+{
+    const char *name;       /**< Points to the name, which is NUL-terminated */
+    size_t len;             /**< Length of the name, excluding the NUL */
+
+} o65_string_view_t;
+
+/**
+ * @brief Table of names that were read in a single block.
+ *
+ * The names are stored back to back in one buffer, and the views
+ * point into that buffer.
+ */
+typedef struct
+{
+    char *buf;                  /**< Buffer that holds the names */
+    size_t buf_len;             /**< Number of bytes of names in the buffer */
+    size_t buf_max;             /**< Number of bytes allocated */
+    o65_string_view_t *names;   /**< Views of the names in the buffer */
+    o65_size_t count;           /**< Number of names */
+    o65_size_t max_count;       /**< Number of views allocated */
+
+} o65_string_table_t;
+
+/**
+ * @brief Initializes a string table to empty.
+ *
+ * @param[out] table The string table to initialize.
+ */
+void o65_string_table_init(o65_string_table_t *table);
+
+/**
+ * @brief Frees a string table.
+ *
+ * @param[in,out] table The string table to free.  It is left empty.
+ */
+void o65_string_table_free(o65_string_table_t *table);
+
+/**
+ * @brief Reads a block of NUL-terminated names from a ".o65" file.
+ *
+ * @param[in] file File pointer.
+ * @param[in] count Number of names to read.
+ * @param[in,out] table The string table to read into.  Any names that
+ * were previously in the table are discarded.
+ *
+ * @return 1 on success, 0 if @a count is larger than the rest of the
+ * file, or -1 for unexpected EOF, a filesystem error, or out of memory.
+ *
+ * The names are never truncated.  If the file is seekable, then the
+ * names are read in large blocks and the terminators are located with
+ * memchr(), and any bytes that were read past the last name are
+ * given back to the file afterwards.
+ */
+int o65_read_string_table
+    (FILE *file, o65_size_t count, o65_string_table_t *table);
+
+/**
+ * @brief Reads the rest of a stream into memory.
+ *
+ * @param[in] file File pointer, which need not be seekable.
+ * @param[out] data Returns the data, which must be freed with free().
+ * @param[out] size Returns the size of the data.
+ *
+ * @return 1 on success, or -1 for a filesystem error or out of memory.
+ *
+ * The stream is read once, in large blocks, into a buffer that grows
+ * as needed.
+ */
+int o65_read_all(FILE *file, uint8_t **data, size_t *size);
+
+/**
+ * @brief Opens an input file, where "-" means standard input.
+ *
+ * @param[in] filename Name of the file to open.
+ * @param[out] buffer Returns a buffer that must be freed with free()
+ * after the file is closed, or NULL if there is no buffer.
+ *
+ * @return The file pointer, which can be closed with fclose(), or NULL
+ * with errno set on error.
+ *
+ * The input tools need to seek within their input.  If standard input
+ * is seekable, then it is used directly.  Otherwise it is read into
+ * memory once and a stream is opened over the buffer.
+ */
+FILE *o65_fopen_input(const char *filename, uint8_t **buffer);
+
 /**
  * @brief Writes a NUL-terminated string to a ".o65" file.
  *
@@ -297,6 +502,26 @@ int o65_write_exported_symbol
     (FILE *file, const o65_header_t *header, const char *name,
      uint8_t segID, o65_size_t offset);
 
+/**
+ * @brief Opens an output file, where "-" means standard output.
+ *
+ * @param[in] filename Name of the file to open.
+ *
+ * @return The file pointer, or NULL with errno set on error.
+ */
+FILE *o65_fopen_output(const char *filename);
+
+/**
+ * @brief Closes a file that was opened with o65_fopen_output().
+ *
+ * @param[in] file The file pointer.
+ *
+ * @return 0 if all of the data was written, or -1 for a filesystem error.
+ *
+ * Standard output is flushed rather than closed.
+ */
+int o65_fclose_output(FILE *file);
+
 /**
  * @brief Gets the name of a CPU from the header mode bits.
  *
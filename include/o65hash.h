@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2023 Southern Storm Software, Pty Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef O65HASH_H
+#define O65HASH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief State of an incremental XXH64 hash computation.
+ */
+typedef struct
+{
+    uint64_t total_len;     /**< Total number of bytes hashed so far */
+    uint64_t v[4];          /**< Accumulators for the four lanes */
+    uint8_t buf[32];        /**< Buffer for a partial 32-byte stripe */
+    size_t buf_len;         /**< Number of bytes in the buffer */
+    uint64_t seed;          /**< Seed for the hash */
+
+} o65_hash_state_t;
+
+/**
+ * @brief Initializes an incremental XXH64 hash computation.
+ *
+ * @param[out] state The hash state to initialize.
+ * @param[in] seed Seed for the hash; usually zero.
+ */
+void o65_hash_init(o65_hash_state_t *state, uint64_t seed);
+
+/**
+ * @brief Adds data to an incremental XXH64 hash computation.
+ *
+ * @param[in,out] state The hash state.
+ * @param[in] data Points to the data to add.
+ * @param[in] len Number of bytes of data to add.
+ */
+void o65_hash_update(o65_hash_state_t *state, const void *data, size_t len);
+
+/**
+ * @brief Finishes an incremental XXH64 hash computation.
+ *
+ * @param[in] state The hash state.
+ *
+ * @return The hash value.  The state can continue to be updated afterwards.
+ */
+uint64_t o65_hash_final(const o65_hash_state_t *state);
+
+/**
+ * @brief Computes the XXH64 hash of a buffer in a single call.
+ *
+ * @param[in] data Points to the data to hash.
+ * @param[in] len Number of bytes of data to hash.
+ * @param[in] seed Seed for the hash; usually zero.
+ *
+ * @return The hash value.
+ */
+uint64_t o65_hash64(const void *data, size_t len, uint64_t seed);
+
+/**
+ * @brief Computes the hash of an exported symbol name for the
+ * O65_OPT_EXPORT_HASH header option.
+ *
+ * @param[in] name The NUL-terminated name of the symbol.
+ *
+ * @return The 16-bit hash value, computed as "h = h * 31 + c" over the
+ * bytes of the name, starting with h = 0.  This is cheap to compute on
+ * a 6502 with shifts and subtraction.
+ */
+uint16_t o65_export_hash(const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -121,6 +121,26 @@ typedef struct
 
 /* Custom header options */
 #define O65_OPT_ELF_MACHINE 'E' /**< ELF machine type and flags */
+#define O65_OPT_CONTENT_HASH 'H' /**< Hash of the image contents */
+#define O65_OPT_EXPORT_HASH 'X' /**< Hash table for the exported symbols */
+#define O65_OPT_PRELINKED   'P' /**< Offsets of the relocation and export tables */
+
+/* Hash algorithms for O65_OPT_CONTENT_HASH */
+#define O65_HASH_XXH64      1   /**< 64-bit xxHash, XXH64 */
+
+/* Hash algorithms for O65_OPT_EXPORT_HASH */
+#define O65_EXPORT_HASH_MUL31   1   /**< 16-bit "h * 31 + c" string hash */
+
+/** Maximum number of slots in an O65_OPT_EXPORT_HASH table */
+#define O65_EXPORT_HASH_MAX_SLOTS 128
+
+/**
+ * Length of an O65_OPT_PRELINKED option, including the length and type
+ * bytes.  The data is two 32-bit little-endian byte offsets, from the
+ * start of the .text segment to the relocation tables and to the
+ * exported symbols.
+ */
+#define O65_PRELINKED_OPT_LEN   10
 
 /* Operating system types */
 #define O65_OS_OSA65        1   /**< OSA/65 */
@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2023 Southern Storm Software, Pty Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef O65MODEL_H
+#define O65MODEL_H
+
+#include "o65options.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Relocation within an in-memory image.
+ *
+ * Skip-ahead entries are folded into the offsets, which are relative
+ * to the start of the segment.
+ */
+typedef struct
+{
+    o65_size_t offset;      /**< Offset of the relocation in the segment */
+    uint8_t type;           /**< Relocation type and segment identifier */
+    uint16_t extra;         /**< Extra value for HIGH and SEG relocations */
+    uint32_t undefid;       /**< Identifier for an undefined reference */
+
+} o65_image_reloc_t;
+
+/**
+ * @brief Exported symbol within an in-memory image.
+ */
+typedef struct
+{
+    const char *name;       /**< Name of the symbol */
+    uint8_t segid;          /**< Segment identifier */
+    o65_size_t value;       /**< Value of the symbol */
+
+} o65_image_export_t;
+
+/**
+ * @brief Image that has been loaded from a ".o65" file into memory.
+ *
+ * Index 0 of the per-segment arrays is for .text and index 1 is for .data.
+ * All of the memory for the image, including the image structure itself,
+ * comes from the image's arena.
+ */
+typedef struct
+{
+    o65_arena_t arena;              /**< Arena that holds the image */
+    o65_header_t header;            /**< Image header */
+    o65_options_t options;          /**< Header options */
+    uint8_t *segments[2];           /**< Contents of .text and .data */
+    o65_size_t sizes[2];            /**< Sizes of .text and .data */
+    const char **externs;           /**< Names of the external references */
+    o65_size_t num_externs;         /**< Number of external references */
+    o65_image_reloc_t *relocs[2];   /**< Relocations for .text and .data */
+    size_t num_relocs[2];           /**< Number of relocations per segment */
+    size_t trailing_skips[2];       /**< Skip entries after the last reloc */
+    o65_image_export_t *exports;    /**< Exported symbols */
+    o65_size_t num_exports;         /**< Number of exported symbols */
+
+} o65_image_t;
+
+/**
+ * @brief Reads an image from a ".o65" file into memory.
+ *
+ * @param[in] file File pointer, positioned at the start of the image.
+ * @param[out] image Returns the image, or NULL on error.
+ *
+ * @return 1 if the image was read, 0 if the file is not in .o65 format
+ * or the image is invalid, or -1 for unexpected EOF, a filesystem error,
+ * or out of memory.
+ *
+ * Only a single image is read.  If the O65_MODE_CHAIN bit is set in the
+ * header, then the next image in the chain follows.
+ *
+ * A file that is too short for the sizes and counts in the image is
+ * reported as unexpected EOF, with the end-of-file indicator set on @a file.
+ */
+int o65_image_read(FILE *file, o65_image_t **image);
+
+/**
+ * @brief Writes an in-memory image to a ".o65" file.
+ *
+ * @param[in] file File pointer.
+ * @param[in] image The image to write.
+ *
+ * @return 0 if the image was written, or -1 for a filesystem error.
+ *
+ * The header is written as-is, so an image that was read with
+ * o65_image_read() and not modified is reproduced byte-for-byte.
+ */
+int o65_image_write(FILE *file, const o65_image_t *image);
+
+/**
+ * @brief Frees an in-memory image.
+ *
+ * @param[in] image The image to free, or NULL.
+ */
+void o65_image_free(o65_image_t *image);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
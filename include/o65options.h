@@ -0,0 +1,228 @@
+/*
+ * Copyright (C) 2023 Southern Storm Software, Pty Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef O65OPTIONS_H
+#define O65OPTIONS_H
+
+#include "o65file.h"
+#include "o65arena.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Entry in a table of header options.
+ */
+typedef struct
+{
+    uint32_t offset;        /**< Offset of the option data in the pool */
+    uint8_t type;           /**< Type of option */
+    uint8_t len;            /**< Length of the option data */
+
+} o65_option_entry_t;
+
+/**
+ * @brief Compact table of header options.
+ *
+ * The option data is stored back to back in a shared byte pool, so each
+ * option only takes up as much memory as it needs.  The fields should be
+ * treated as opaque; use the accessor functions instead.
+ */
+typedef struct
+{
+    o65_option_entry_t *entries;    /**< Entries in file order */
+    size_t count;                   /**< Number of entries */
+    size_t max_count;               /**< Number of entries allocated */
+    uint8_t *pool;                  /**< Pool of option data */
+    size_t pool_len;                /**< Number of bytes in use in the pool */
+    size_t pool_max;                /**< Number of bytes allocated */
+
+} o65_options_t;
+
+/**
+ * @brief Initializes a table of header options to empty.
+ *
+ * @param[out] options The table to initialize.
+ */
+void o65_options_init(o65_options_t *options);
+
+/**
+ * @brief Frees a table of header options.
+ *
+ * @param[in,out] options The table to free.  It is left empty.
+ *
+ * This must not be called on a table that was copied into an arena
+ * with o65_options_copy().
+ */
+void o65_options_free(o65_options_t *options);
+
+/**
+ * @brief Adds a header option to the end of a table.
+ *
+ * @param[in,out] options The table to add to.
+ * @param[in] type Type of option.
+ * @param[in] data Points to the option data.
+ * @param[in] len Length of the option data, at most O65_MAX_OPT_SIZE - 2.
+ *
+ * @return 0 if the option was added, or -1 if out of memory or
+ * @a len is too large.
+ */
+int o65_options_add
+    (o65_options_t *options, uint8_t type, const void *data, size_t len);
+
+/**
+ * @brief Sets a header option, replacing the first option of the same type.
+ *
+ * @param[in,out] options The table to modify.
+ * @param[in] type Type of option.
+ * @param[in] data Points to the option data.
+ * @param[in] len Length of the option data, at most O65_MAX_OPT_SIZE - 2.
+ *
+ * @return 0 if the option was set, or -1 if out of memory or
+ * @a len is too large.
+ *
+ * If there is no option of the same type, then it is added to the end.
+ */
+int o65_options_set
+    (o65_options_t *options, uint8_t type, const void *data, size_t len);
+
+/**
+ * @brief Sets a header option to a string value.
+ *
+ * @param[in,out] options The table to modify.
+ * @param[in] type Type of option.
+ * @param[in] value Points to the string value to set.
+ * @param[in] len Length of the string value in bytes, excluding the
+ * terminating NUL.  Values that are too long are truncated.
+ *
+ * @return 0 if the option was set, or -1 if out of memory.
+ */
+int o65_options_set_string
+    (o65_options_t *options, uint8_t type, const char *value, size_t len);
+
+/**
+ * @brief Gets the number of header options in a table.
+ *
+ * @param[in] options The table.
+ *
+ * @return The number of options.
+ */
+size_t o65_options_count(const o65_options_t *options);
+
+/**
+ * @brief Gets the type of a header option.
+ *
+ * @param[in] options The table.
+ * @param[in] index Index of the option, less than o65_options_count().
+ *
+ * @return The type of the option.
+ */
+uint8_t o65_options_type(const o65_options_t *options, size_t index);
+
+/**
+ * @brief Gets the length of the data for a header option.
+ *
+ * @param[in] options The table.
+ * @param[in] index Index of the option, less than o65_options_count().
+ *
+ * @return The length of the data, excluding the length and type bytes.
+ */
+uint8_t o65_options_len(const o65_options_t *options, size_t index);
+
+/**
+ * @brief Gets the data for a header option.
+ *
+ * @param[in] options The table.
+ * @param[in] index Index of the option, less than o65_options_count().
+ *
+ * @return A pointer to the data, which remains valid until the
+ * table is next modified.
+ */
+const uint8_t *o65_options_data(const o65_options_t *options, size_t index);
+
+/**
+ * @brief Finds the first header option of a specific type.
+ *
+ * @param[in] options The table.
+ * @param[in] type The type of option to look for.
+ * @param[out] index Returns the index of the option.
+ *
+ * @return 1 if the option was found, or 0 if not found.
+ */
+int o65_options_find
+    (const o65_options_t *options, uint8_t type, size_t *index);
+
+/**
+ * @brief Copies a table of header options into an arena.
+ *
+ * @param[out] dest The table to copy to.
+ * @param[in] src The table to copy from.
+ * @param[in,out] arena The arena to allocate the copy from.
+ *
+ * @return 0 if the table was copied, or -1 if out of memory.
+ *
+ * The copy is packed to its exact size, is freed along with the arena,
+ * and must not be modified afterwards.
+ */
+int o65_options_copy
+    (o65_options_t *dest, const o65_options_t *src, o65_arena_t *arena);
+
+/**
+ * @brief Reads all of the header options from a ".o65" file.
+ *
+ * @param[in] file File pointer, positioned just after the header.
+ * @param[in,out] options The table to add the options to.
+ *
+ * @return 1 if the options were read, 0 if the option data is invalid,
+ * or -1 for unexpected EOF, a filesystem error, or out of memory.
+ */
+int o65_options_read(FILE *file, o65_options_t *options);
+
+/**
+ * @brief Writes a single header option from a table to a ".o65" file.
+ *
+ * @param[in] file File pointer.
+ * @param[in] options The table.
+ * @param[in] index Index of the option to write.
+ *
+ * @return 0 if the option was written, or -1 for a filesystem error.
+ */
+int o65_options_write_entry
+    (FILE *file, const o65_options_t *options, size_t index);
+
+/**
+ * @brief Writes all of the header options in a table to a ".o65" file,
+ * followed by the terminator.
+ *
+ * @param[in] file File pointer.
+ * @param[in] options The table.
+ *
+ * @return 0 if the options were written, or -1 for a filesystem error.
+ */
+int o65_options_write(FILE *file, const o65_options_t *options);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
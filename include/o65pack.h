@@ -0,0 +1,253 @@
+/*
+ * Copyright (C) 2023 Southern Storm Software, Pty Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef O65PACK_H
+#define O65PACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A pack file holds many ".o65" files in a single container:
+ *
+ *     header      16 bytes: magic, version, reserved
+ *     members     each member starts on an O65_PACK_ALIGN boundary
+ *     index       O65_PACK_ENTRY_SIZE bytes per member, sorted by name
+ *     names       member names, without NUL terminators
+ *     trailer     24 bytes: index offset, count, names size, magic
+ *
+ * All values are little-endian.  Each index entry has the 64-bit offset
+ * and length of the member, the 64-bit XXH64 fingerprint of the member's
+ * contents, and the 32-bit offset and length of the name.
+ *
+ * Members are referred to as "PACK:NAME", where PACK is the name of
+ * the pack file and NAME is the name of the member within the pack.
+ */
+
+/* Pack file format constants */
+#define O65_PACK_VERSION    1       /**< Version of the pack file format */
+#define O65_PACK_ALIGN      4096    /**< Alignment of the members */
+#define O65_PACK_HEADER_SIZE 16     /**< Size of the pack header */
+#define O65_PACK_ENTRY_SIZE 32      /**< Size of an index entry */
+#define O65_PACK_TRAILER_SIZE 24    /**< Size of the pack trailer */
+
+/**
+ * @brief Pack file that has been mapped into memory.
+ */
+typedef struct o65_pack_s o65_pack_t;
+
+/**
+ * @brief Member of a pack file.
+ */
+typedef struct
+{
+    const char *name;       /**< Name of the member, not NUL-terminated */
+    size_t name_len;        /**< Length of the name */
+    const uint8_t *data;    /**< Contents of the member */
+    size_t size;            /**< Size of the member in bytes */
+    uint64_t fingerprint;   /**< XXH64 fingerprint of the contents */
+
+} o65_pack_member_t;
+
+/**
+ * @brief Member that has been added to a pack that is being built.
+ */
+typedef struct
+{
+    char *name;             /**< Name of the member */
+    uint64_t offset;        /**< Offset of the member in the pack */
+    uint64_t size;          /**< Size of the member in bytes */
+    uint64_t fingerprint;   /**< XXH64 fingerprint of the contents */
+
+} o65_pack_entry_t;
+
+/**
+ * @brief State for building a pack file.
+ */
+typedef struct
+{
+    FILE *file;                 /**< File that the pack is written to */
+    uint64_t posn;              /**< Current position in the file */
+    o65_pack_entry_t *entries;  /**< Members that have been added so far */
+    size_t count;               /**< Number of members */
+    size_t max_count;           /**< Allocated size of the entries array */
+
+} o65_pack_builder_t;
+
+/**
+ * @brief Starts building a pack file.
+ *
+ * @param[out] builder The builder to initialize.
+ * @param[in] file File to write the pack to, positioned at the start.
+ *
+ * @return 0 on success, or -1 for a filesystem error.
+ */
+int o65_pack_builder_init(o65_pack_builder_t *builder, FILE *file);
+
+/**
+ * @brief Adds a member to a pack file.
+ *
+ * @param[in,out] builder The builder.
+ * @param[in] name Name of the member.
+ * @param[in] data Contents of the member.
+ * @param[in] size Size of the member in bytes.
+ *
+ * @return 0 on success, or -1 for a filesystem error or out of memory.
+ */
+int o65_pack_builder_add
+    (o65_pack_builder_t *builder, const char *name,
+     const uint8_t *data, size_t size);
+
+/**
+ * @brief Finishes building a pack file by writing the index.
+ *
+ * @param[in,out] builder The builder, which is freed afterwards.
+ *
+ * @return 0 on success, or -1 for a filesystem error or out of memory.
+ * If two members have the same name, then -1 is returned and errno
+ * is set to EEXIST.
+ *
+ * The file itself is not closed.
+ */
+int o65_pack_builder_finish(o65_pack_builder_t *builder);
+
+/**
+ * @brief Frees a pack builder without writing the index.
+ *
+ * @param[in,out] builder The builder.
+ */
+void o65_pack_builder_free(o65_pack_builder_t *builder);
+
+/**
+ * @brief Opens a pack file and maps it into memory.
+ *
+ * @param[in] filename Name of the pack file.
+ * @param[out] pack Returns the pack, or NULL on error.
+ *
+ * @return 1 if the pack was opened, 0 if the file is not in pack format,
+ * or -1 for a filesystem error or out of memory.
+ */
+int o65_pack_open(const char *filename, o65_pack_t **pack);
+
+/**
+ * @brief Closes a pack file and unmaps it from memory.
+ *
+ * @param[in] pack The pack to close, or NULL.
+ *
+ * Members that were returned from the pack must not be used afterwards.
+ */
+void o65_pack_close(o65_pack_t *pack);
+
+/**
+ * @brief Gets the name of the file that a pack was opened from.
+ *
+ * @param[in] pack The pack.
+ *
+ * @return The name of the pack file.
+ */
+const char *o65_pack_filename(const o65_pack_t *pack);
+
+/**
+ * @brief Gets the number of members in a pack.
+ *
+ * @param[in] pack The pack.
+ *
+ * @return The number of members.
+ */
+size_t o65_pack_count(const o65_pack_t *pack);
+
+/**
+ * @brief Gets a member of a pack by index.
+ *
+ * @param[in] pack The pack.
+ * @param[in] index Index of the member, in name order.
+ * @param[out] member Returns the member details.
+ */
+void o65_pack_member(const o65_pack_t *pack, size_t index,
+                     o65_pack_member_t *member);
+
+/**
+ * @brief Finds a member of a pack by name.
+ *
+ * @param[in] pack The pack.
+ * @param[in] name Name of the member to find.
+ * @param[in] name_len Length of the name.
+ * @param[out] member Returns the member details.
+ *
+ * @return 1 if the member was found, or 0 if it was not.
+ */
+int o65_pack_find(const o65_pack_t *pack, const char *name, size_t name_len,
+                  o65_pack_member_t *member);
+
+/**
+ * @brief Checks the fingerprint of a pack member against its contents.
+ *
+ * @param[in] member The member to check.
+ *
+ * @return 1 if the fingerprint matches, or 0 if it does not.
+ */
+int o65_pack_verify(const o65_pack_member_t *member);
+
+/**
+ * @brief Looks up a "PACK:NAME" member reference.
+ *
+ * @param[in] spec The member reference.
+ * @param[in,out] cache The pack that was opened most recently, or NULL.
+ * This is reused if @a spec refers to the same pack, or closed and
+ * replaced with the new pack otherwise.
+ * @param[out] member Returns the member details.
+ *
+ * @return 1 if the member was found, 0 if @a spec does not refer to a
+ * member of a pack, or -1 for a filesystem error or out of memory.
+ *
+ * The member remains valid until the pack in @a cache is closed or
+ * replaced.  Callers that refer to many members of the same pack only
+ * need to open and map the pack once.
+ */
+int o65_pack_lookup(const char *spec, o65_pack_t **cache,
+                    o65_pack_member_t *member);
+
+/**
+ * @brief Opens a ".o65" file or a "PACK:NAME" member for reading.
+ *
+ * @param[in] spec Name of the file or member to open.
+ * @param[in,out] cache The pack that was opened most recently, or NULL.
+ *
+ * @return The file pointer, or NULL with errno set on error.
+ *
+ * If @a spec names an existing file, then it is opened directly.
+ * Otherwise a stream is opened over the contents of the pack member.
+ * The stream must be closed before the pack in @a cache is closed
+ * or replaced.
+ */
+FILE *o65_pack_fopen(const char *spec, o65_pack_t **cache);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2023 Southern Storm Software, Pty Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef O65PREFETCH_H
+#define O65PREFETCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Default number of files to keep in flight when prefetching */
+#define O65_PREFETCH_DEPTH 64
+
+/**
+ * @brief State of a pipelined file prefetcher.
+ */
+typedef struct o65_prefetch_s o65_prefetch_t;
+
+/**
+ * @brief Callback that supplies the names of the files to prefetch.
+ *
+ * @param[in] ctx Context pointer that was passed to o65_prefetch_new().
+ *
+ * @return The name of the next file, or NULL if there are no more files.
+ * The name is copied, so it only needs to remain valid until the next call.
+ */
+typedef const char *(*o65_prefetch_source_t)(void *ctx);
+
+/**
+ * @brief Contents of a file that was loaded by the prefetcher.
+ */
+typedef struct
+{
+    char *filename;         /**< Name of the file */
+    uint8_t *data;          /**< Contents of the file, or NULL on error */
+    size_t size;            /**< Size of the file contents in bytes */
+    int error;              /**< errno value if the file could not be read */
+
+} o65_prefetch_file_t;
+
+/**
+ * @brief Creates a prefetcher that loads whole files into memory.
+ *
+ * @param[in] depth Maximum number of files to have in flight at once;
+ * zero selects O65_PREFETCH_DEPTH.
+ * @param[in] source Callback that supplies the file names.
+ * @param[in] ctx Context pointer for @a source.
+ *
+ * @return The prefetcher, or NULL if out of memory.
+ *
+ * On Linux, the files are opened, sized, read, and closed with io_uring
+ * so that many requests are outstanding at once and the syscalls are
+ * submitted in batches.  If io_uring is not available at build time or
+ * at runtime, then each file is loaded with open() and pread() when it
+ * is requested instead.
+ */
+o65_prefetch_t *o65_prefetch_new
+    (unsigned depth, o65_prefetch_source_t source, void *ctx);
+
+/**
+ * @brief Frees a prefetcher, discarding any files that are still in flight.
+ *
+ * @param[in] prefetch The prefetcher to free, or NULL.
+ */
+void o65_prefetch_free(o65_prefetch_t *prefetch);
+
+/**
+ * @brief Gets the next file from a prefetcher.
+ *
+ * @param[in,out] prefetch The prefetcher.
+ * @param[out] file Returns the file details.  If "error" is non-zero,
+ * then the file could not be read and "data" is NULL.
+ *
+ * @return 1 if a file was returned, or 0 if there are no more files.
+ *
+ * Files are returned in the same order as the source supplied them.
+ * The file must be released with o65_prefetch_release() once the
+ * caller has finished with it.
+ */
+int o65_prefetch_next(o65_prefetch_t *prefetch, o65_prefetch_file_t *file);
+
+/**
+ * @brief Releases the memory for a file that was returned by the prefetcher.
+ *
+ * @param[in,out] file The file to release.
+ */
+void o65_prefetch_release(o65_prefetch_file_t *file);
+
+/**
+ * @brief Gets the name of the I/O backend that a prefetcher is using.
+ *
+ * @param[in] prefetch The prefetcher.
+ *
+ * @return "io_uring" or "pread".
+ */
+const char *o65_prefetch_backend(const o65_prefetch_t *prefetch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,247 @@
+/*
+ * Copyright (C) 2023 Southern Storm Software, Pty Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef O65STATS_H
+#define O65STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Counters that are collected by the library and the tools.
+ */
+typedef enum
+{
+    O65_STAT_BYTES_READ,        /**< Bytes read from ".o65" files */
+    O65_STAT_BYTES_WRITTEN,     /**< Bytes written to output files */
+    O65_STAT_OPTIONS,           /**< Header options that were read */
+    O65_STAT_RELOC_WORD,        /**< WORD relocations decoded */
+    O65_STAT_RELOC_HIGH,        /**< HIGH relocations decoded */
+    O65_STAT_RELOC_LOW,         /**< LOW relocations decoded */
+    O65_STAT_RELOC_SEGADR,      /**< SEGADR relocations decoded */
+    O65_STAT_RELOC_SEG,         /**< SEG relocations decoded */
+    O65_STAT_RELOC_OTHER,       /**< Relocations of unknown type decoded */
+    O65_STAT_RELOC_SKIP,        /**< Skip-ahead relocation entries decoded */
+    O65_STAT_EXTERNS_RESOLVED,  /**< External references resolved */
+    O65_STAT_BYTES_TRIMMED,     /**< Zero bytes moved from .data to .bss */
+    O65_STAT_PRELINKED,         /**< Images whose relocation was skipped */
+    O65_STAT_COUNT              /**< Number of counters */
+
+} o65_stat_t;
+
+/**
+ * @brief Phases of processing that are timed by the tools.
+ */
+typedef enum
+{
+    O65_SPAN_FILE,              /**< Processing of an entire file */
+    O65_SPAN_OPEN,              /**< Opening a file */
+    O65_SPAN_HEADER,            /**< Reading or validating the header */
+    O65_SPAN_OPTIONS,           /**< Reading the header options */
+    O65_SPAN_SEGMENTS,          /**< Reading the segments */
+    O65_SPAN_EXTERNS,           /**< Reading or resolving the externals */
+    O65_SPAN_RELOCS,            /**< Reading or applying the relocations */
+    O65_SPAN_EXPORTS,           /**< Reading the exported symbols */
+    O65_SPAN_WRITE,             /**< Writing the output */
+    O65_SPAN_COUNT              /**< Number of spans */
+
+} o65_span_t;
+
+/* Flags for o65_stats_flags */
+#define O65_STATS_SUMMARY   0x0001  /**< Report a summary at exit */
+#define O65_STATS_TRACE     0x0002  /**< Report each span as it ends */
+#define O65_STATS_JSON      0x0004  /**< Use JSON instead of plain text */
+#define O65_STATS_EVENTS    0x0008  /**< Record events for a trace file */
+
+/**
+ * @brief Flags that control the collection of statistics; zero if disabled.
+ */
+extern unsigned o65_stats_flags;
+
+/**
+ * @brief Values of the counters that have been collected so far.
+ */
+extern uint64_t o65_stats_counters[O65_STAT_COUNT];
+
+#if defined(__GNUC__)
+#define O65_UNLIKELY(x) __builtin_expect(!!(x), 0)
+#else
+#define O65_UNLIKELY(x) (x)
+#endif
+
+/*
+ * Statistics from worker threads need thread-local storage, and the trace
+ * buffers need atomic operations.  Both come from the GNU C extensions,
+ * which GCC, Clang, and compatible compilers provide even in C99 mode.
+ * Other compilers compile the statistics out as though O65_NO_STATS
+ * had been defined.
+ */
+#if defined(__GNUC__)
+#define O65_THREAD_LOCAL __thread
+#else
+#define O65_THREAD_LOCAL
+#if !defined(O65_NO_STATS)
+#define O65_NO_STATS 1
+#endif
+#endif
+
+/**
+ * @brief Private counters for the current thread, or NULL to update
+ * o65_stats_counters directly.
+ *
+ * Worker threads count into their own array with o65_stats_redirect(),
+ * and the main thread adds them up with o65_stats_merge() once the
+ * workers have been joined.  No atomic operations are needed.
+ */
+extern O65_THREAD_LOCAL uint64_t *o65_stats_thread_counters;
+
+#define O65_STATS_COUNTER_ADD(stat, n) \
+    ((void)((o65_stats_thread_counters ? o65_stats_thread_counters \
+                                       : o65_stats_counters)[(stat)] += (n)))
+
+/* Building with O65_NO_STATS compiles all of the instrumentation out */
+#if defined(O65_NO_STATS)
+#define O65_STATS_ON()  0
+#else
+#define O65_STATS_ON()  O65_UNLIKELY(o65_stats_flags != 0)
+#endif
+
+/**
+ * @brief Adds a value to a counter if statistics are enabled.
+ *
+ * @param stat The counter to add to; e.g. O65_STAT_BYTES_READ.
+ * @param n The value to add.
+ */
+#define O65_STATS_ADD(stat, n) \
+    do { \
+        if (O65_STATS_ON()) \
+            O65_STATS_COUNTER_ADD((stat), (n)); \
+    } while (0)
+
+/**
+ * @brief Starts timing a span if statistics are enabled.
+ *
+ * @return The start time, or zero if statistics are disabled.
+ */
+#define O65_SPAN_BEGIN() (O65_STATS_ON() ? o65_stats_now() : 0)
+
+/**
+ * @brief Stops timing a span if statistics are enabled.
+ *
+ * @param span The span that was being timed; e.g. O65_SPAN_RELOCS.
+ * @param start The start time from O65_SPAN_BEGIN().
+ * @param name Name of the file being processed, for tracing.  May be NULL.
+ */
+#define O65_SPAN_END(span, start, name) \
+    do { \
+        if (O65_STATS_ON()) \
+            o65_stats_span_end((span), (start), (name)); \
+    } while (0)
+
+/**
+ * @brief Enables the collection of statistics.
+ *
+ * @param flags Combination of O65_STATS_SUMMARY, O65_STATS_TRACE,
+ * and O65_STATS_JSON.
+ *
+ * Calling this resets the counters and the start time for the report.
+ */
+void o65_stats_enable(unsigned flags);
+
+/**
+ * @brief Directs the counter updates of the calling thread into a
+ * private array.
+ *
+ * @param[out] counters Array of O65_STAT_COUNT counters, which is
+ * cleared to zero; or NULL to go back to updating the global counters.
+ */
+void o65_stats_redirect(uint64_t *counters);
+
+/**
+ * @brief Adds the private counters of a thread to the global counters.
+ *
+ * @param[in] counters Array of O65_STAT_COUNT counters that was passed
+ * to o65_stats_redirect().
+ *
+ * The thread that owned @a counters must have finished with them;
+ * e.g. because it has been joined.
+ */
+void o65_stats_merge(const uint64_t *counters);
+
+/**
+ * @brief Gets the current value of the monotonic clock.
+ *
+ * @return The time in nanoseconds.
+ */
+uint64_t o65_stats_now(void);
+
+/**
+ * @brief Records the end of a span.
+ *
+ * @param span The span that was being timed.
+ * @param start The start time of the span from o65_stats_now().
+ * @param name Name of the file being processed, for tracing.  May be NULL.
+ */
+void o65_stats_span_end(o65_span_t span, uint64_t start, const char *name);
+
+/**
+ * @brief Reports the statistics that have been collected.
+ *
+ * @param[in] file The file to write the report to; usually stderr.
+ *
+ * Nothing is reported to @a file unless O65_STATS_SUMMARY is enabled.
+ * The trace file is also written at this point if one was requested.
+ * No other thread may be recording spans when this is called.
+ */
+void o65_stats_report(FILE *file);
+
+/**
+ * @brief Records span events for writing to a trace file on exit.
+ *
+ * @param[in] filename Name of the file to write the trace events to.
+ *
+ * The trace file is in the Chrome trace event format, which can be loaded
+ * into "chrome://tracing" or Perfetto.  Events are buffered per thread
+ * and are written by o65_stats_report() once all threads are done.
+ */
+void o65_stats_trace_file(const char *filename);
+
+/**
+ * @brief Parses the argument to a "--stats" or "--trace" command-line option.
+ *
+ * @param[in] format The format argument, which may be NULL, "text", or "json".
+ * @param[in] flags O65_STATS_SUMMARY for "--stats", or O65_STATS_TRACE
+ * for "--trace".
+ *
+ * @return Non-zero if the option was accepted, or zero if @a format is invalid.
+ */
+int o65_stats_option(const char *format, unsigned flags);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2023 Southern Storm Software, Pty Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef O65SYMMAP_H
+#define O65SYMMAP_H
+
+#include "o65file.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A symbol map is a sidecar file that maps segment-relative addresses in
+ * a ".o65" file back to symbol names:
+ *
+ *     header      16 bytes: magic, version, number of symbols
+ *     symbols     O65_SYMMAP_ENTRY_SIZE bytes per symbol, sorted
+ *     names       NUL-terminated symbol names
+ *
+ * All values are little-endian.  Each symbol has the 32-bit offset of the
+ * symbol within its segment, the 32-bit offset of its name, the 16-bit
+ * index of the image in the ".o65" chain, the segment identifier, and
+ * O65_SYMMAP_* flags.  The symbols are sorted by image, segment, and
+ * offset, with at most one symbol for each address, so that the map can
+ * be binary-searched in place after it is mapped into memory.
+ */
+
+/* Symbol map format constants */
+#define O65_SYMMAP_VERSION      1   /**< Version of the symbol map format */
+#define O65_SYMMAP_HEADER_SIZE  16  /**< Size of the symbol map header */
+#define O65_SYMMAP_ENTRY_SIZE   12  /**< Size of a symbol entry */
+
+/* Symbol flags */
+#define O65_SYMMAP_GLOBAL       0x01    /**< Symbol is global */
+#define O65_SYMMAP_FUNC         0x02    /**< Symbol is a function */
+
+/**
+ * @brief Symbol map that has been mapped into memory.
+ */
+typedef struct o65_symmap_s o65_symmap_t;
+
+/**
+ * @brief Symbol in a symbol map.
+ */
+typedef struct
+{
+    const char *name;       /**< Name of the symbol */
+    o65_size_t offset;      /**< Offset of the symbol within its segment */
+    uint16_t image;         /**< Index of the image in the ".o65" chain */
+    uint8_t segid;          /**< Segment identifier; e.g. O65_SEGID_TEXT */
+    uint8_t flags;          /**< O65_SYMMAP_* flags */
+
+} o65_symbol_t;
+
+/**
+ * @brief Writes a symbol map.
+ *
+ * @param[in] file File to write the symbol map to.
+ * @param[in,out] symbols The symbols to write, which are sorted in place.
+ * @param[in] count Number of symbols.
+ *
+ * @return 0 on success, or -1 for a filesystem error or out of memory.
+ *
+ * If several symbols have the same address, then only one is written.
+ * Global symbols are preferred over local symbols, and then the symbol
+ * whose name sorts first.
+ */
+int o65_symmap_write(FILE *file, o65_symbol_t *symbols, size_t count);
+
+/**
+ * @brief Opens a symbol map and maps it into memory.
+ *
+ * @param[in] filename Name of the symbol map file.
+ * @param[out] map Returns the symbol map, or NULL on error.
+ *
+ * @return 1 if the symbol map was opened, 0 if the file is not in symbol
+ * map format, or -1 for a filesystem error or out of memory.
+ */
+int o65_symmap_open(const char *filename, o65_symmap_t **map);
+
+/**
+ * @brief Closes a symbol map and unmaps it from memory.
+ *
+ * @param[in] map The symbol map to close, or NULL.
+ */
+void o65_symmap_close(o65_symmap_t *map);
+
+/**
+ * @brief Gets the number of symbols in a symbol map.
+ *
+ * @param[in] map The symbol map.
+ *
+ * @return The number of symbols.
+ */
+size_t o65_symmap_count(const o65_symmap_t *map);
+
+/**
+ * @brief Gets a symbol from a symbol map by index.
+ *
+ * @param[in] map The symbol map.
+ * @param[in] index Index of the symbol, in address order.
+ * @param[out] symbol Returns the symbol.
+ */
+void o65_symmap_get(const o65_symmap_t *map, size_t index,
+                    o65_symbol_t *symbol);
+
+/**
+ * @brief Finds the symbol that contains an address.
+ *
+ * @param[in] map The symbol map.
+ * @param[in] image Index of the image in the ".o65" chain.
+ * @param[in] segid Segment identifier.
+ * @param[in] offset Offset of the address within the segment.
+ * @param[out] symbol Returns the symbol with the highest offset that is
+ * less than or equal to @a offset in the same image and segment.
+ *
+ * @return 1 if a symbol was found, or 0 if there is no such symbol.
+ *
+ * The lookup is a binary search on the mapped file, so it takes
+ * O(log n) time and does not allocate memory.
+ */
+int o65_symmap_lookup(const o65_symmap_t *map, unsigned image, uint8_t segid,
+                      o65_size_t offset, o65_symbol_t *symbol);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
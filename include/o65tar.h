@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2023 Southern Storm Software, Pty Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef O65TAR_H
+#define O65TAR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Limits on tar archive members */
+#define O65_TAR_NAME_MAX    4096        /**< Longest member name supported */
+#define O65_TAR_SIZE_MAX    0x7FFFFFFFU /**< Largest member supported */
+
+/**
+ * @brief State of a streaming tar archive reader.
+ *
+ * The archive is read sequentially from start to finish, so it can
+ * come from a pipe.  ustar, pax, and GNU long name archives are
+ * supported.  Only regular files are returned; other members such as
+ * directories and links are skipped.
+ */
+typedef struct
+{
+    FILE *file;             /**< File that the archive is read from */
+    uint64_t posn;          /**< Current position in the archive */
+    char name[O65_TAR_NAME_MAX]; /**< Name of the current member */
+    uint8_t *data;          /**< Contents of the current member */
+    size_t max_size;        /**< Allocated size of the data buffer */
+    const char *error;      /**< Description of the last format error */
+
+} o65_tar_t;
+
+/**
+ * @brief Member of a tar archive.
+ */
+typedef struct
+{
+    const char *name;       /**< Name of the member */
+    const uint8_t *data;    /**< Contents of the member */
+    size_t size;            /**< Size of the member in bytes */
+    uint64_t offset;        /**< Offset of the member's header */
+
+} o65_tar_member_t;
+
+/**
+ * @brief Initializes a tar archive reader.
+ *
+ * @param[out] tar The reader to initialize.
+ * @param[in] file File to read the archive from, positioned at the start.
+ */
+void o65_tar_init(o65_tar_t *tar, FILE *file);
+
+/**
+ * @brief Frees the memory for a tar archive reader.
+ *
+ * @param[in,out] tar The reader.  The file itself is not closed.
+ */
+void o65_tar_free(o65_tar_t *tar);
+
+/**
+ * @brief Reads the next regular file from a tar archive.
+ *
+ * @param[in,out] tar The reader.
+ * @param[out] member Returns the member details.
+ *
+ * @return 1 if a member was read, 0 if the archive is invalid, or -1
+ * for unexpected EOF, a filesystem error, or out of memory.  At the end
+ * of the archive, 1 is returned and the member name is set to NULL.
+ *
+ * If 0 is returned, then "error" in @a tar describes the problem.
+ * The member's name and contents remain valid until the next call.
+ */
+int o65_tar_next(o65_tar_t *tar, o65_tar_member_t *member);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
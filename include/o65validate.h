@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2023 Southern Storm Software, Pty Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef O65VALIDATE_H
+#define O65VALIDATE_H
+
+#include "o65file.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Maximum length of a validation error message, including the NUL. */
+#define O65_MESSAGE_MAX     128
+
+/**
+ * @brief Information about the first problem that was found in a file.
+ */
+typedef struct
+{
+    /** Byte offset of the problem from the start of the file. */
+    unsigned long offset;
+
+    /** Name of the field that contains the problem; e.g. "tlen". */
+    const char *field;
+
+    /** Description of the problem. */
+    char message[O65_MESSAGE_MAX];
+
+} o65_validate_error_t;
+
+/**
+ * @brief Validates the structure of a ".o65" file in a single pass.
+ *
+ * @param[in] file File pointer, positioned at the start of the file.
+ * @param[out] error Returns the details of the first problem found.
+ * May be NULL if the caller doesn't need the details.
+ *
+ * @return 1 if the file is valid, 0 if the file is invalid, or -1 on
+ * a filesystem error.  Unexpected EOF is reported as an invalid file.
+ *
+ * The header fields, header option lengths, external and exported symbol
+ * tables, and relocation tables are checked for consistency, including
+ * that relocations fit within their segments and refer to valid segments
+ * and external symbols.  All images in a chain are validated, and there
+ * must not be any trailing data after the last image.
+ *
+ * The segment contents are skipped and are never loaded into memory.
+ */
+int o65_validate(FILE *file, o65_validate_error_t *error);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2023 Southern Storm Software, Pty Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef O65VISIT_H
+#define O65VISIT_H
+
+#include "o65file.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Return values for visitor callbacks */
+#define O65_VISIT_CONTINUE  0   /**< Continue with the next element */
+#define O65_VISIT_SKIP      1   /**< Skip the payload that follows */
+#define O65_VISIT_STOP      2   /**< Stop walking the file immediately */
+
+/**
+ * @brief Callbacks for walking the elements of a ".o65" file.
+ *
+ * Any of the callbacks may be NULL if the caller isn't interested in
+ * that kind of element.  The callbacks return O65_VISIT_CONTINUE to
+ * keep going or O65_VISIT_STOP to end the walk early.  The "begin"
+ * callbacks can also return O65_VISIT_SKIP to skip the payload that
+ * follows without reporting its elements.
+ *
+ * The "header" argument to each callback is the header of the image
+ * that is currently being walked.
+ */
+typedef struct
+{
+    /** Called when the header of an image has been read */
+    int (*header)(void *ctx, const o65_header_t *header);
+
+    /** Called for each header option, excluding the terminator */
+    int (*option)(void *ctx, const o65_header_t *header,
+                  const o65_option_t *option);
+
+    /**
+     * Called before the .text or .data segment is read.  Returning
+     * O65_VISIT_SKIP seeks past the data without loading it.  If this
+     * callback is NULL, then the data is loaded only if "segment" is
+     * not NULL.
+     */
+    int (*begin_segment)(void *ctx, const o65_header_t *header,
+                         uint8_t segid, o65_size_t size);
+
+    /** Called with the contents of the .text or .data segment */
+    int (*segment)(void *ctx, const o65_header_t *header, uint8_t segid,
+                   const uint8_t *data, o65_size_t size);
+
+    /** Called before the external symbol names are read */
+    int (*begin_externs)(void *ctx, const o65_header_t *header,
+                         o65_size_t count);
+
+    /** Called for each external symbol name */
+    int (*extern_symbol)(void *ctx, const o65_header_t *header,
+                         o65_size_t index, const char *name);
+
+    /** Called before the relocation table for .text or .data is read */
+    int (*begin_relocs)(void *ctx, const o65_header_t *header,
+                        uint8_t segid);
+
+    /**
+     * Called for each relocation, excluding skip-ahead entries.  The
+     * "addr" is the address of the relocated byte, based on the
+     * original segment base in the header.
+     */
+    int (*reloc)(void *ctx, const o65_header_t *header, uint8_t segid,
+                 o65_size_t addr, const o65_reloc_t *reloc);
+
+    /** Called before the exported symbols are read */
+    int (*begin_exports)(void *ctx, const o65_header_t *header,
+                         o65_size_t count);
+
+    /** Called for each exported symbol */
+    int (*export_symbol)(void *ctx, const o65_header_t *header,
+                         const char *name, uint8_t segid, o65_size_t value);
+
+    /** Called at the end of each image */
+    int (*end_image)(void *ctx, const o65_header_t *header);
+
+} o65_visitor_t;
+
+/**
+ * @brief Walks all of the images in a ".o65" file in a single forward pass.
+ *
+ * @param[in] file File pointer, positioned at the start of the file.
+ * @param[in] visitor Callbacks to invoke for each element of the file.
+ * @param[in] ctx Context pointer to pass to the callbacks.
+ *
+ * @return 1 if the whole file was walked or a callback stopped the walk,
+ * 0 if the file is not in .o65 format or is invalid, or -1 for unexpected
+ * EOF or a filesystem error.
+ *
+ * Chained images are walked one after the other.  Segments that are
+ * skipped are seeked past if the file is seekable, or read and discarded
+ * otherwise.  Symbol names are passed to the callbacks in full.
+ */
+int o65_visit(FILE *file, const o65_visitor_t *visitor, void *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
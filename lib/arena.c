@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2023 Southern Storm Software, Pty Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "o65arena.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Alignment of the allocations from an arena */
+#define O65_ARENA_ALIGN 16
+
+struct o65_arena_block_s
+{
+    o65_arena_block_t *next;
+    union {
+        long double ld;
+        void *ptr;
+        long long ll;
+    } data[1];
+};
+
+/* Offset of the data within a block */
+#define O65_ARENA_HEADER offsetof(o65_arena_block_t, data)
+
+void o65_arena_init(o65_arena_t *arena)
+{
+    arena->blocks = NULL;
+    arena->posn = 0;
+    arena->size = 0;
+}
+
+void o65_arena_free(o65_arena_t *arena)
+{
+    o65_arena_block_t *block = arena->blocks;
+    o65_arena_block_t *next;
+    while (block != NULL) {
+        next = block->next;
+        free(block);
+        block = next;
+    }
+    o65_arena_init(arena);
+}
+
+void *o65_arena_alloc(o65_arena_t *arena, size_t size)
+{
+    o65_arena_block_t *block;
+    size_t block_size;
+    uint8_t *ptr;
+
+    /* Round the size up to keep the next allocation aligned */
+    if (size == 0)
+        size = 1;
+    size = (size + O65_ARENA_ALIGN - 1) & ~((size_t)(O65_ARENA_ALIGN - 1));
+    if (size == 0)
+        return NULL;
+
+    /* Allocate from the current block if there is room */
+    if (arena->blocks && size <= (arena->size - arena->posn)) {
+        ptr = ((uint8_t *)(arena->blocks->data)) + arena->posn;
+        arena->posn += size;
+        return ptr;
+    }
+
+    /* Large allocations get a block of their own, which is placed after
+     * the current block so that the rest of the current block is kept */
+    if (size > (O65_ARENA_BLOCK_SIZE / 4)) {
+        if (size > ((size_t)-1) - O65_ARENA_HEADER)
+            return NULL;
+        block = calloc(1, O65_ARENA_HEADER + size);
+        if (!block)
+            return NULL;
+        if (arena->blocks) {
+            block->next = arena->blocks->next;
+            arena->blocks->next = block;
+        } else {
+            block->next = NULL;
+            arena->blocks = block;
+            arena->posn = size;
+            arena->size = size;
+        }
+        return block->data;
+    }
+
+    /* Start a new block */
+    block_size = O65_ARENA_BLOCK_SIZE - O65_ARENA_HEADER;
+    block = calloc(1, O65_ARENA_HEADER + block_size);
+    if (!block)
+        return NULL;
+    block->next = arena->blocks;
+    arena->blocks = block;
+    arena->posn = size;
+    arena->size = block_size;
+    return block->data;
+}
+
+void *o65_arena_memdup(o65_arena_t *arena, const void *data, size_t size)
+{
+    void *ptr = o65_arena_alloc(arena, size);
+    if (ptr && size)
+        memcpy(ptr, data, size);
+    return ptr;
+}
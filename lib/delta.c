@@ -0,0 +1,298 @@
+/*
+ * Copyright (C) 2023 Southern Storm Software, Pty Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "o65delta.h"
+#include "o65file.h"
+#include "o65hash.h"
+#include "o65stats.h"
+#include <string.h>
+
+/**
+ * @brief Reads an unsigned LEB128 value from a delta patch.
+ *
+ * @param[in] patch The patch to read from.
+ * @param[out] value Returns the value.
+ *
+ * @return 1 if the value was read, 0 if the value is too large, or -1
+ * for unexpected EOF or a filesystem error.
+ */
+static int read_varint(FILE *patch, uint32_t *value)
+{
+    uint32_t result = 0;
+    int shift = 0;
+    int ch;
+    for (;;) {
+        if ((ch = getc(patch)) == EOF)
+            return -1;
+        if (shift > 28 || (shift == 28 && (ch & 0x70) != 0))
+            return 0;
+        result |= ((uint32_t)(ch & 0x7F)) << shift;
+        if ((ch & 0x80) == 0)
+            break;
+        shift += 7;
+    }
+    *value = result;
+    return 1;
+}
+
+/**
+ * @brief Reads a 64-bit value in little-endian byte order.
+ *
+ * @param[in] buf Points to the eight bytes to convert.
+ *
+ * @return The 64-bit value.
+ */
+static uint64_t read_uint64(const uint8_t *buf)
+{
+    return ((uint64_t)o65_read_uint32(buf)) |
+           (((uint64_t)o65_read_uint32(buf + 4)) << 32);
+}
+
+/**
+ * @brief Hashes the entire contents of the old file.
+ *
+ * @param[in] old The old file.
+ * @param[in] buf Working buffer of O65_DELTA_BUFFER_SIZE bytes.
+ * @param[out] size Returns the size of the file.
+ * @param[out] hash Returns the XXH64 hash of the file.
+ *
+ * @return 1 if the file was hashed, or -1 on a filesystem error.
+ */
+static int hash_old_file
+    (FILE *old, uint8_t *buf, uint64_t *size, uint64_t *hash)
+{
+    o65_hash_state_t state;
+    size_t len;
+    if (fseek(old, 0, SEEK_SET) < 0)
+        return -1;
+    o65_hash_init(&state, 0);
+    *size = 0;
+    while ((len = fread(buf, 1, O65_DELTA_BUFFER_SIZE, old)) > 0) {
+        o65_hash_update(&state, buf, len);
+        *size += len;
+    }
+    if (ferror(old))
+        return -1;
+    *hash = o65_hash_final(&state);
+    return 1;
+}
+
+/**
+ * @brief Writes a block of the new file and adds it to the hash.
+ *
+ * @param[out] out The new file.
+ * @param[in,out] state Hash state for the new file.
+ * @param[in] buf Points to the data to write.
+ * @param[in] len Number of bytes to write.
+ *
+ * @return 1 if the data was written, or -1 on a filesystem error.
+ */
+static int write_block
+    (FILE *out, o65_hash_state_t *state, const uint8_t *buf, size_t len)
+{
+    if (fwrite(buf, 1, len, out) != len)
+        return -1;
+    o65_hash_update(state, buf, len);
+    O65_STATS_ADD(O65_STAT_BYTES_WRITTEN, len);
+    return 1;
+}
+
+/**
+ * @brief Applies a copy operation from a delta patch.
+ *
+ * @param[in] old The old file.
+ * @param[in] patch The patch to read the operation's fields from.
+ * @param[out] out The new file.
+ * @param[in,out] state Hash state for the new file.
+ * @param[in] buf Working buffer of O65_DELTA_BUFFER_SIZE bytes.
+ * @param[in] old_size Size of the old file.
+ * @param[in,out] old_posn Position in the old file after the last copy.
+ * @param[in,out] remaining Number of bytes left to write to the new file.
+ *
+ * @return 1 on success, 0 if the operation is invalid, or -1 for
+ * unexpected EOF or a filesystem error.
+ */
+static int apply_copy
+    (FILE *old, FILE *patch, FILE *out, o65_hash_state_t *state,
+     uint8_t *buf, uint64_t old_size, uint64_t *old_posn, uint64_t *remaining)
+{
+    uint32_t zigzag;
+    uint32_t len;
+    uint32_t num_fixups;
+    uint32_t gap;
+    uint64_t fixup;
+    uint64_t posn;
+    uint64_t done;
+    size_t chunk;
+    int result;
+    int ch;
+
+    /* Read the position and length of the bytes to copy */
+    if ((result = read_varint(patch, &zigzag)) <= 0)
+        return result;
+    if ((result = read_varint(patch, &len)) <= 0)
+        return result;
+    if ((result = read_varint(patch, &num_fixups)) <= 0)
+        return result;
+    if (zigzag & 1) {
+        posn = (uint64_t)(zigzag >> 1) + 1;
+        if (posn > *old_posn)
+            return 0;
+        posn = *old_posn - posn;
+    } else {
+        posn = *old_posn + (zigzag >> 1);
+    }
+    if (posn > old_size || len > (old_size - posn) || len > *remaining)
+        return 0;
+    if (num_fixups > len)
+        return 0;
+    if (fseek(old, (long)posn, SEEK_SET) < 0)
+        return -1;
+
+    /* Find the position of the first fixup */
+    fixup = len;
+    if (num_fixups > 0) {
+        if ((result = read_varint(patch, &gap)) <= 0)
+            return result;
+        fixup = gap;
+    }
+
+    /* Copy the bytes a buffer at a time, replacing the fixups as we go */
+    for (done = 0; done < len; done += chunk) {
+        chunk = len - done;
+        if (chunk > O65_DELTA_BUFFER_SIZE)
+            chunk = O65_DELTA_BUFFER_SIZE;
+        if (fread(buf, 1, chunk, old) != chunk)
+            return -1;
+        while (num_fixups > 0 && fixup < (done + chunk)) {
+            if ((ch = getc(patch)) == EOF)
+                return -1;
+            buf[fixup - done] = (uint8_t)ch;
+            if (--num_fixups > 0) {
+                if ((result = read_varint(patch, &gap)) <= 0)
+                    return result;
+                fixup += (uint64_t)gap + 1;
+            }
+        }
+        if ((result = write_block(out, state, buf, chunk)) <= 0)
+            return result;
+    }
+
+    /* All fixups must have been within the copied range */
+    if (num_fixups > 0)
+        return 0;
+    *old_posn = posn + len;
+    *remaining -= len;
+    return 1;
+}
+
+/**
+ * @brief Applies a literal operation from a delta patch.
+ *
+ * @param[in] patch The patch to read the operation's fields from.
+ * @param[out] out The new file.
+ * @param[in,out] state Hash state for the new file.
+ * @param[in] buf Working buffer of O65_DELTA_BUFFER_SIZE bytes.
+ * @param[in,out] remaining Number of bytes left to write to the new file.
+ *
+ * @return 1 on success, 0 if the operation is invalid, or -1 for
+ * unexpected EOF or a filesystem error.
+ */
+static int apply_literal
+    (FILE *patch, FILE *out, o65_hash_state_t *state,
+     uint8_t *buf, uint64_t *remaining)
+{
+    uint32_t len;
+    size_t chunk;
+    int result;
+    if ((result = read_varint(patch, &len)) <= 0)
+        return result;
+    if (len > *remaining)
+        return 0;
+    *remaining -= len;
+    while (len > 0) {
+        chunk = len;
+        if (chunk > O65_DELTA_BUFFER_SIZE)
+            chunk = O65_DELTA_BUFFER_SIZE;
+        if (fread(buf, 1, chunk, patch) != chunk)
+            return -1;
+        if ((result = write_block(out, state, buf, chunk)) <= 0)
+            return result;
+        len -= chunk;
+    }
+    return 1;
+}
+
+int o65_delta_apply(FILE *old, FILE *patch, FILE *out)
+{
+    uint8_t buf[O65_DELTA_BUFFER_SIZE];
+    o65_hash_state_t state;
+    uint64_t expected_size;
+    uint64_t expected_hash;
+    uint64_t old_size;
+    uint64_t old_hash;
+    uint64_t old_posn;
+    uint64_t new_hash;
+    uint64_t remaining;
+    int result;
+    int op;
+
+    /* Read and check the patch header */
+    if (fread(buf, 1, O65_DELTA_HEADER_SIZE, patch) != O65_DELTA_HEADER_SIZE)
+        return -1;
+    if (memcmp(buf, O65_DELTA_MAGIC, 4) != 0 || buf[4] != O65_DELTA_VERSION)
+        return 0;
+    expected_size = o65_read_uint32(buf + 5);
+    expected_hash = read_uint64(buf + 9);
+    remaining = o65_read_uint32(buf + 17);
+    new_hash = read_uint64(buf + 21);
+
+    /* Make sure that the patch is for this version of the old file */
+    if ((result = hash_old_file(old, buf, &old_size, &old_hash)) <= 0)
+        return result;
+    if (old_size != expected_size || old_hash != expected_hash)
+        return 0;
+
+    /* Apply the operations in order */
+    o65_hash_init(&state, 0);
+    old_posn = 0;
+    for (;;) {
+        if ((op = getc(patch)) == EOF)
+            return -1;
+        if (op == O65_DELTA_END)
+            break;
+        else if (op == O65_DELTA_COPY)
+            result = apply_copy(old, patch, out, &state, buf,
+                                old_size, &old_posn, &remaining);
+        else if (op == O65_DELTA_LITERAL)
+            result = apply_literal(patch, out, &state, buf, &remaining);
+        else
+            result = 0;
+        if (result <= 0)
+            return result;
+    }
+
+    /* The new file must be complete and have the expected contents */
+    if (remaining != 0 || o65_hash_final(&state) != new_hash)
+        return 0;
+    return 1;
+}
@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2023 Southern Storm Software, Pty Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Implementation of the XXH64 hash algorithm from the xxHash family:
+ * https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md
+ */
+
+#include "o65hash.h"
+#include <string.h>
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+#define ROTL64(x, bits) (((x) << (bits)) | ((x) >> (64 - (bits))))
+
+/**
+ * @brief Reads a 64-bit value in little-endian byte order.
+ *
+ * @param[in] p Points to the eight bytes to convert.
+ *
+ * @return The 64-bit value.
+ */
+static uint64_t read_le64(const uint8_t *p)
+{
+    return ((uint64_t)(p[0]))         | (((uint64_t)(p[1])) << 8) |
+           (((uint64_t)(p[2])) << 16) | (((uint64_t)(p[3])) << 24) |
+           (((uint64_t)(p[4])) << 32) | (((uint64_t)(p[5])) << 40) |
+           (((uint64_t)(p[6])) << 48) | (((uint64_t)(p[7])) << 56);
+}
+
+/**
+ * @brief Reads a 32-bit value in little-endian byte order.
+ *
+ * @param[in] p Points to the four bytes to convert.
+ *
+ * @return The 32-bit value.
+ */
+static uint32_t read_le32(const uint8_t *p)
+{
+    return ((uint32_t)(p[0]))         | (((uint32_t)(p[1])) << 8) |
+           (((uint32_t)(p[2])) << 16) | (((uint32_t)(p[3])) << 24);
+}
+
+/**
+ * @brief Mixes an 8-byte input value into a lane accumulator.
+ *
+ * @param[in] acc The accumulator.
+ * @param[in] input The input value.
+ *
+ * @return The new accumulator value.
+ */
+static uint64_t xxh64_round(uint64_t acc, uint64_t input)
+{
+    acc += input * PRIME64_2;
+    acc = ROTL64(acc, 31);
+    return acc * PRIME64_1;
+}
+
+/**
+ * @brief Merges a lane accumulator into the final hash value.
+ *
+ * @param[in] acc The hash value so far.
+ * @param[in] value The lane accumulator to merge.
+ *
+ * @return The new hash value.
+ */
+static uint64_t xxh64_merge_round(uint64_t acc, uint64_t value)
+{
+    acc ^= xxh64_round(0, value);
+    return acc * PRIME64_1 + PRIME64_4;
+}
+
+/**
+ * @brief Processes a full 32-byte stripe of input.
+ *
+ * @param[in,out] v The four lane accumulators.
+ * @param[in] p Points to the stripe.
+ */
+static void xxh64_stripe(uint64_t v[4], const uint8_t *p)
+{
+    v[0] = xxh64_round(v[0], read_le64(p));
+    v[1] = xxh64_round(v[1], read_le64(p + 8));
+    v[2] = xxh64_round(v[2], read_le64(p + 16));
+    v[3] = xxh64_round(v[3], read_le64(p + 24));
+}
+
+void o65_hash_init(o65_hash_state_t *state, uint64_t seed)
+{
+    memset(state, 0, sizeof(o65_hash_state_t));
+    state->seed = seed;
+    state->v[0] = seed + PRIME64_1 + PRIME64_2;
+    state->v[1] = seed + PRIME64_2;
+    state->v[2] = seed;
+    state->v[3] = seed - PRIME64_1;
+}
+
+void o65_hash_update(o65_hash_state_t *state, const void *data, size_t len)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    size_t fill;
+
+    state->total_len += len;
+
+    /* Top up a partial stripe from last time */
+    if (state->buf_len > 0) {
+        fill = 32 - state->buf_len;
+        if (len < fill) {
+            memcpy(state->buf + state->buf_len, p, len);
+            state->buf_len += len;
+            return;
+        }
+        memcpy(state->buf + state->buf_len, p, fill);
+        xxh64_stripe(state->v, state->buf);
+        state->buf_len = 0;
+        p += fill;
+        len -= fill;
+    }
+
+    /* Process whole stripes directly from the input */
+    while (len >= 32) {
+        xxh64_stripe(state->v, p);
+        p += 32;
+        len -= 32;
+    }
+
+    /* Save the left-over bytes for next time */
+    memcpy(state->buf, p, len);
+    state->buf_len = len;
+}
+
+uint64_t o65_hash_final(const o65_hash_state_t *state)
+{
+    const uint8_t *p = state->buf;
+    size_t len = state->buf_len;
+    uint64_t h;
+
+    /* Merge the lanes, or start from the seed for short inputs */
+    if (state->total_len >= 32) {
+        h = ROTL64(state->v[0], 1) + ROTL64(state->v[1], 7) +
+            ROTL64(state->v[2], 12) + ROTL64(state->v[3], 18);
+        h = xxh64_merge_round(h, state->v[0]);
+        h = xxh64_merge_round(h, state->v[1]);
+        h = xxh64_merge_round(h, state->v[2]);
+        h = xxh64_merge_round(h, state->v[3]);
+    } else {
+        h = state->seed + PRIME64_5;
+    }
+    h += state->total_len;
+
+    /* Process the remaining bytes of the last partial stripe */
+    while (len >= 8) {
+        h ^= xxh64_round(0, read_le64(p));
+        h = ROTL64(h, 27) * PRIME64_1 + PRIME64_4;
+        p += 8;
+        len -= 8;
+    }
+    if (len >= 4) {
+        h ^= ((uint64_t)read_le32(p)) * PRIME64_1;
+        h = ROTL64(h, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+        len -= 4;
+    }
+    while (len > 0) {
+        h ^= ((uint64_t)(*p)) * PRIME64_5;
+        h = ROTL64(h, 11) * PRIME64_1;
+        ++p;
+        --len;
+    }
+
+    /* Final avalanche */
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+uint64_t o65_hash64(const void *data, size_t len, uint64_t seed)
+{
+    o65_hash_state_t state;
+    o65_hash_init(&state, seed);
+    o65_hash_update(&state, data, len);
+    return o65_hash_final(&state);
+}
+
+uint16_t o65_export_hash(const char *name)
+{
+    uint16_t hash = 0;
+    while (*name != '\0') {
+        hash = (uint16_t)(hash * 31U + (uint8_t)(*name));
+        ++name;
+    }
+    return hash;
+}
@@ -0,0 +1,406 @@
+/*
+ * Copyright (C) 2023 Southern Storm Software, Pty Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "o65model.h"
+#include "o65stats.h"
+#include <stdlib.h>
+#include <string.h>
+
+/** Growable scratch buffer for data whose size isn't known in advance */
+typedef struct
+{
+    uint8_t *data;          /**< Points to the buffer */
+    size_t len;             /**< Number of bytes in use */
+    size_t max_len;         /**< Number of bytes that have been allocated */
+
+} o65_scratch_t;
+
+/**
+ * @brief Appends data to a scratch buffer.
+ *
+ * @param[in,out] scratch The scratch buffer.
+ * @param[in] data Points to the data to append.
+ * @param[in] size Number of bytes to append.
+ *
+ * @return Non-zero on success, or zero if out of memory.
+ */
+static int o65_scratch_append
+    (o65_scratch_t *scratch, const void *data, size_t size)
+{
+    if (size > (scratch->max_len - scratch->len)) {
+        size_t new_len = scratch->max_len ? scratch->max_len : 256;
+        uint8_t *new_data;
+        while (size > (new_len - scratch->len))
+            new_len *= 2;
+        new_data = realloc(scratch->data, new_len);
+        if (!new_data)
+            return 0;
+        scratch->data = new_data;
+        scratch->max_len = new_len;
+    }
+    memcpy(scratch->data + scratch->len, data, size);
+    scratch->len += size;
+    return 1;
+}
+
+/**
+ * @brief Checks that the rest of the file is large enough for a block.
+ *
+ * @param[in] file File pointer.
+ * @param[in] size Number of bytes that the block needs.
+ *
+ * @return 1 if the file is large enough, or -1 if it is truncated.
+ *
+ * A truncated file is left at its end with the end-of-file indicator set,
+ * so that callers report it like any other short read.
+ */
+static int o65_image_check_remaining(FILE *file, uint64_t size)
+{
+    if (o65_check_remaining(file, size))
+        return 1;
+    fseek(file, 0, SEEK_END);
+    getc(file);
+    return -1;
+}
+
+/**
+ * @brief Reads a NUL-terminated name of any length into an arena.
+ *
+ * @param[in] file File pointer.
+ * @param[in,out] image The image that is being loaded.
+ * @param[in,out] scratch Scratch buffer to collect the name in.
+ * @param[out] name Returns the name.
+ *
+ * @return 1 on success, or -1 for unexpected EOF or out of memory.
+ */
+static int o65_image_read_name
+    (FILE *file, o65_image_t *image, o65_scratch_t *scratch, const char **name)
+{
+    char ch;
+    int c;
+    scratch->len = 0;
+    do {
+        if ((c = getc(file)) == EOF)
+            return -1;
+        ch = (char)c;
+        if (!o65_scratch_append(scratch, &ch, 1))
+            return -1;
+    } while (c != 0);
+    O65_STATS_ADD(O65_STAT_BYTES_READ, scratch->len);
+    *name = o65_arena_memdup(&(image->arena), scratch->data, scratch->len);
+    return *name ? 1 : -1;
+}
+
+/**
+ * @brief Reads the relocation table for a segment into an image.
+ *
+ * @param[in] file File pointer.
+ * @param[in,out] image The image that is being loaded.
+ * @param[in,out] scratch Scratch buffer to collect the relocations in.
+ * @param[in] seg Index of the segment; 0 for .text, 1 for .data.
+ *
+ * @return 1 on success, 0 if the table is invalid, or -1 for unexpected
+ * EOF or out of memory.
+ */
+static int o65_image_read_relocs
+    (FILE *file, o65_image_t *image, o65_scratch_t *scratch, int seg)
+{
+    const o65_decoder_t *decoder = o65_get_decoder(&(image->header));
+    o65_image_reloc_t entry;
+    o65_reloc_t reloc;
+    o65_size_t offset = ~((o65_size_t)0);
+    size_t skips = 0;
+    int result;
+
+    scratch->len = 0;
+    memset(&entry, 0, sizeof(entry));
+    for (;;) {
+        result = decoder->read_reloc(file, &reloc);
+        if (result <= 0)
+            return result;
+        if (reloc.offset == 0)
+            break;
+        if (reloc.offset == 255) {
+            offset += 254;
+            ++skips;
+            continue;
+        }
+        offset += reloc.offset;
+        skips = 0;
+        entry.offset = offset;
+        entry.type = reloc.type;
+        entry.extra = reloc.extra;
+        entry.undefid = reloc.undefid;
+        if (!o65_scratch_append(scratch, &entry, sizeof(entry)))
+            return -1;
+    }
+
+    /* Copy the relocations into the arena now that we know the size */
+    image->num_relocs[seg] = scratch->len / sizeof(o65_image_reloc_t);
+    image->trailing_skips[seg] = skips;
+    image->relocs[seg] = o65_arena_memdup
+        (&(image->arena), scratch->data, scratch->len);
+    return image->relocs[seg] ? 1 : -1;
+}
+
+/**
+ * @brief Reads the contents of an image after the header.
+ *
+ * @param[in] file File pointer.
+ * @param[in,out] image The image to load into, with the header filled in.
+ * @param[in,out] scratch Scratch buffer for data of unknown size.
+ *
+ * @return 1 on success, 0 if the image is invalid, or -1 for unexpected
+ * EOF, a filesystem error, or out of memory.
+ */
+static int o65_image_read_body
+    (FILE *file, o65_image_t *image, o65_scratch_t *scratch)
+{
+    const o65_decoder_t *decoder = o65_get_decoder(&(image->header));
+    o65_image_export_t *export;
+    o65_string_table_t names;
+    o65_options_t options;
+    const char *pool;
+    o65_size_t index;
+    int result;
+    int ch;
+    int seg;
+
+    /* Read the header options and pack them into the arena */
+    o65_options_init(&options);
+    result = o65_options_read(file, &options);
+    if (result > 0 &&
+            o65_options_copy(&(image->options), &options, &(image->arena)) < 0) {
+        result = -1;
+    }
+    o65_options_free(&options);
+    if (result <= 0)
+        return result;
+
+    /* Read the .text and .data segments */
+    image->sizes[0] = image->header.tlen;
+    image->sizes[1] = image->header.dlen;
+    for (seg = 0; seg < 2; ++seg) {
+        if (o65_image_check_remaining(file, image->sizes[seg]) < 0)
+            return -1;
+        image->segments[seg] = o65_arena_alloc
+            (&(image->arena), image->sizes[seg]);
+        if (!(image->segments[seg]))
+            return -1;
+        if (fread(image->segments[seg], 1, image->sizes[seg], file)
+                != image->sizes[seg]) {
+            return -1;
+        }
+        O65_STATS_ADD(O65_STAT_BYTES_READ, image->sizes[seg]);
+    }
+
+    /* Read the external references as a block and copy the names into
+     * the arena in one go */
+    result = decoder->read_count(file, &(image->num_externs));
+    if (result <= 0)
+        return result;
+    if (o65_image_check_remaining(file, image->num_externs) < 0)
+        return -1;
+    o65_string_table_init(&names);
+    result = o65_read_string_table(file, image->num_externs, &names);
+    if (result > 0) {
+        pool = o65_arena_memdup(&(image->arena), names.buf, names.buf_len);
+        image->externs = o65_arena_alloc
+            (&(image->arena), image->num_externs * sizeof(const char *));
+        if (pool && image->externs) {
+            for (index = 0; index < image->num_externs; ++index) {
+                image->externs[index] =
+                    pool + (names.names[index].name - names.buf);
+            }
+        } else {
+            result = -1;
+        }
+    }
+    o65_string_table_free(&names);
+    if (result <= 0)
+        return result;
+
+    /* Read the relocation tables */
+    for (seg = 0; seg < 2; ++seg) {
+        result = o65_image_read_relocs(file, image, scratch, seg);
+        if (result <= 0)
+            return result;
+    }
+
+    /* Read the exported symbols */
+    result = decoder->read_count(file, &(image->num_exports));
+    if (result <= 0)
+        return result;
+    if (o65_image_check_remaining(file, image->num_exports) < 0)
+        return -1;
+    image->exports = o65_arena_alloc
+        (&(image->arena), image->num_exports * sizeof(o65_image_export_t));
+    if (!(image->exports))
+        return -1;
+    for (index = 0; index < image->num_exports; ++index) {
+        export = &(image->exports[index]);
+        result = o65_image_read_name(file, image, scratch, &(export->name));
+        if (result <= 0)
+            return result;
+        if ((ch = getc(file)) == EOF)
+            return -1;
+        O65_STATS_ADD(O65_STAT_BYTES_READ, 1);
+        export->segid = (uint8_t)ch;
+        result = decoder->read_count(file, &(export->value));
+        if (result <= 0)
+            return result;
+    }
+    return 1;
+}
+
+int o65_image_read(FILE *file, o65_image_t **image)
+{
+    o65_scratch_t scratch;
+    o65_arena_t arena;
+    o65_image_t *img;
+    int result;
+
+    /* The image structure lives inside its own arena */
+    *image = NULL;
+    o65_arena_init(&arena);
+    img = o65_arena_alloc(&arena, sizeof(o65_image_t));
+    if (!img)
+        return -1;
+    img->arena = arena;
+
+    /* Read the header and then the rest of the image */
+    memset(&scratch, 0, sizeof(scratch));
+    result = o65_read_header(file, &(img->header));
+    if (result > 0)
+        result = o65_image_read_body(file, img, &scratch);
+    free(scratch.data);
+    if (result <= 0) {
+        o65_image_free(img);
+        return result;
+    }
+    *image = img;
+    return 1;
+}
+
+/**
+ * @brief Writes the relocation table for a segment.
+ *
+ * @param[in] file File pointer.
+ * @param[in] image The image to write.
+ * @param[in] seg Index of the segment; 0 for .text, 1 for .data.
+ *
+ * @return 0 if the table was written, or -1 for a filesystem error.
+ */
+static int o65_image_write_relocs
+    (FILE *file, const o65_image_t *image, int seg)
+{
+    const o65_image_reloc_t *entry = image->relocs[seg];
+    o65_size_t prev = ~((o65_size_t)0);
+    o65_size_t delta;
+    o65_reloc_t reloc;
+    size_t index;
+
+    memset(&reloc, 0, sizeof(reloc));
+    for (index = 0; index < image->num_relocs[seg]; ++index, ++entry) {
+        delta = entry->offset - prev;
+        prev = entry->offset;
+        while (delta > 254) {
+            if (putc(255, file) < 0)
+                return -1;
+            O65_STATS_ADD(O65_STAT_BYTES_WRITTEN, 1);
+            delta -= 254;
+        }
+        reloc.offset = (uint8_t)delta;
+        reloc.type = entry->type;
+        reloc.extra = entry->extra;
+        reloc.undefid = entry->undefid;
+        if (o65_write_reloc(file, &(image->header), &reloc) < 0)
+            return -1;
+    }
+    for (index = 0; index < image->trailing_skips[seg]; ++index) {
+        if (putc(255, file) < 0)
+            return -1;
+        O65_STATS_ADD(O65_STAT_BYTES_WRITTEN, 1);
+    }
+    if (putc(0, file) < 0)
+        return -1;
+    O65_STATS_ADD(O65_STAT_BYTES_WRITTEN, 1);
+    return 0;
+}
+
+int o65_image_write(FILE *file, const o65_image_t *image)
+{
+    const o65_image_export_t *export;
+    o65_size_t index;
+    int seg;
+
+    /* Header and options */
+    if (o65_write_raw_header(file, &(image->header)) < 0)
+        return -1;
+    if (o65_options_write(file, &(image->options)) < 0)
+        return -1;
+
+    /* Segments */
+    for (seg = 0; seg < 2; ++seg) {
+        if (fwrite(image->segments[seg], 1, image->sizes[seg], file)
+                != image->sizes[seg]) {
+            return -1;
+        }
+        O65_STATS_ADD(O65_STAT_BYTES_WRITTEN, image->sizes[seg]);
+    }
+
+    /* External references */
+    if (o65_write_count(file, &(image->header), image->num_externs) < 0)
+        return -1;
+    for (index = 0; index < image->num_externs; ++index) {
+        if (o65_write_string(file, image->externs[index]) < 0)
+            return -1;
+    }
+
+    /* Relocation tables */
+    for (seg = 0; seg < 2; ++seg) {
+        if (o65_image_write_relocs(file, image, seg) < 0)
+            return -1;
+    }
+
+    /* Exported symbols */
+    if (o65_write_count(file, &(image->header), image->num_exports) < 0)
+        return -1;
+    for (index = 0; index < image->num_exports; ++index) {
+        export = &(image->exports[index]);
+        if (o65_write_exported_symbol(file, &(image->header), export->name,
+                                      export->segid, export->value) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void o65_image_free(o65_image_t *image)
+{
+    o65_arena_t arena;
+    if (image) {
+        /* Copy the arena out first because it contains the image itself */
+        arena = image->arena;
+        o65_arena_free(&arena);
+    }
+}
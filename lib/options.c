@@ -0,0 +1,253 @@
+/*
+ * Copyright (C) 2023 Southern Storm Software, Pty Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "o65options.h"
+#include "o65stats.h"
+#include <stdlib.h>
+#include <string.h>
+
+void o65_options_init(o65_options_t *options)
+{
+    memset(options, 0, sizeof(o65_options_t));
+}
+
+void o65_options_free(o65_options_t *options)
+{
+    free(options->entries);
+    free(options->pool);
+    o65_options_init(options);
+}
+
+/**
+ * @brief Appends data to the pool for a table of header options.
+ *
+ * @param[in,out] options The table.
+ * @param[in] data Points to the data to append.
+ * @param[in] len Length of the data.
+ * @param[out] offset Returns the offset of the data in the pool.
+ *
+ * @return 0 on success, or -1 if out of memory.
+ */
+static int o65_options_append_pool
+    (o65_options_t *options, const void *data, size_t len, uint32_t *offset)
+{
+    if (len > (options->pool_max - options->pool_len)) {
+        size_t new_max = options->pool_max ? options->pool_max : 256;
+        uint8_t *new_pool;
+        while (len > (new_max - options->pool_len))
+            new_max *= 2;
+        if (new_max > 0xFFFFFFFFU)
+            return -1;
+        new_pool = realloc(options->pool, new_max);
+        if (!new_pool)
+            return -1;
+        options->pool = new_pool;
+        options->pool_max = new_max;
+    }
+    *offset = (uint32_t)(options->pool_len);
+    if (len > 0)
+        memcpy(options->pool + options->pool_len, data, len);
+    options->pool_len += len;
+    return 0;
+}
+
+int o65_options_add
+    (o65_options_t *options, uint8_t type, const void *data, size_t len)
+{
+    o65_option_entry_t *entry;
+    if (len > (O65_MAX_OPT_SIZE - 2))
+        return -1;
+    if (options->count >= options->max_count) {
+        size_t new_max = options->max_count ? options->max_count * 2 : 8;
+        entry = realloc(options->entries,
+                        new_max * sizeof(o65_option_entry_t));
+        if (!entry)
+            return -1;
+        options->entries = entry;
+        options->max_count = new_max;
+    }
+    entry = &(options->entries[options->count]);
+    if (o65_options_append_pool(options, data, len, &(entry->offset)) < 0)
+        return -1;
+    entry->type = type;
+    entry->len = (uint8_t)len;
+    ++(options->count);
+    return 0;
+}
+
+int o65_options_set
+    (o65_options_t *options, uint8_t type, const void *data, size_t len)
+{
+    o65_option_entry_t *entry;
+    size_t index;
+    if (len > (O65_MAX_OPT_SIZE - 2))
+        return -1;
+    if (!o65_options_find(options, type, &index))
+        return o65_options_add(options, type, data, len);
+
+    /* Reuse the existing space in the pool if the new value fits */
+    entry = &(options->entries[index]);
+    if (len <= entry->len) {
+        if (len > 0)
+            memmove(options->pool + entry->offset, data, len);
+    } else if (o65_options_append_pool
+                    (options, data, len, &(entry->offset)) < 0) {
+        return -1;
+    }
+    entry->len = (uint8_t)len;
+    return 0;
+}
+
+int o65_options_set_string
+    (o65_options_t *options, uint8_t type, const char *value, size_t len)
+{
+    uint8_t data[O65_MAX_OPT_SIZE - 2];
+    if (len >= sizeof(data))
+        len = sizeof(data) - 1;
+    memcpy(data, value, len);
+    data[len] = '\0';
+    return o65_options_set(options, type, data, len + 1);
+}
+
+size_t o65_options_count(const o65_options_t *options)
+{
+    return options->count;
+}
+
+uint8_t o65_options_type(const o65_options_t *options, size_t index)
+{
+    return options->entries[index].type;
+}
+
+uint8_t o65_options_len(const o65_options_t *options, size_t index)
+{
+    return options->entries[index].len;
+}
+
+const uint8_t *o65_options_data(const o65_options_t *options, size_t index)
+{
+    return options->pool + options->entries[index].offset;
+}
+
+int o65_options_find
+    (const o65_options_t *options, uint8_t type, size_t *index)
+{
+    size_t posn;
+    for (posn = 0; posn < options->count; ++posn) {
+        if (options->entries[posn].type == type) {
+            *index = posn;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int o65_options_copy
+    (o65_options_t *dest, const o65_options_t *src, o65_arena_t *arena)
+{
+    o65_option_entry_t *entries;
+    uint8_t *pool;
+    size_t index;
+    uint32_t offset = 0;
+
+    /* Entries that were replaced by o65_options_set() may have left
+     * holes in the source pool, so pack the data as we copy it */
+    entries = o65_arena_alloc(arena, src->count * sizeof(o65_option_entry_t));
+    if (!entries)
+        return -1;
+    for (index = 0; index < src->count; ++index)
+        offset += src->entries[index].len;
+    pool = o65_arena_alloc(arena, offset);
+    if (!pool)
+        return -1;
+    offset = 0;
+    for (index = 0; index < src->count; ++index) {
+        entries[index].offset = offset;
+        entries[index].type = src->entries[index].type;
+        entries[index].len = src->entries[index].len;
+        memcpy(pool + offset, src->pool + src->entries[index].offset,
+               src->entries[index].len);
+        offset += src->entries[index].len;
+    }
+    dest->entries = entries;
+    dest->count = src->count;
+    dest->max_count = src->count;
+    dest->pool = pool;
+    dest->pool_len = offset;
+    dest->pool_max = offset;
+    return 0;
+}
+
+int o65_options_read(FILE *file, o65_options_t *options)
+{
+    uint8_t data[O65_MAX_OPT_SIZE];
+    int len;
+    int type;
+    for (;;) {
+        /* Get the length of the option; zero indicates the end */
+        if ((len = getc(file)) == EOF)
+            return -1;
+        O65_STATS_ADD(O65_STAT_BYTES_READ, 1);
+        if (len == 0)
+            return 1;
+
+        /* The length must be 2 or greater for a valid option */
+        if (len < 2)
+            return 0;
+
+        /* Read the type and data and add them to the table */
+        if ((type = getc(file)) == EOF)
+            return -1;
+        len -= 2;
+        if (len > 0 && fread(data, 1, len, file) != (size_t)len)
+            return -1;
+        O65_STATS_ADD(O65_STAT_BYTES_READ, len + 1);
+        O65_STATS_ADD(O65_STAT_OPTIONS, 1);
+        if (o65_options_add(options, (uint8_t)type, data, len) < 0)
+            return -1;
+    }
+}
+
+int o65_options_write_entry
+    (FILE *file, const o65_options_t *options, size_t index)
+{
+    const o65_option_entry_t *entry = &(options->entries[index]);
+    if (putc(entry->len + 2, file) < 0 || putc(entry->type, file) < 0)
+        return -1;
+    if (entry->len > 0 &&
+            fwrite(options->pool + entry->offset, 1, entry->len, file)
+                != entry->len) {
+        return -1;
+    }
+    O65_STATS_ADD(O65_STAT_BYTES_WRITTEN, entry->len + 2);
+    return 0;
+}
+
+int o65_options_write(FILE *file, const o65_options_t *options)
+{
+    size_t index;
+    for (index = 0; index < options->count; ++index) {
+        if (o65_options_write_entry(file, options, index) < 0)
+            return -1;
+    }
+    return o65_write_option(file, NULL);
+}
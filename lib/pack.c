@@ -0,0 +1,469 @@
+/*
+ * Copyright (C) 2023 Southern Storm Software, Pty Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "o65pack.h"
+#include "o65file.h"
+#include "o65hash.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Magic numbers at the start and end of a pack file */
+static const uint8_t o65_pack_magic[8] =
+    {'o', '6', '5', 'p', 'a', 'c', 'k', 0x1A};
+static const uint8_t o65_pack_index_magic[8] =
+    {'o', '6', '5', 'i', 'n', 'd', 'x', 0x1A};
+
+struct o65_pack_s
+{
+    char *filename;             /**< Name of the pack file */
+    const uint8_t *data;        /**< Mapped contents of the pack file */
+    size_t size;                /**< Size of the pack file */
+    const uint8_t *index;       /**< Points to the index entries */
+    const char *names;          /**< Points to the member names */
+    size_t count;               /**< Number of members */
+};
+
+/**
+ * @brief Reads a 64-bit little-endian value from a buffer.
+ *
+ * @param[in] buf The buffer.
+ *
+ * @return The value.
+ */
+static uint64_t o65_pack_read_uint64(const uint8_t *buf)
+{
+    return ((uint64_t)o65_read_uint32(buf)) |
+           (((uint64_t)o65_read_uint32(buf + 4)) << 32);
+}
+
+/**
+ * @brief Writes a 64-bit little-endian value to a buffer.
+ *
+ * @param[out] buf The buffer.
+ * @param[in] value The value.
+ */
+static void o65_pack_write_uint64(uint8_t *buf, uint64_t value)
+{
+    o65_write_uint32(buf, (uint32_t)value);
+    o65_write_uint32(buf + 4, (uint32_t)(value >> 32));
+}
+
+/**
+ * @brief Writes data to a pack file that is being built.
+ *
+ * @param[in,out] builder The builder.
+ * @param[in] data The data to write.
+ * @param[in] size Number of bytes to write.
+ *
+ * @return 0 on success, or -1 for a filesystem error.
+ */
+static int o65_pack_builder_write
+    (o65_pack_builder_t *builder, const void *data, size_t size)
+{
+    if (size > 0 && fwrite(data, 1, size, builder->file) != size)
+        return -1;
+    builder->posn += size;
+    return 0;
+}
+
+/**
+ * @brief Pads a pack file that is being built to the next member boundary.
+ *
+ * @param[in,out] builder The builder.
+ *
+ * @return 0 on success, or -1 for a filesystem error.
+ */
+static int o65_pack_builder_pad(o65_pack_builder_t *builder)
+{
+    static const uint8_t zeroes[64] = {0};
+    size_t pad = (size_t)(-builder->posn & (O65_PACK_ALIGN - 1));
+    size_t len;
+    while (pad > 0) {
+        len = pad < sizeof(zeroes) ? pad : sizeof(zeroes);
+        if (o65_pack_builder_write(builder, zeroes, len) < 0)
+            return -1;
+        pad -= len;
+    }
+    return 0;
+}
+
+int o65_pack_builder_init(o65_pack_builder_t *builder, FILE *file)
+{
+    uint8_t header[O65_PACK_HEADER_SIZE];
+    memset(builder, 0, sizeof(o65_pack_builder_t));
+    builder->file = file;
+    memset(header, 0, sizeof(header));
+    memcpy(header, o65_pack_magic, sizeof(o65_pack_magic));
+    o65_write_uint32(header + 8, O65_PACK_VERSION);
+    return o65_pack_builder_write(builder, header, sizeof(header));
+}
+
+int o65_pack_builder_add
+    (o65_pack_builder_t *builder, const char *name,
+     const uint8_t *data, size_t size)
+{
+    o65_pack_entry_t *entry;
+
+    /* Make room for another entry */
+    if (builder->count >= builder->max_count) {
+        size_t new_max = builder->max_count ? builder->max_count * 2 : 64;
+        o65_pack_entry_t *new_entries = realloc
+            (builder->entries, new_max * sizeof(o65_pack_entry_t));
+        if (!new_entries)
+            return -1;
+        builder->entries = new_entries;
+        builder->max_count = new_max;
+    }
+    entry = &(builder->entries[builder->count]);
+    if ((entry->name = strdup(name)) == NULL)
+        return -1;
+    ++(builder->count);
+
+    /* Write the member on the next page boundary */
+    if (o65_pack_builder_pad(builder) < 0)
+        return -1;
+    entry->offset = builder->posn;
+    entry->size = size;
+    entry->fingerprint = o65_hash64(data, size, 0);
+    return o65_pack_builder_write(builder, data, size);
+}
+
+/**
+ * @brief Compares two entries by name for sorting.
+ *
+ * @param[in] e1 Points to the first entry.
+ * @param[in] e2 Points to the second entry.
+ *
+ * @return Less than, equal to, or greater than zero.
+ */
+static int o65_pack_compare_entries(const void *e1, const void *e2)
+{
+    const o65_pack_entry_t *entry1 = (const o65_pack_entry_t *)e1;
+    const o65_pack_entry_t *entry2 = (const o65_pack_entry_t *)e2;
+    return strcmp(entry1->name, entry2->name);
+}
+
+int o65_pack_builder_finish(o65_pack_builder_t *builder)
+{
+    uint8_t buf[O65_PACK_ENTRY_SIZE];
+    uint64_t index_offset;
+    uint64_t names_size = 0;
+    size_t name_len;
+    size_t index;
+    int result = -1;
+
+    /* Sort the entries by name and check for duplicates.  strcmp()
+     * orders the names in the same way as the byte-wise comparison
+     * that is used when searching the index. */
+    if (builder->count > 0) {
+        qsort(builder->entries, builder->count, sizeof(o65_pack_entry_t),
+              o65_pack_compare_entries);
+    }
+    for (index = 1; index < builder->count; ++index) {
+        if (!strcmp(builder->entries[index - 1].name,
+                    builder->entries[index].name)) {
+            o65_pack_builder_free(builder);
+            errno = EEXIST;
+            return -1;
+        }
+    }
+
+    /* Write the index entries */
+    index_offset = builder->posn;
+    for (index = 0; index < builder->count; ++index) {
+        const o65_pack_entry_t *entry = &(builder->entries[index]);
+        name_len = strlen(entry->name);
+        o65_pack_write_uint64(buf, entry->offset);
+        o65_pack_write_uint64(buf + 8, entry->size);
+        o65_pack_write_uint64(buf + 16, entry->fingerprint);
+        o65_write_uint32(buf + 24, (uint32_t)names_size);
+        o65_write_uint32(buf + 28, (uint32_t)name_len);
+        if (o65_pack_builder_write(builder, buf, O65_PACK_ENTRY_SIZE) < 0)
+            goto done;
+        names_size += name_len;
+    }
+
+    /* Write the names */
+    for (index = 0; index < builder->count; ++index) {
+        const char *name = builder->entries[index].name;
+        if (o65_pack_builder_write(builder, name, strlen(name)) < 0)
+            goto done;
+    }
+
+    /* Write the trailer */
+    o65_pack_write_uint64(buf, index_offset);
+    o65_write_uint32(buf + 8, (uint32_t)(builder->count));
+    o65_write_uint32(buf + 12, (uint32_t)names_size);
+    memcpy(buf + 16, o65_pack_index_magic, sizeof(o65_pack_index_magic));
+    if (o65_pack_builder_write(builder, buf, O65_PACK_TRAILER_SIZE) < 0)
+        goto done;
+    result = 0;
+
+done:
+    o65_pack_builder_free(builder);
+    return result;
+}
+
+void o65_pack_builder_free(o65_pack_builder_t *builder)
+{
+    size_t index;
+    for (index = 0; index < builder->count; ++index)
+        free(builder->entries[index].name);
+    free(builder->entries);
+    builder->entries = NULL;
+    builder->count = 0;
+    builder->max_count = 0;
+}
+
+/**
+ * @brief Checks the structure of a pack file that has been mapped.
+ *
+ * @param[in,out] pack The pack, which has "data" and "size" set.
+ *
+ * @return 1 if the pack is valid, or 0 if it is not.
+ *
+ * Every entry is checked up front so that the members can be used
+ * later without further bounds checks.
+ */
+static int o65_pack_check(o65_pack_t *pack)
+{
+    const uint8_t *trailer;
+    const uint8_t *entry;
+    uint64_t index_offset;
+    uint64_t index_size;
+    uint64_t names_size;
+    uint64_t offset;
+    uint64_t size;
+    size_t index;
+
+    /* Check the header and the trailer */
+    if (pack->size < (O65_PACK_HEADER_SIZE + O65_PACK_TRAILER_SIZE))
+        return 0;
+    if (memcmp(pack->data, o65_pack_magic, sizeof(o65_pack_magic)) != 0 ||
+            o65_read_uint32(pack->data + 8) != O65_PACK_VERSION) {
+        return 0;
+    }
+    trailer = pack->data + pack->size - O65_PACK_TRAILER_SIZE;
+    if (memcmp(trailer + 16, o65_pack_index_magic,
+               sizeof(o65_pack_index_magic)) != 0) {
+        return 0;
+    }
+    index_offset = o65_pack_read_uint64(trailer);
+    pack->count = o65_read_uint32(trailer + 8);
+    names_size = o65_read_uint32(trailer + 12);
+    index_size = ((uint64_t)(pack->count)) * O65_PACK_ENTRY_SIZE;
+
+    /* The index and names must exactly fill the space between the
+     * members and the trailer.  The values come from the file, so each
+     * one is checked against the space that is left rather than adding
+     * them up, which could wrap around. */
+    size = pack->size - O65_PACK_TRAILER_SIZE;
+    if (index_offset < O65_PACK_HEADER_SIZE || index_offset > size)
+        return 0;
+    size -= index_offset;
+    if (index_size > size)
+        return 0;
+    size -= index_size;
+    if (names_size != size)
+        return 0;
+    pack->index = pack->data + index_offset;
+    pack->names = (const char *)(pack->index + index_size);
+
+    /* Check that the members and names are within bounds */
+    for (index = 0; index < pack->count; ++index) {
+        entry = pack->index + index * O65_PACK_ENTRY_SIZE;
+        offset = o65_pack_read_uint64(entry);
+        size = o65_pack_read_uint64(entry + 8);
+        if (offset < O65_PACK_HEADER_SIZE || offset > index_offset ||
+                size > (index_offset - offset)) {
+            return 0;
+        }
+        offset = o65_read_uint32(entry + 24);
+        size = o65_read_uint32(entry + 28);
+        if (offset > names_size || size > (names_size - offset))
+            return 0;
+    }
+    return 1;
+}
+
+int o65_pack_open(const char *filename, o65_pack_t **pack)
+{
+    struct stat st;
+    void *data;
+    int fd;
+
+    /* Map the whole file into memory */
+    *pack = NULL;
+    if ((fd = open(filename, O_RDONLY | O_CLOEXEC)) < 0)
+        return -1;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return -1;
+    }
+    if (!S_ISREG(st.st_mode) ||
+            st.st_size < (O65_PACK_HEADER_SIZE + O65_PACK_TRAILER_SIZE)) {
+        close(fd);
+        return 0;
+    }
+    data = mmap(NULL, (size_t)(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return -1;
+
+    /* Check the structure of the pack */
+    if ((*pack = calloc(1, sizeof(o65_pack_t))) == NULL ||
+            ((*pack)->filename = strdup(filename)) == NULL) {
+        free(*pack);
+        *pack = NULL;
+        munmap(data, (size_t)(st.st_size));
+        return -1;
+    }
+    (*pack)->data = (const uint8_t *)data;
+    (*pack)->size = (size_t)(st.st_size);
+    if (!o65_pack_check(*pack)) {
+        o65_pack_close(*pack);
+        *pack = NULL;
+        return 0;
+    }
+    return 1;
+}
+
+void o65_pack_close(o65_pack_t *pack)
+{
+    if (!pack)
+        return;
+    munmap((void *)(pack->data), pack->size);
+    free(pack->filename);
+    free(pack);
+}
+
+const char *o65_pack_filename(const o65_pack_t *pack)
+{
+    return pack->filename;
+}
+
+size_t o65_pack_count(const o65_pack_t *pack)
+{
+    return pack->count;
+}
+
+void o65_pack_member(const o65_pack_t *pack, size_t index,
+                     o65_pack_member_t *member)
+{
+    const uint8_t *entry = pack->index + index * O65_PACK_ENTRY_SIZE;
+    member->name = pack->names + o65_read_uint32(entry + 24);
+    member->name_len = o65_read_uint32(entry + 28);
+    member->data = pack->data + o65_pack_read_uint64(entry);
+    member->size = (size_t)o65_pack_read_uint64(entry + 8);
+    member->fingerprint = o65_pack_read_uint64(entry + 16);
+}
+
+int o65_pack_find(const o65_pack_t *pack, const char *name, size_t name_len,
+                  o65_pack_member_t *member)
+{
+    size_t left = 0;
+    size_t right = pack->count;
+    size_t mid;
+    int cmp;
+
+    /* Binary search on the sorted index */
+    while (left < right) {
+        mid = left + (right - left) / 2;
+        o65_pack_member(pack, mid, member);
+        cmp = memcmp(name, member->name,
+                     name_len < member->name_len ? name_len : member->name_len);
+        if (cmp == 0) {
+            if (name_len == member->name_len)
+                return 1;
+            cmp = name_len < member->name_len ? -1 : 1;
+        }
+        if (cmp < 0)
+            right = mid;
+        else
+            left = mid + 1;
+    }
+    return 0;
+}
+
+int o65_pack_verify(const o65_pack_member_t *member)
+{
+    return o65_hash64(member->data, member->size, 0) == member->fingerprint;
+}
+
+int o65_pack_lookup(const char *spec, o65_pack_t **cache,
+                    o65_pack_member_t *member)
+{
+    const char *colon = spec;
+    const char *name;
+    char *filename;
+    o65_pack_t *pack;
+    int result;
+
+    /* The pack name may itself contain colons, so try each one in turn */
+    while ((colon = strchr(colon, ':')) != NULL) {
+        name = colon + 1;
+        if (*cache && !strncmp(o65_pack_filename(*cache), spec,
+                               (size_t)(colon - spec)) &&
+                o65_pack_filename(*cache)[colon - spec] == '\0') {
+            return o65_pack_find(*cache, name, strlen(name), member);
+        }
+        if ((filename = strndup(spec, (size_t)(colon - spec))) == NULL)
+            return -1;
+        result = o65_pack_open(filename, &pack);
+        free(filename);
+        if (result > 0) {
+            o65_pack_close(*cache);
+            *cache = pack;
+            return o65_pack_find(pack, name, strlen(name), member);
+        } else if (result < 0 && errno != ENOENT && errno != ENOTDIR) {
+            return -1;
+        }
+        ++colon;
+    }
+    return 0;
+}
+
+FILE *o65_pack_fopen(const char *spec, o65_pack_t **cache)
+{
+    o65_pack_member_t member;
+    FILE *file;
+    int result;
+
+    /* Regular files take precedence over pack members */
+    if ((file = fopen(spec, "rb")) != NULL || errno != ENOENT ||
+            !strchr(spec, ':')) {
+        return file;
+    }
+    result = o65_pack_lookup(spec, cache, &member);
+    if (result == 0) {
+        errno = ENOENT;
+        return NULL;
+    } else if (result < 0) {
+        return NULL;
+    }
+    return fmemopen((void *)(member.data), member.size, "rb");
+}
@@ -0,0 +1,648 @@
+/*
+ * Copyright (C) 2023 Southern Storm Software, Pty Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+#include "o65prefetch.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(O65_HAVE_IO_URING)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+/* States of a slot in the prefetch queue */
+#define O65_SLOT_FREE       0   /**< Slot is not in use */
+#define O65_SLOT_OPEN       1   /**< Waiting for the file to open */
+#define O65_SLOT_STAT       2   /**< Waiting for the size of the file */
+#define O65_SLOT_READ       3   /**< Waiting for the file data */
+#define O65_SLOT_CLOSE      4   /**< Waiting for the file to close */
+#define O65_SLOT_DONE       5   /**< File is ready to be handed over */
+
+/* Largest read to request at once, which is the Linux limit */
+#define O65_MAX_READ        0x7FFFF000U
+
+/** Slot for a file in the prefetch queue */
+typedef struct
+{
+    int state;              /**< Current state of the slot */
+    int fd;                 /**< File descriptor while the file is open */
+    char *filename;         /**< Name of the file */
+    uint8_t *data;          /**< Buffer for the file contents */
+    size_t size;            /**< Size of the file contents */
+    size_t posn;            /**< Number of bytes read so far */
+    int error;              /**< errno value if the file couldn't be read */
+#if defined(O65_HAVE_IO_URING)
+    struct statx stx;       /**< Receives the size of the file */
+    int busy;               /**< Non-zero while the kernel owns the slot */
+#endif
+
+} o65_prefetch_slot_t;
+
+struct o65_prefetch_s
+{
+    o65_prefetch_source_t source;   /**< Source of the file names */
+    void *ctx;                      /**< Context pointer for the source */
+    int eof;                        /**< Non-zero if the source is empty */
+    unsigned depth;                 /**< Number of slots in the queue */
+    unsigned head;                  /**< Index of the oldest slot */
+    unsigned used;                  /**< Number of slots in use */
+    o65_prefetch_slot_t *slots;     /**< Slots in the queue */
+#if defined(O65_HAVE_IO_URING)
+    int ring_fd;                    /**< io_uring descriptor, or -1 */
+    void *sq_ring;                  /**< Mapping for the submission ring */
+    size_t sq_ring_size;            /**< Size of the submission ring mapping */
+    void *cq_ring;                  /**< Mapping for the completion ring */
+    size_t cq_ring_size;            /**< Size of the completion ring mapping */
+    struct io_uring_sqe *sqes;      /**< Submission queue entries */
+    size_t sqes_size;               /**< Size of the entries mapping */
+    unsigned *sq_head;              /**< Head of the submission ring */
+    unsigned *sq_tail;              /**< Tail of the submission ring */
+    unsigned *sq_mask;              /**< Index mask for the submission ring */
+    unsigned *sq_array;             /**< Submission ring entries */
+    unsigned *cq_head;              /**< Head of the completion ring */
+    unsigned *cq_tail;              /**< Tail of the completion ring */
+    unsigned *cq_mask;              /**< Index mask for the completion ring */
+    struct io_uring_cqe *cqes;      /**< Completion queue entries */
+    unsigned to_submit;             /**< Entries waiting to be submitted */
+#endif
+};
+
+/**
+ * @brief Loads a whole file into memory with blocking I/O.
+ *
+ * @param[in,out] slot The slot for the file.
+ */
+static void o65_prefetch_load(o65_prefetch_slot_t *slot)
+{
+    struct stat st;
+    ssize_t len;
+    int fd;
+
+    if ((fd = open(slot->filename, O_RDONLY | O_CLOEXEC)) < 0) {
+        slot->error = errno;
+        return;
+    }
+    if (fstat(fd, &st) < 0) {
+        slot->error = errno;
+        close(fd);
+        return;
+    }
+    slot->size = (size_t)(st.st_size);
+    slot->data = malloc(slot->size ? slot->size : 1);
+    if (!(slot->data)) {
+        slot->error = ENOMEM;
+        close(fd);
+        return;
+    }
+    while (slot->posn < slot->size) {
+        len = pread(fd, slot->data + slot->posn,
+                    slot->size - slot->posn, (off_t)(slot->posn));
+        if (len < 0 && errno == EINTR)
+            continue;
+        if (len < 0) {
+            slot->error = errno;
+            break;
+        }
+        if (len == 0) {
+            /* The file got shorter since we checked the size */
+            slot->size = slot->posn;
+            break;
+        }
+        slot->posn += (size_t)len;
+    }
+    close(fd);
+}
+
+#if defined(O65_HAVE_IO_URING)
+
+/**
+ * @brief Sets up io_uring for a prefetcher.
+ *
+ * @param[in,out] prefetch The prefetcher.
+ *
+ * @return Non-zero if io_uring is available, or zero to use pread().
+ */
+static int o65_ring_setup(o65_prefetch_t *prefetch)
+{
+    struct io_uring_params p;
+    uint8_t *sq;
+    uint8_t *cq;
+    int fd;
+
+    memset(&p, 0, sizeof(p));
+    fd = (int)syscall(__NR_io_uring_setup, prefetch->depth, &p);
+    if (fd < 0)
+        return 0;
+
+    /* Opening, sizing, and closing files needs Linux 5.6 or later,
+     * which is also when IORING_FEAT_CUR_PERSONALITY was added */
+    if ((p.features & IORING_FEAT_CUR_PERSONALITY) == 0) {
+        close(fd);
+        return 0;
+    }
+
+    /* Map the rings into memory */
+    prefetch->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    prefetch->cq_ring_size =
+        p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (prefetch->cq_ring_size > prefetch->sq_ring_size)
+            prefetch->sq_ring_size = prefetch->cq_ring_size;
+        prefetch->cq_ring_size = 0;
+    }
+    prefetch->sq_ring = mmap(NULL, prefetch->sq_ring_size,
+                             PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                             fd, IORING_OFF_SQ_RING);
+    if (prefetch->sq_ring == MAP_FAILED) {
+        close(fd);
+        return 0;
+    }
+    if (prefetch->cq_ring_size != 0) {
+        prefetch->cq_ring = mmap(NULL, prefetch->cq_ring_size,
+                                 PROT_READ | PROT_WRITE,
+                                 MAP_SHARED | MAP_POPULATE,
+                                 fd, IORING_OFF_CQ_RING);
+        if (prefetch->cq_ring == MAP_FAILED) {
+            munmap(prefetch->sq_ring, prefetch->sq_ring_size);
+            close(fd);
+            return 0;
+        }
+    } else {
+        prefetch->cq_ring = prefetch->sq_ring;
+    }
+    prefetch->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    prefetch->sqes = mmap(NULL, prefetch->sqes_size,
+                          PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          fd, IORING_OFF_SQES);
+    if (prefetch->sqes == MAP_FAILED) {
+        if (prefetch->cq_ring_size != 0)
+            munmap(prefetch->cq_ring, prefetch->cq_ring_size);
+        munmap(prefetch->sq_ring, prefetch->sq_ring_size);
+        close(fd);
+        return 0;
+    }
+
+    /* Find the ring fields within the mappings */
+    sq = (uint8_t *)(prefetch->sq_ring);
+    cq = (uint8_t *)(prefetch->cq_ring);
+    prefetch->sq_head = (unsigned *)(sq + p.sq_off.head);
+    prefetch->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    prefetch->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    prefetch->sq_array = (unsigned *)(sq + p.sq_off.array);
+    prefetch->cq_head = (unsigned *)(cq + p.cq_off.head);
+    prefetch->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    prefetch->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    prefetch->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    prefetch->ring_fd = fd;
+    return 1;
+}
+
+/**
+ * @brief Tears down io_uring for a prefetcher.
+ *
+ * @param[in,out] prefetch The prefetcher.
+ */
+static void o65_ring_close(o65_prefetch_t *prefetch)
+{
+    if (prefetch->ring_fd < 0)
+        return;
+    munmap(prefetch->sqes, prefetch->sqes_size);
+    if (prefetch->cq_ring_size != 0)
+        munmap(prefetch->cq_ring, prefetch->cq_ring_size);
+    munmap(prefetch->sq_ring, prefetch->sq_ring_size);
+    close(prefetch->ring_fd);
+    prefetch->ring_fd = -1;
+}
+
+/**
+ * @brief Queues an operation for a slot in the submission ring.
+ *
+ * @param[in,out] prefetch The prefetcher.
+ * @param[in,out] slot The slot to queue the operation for.
+ * @param[in] state The new state of the slot, which selects the operation.
+ *
+ * There is never more than one operation in flight for each slot, and the
+ * rings have at least as many entries as there are slots, so there is
+ * always room in the submission ring.
+ */
+static void o65_ring_queue
+    (o65_prefetch_t *prefetch, o65_prefetch_slot_t *slot, int state)
+{
+    unsigned tail = *(prefetch->sq_tail);
+    unsigned index = tail & *(prefetch->sq_mask);
+    struct io_uring_sqe *sqe = &(prefetch->sqes[index]);
+    size_t len;
+
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    switch (state) {
+    case O65_SLOT_OPEN:
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (uint64_t)(uintptr_t)(slot->filename);
+        sqe->open_flags = O_RDONLY | O_CLOEXEC;
+        break;
+
+    case O65_SLOT_STAT:
+        sqe->opcode = IORING_OP_STATX;
+        sqe->fd = slot->fd;
+        sqe->addr = (uint64_t)(uintptr_t)"";
+        sqe->len = STATX_SIZE;
+        sqe->statx_flags = AT_EMPTY_PATH;
+        sqe->off = (uint64_t)(uintptr_t)&(slot->stx);
+        break;
+
+    case O65_SLOT_READ:
+        len = slot->size - slot->posn;
+        if (len > O65_MAX_READ)
+            len = O65_MAX_READ;
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = slot->fd;
+        sqe->addr = (uint64_t)(uintptr_t)(slot->data + slot->posn);
+        sqe->len = (uint32_t)len;
+        sqe->off = slot->posn;
+        break;
+
+    default:
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->fd = slot->fd;
+        state = O65_SLOT_CLOSE;
+        break;
+    }
+    sqe->user_data = (uint64_t)(slot - prefetch->slots);
+    prefetch->sq_array[index] = index;
+    __atomic_store_n(prefetch->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ++(prefetch->to_submit);
+    slot->state = state;
+}
+
+/**
+ * @brief Advances a slot when an operation completes.
+ *
+ * @param[in,out] prefetch The prefetcher.
+ * @param[in,out] slot The slot whose operation completed.
+ * @param[in] res Result of the operation; negative errno on failure.
+ */
+static void o65_ring_complete
+    (o65_prefetch_t *prefetch, o65_prefetch_slot_t *slot, int res)
+{
+    switch (slot->state) {
+    case O65_SLOT_OPEN:
+        if (res < 0) {
+            slot->error = -res;
+            slot->state = O65_SLOT_DONE;
+        } else {
+            slot->fd = res;
+            o65_ring_queue(prefetch, slot, O65_SLOT_STAT);
+        }
+        break;
+
+    case O65_SLOT_STAT:
+        if (res < 0) {
+            slot->error = -res;
+            o65_ring_queue(prefetch, slot, O65_SLOT_CLOSE);
+            break;
+        }
+        slot->size = (size_t)(slot->stx.stx_size);
+        slot->data = malloc(slot->size ? slot->size : 1);
+        if (!(slot->data)) {
+            slot->error = ENOMEM;
+            o65_ring_queue(prefetch, slot, O65_SLOT_CLOSE);
+        } else if (slot->size == 0) {
+            o65_ring_queue(prefetch, slot, O65_SLOT_CLOSE);
+        } else {
+            o65_ring_queue(prefetch, slot, O65_SLOT_READ);
+        }
+        break;
+
+    case O65_SLOT_READ:
+        if (res == -EINTR || res == -EAGAIN) {
+            o65_ring_queue(prefetch, slot, O65_SLOT_READ);
+        } else if (res < 0) {
+            slot->error = -res;
+            o65_ring_queue(prefetch, slot, O65_SLOT_CLOSE);
+        } else if (res == 0) {
+            /* The file got shorter since we checked the size */
+            slot->size = slot->posn;
+            o65_ring_queue(prefetch, slot, O65_SLOT_CLOSE);
+        } else {
+            slot->posn += (size_t)res;
+            if (slot->posn < slot->size)
+                o65_ring_queue(prefetch, slot, O65_SLOT_READ);
+            else
+                o65_ring_queue(prefetch, slot, O65_SLOT_CLOSE);
+        }
+        break;
+
+    default:
+        slot->fd = -1;
+        slot->state = O65_SLOT_DONE;
+        break;
+    }
+}
+
+/**
+ * @brief Submits the queued operations and processes completions.
+ *
+ * @param[in,out] prefetch The prefetcher.
+ * @param[in] wait Non-zero to wait for at least one completion.
+ *
+ * @return Zero on success, or an errno value if io_uring failed.
+ */
+static int o65_ring_run(o65_prefetch_t *prefetch, int wait)
+{
+    struct io_uring_cqe *cqe;
+    unsigned head;
+    long result;
+
+    /* Submit everything that is queued in a single system call */
+    if (prefetch->to_submit > 0 || wait) {
+        do {
+            result = syscall(__NR_io_uring_enter, prefetch->ring_fd,
+                             prefetch->to_submit, wait ? 1 : 0,
+                             wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        } while (result < 0 && errno == EINTR);
+        if (result < 0)
+            return errno;
+        prefetch->to_submit -= (unsigned)result;
+    }
+
+    /* Process the completions, which may queue follow-on operations */
+    head = *(prefetch->cq_head);
+    while (head != __atomic_load_n(prefetch->cq_tail, __ATOMIC_ACQUIRE)) {
+        cqe = &(prefetch->cqes[head & *(prefetch->cq_mask)]);
+        o65_ring_complete
+            (prefetch, &(prefetch->slots[cqe->user_data]), cqe->res);
+        ++head;
+        __atomic_store_n(prefetch->cq_head, head, __ATOMIC_RELEASE);
+    }
+    return 0;
+}
+
+/**
+ * @brief Abandons io_uring after a failure and resets the slots in flight.
+ *
+ * @param[in,out] prefetch The prefetcher.
+ *
+ * Operations that the kernel has already consumed are drained so that it
+ * is no longer writing into our buffers, and the descriptors that they
+ * opened are closed.  Slots that still need data are put back into the
+ * OPEN state, so that o65_prefetch_load() will read them with pread().
+ * If the ring cannot even be drained, the buffers that the kernel may
+ * still write into are leaked rather than freed.
+ */
+static void o65_ring_abandon(o65_prefetch_t *prefetch)
+{
+    o65_prefetch_slot_t *slot;
+    struct io_uring_cqe *cqe;
+    unsigned inflight = 0;
+    unsigned index;
+    unsigned head;
+    unsigned tail;
+    long result;
+
+    /* Every slot that is waiting on an operation belongs to the kernel,
+     * except for those whose operation was never submitted */
+    for (index = 0; index < prefetch->used; ++index) {
+        slot = &(prefetch->slots[(prefetch->head + index) % prefetch->depth]);
+        slot->busy = (slot->state != O65_SLOT_DONE);
+        if (slot->busy)
+            ++inflight;
+    }
+    head = __atomic_load_n(prefetch->sq_head, __ATOMIC_ACQUIRE);
+    tail = *(prefetch->sq_tail);
+    for (; head != tail; ++head) {
+        index = prefetch->sq_array[head & *(prefetch->sq_mask)];
+        slot = &(prefetch->slots[prefetch->sqes[index].user_data]);
+        if (slot->busy) {
+            slot->busy = 0;
+            --inflight;
+        }
+    }
+    prefetch->to_submit = 0;
+
+    /* Wait for the operations in flight without queueing any more */
+    for (;;) {
+        head = *(prefetch->cq_head);
+        while (head != __atomic_load_n(prefetch->cq_tail, __ATOMIC_ACQUIRE)) {
+            cqe = &(prefetch->cqes[head & *(prefetch->cq_mask)]);
+            slot = &(prefetch->slots[cqe->user_data]);
+            if (slot->state == O65_SLOT_OPEN && cqe->res >= 0) {
+                slot->fd = cqe->res;
+            } else if (slot->state == O65_SLOT_CLOSE) {
+                slot->fd = -1;
+                slot->state = O65_SLOT_DONE;
+            }
+            if (slot->busy) {
+                slot->busy = 0;
+                --inflight;
+            }
+            ++head;
+            __atomic_store_n(prefetch->cq_head, head, __ATOMIC_RELEASE);
+        }
+        if (inflight == 0)
+            break;
+        result = syscall(__NR_io_uring_enter, prefetch->ring_fd, 0, 1,
+                         IORING_ENTER_GETEVENTS, NULL, 0);
+        if (result < 0 && errno != EINTR)
+            break;
+    }
+
+    /* Close what is still open, and reset the slots that need data */
+    for (index = 0; index < prefetch->used; ++index) {
+        slot = &(prefetch->slots[(prefetch->head + index) % prefetch->depth]);
+        if (slot->state == O65_SLOT_DONE)
+            continue;
+        if (slot->state == O65_SLOT_CLOSE) {
+            /* The data is complete and only the close is outstanding */
+            if (!(slot->busy) && slot->fd >= 0)
+                close(slot->fd);
+            slot->fd = -1;
+            slot->state = O65_SLOT_DONE;
+            continue;
+        }
+        if (slot->busy) {
+            /* The kernel may still write into the buffer, so leak it */
+            slot->data = NULL;
+        } else {
+            free(slot->data);
+            slot->data = NULL;
+        }
+        if (slot->fd >= 0)
+            close(slot->fd);
+        slot->fd = -1;
+        slot->size = 0;
+        slot->posn = 0;
+        slot->error = 0;
+        slot->busy = 0;
+        slot->state = O65_SLOT_OPEN;
+    }
+    o65_ring_close(prefetch);
+}
+
+#endif /* O65_HAVE_IO_URING */
+
+o65_prefetch_t *o65_prefetch_new
+    (unsigned depth, o65_prefetch_source_t source, void *ctx)
+{
+    o65_prefetch_t *prefetch = calloc(1, sizeof(o65_prefetch_t));
+    if (!prefetch)
+        return NULL;
+    prefetch->source = source;
+    prefetch->ctx = ctx;
+    prefetch->depth = depth ? depth : O65_PREFETCH_DEPTH;
+    prefetch->slots = calloc(prefetch->depth, sizeof(o65_prefetch_slot_t));
+    if (!(prefetch->slots)) {
+        free(prefetch);
+        return NULL;
+    }
+#if defined(O65_HAVE_IO_URING)
+    prefetch->ring_fd = -1;
+    if (!o65_ring_setup(prefetch))
+        prefetch->ring_fd = -1;
+#endif
+    return prefetch;
+}
+
+void o65_prefetch_free(o65_prefetch_t *prefetch)
+{
+    o65_prefetch_file_t file;
+    if (!prefetch)
+        return;
+
+    /* Drain the files that are in flight so that the kernel is no longer
+     * writing into our buffers and the descriptors are closed */
+    prefetch->eof = 1;
+    while (o65_prefetch_next(prefetch, &file))
+        o65_prefetch_release(&file);
+#if defined(O65_HAVE_IO_URING)
+    o65_ring_close(prefetch);
+#endif
+    free(prefetch->slots);
+    free(prefetch);
+}
+
+/**
+ * @brief Fills the free slots with more files from the source.
+ *
+ * @param[in,out] prefetch The prefetcher.
+ */
+static void o65_prefetch_fill(o65_prefetch_t *prefetch)
+{
+    o65_prefetch_slot_t *slot;
+    const char *name;
+    while (!(prefetch->eof) && prefetch->used < prefetch->depth) {
+        name = prefetch->source(prefetch->ctx);
+        if (!name) {
+            prefetch->eof = 1;
+            break;
+        }
+        slot = &(prefetch->slots
+            [(prefetch->head + prefetch->used) % prefetch->depth]);
+        memset(slot, 0, sizeof(o65_prefetch_slot_t));
+        slot->fd = -1;
+        ++(prefetch->used);
+        if ((slot->filename = strdup(name)) == NULL) {
+            slot->error = ENOMEM;
+            slot->state = O65_SLOT_DONE;
+            continue;
+        }
+#if defined(O65_HAVE_IO_URING)
+        if (prefetch->ring_fd >= 0) {
+            o65_ring_queue(prefetch, slot, O65_SLOT_OPEN);
+            continue;
+        }
+#endif
+        /* Without io_uring, files are loaded when they are requested */
+        slot->state = O65_SLOT_OPEN;
+        if (prefetch->used == 1)
+            break;
+    }
+}
+
+int o65_prefetch_next(o65_prefetch_t *prefetch, o65_prefetch_file_t *file)
+{
+    o65_prefetch_slot_t *slot;
+
+    memset(file, 0, sizeof(o65_prefetch_file_t));
+    o65_prefetch_fill(prefetch);
+    if (prefetch->used == 0)
+        return 0;
+    slot = &(prefetch->slots[prefetch->head]);
+
+#if defined(O65_HAVE_IO_URING)
+    if (prefetch->ring_fd >= 0) {
+        /* Submit the new requests, and wait until the oldest is done */
+        int wait = 0;
+        int error;
+        while ((error = o65_ring_run(prefetch, wait)) == 0 &&
+                slot->state != O65_SLOT_DONE) {
+            wait = 1;
+        }
+        if (error != 0) {
+            /* io_uring has failed, so load the rest of the files
+             * with pread() instead */
+            o65_ring_abandon(prefetch);
+        }
+    }
+#endif
+    if (slot->state != O65_SLOT_DONE) {
+        o65_prefetch_load(slot);
+        slot->state = O65_SLOT_DONE;
+    }
+
+    /* Hand the file over to the caller */
+    file->filename = slot->filename;
+    file->error = slot->error;
+    if (slot->error == 0) {
+        file->data = slot->data;
+        file->size = slot->size;
+    } else {
+        free(slot->data);
+    }
+    slot->state = O65_SLOT_FREE;
+    prefetch->head = (prefetch->head + 1) % prefetch->depth;
+    --(prefetch->used);
+    return 1;
+}
+
+void o65_prefetch_release(o65_prefetch_file_t *file)
+{
+    free(file->filename);
+    free(file->data);
+    memset(file, 0, sizeof(o65_prefetch_file_t));
+}
+
+const char *o65_prefetch_backend(const o65_prefetch_t *prefetch)
+{
+#if defined(O65_HAVE_IO_URING)
+    if (prefetch->ring_fd >= 0)
+        return "io_uring";
+#else
+    (void)prefetch;
+#endif
+    return "pread";
+}
@@ -21,25 +21,11 @@
  */
 
 #include "o65file.h"
+#include "o65stats.h"
 #include <string.h>
 #include <stdlib.h>
-
-uint16_t o65_read_uint16(const uint8_t *buf)
-{
-    return buf[0] | (((uint16_t)(buf[1])) << 8);
-}
-
-uint32_t o65_read_uint24(const uint8_t *buf)
-{
-    return buf[0] | (((uint32_t)(buf[1])) << 8) |
-           (((uint32_t)(buf[2])) << 16);
-}
-
-uint32_t o65_read_uint32(const uint8_t *buf)
-{
-    return buf[0] | (((uint32_t)(buf[1])) << 8) |
-           (((uint32_t)(buf[2])) << 16) | (((uint32_t)(buf[3])) << 24);
-}
+#include <sys/stat.h>
+#include <unistd.h>
 
 int o65_read_header(FILE *file, o65_header_t *header)
 {
@@ -48,6 +34,7 @@ int o65_read_header(FILE *file, o65_header_t *header)
     /* Read the first 8 bytes and byte-swap the mode field */
     if (fread(buf, 1, 8, file) != 8)
         return -1;
+    O65_STATS_ADD(O65_STAT_BYTES_READ, 8);
     header->mode = o65_read_uint16(buf + 6);
 
     /* Verify the magic number */
@@ -69,6 +56,7 @@ int o65_read_header(FILE *file, o65_header_t *header)
         /* 16-bit fields */
         if (fread(buf, 1, 18, file) != 18)
             return -1;
+        O65_STATS_ADD(O65_STAT_BYTES_READ, 18);
         header->tbase = o65_read_uint16(buf);
         header->tlen  = o65_read_uint16(buf + 2);
         header->dbase = o65_read_uint16(buf + 4);
@@ -82,6 +70,7 @@ int o65_read_header(FILE *file, o65_header_t *header)
         /* 32-bit fields */
         if (fread(buf, 1, 36, file) != 36)
             return -1;
+        O65_STATS_ADD(O65_STAT_BYTES_READ, 36);
         header->tbase = o65_read_uint32(buf);
         header->tlen  = o65_read_uint32(buf + 4);
         header->dbase = o65_read_uint32(buf + 8);
@@ -107,6 +96,7 @@ int o65_read_option(FILE *file, o65_option_t *option)
         return -1;
 
     /* If the length is zero, then there are no more options */
+    O65_STATS_ADD(O65_STAT_BYTES_READ, 1);
     if (ch == 0)
         return 1;
 
@@ -126,76 +116,205 @@ int o65_read_option(FILE *file, o65_option_t *option)
         if (fread(option->data, 1, ch, file) != (size_t)ch)
             return -1;
     }
+    O65_STATS_ADD(O65_STAT_BYTES_READ, option->len - 1);
+    O65_STATS_ADD(O65_STAT_OPTIONS, 1);
     return 1;
 }
 
-int o65_read_reloc
-    (FILE *file, const o65_header_t *header, o65_reloc_t *reloc)
+/**
+ * @brief Counts the bytes and type of a relocation that was just read.
+ *
+ * @param[in] is32 Non-zero if the image uses 32-bit sizes.
+ * @param[in] paged Non-zero if the image uses page alignment.
+ * @param[in] reloc The relocation that was read.
+ */
+static void o65_stats_reloc(int is32, int paged, const o65_reloc_t *reloc)
 {
-    int ch;
-
-    /* Clear the relocation details in case of error */
-    reloc->offset = 0;
-    reloc->type = 0;
-    reloc->extra = 0;
-    reloc->undefid = 0;
-
-    /* Read the relocation offset */
-    if ((ch = fgetc(file)) == EOF)
-        return -1;
-    reloc->offset = (uint8_t)ch;
+    uint64_t size = 2;
+    if ((reloc->type & O65_RELOC_SEGID) == O65_SEGID_UNDEF)
+        size += is32 ? 4 : 2;
+    switch (reloc->type & O65_RELOC_TYPE) {
+    case O65_RELOC_WORD:
+        O65_STATS_COUNTER_ADD(O65_STAT_RELOC_WORD, 1);
+        break;
 
-    /* Zero for the end of the table, 255 for a skip-ahead entry */
-    if (ch == 0 || ch == 255)
-        return 1;
+    case O65_RELOC_HIGH:
+        if (!paged)
+            ++size;
+        O65_STATS_COUNTER_ADD(O65_STAT_RELOC_HIGH, 1);
+        break;
 
-    /* Read the type/segment byte */
-    if ((ch = fgetc(file)) == EOF)
-        return -1;
-    reloc->type = (uint8_t)ch;
-
-    /* Undefined relocations are followed by the index of the external symbol */
-    if ((reloc->type & O65_RELOC_SEGID) == O65_SEGID_UNDEF) {
-        int size = ((header->mode & O65_MODE_32BIT) == 0) ? 2 : 4;
-        int bit = 0;
-        while (size > 0) {
-            if ((ch = fgetc(file)) == EOF)
-                return -1;
-            reloc->undefid |= (((uint32_t)(ch & 0xFF)) << bit);
-            --size;
-            bit += 8;
-        }
-    }
+    case O65_RELOC_LOW:
+        O65_STATS_COUNTER_ADD(O65_STAT_RELOC_LOW, 1);
+        break;
 
-    /* Determine if we need to read any extra details */
-    switch (reloc->type & O65_RELOC_TYPE) {
-    case O65_RELOC_HIGH:
-        if ((header->mode & O65_MODE_PAGED) == 0) {
-            /* Need the low byte of the HIGH relocation from the file */
-            if ((ch = fgetc(file)) == EOF)
-                return -1;
-            reloc->extra = (uint8_t)ch;
-        }
+    case O65_RELOC_SEGADR:
+        O65_STATS_COUNTER_ADD(O65_STAT_RELOC_SEGADR, 1);
         break;
 
     case O65_RELOC_SEG:
-        /* Need the lower two bytes of the SEG relocation from the file */
-        if ((ch = fgetc(file)) == EOF)
-            return -1;
-        reloc->extra = (uint8_t)ch;
-        if ((ch = fgetc(file)) == EOF)
-            return -1;
-        reloc->extra |= (uint16_t)(ch << 8);
+        size += 2;
+        O65_STATS_COUNTER_ADD(O65_STAT_RELOC_SEG, 1);
         break;
 
-    default: break;
+    default:
+        O65_STATS_COUNTER_ADD(O65_STAT_RELOC_OTHER, 1);
+        break;
     }
-    return 1;
+    O65_STATS_COUNTER_ADD(O65_STAT_BYTES_READ, size);
+}
+
+/*
+ * Generates the relocation and count decoders for one combination of
+ * the O65_MODE_32BIT and O65_MODE_PAGED flags.  The flags are passed in
+ * as constants so that the compiler folds away the mode tests, leaving
+ * a decoder with no per-entry branching on the header mode.
+ */
+#define O65_DECODER(suffix, is32, paged) \
+static int o65_read_reloc_##suffix(FILE *file, o65_reloc_t *reloc) \
+{ \
+    uint8_t buf[4]; \
+    int ch; \
+    \
+    /* Clear the relocation details in case of error */ \
+    reloc->offset = 0; \
+    reloc->type = 0; \
+    reloc->extra = 0; \
+    reloc->undefid = 0; \
+    \
+    /* Read the relocation offset */ \
+    if ((ch = getc(file)) == EOF) \
+        return -1; \
+    reloc->offset = (uint8_t)ch; \
+    \
+    /* Zero for the end of the table, 255 for a skip-ahead entry */ \
+    if (ch == 0 || ch == 255) { \
+        O65_STATS_ADD(O65_STAT_BYTES_READ, 1); \
+        if (ch == 255) \
+            O65_STATS_ADD(O65_STAT_RELOC_SKIP, 1); \
+        return 1; \
+    } \
+    \
+    /* Read the type/segment byte */ \
+    if ((ch = getc(file)) == EOF) \
+        return -1; \
+    reloc->type = (uint8_t)ch; \
+    \
+    /* Undefined relocations are followed by the index of the symbol */ \
+    if ((reloc->type & O65_RELOC_SEGID) == O65_SEGID_UNDEF) { \
+        if (is32) { \
+            if (fread(buf, 1, 4, file) != 4) \
+                return -1; \
+            reloc->undefid = o65_read_uint32(buf); \
+        } else { \
+            if (fread(buf, 1, 2, file) != 2) \
+                return -1; \
+            reloc->undefid = o65_read_uint16(buf); \
+        } \
+    } \
+    \
+    /* Determine if we need to read any extra details */ \
+    switch (reloc->type & O65_RELOC_TYPE) { \
+    case O65_RELOC_HIGH: \
+        if (!(paged)) { \
+            /* Need the low byte of the HIGH relocation from the file */ \
+            if ((ch = getc(file)) == EOF) \
+                return -1; \
+            reloc->extra = (uint8_t)ch; \
+        } \
+        break; \
+    \
+    case O65_RELOC_SEG: \
+        /* Need the lower two bytes of the SEG relocation from the file */ \
+        if (fread(buf, 1, 2, file) != 2) \
+            return -1; \
+        reloc->extra = o65_read_uint16(buf); \
+        break; \
+    \
+    default: break; \
+    } \
+    if (O65_STATS_ON()) \
+        o65_stats_reloc((is32), (paged), reloc); \
+    return 1; \
+} \
+static int o65_read_count_##suffix(FILE *file, o65_size_t *count) \
+{ \
+    uint8_t buf[4]; \
+    if (is32) { \
+        if (fread(buf, 1, 4, file) != 4) \
+            return -1; \
+        O65_STATS_ADD(O65_STAT_BYTES_READ, 4); \
+        *count = o65_read_uint32(buf); \
+    } else { \
+        if (fread(buf, 1, 2, file) != 2) \
+            return -1; \
+        O65_STATS_ADD(O65_STAT_BYTES_READ, 2); \
+        *count = o65_read_uint16(buf); \
+    } \
+    return 1; \
+}
+
+O65_DECODER(16, 0, 0)
+O65_DECODER(16_paged, 0, 1)
+O65_DECODER(32, 1, 0)
+O65_DECODER(32_paged, 1, 1)
+
+/* Decoder tables, indexed by the 32-bit flag and then the paged flag */
+static const o65_decoder_t o65_decoders[4] = {
+    {o65_read_reloc_16,       o65_read_count_16},
+    {o65_read_reloc_16_paged, o65_read_count_16_paged},
+    {o65_read_reloc_32,       o65_read_count_32},
+    {o65_read_reloc_32_paged, o65_read_count_32_paged}
+};
+
+const o65_decoder_t *o65_get_decoder(const o65_header_t *header)
+{
+    unsigned index = 0;
+    if ((header->mode & O65_MODE_32BIT) != 0)
+        index += 2;
+    if ((header->mode & O65_MODE_PAGED) != 0)
+        index += 1;
+    return &(o65_decoders[index]);
+}
+
+int o65_read_reloc
+    (FILE *file, const o65_header_t *header, o65_reloc_t *reloc)
+{
+    return o65_get_decoder(header)->read_reloc(file, reloc);
+}
+
+int o65_check_remaining(FILE *file, uint64_t size)
+{
+    struct stat st;
+    long posn;
+    long end;
+    int fd;
+
+    /* Find the current position; the file isn't seekable if this fails */
+    posn = ftell(file);
+    if (posn < 0)
+        return 1;
+
+    /* Regular files can get the length from the filesystem cheaply */
+    fd = fileno(file);
+    if (fd >= 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+        return ((uint64_t)(st.st_size)) >= ((uint64_t)posn) + size;
+
+    /* Otherwise seek to the end and back; e.g. for fmemopen() streams */
+    if (fseek(file, 0, SEEK_END) < 0)
+        return 1;
+    end = ftell(file);
+    if (fseek(file, posn, SEEK_SET) < 0 || end < 0)
+        return 1;
+    return ((uint64_t)end) >= ((uint64_t)posn) + size;
 }
 
 int o65_read_segment(FILE *file, uint8_t **data, o65_size_t size)
 {
     if (size) {
+        *data = NULL;
+        if (!o65_check_remaining(file, size))
+            return 0;
         *data = (uint8_t *)malloc(size);
         if (!(*data))
             return -1;
@@ -203,6 +322,7 @@ int o65_read_segment(FILE *file, uint8_t **data, o65_size_t size)
             free(*data);
             return -1;
         }
+        O65_STATS_ADD(O65_STAT_BYTES_READ, size);
         return 1;
     } else {
         *data = NULL;
@@ -212,17 +332,7 @@ int o65_read_segment(FILE *file, uint8_t **data, o65_size_t size)
 
 int o65_read_count(FILE *file, const o65_header_t *header, o65_size_t *count)
 {
-    uint8_t buf[4];
-    if ((header->mode & O65_MODE_32BIT) == 0) {
-        if (fread(buf, 1, 2, file) != 2)
-            return -1;
-        *count = o65_read_uint16(buf);
-    } else {
-        if (fread(buf, 1, 4, file) != 2)
-            return -1;
-        *count = o65_read_uint32(buf);
-    }
-    return 1;
+    return o65_get_decoder(header)->read_count(file, count);
 }
 
 int o65_read_string(FILE *file, char *str, size_t max_size)
@@ -241,7 +351,191 @@ int o65_read_string(FILE *file, char *str, size_t max_size)
         } else {
             truncated = 1;
         }
+        O65_STATS_ADD(O65_STAT_BYTES_READ, 1);
     }
+    O65_STATS_ADD(O65_STAT_BYTES_READ, 1);
     str[posn] = '\0';
     return truncated ? 0 : 1;
 }
+
+void o65_string_table_init(o65_string_table_t *table)
+{
+    memset(table, 0, sizeof(o65_string_table_t));
+}
+
+void o65_string_table_free(o65_string_table_t *table)
+{
+    free(table->buf);
+    free(table->names);
+    o65_string_table_init(table);
+}
+
+/**
+ * @brief Makes sure that there is room for more bytes in a string table.
+ *
+ * @param[in,out] table The string table.
+ * @param[in] size Number of bytes that are needed.
+ *
+ * @return Non-zero on success, or zero if out of memory.
+ */
+static int o65_string_table_reserve(o65_string_table_t *table, size_t size)
+{
+    size_t new_max;
+    char *new_buf;
+    if (size <= (table->buf_max - table->buf_len))
+        return 1;
+    new_max = table->buf_max ? table->buf_max : 4096;
+    while (size > (new_max - table->buf_len)) {
+        if (new_max > (((size_t)-1) / 2))
+            return 0;
+        new_max *= 2;
+    }
+    new_buf = (char *)realloc(table->buf, new_max);
+    if (!new_buf)
+        return 0;
+    table->buf = new_buf;
+    table->buf_max = new_max;
+    return 1;
+}
+
+int o65_read_string_table
+    (FILE *file, o65_size_t count, o65_string_table_t *table)
+{
+    size_t name_start = 0;
+    size_t posn = 0;
+    size_t len;
+    o65_size_t index;
+    const char *nul;
+    int seekable;
+    int ch;
+
+    /* Every name needs at least one byte, so check the count is sane
+     * before we allocate memory based on it */
+    table->buf_len = 0;
+    table->count = 0;
+    if (count == 0)
+        return 1;
+    if (!o65_check_remaining(file, count))
+        return 0;
+    if (count > table->max_count) {
+        o65_string_view_t *names = (o65_string_view_t *)realloc
+            (table->names, count * sizeof(o65_string_view_t));
+        if (!names)
+            return -1;
+        table->names = names;
+        table->max_count = count;
+    }
+
+    /* Read the names in blocks if we can give back the extra bytes later.
+     * Otherwise we have to read the names a byte at a time */
+    seekable = (ftell(file) >= 0);
+    while (table->count < count) {
+        /* Find the next terminator in the bytes we already have */
+        if (posn < table->buf_len) {
+            nul = (const char *)memchr
+                (table->buf + posn, '\0', table->buf_len - posn);
+            if (nul) {
+                posn = (size_t)(nul - table->buf) + 1;
+                table->names[table->count].len = posn - 1 - name_start;
+                (table->count)++;
+                name_start = posn;
+                continue;
+            }
+            posn = table->buf_len;
+        }
+
+        /* Read more data into the buffer */
+        if (seekable) {
+            if (!o65_string_table_reserve(table, 4096))
+                return -1;
+            len = fread(table->buf + table->buf_len, 1,
+                        table->buf_max - table->buf_len, file);
+            if (len == 0)
+                return -1;
+            table->buf_len += len;
+        } else {
+            if (!o65_string_table_reserve(table, 1))
+                return -1;
+            if ((ch = getc(file)) == EOF)
+                return -1;
+            table->buf[(table->buf_len)++] = (char)ch;
+        }
+    }
+
+    /* Give back the bytes that we read past the end of the last name */
+    if (posn < table->buf_len) {
+        if (fseek(file, -((long)(table->buf_len - posn)), SEEK_CUR) < 0)
+            return -1;
+        table->buf_len = posn;
+    }
+    O65_STATS_ADD(O65_STAT_BYTES_READ, posn);
+
+    /* The buffer has stopped moving, so we can now point at the names */
+    name_start = 0;
+    for (index = 0; index < count; ++index) {
+        table->names[index].name = table->buf + name_start;
+        name_start += table->names[index].len + 1;
+    }
+    return 1;
+}
+
+int o65_read_all(FILE *file, uint8_t **data, size_t *size)
+{
+    uint8_t *buf = NULL;
+    uint8_t *new_buf;
+    size_t len = 0;
+    size_t max_len = 0;
+    size_t n;
+
+    for (;;) {
+        if (len >= max_len) {
+            max_len = max_len ? max_len * 2 : 65536;
+            if ((new_buf = realloc(buf, max_len)) == NULL) {
+                free(buf);
+                return -1;
+            }
+            buf = new_buf;
+        }
+        n = fread(buf + len, 1, max_len - len, file);
+        if (n == 0)
+            break;
+        len += n;
+    }
+    if (ferror(file)) {
+        free(buf);
+        return -1;
+    }
+    *data = buf;
+    *size = len;
+    return 1;
+}
+
+FILE *o65_fopen_input(const char *filename, uint8_t **buffer)
+{
+    size_t size;
+    FILE *file;
+    int fd;
+
+    *buffer = NULL;
+    if (strcmp(filename, "-") != 0)
+        return fopen(filename, "rb");
+
+    /* Use a duplicate of a seekable standard input so that the caller
+     * can close it in the same way as any other file */
+    if (lseek(STDIN_FILENO, 0, SEEK_CUR) >= 0) {
+        if ((fd = dup(STDIN_FILENO)) < 0)
+            return NULL;
+        if ((file = fdopen(fd, "rb")) == NULL)
+            close(fd);
+        return file;
+    }
+
+    /* Pipes and terminals are read into memory first */
+    if (o65_read_all(stdin, buffer, &size) < 0)
+        return NULL;
+    if ((file = fmemopen(*buffer, size, "rb")) == NULL) {
+        free(*buffer);
+        *buffer = NULL;
+    }
+    return file;
+}
@@ -0,0 +1,471 @@
+/*
+ * Copyright (C) 2023 Southern Storm Software, Pty Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "o65stats.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Number of events in each per-thread ring buffer; must be a power of 2 */
+#define TRACE_RING_SIZE 65536
+
+/* Name offset for events that are not associated with a file */
+#define TRACE_NO_NAME ((size_t)-1)
+
+/* Spans can end on several threads at once, so the shared state is
+ * updated with the GNU atomic builtins.  Other compilers always build
+ * with O65_NO_STATS (see o65stats.h), which means that nothing is ever
+ * recorded, and plain loads and stores will do. */
+#if defined(__GNUC__)
+#define STATS_LOAD(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define STATS_STORE(ptr, value) \
+    __atomic_store_n((ptr), (value), __ATOMIC_RELEASE)
+#define STATS_ADD(ptr, n) __atomic_add_fetch((ptr), (n), __ATOMIC_RELAXED)
+#define STATS_CAS(ptr, expected, desired) \
+    __atomic_compare_exchange_n((ptr), (expected), (desired), 1, \
+                                __ATOMIC_RELEASE, __ATOMIC_RELAXED)
+#else
+#define STATS_LOAD(ptr) (*(ptr))
+#define STATS_STORE(ptr, value) ((void)(*(ptr) = (value)))
+#define STATS_ADD(ptr, n) (*(ptr) += (n))
+#define STATS_CAS(ptr, expected, desired) ((*(ptr) = (desired)), 1)
+#endif
+
+unsigned o65_stats_flags = 0;
+uint64_t o65_stats_counters[O65_STAT_COUNT];
+O65_THREAD_LOCAL uint64_t *o65_stats_thread_counters = NULL;
+
+/** Accumulated information about a span */
+typedef struct
+{
+    uint64_t count;     /**< Number of times the span was recorded */
+    uint64_t total;     /**< Total time in nanoseconds */
+
+} o65_span_info_t;
+
+/** Span event that was recorded for the trace file */
+typedef struct
+{
+    uint64_t start;     /**< Start time in nanoseconds */
+    uint64_t duration;  /**< Duration in nanoseconds */
+    size_t name;        /**< Offset of the file name in the name pool */
+    o65_span_t span;    /**< Type of span */
+
+} o65_trace_event_t;
+
+/** Per-thread buffer of span events */
+typedef struct o65_trace_buffer_s
+{
+    struct o65_trace_buffer_s *next;    /**< Next buffer in the global list */
+    unsigned tid;                       /**< Thread identifier for the trace */
+    uint64_t head;                      /**< Number of events ever recorded */
+    char *names;                        /**< Pool of file names */
+    size_t names_len;                   /**< Length of the name pool */
+    size_t names_max;                   /**< Maximum length of the name pool */
+    size_t last_name;                   /**< Offset of the last name added */
+    o65_trace_event_t events[TRACE_RING_SIZE]; /**< Ring buffer of events */
+
+} o65_trace_buffer_t;
+
+static o65_span_info_t span_info[O65_SPAN_COUNT];
+static uint64_t start_time;
+static const char *trace_filename = NULL;
+static o65_trace_buffer_t *trace_buffers = NULL;
+static unsigned trace_next_tid = 0;
+static O65_THREAD_LOCAL o65_trace_buffer_t *trace_buffer = NULL;
+
+static const char * const counter_names[O65_STAT_COUNT] = {
+    "bytes_read",
+    "bytes_written",
+    "options",
+    "reloc_word",
+    "reloc_high",
+    "reloc_low",
+    "reloc_segadr",
+    "reloc_seg",
+    "reloc_other",
+    "reloc_skip",
+    "externs_resolved",
+    "bytes_trimmed",
+    "prelinked"
+};
+
+static const char * const span_names[O65_SPAN_COUNT] = {
+    "file",
+    "open",
+    "header",
+    "options",
+    "segments",
+    "externs",
+    "relocs",
+    "exports",
+    "write"
+};
+
+void o65_stats_enable(unsigned flags)
+{
+    o65_stats_flags = flags;
+    memset(o65_stats_counters, 0, sizeof(o65_stats_counters));
+    memset(span_info, 0, sizeof(span_info));
+    start_time = o65_stats_now();
+}
+
+void o65_stats_redirect(uint64_t *counters)
+{
+    if (counters)
+        memset(counters, 0, O65_STAT_COUNT * sizeof(uint64_t));
+    o65_stats_thread_counters = counters;
+}
+
+void o65_stats_merge(const uint64_t *counters)
+{
+    int index;
+    for (index = 0; index < O65_STAT_COUNT; ++index)
+        o65_stats_counters[index] += counters[index];
+}
+
+uint64_t o65_stats_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)(ts.tv_sec)) * 1000000000U + (uint64_t)(ts.tv_nsec);
+}
+
+/**
+ * @brief Writes a string to a file as a quoted JSON string.
+ *
+ * @param[in] file The file to write to.
+ * @param[in] str The string to write.
+ */
+static void write_json_string(FILE *file, const char *str)
+{
+    putc('"', file);
+    while (*str != '\0') {
+        int ch = (unsigned char)(*str++);
+        if (ch == '"' || ch == '\\')
+            fprintf(file, "\\%c", ch);
+        else if (ch < 0x20)
+            fprintf(file, "\\u%04x", ch);
+        else
+            putc(ch, file);
+    }
+    putc('"', file);
+}
+
+/**
+ * @brief Gets the trace buffer for the current thread, creating it if necessary.
+ *
+ * @return A pointer to the buffer, or NULL if out of memory.
+ *
+ * New buffers are pushed onto the global list with a compare-and-swap,
+ * so threads never block each other while recording events.
+ */
+static o65_trace_buffer_t *get_trace_buffer(void)
+{
+    o65_trace_buffer_t *buffer = trace_buffer;
+    if (buffer)
+        return buffer;
+    buffer = calloc(1, sizeof(o65_trace_buffer_t));
+    if (!buffer)
+        return NULL;
+    buffer->tid = STATS_ADD(&trace_next_tid, 1);
+    buffer->last_name = TRACE_NO_NAME;
+    buffer->next = STATS_LOAD(&trace_buffers);
+    while (!STATS_CAS(&trace_buffers, &(buffer->next), buffer)) {
+        /* Try again with the new list head in buffer->next */
+    }
+    trace_buffer = buffer;
+    return buffer;
+}
+
+/**
+ * @brief Adds a file name to the name pool of a trace buffer.
+ *
+ * @param[in,out] buffer The trace buffer.
+ * @param[in] name The name to add, or NULL.
+ *
+ * @return The offset of the name in the pool, or TRACE_NO_NAME.
+ *
+ * Consecutive spans for the same file share the same copy of the name.
+ */
+static size_t add_trace_name(o65_trace_buffer_t *buffer, const char *name)
+{
+    size_t len;
+    size_t offset;
+    if (!name)
+        return TRACE_NO_NAME;
+    if (buffer->last_name != TRACE_NO_NAME &&
+            !strcmp(buffer->names + buffer->last_name, name)) {
+        return buffer->last_name;
+    }
+    len = strlen(name) + 1;
+    if ((buffer->names_len + len) > buffer->names_max) {
+        size_t new_max = buffer->names_max ? buffer->names_max * 2 : 4096;
+        char *new_names;
+        while ((buffer->names_len + len) > new_max)
+            new_max *= 2;
+        new_names = realloc(buffer->names, new_max);
+        if (!new_names)
+            return TRACE_NO_NAME;
+        buffer->names = new_names;
+        buffer->names_max = new_max;
+    }
+    offset = buffer->names_len;
+    memcpy(buffer->names + offset, name, len);
+    buffer->names_len += len;
+    buffer->last_name = offset;
+    return offset;
+}
+
+/**
+ * @brief Records a span event in the trace buffer for the current thread.
+ *
+ * @param[in] span The span that ended.
+ * @param[in] start The start time of the span.
+ * @param[in] end The end time of the span.
+ * @param[in] name Name of the file being processed, or NULL.
+ *
+ * If the ring buffer is full, the oldest event is overwritten.
+ */
+static void record_trace_event
+    (o65_span_t span, uint64_t start, uint64_t end, const char *name)
+{
+    o65_trace_buffer_t *buffer = get_trace_buffer();
+    o65_trace_event_t *event;
+    if (!buffer)
+        return;
+    event = &(buffer->events[buffer->head & (TRACE_RING_SIZE - 1)]);
+    event->start = start;
+    event->duration = end - start;
+    event->name = add_trace_name(buffer, name);
+    event->span = span;
+    STATS_STORE(&(buffer->head), buffer->head + 1);
+}
+
+void o65_stats_span_end(o65_span_t span, uint64_t start, const char *name)
+{
+    uint64_t end = o65_stats_now();
+    STATS_ADD(&(span_info[span].count), 1);
+    STATS_ADD(&(span_info[span].total), end - start);
+    if (o65_stats_flags & O65_STATS_EVENTS)
+        record_trace_event(span, start, end, name);
+    if (o65_stats_flags & O65_STATS_TRACE) {
+        if (o65_stats_flags & O65_STATS_JSON) {
+            fprintf(stderr, "{\"span\": \"%s\", \"start_us\": %.3f, \"dur_us\": %.3f",
+                    span_names[span], (start - start_time) / 1000.0,
+                    (end - start) / 1000.0);
+            if (name) {
+                fprintf(stderr, ", \"file\": ");
+                write_json_string(stderr, name);
+            }
+            fprintf(stderr, "}\n");
+        } else {
+            fprintf(stderr, "trace: %-8s %12.3f us", span_names[span],
+                    (end - start) / 1000.0);
+            if (name)
+                fprintf(stderr, "  %s", name);
+            fprintf(stderr, "\n");
+        }
+    }
+}
+
+/** Reference to an event in a trace buffer, for sorting */
+typedef struct
+{
+    const o65_trace_buffer_t *buffer;   /**< Buffer containing the event */
+    const o65_trace_event_t *event;     /**< The event */
+
+} o65_trace_ref_t;
+
+/**
+ * @brief Compares two trace events by start time.
+ *
+ * @param[in] e1 The first event reference.
+ * @param[in] e2 The second event reference.
+ *
+ * @return -1, 0, or 1 depending upon the order of the events.
+ */
+static int compare_trace_ref(const void *e1, const void *e2)
+{
+    const o65_trace_event_t *ev1 = ((const o65_trace_ref_t *)e1)->event;
+    const o65_trace_event_t *ev2 = ((const o65_trace_ref_t *)e2)->event;
+    if (ev1->start < ev2->start)
+        return -1;
+    else if (ev1->start > ev2->start)
+        return 1;
+    else if (ev1->duration > ev2->duration)
+        return -1; /* Enclosing spans come first */
+    else if (ev1->duration < ev2->duration)
+        return 1;
+    return 0;
+}
+
+/**
+ * @brief Merges the per-thread trace buffers and writes the trace file.
+ */
+static void write_trace_file(void)
+{
+    o65_trace_buffer_t *buffer;
+    o65_trace_ref_t *refs;
+    size_t num_refs = 0;
+    size_t index;
+    uint64_t dropped = 0;
+    uint64_t head, count;
+    FILE *file;
+    int pid;
+
+    /* Collect the events from all of the ring buffers */
+    buffer = STATS_LOAD(&trace_buffers);
+    for (; buffer; buffer = buffer->next) {
+        head = STATS_LOAD(&(buffer->head));
+        num_refs += head < TRACE_RING_SIZE ? head : TRACE_RING_SIZE;
+    }
+    refs = calloc(num_refs ? num_refs : 1, sizeof(o65_trace_ref_t));
+    if (!refs) {
+        perror(trace_filename);
+        return;
+    }
+    num_refs = 0;
+    buffer = STATS_LOAD(&trace_buffers);
+    for (; buffer; buffer = buffer->next) {
+        head = STATS_LOAD(&(buffer->head));
+        count = head < TRACE_RING_SIZE ? head : TRACE_RING_SIZE;
+        dropped += head - count;
+        for (; count > 0; --count) {
+            refs[num_refs].buffer = buffer;
+            refs[num_refs].event =
+                &(buffer->events[(head - count) & (TRACE_RING_SIZE - 1)]);
+            ++num_refs;
+        }
+    }
+    qsort(refs, num_refs, sizeof(o65_trace_ref_t), compare_trace_ref);
+
+    /* Write the events in the Chrome trace event format */
+    if ((file = fopen(trace_filename, "w")) == NULL) {
+        perror(trace_filename);
+        free(refs);
+        return;
+    }
+    pid = (int)getpid();
+    fprintf(file, "{\"displayTimeUnit\": \"ns\", "
+                  "\"otherData\": {\"dropped_events\": %llu}, "
+                  "\"traceEvents\": [\n",
+            (unsigned long long)dropped);
+    fprintf(file, "{\"name\": \"process_name\", \"ph\": \"M\", "
+                  "\"pid\": %d, \"args\": {\"name\": \"o65\"}}",
+            pid);
+    buffer = STATS_LOAD(&trace_buffers);
+    for (; buffer; buffer = buffer->next) {
+        fprintf(file, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", "
+                      "\"pid\": %d, \"tid\": %u, "
+                      "\"args\": {\"name\": \"thread %u\"}}",
+                pid, buffer->tid, buffer->tid);
+    }
+    for (index = 0; index < num_refs; ++index) {
+        const o65_trace_event_t *event = refs[index].event;
+        fprintf(file, ",\n{\"name\": \"%s\", \"cat\": \"o65\", \"ph\": \"X\", "
+                      "\"ts\": %.3f, \"dur\": %.3f, \"pid\": %d, \"tid\": %u",
+                span_names[event->span],
+                (event->start - start_time) / 1000.0,
+                event->duration / 1000.0, pid, refs[index].buffer->tid);
+        if (event->name != TRACE_NO_NAME) {
+            fprintf(file, ", \"args\": {\"file\": ");
+            write_json_string(file, refs[index].buffer->names + event->name);
+            fprintf(file, "}");
+        }
+        fprintf(file, "}");
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+    free(refs);
+    if (dropped != 0) {
+        fprintf(stderr, "%s: %llu oldest events were dropped\n",
+                trace_filename, (unsigned long long)dropped);
+    }
+}
+
+void o65_stats_report(FILE *file)
+{
+    uint64_t total;
+    int index;
+
+    /* Write the trace file if one was requested */
+    if (trace_filename && (o65_stats_flags & O65_STATS_EVENTS))
+        write_trace_file();
+
+    /* Bail out if we don't need to report anything else */
+    if (!(o65_stats_flags & O65_STATS_SUMMARY))
+        return;
+    total = o65_stats_now() - start_time;
+
+    /* Report the counters and spans in the requested format */
+    if (o65_stats_flags & O65_STATS_JSON) {
+        fprintf(file, "{\n    \"total_us\": %.3f,\n    \"counters\": {\n",
+                total / 1000.0);
+        for (index = 0; index < O65_STAT_COUNT; ++index) {
+            fprintf(file, "        \"%s\": %llu%s\n", counter_names[index],
+                    (unsigned long long)(o65_stats_counters[index]),
+                    (index + 1) < O65_STAT_COUNT ? "," : "");
+        }
+        fprintf(file, "    },\n    \"spans\": {\n");
+        for (index = 0; index < O65_SPAN_COUNT; ++index) {
+            fprintf(file, "        \"%s\": {\"count\": %llu, \"total_us\": %.3f}%s\n",
+                    span_names[index],
+                    (unsigned long long)(span_info[index].count),
+                    span_info[index].total / 1000.0,
+                    (index + 1) < O65_SPAN_COUNT ? "," : "");
+        }
+        fprintf(file, "    }\n}\n");
+    } else {
+        fprintf(file, "Statistics:\n");
+        for (index = 0; index < O65_STAT_COUNT; ++index) {
+            fprintf(file, "    %-18s %llu\n", counter_names[index],
+                    (unsigned long long)(o65_stats_counters[index]));
+        }
+        fprintf(file, "\nTimings:\n");
+        for (index = 0; index < O65_SPAN_COUNT; ++index) {
+            if (span_info[index].count == 0)
+                continue;
+            fprintf(file, "    %-18s %12.3f us in %llu spans\n",
+                    span_names[index], span_info[index].total / 1000.0,
+                    (unsigned long long)(span_info[index].count));
+        }
+        fprintf(file, "    %-18s %12.3f us\n", "total", total / 1000.0);
+    }
+}
+
+void o65_stats_trace_file(const char *filename)
+{
+    trace_filename = filename;
+    o65_stats_enable(o65_stats_flags | O65_STATS_EVENTS);
+}
+
+int o65_stats_option(const char *format, unsigned flags)
+{
+    if (format && !strcmp(format, "json"))
+        flags |= O65_STATS_JSON;
+    else if (format && strcmp(format, "text") != 0)
+        return 0;
+    o65_stats_enable(o65_stats_flags | flags);
+    return 1;
+}
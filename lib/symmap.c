@@ -0,0 +1,257 @@
+/*
+ * Copyright (C) 2023 Southern Storm Software, Pty Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "o65symmap.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Magic number at the start of a symbol map */
+static const uint8_t o65_symmap_magic[8] =
+    {'o', '6', '5', 's', 'm', 'a', 'p', 0x1A};
+
+struct o65_symmap_s
+{
+    const uint8_t *data;        /**< Mapped contents of the symbol map */
+    size_t size;                /**< Size of the symbol map */
+    const uint8_t *entries;     /**< Points to the symbol entries */
+    const char *names;          /**< Points to the symbol names */
+    size_t count;               /**< Number of symbols */
+};
+
+/**
+ * @brief Compares two symbols by address for sorting.
+ *
+ * @param[in] s1 Points to the first symbol.
+ * @param[in] s2 Points to the second symbol.
+ *
+ * @return Less than, equal to, or greater than zero.
+ *
+ * Symbols with the same address are ordered with the preferred
+ * symbol first: global before local, and then by name.
+ */
+static int o65_symmap_compare(const void *s1, const void *s2)
+{
+    const o65_symbol_t *sym1 = (const o65_symbol_t *)s1;
+    const o65_symbol_t *sym2 = (const o65_symbol_t *)s2;
+    if (sym1->image != sym2->image)
+        return sym1->image < sym2->image ? -1 : 1;
+    if (sym1->segid != sym2->segid)
+        return sym1->segid < sym2->segid ? -1 : 1;
+    if (sym1->offset != sym2->offset)
+        return sym1->offset < sym2->offset ? -1 : 1;
+    if ((sym1->flags ^ sym2->flags) & O65_SYMMAP_GLOBAL)
+        return (sym1->flags & O65_SYMMAP_GLOBAL) ? -1 : 1;
+    return strcmp(sym1->name, sym2->name);
+}
+
+/**
+ * @brief Determines if two symbols have the same address.
+ *
+ * @param[in] sym1 The first symbol.
+ * @param[in] sym2 The second symbol.
+ *
+ * @return Non-zero if the addresses are the same.
+ */
+static int o65_symmap_same_address
+    (const o65_symbol_t *sym1, const o65_symbol_t *sym2)
+{
+    return sym1->image == sym2->image && sym1->segid == sym2->segid &&
+           sym1->offset == sym2->offset;
+}
+
+int o65_symmap_write(FILE *file, o65_symbol_t *symbols, size_t count)
+{
+    uint8_t buf[O65_SYMMAP_HEADER_SIZE];
+    uint32_t name_offset = 0;
+    size_t num_written = 0;
+    size_t index;
+    size_t len;
+
+    /* Sort the symbols and count the unique addresses */
+    if (count > 0)
+        qsort(symbols, count, sizeof(o65_symbol_t), o65_symmap_compare);
+    for (index = 0; index < count; ++index) {
+        if (index == 0 ||
+                !o65_symmap_same_address(&(symbols[index - 1]),
+                                         &(symbols[index]))) {
+            ++num_written;
+        }
+    }
+
+    /* Write the header */
+    memcpy(buf, o65_symmap_magic, sizeof(o65_symmap_magic));
+    o65_write_uint32(buf + 8, O65_SYMMAP_VERSION);
+    o65_write_uint32(buf + 12, (uint32_t)num_written);
+    if (fwrite(buf, 1, O65_SYMMAP_HEADER_SIZE, file) != O65_SYMMAP_HEADER_SIZE)
+        return -1;
+
+    /* Write the symbol entries */
+    for (index = 0; index < count; ++index) {
+        const o65_symbol_t *symbol = &(symbols[index]);
+        if (index > 0 && o65_symmap_same_address(&(symbols[index - 1]), symbol))
+            continue;
+        o65_write_uint32(buf, symbol->offset);
+        o65_write_uint32(buf + 4, name_offset);
+        o65_write_uint16(buf + 8, symbol->image);
+        buf[10] = symbol->segid;
+        buf[11] = symbol->flags;
+        if (fwrite(buf, 1, O65_SYMMAP_ENTRY_SIZE, file) != O65_SYMMAP_ENTRY_SIZE)
+            return -1;
+        name_offset += (uint32_t)(strlen(symbol->name) + 1);
+    }
+
+    /* Write the names */
+    for (index = 0; index < count; ++index) {
+        const o65_symbol_t *symbol = &(symbols[index]);
+        if (index > 0 && o65_symmap_same_address(&(symbols[index - 1]), symbol))
+            continue;
+        len = strlen(symbol->name) + 1;
+        if (fwrite(symbol->name, 1, len, file) != len)
+            return -1;
+    }
+    return 0;
+}
+
+int o65_symmap_open(const char *filename, o65_symmap_t **map)
+{
+    const uint8_t *entry;
+    struct stat st;
+    size_t names_size;
+    size_t index;
+    void *data;
+    int fd;
+
+    /* Map the whole file into memory */
+    *map = NULL;
+    if ((fd = open(filename, O_RDONLY | O_CLOEXEC)) < 0)
+        return -1;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return -1;
+    }
+    if (!S_ISREG(st.st_mode) || st.st_size < O65_SYMMAP_HEADER_SIZE) {
+        close(fd);
+        return 0;
+    }
+    data = mmap(NULL, (size_t)(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return -1;
+    if ((*map = calloc(1, sizeof(o65_symmap_t))) == NULL) {
+        munmap(data, (size_t)(st.st_size));
+        return -1;
+    }
+    (*map)->data = (const uint8_t *)data;
+    (*map)->size = (size_t)(st.st_size);
+
+    /* Check the header and the bounds of the names.  The last name must
+     * be terminated, which means that every name is terminated. */
+    (*map)->count = o65_read_uint32((*map)->data + 12);
+    (*map)->entries = (*map)->data + O65_SYMMAP_HEADER_SIZE;
+    if (memcmp(data, o65_symmap_magic, sizeof(o65_symmap_magic)) != 0 ||
+            o65_read_uint32((*map)->data + 8) != O65_SYMMAP_VERSION ||
+            (*map)->count > ((*map)->size - O65_SYMMAP_HEADER_SIZE) /
+                                O65_SYMMAP_ENTRY_SIZE) {
+        o65_symmap_close(*map);
+        *map = NULL;
+        return 0;
+    }
+    (*map)->names = (const char *)
+        ((*map)->entries + (*map)->count * O65_SYMMAP_ENTRY_SIZE);
+    names_size = (*map)->size - O65_SYMMAP_HEADER_SIZE -
+                 (*map)->count * O65_SYMMAP_ENTRY_SIZE;
+    if ((*map)->count > 0 &&
+            (names_size == 0 || (*map)->names[names_size - 1] != '\0')) {
+        o65_symmap_close(*map);
+        *map = NULL;
+        return 0;
+    }
+    for (index = 0; index < (*map)->count; ++index) {
+        entry = (*map)->entries + index * O65_SYMMAP_ENTRY_SIZE;
+        if (o65_read_uint32(entry + 4) >= names_size) {
+            o65_symmap_close(*map);
+            *map = NULL;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void o65_symmap_close(o65_symmap_t *map)
+{
+    if (!map)
+        return;
+    munmap((void *)(map->data), map->size);
+    free(map);
+}
+
+size_t o65_symmap_count(const o65_symmap_t *map)
+{
+    return map->count;
+}
+
+void o65_symmap_get(const o65_symmap_t *map, size_t index,
+                    o65_symbol_t *symbol)
+{
+    const uint8_t *entry = map->entries + index * O65_SYMMAP_ENTRY_SIZE;
+    symbol->offset = o65_read_uint32(entry);
+    symbol->name = map->names + o65_read_uint32(entry + 4);
+    symbol->image = o65_read_uint16(entry + 8);
+    symbol->segid = entry[10];
+    symbol->flags = entry[11];
+}
+
+int o65_symmap_lookup(const o65_symmap_t *map, unsigned image, uint8_t segid,
+                      o65_size_t offset, o65_symbol_t *symbol)
+{
+    const uint8_t *entry;
+    uint64_t key = (((uint64_t)image) << 40) | (((uint64_t)segid) << 32) |
+                   offset;
+    uint64_t entry_key;
+    size_t left = 0;
+    size_t right = map->count;
+    size_t mid;
+
+    /* Find the first symbol whose address is greater than the key */
+    while (left < right) {
+        mid = left + (right - left) / 2;
+        entry = map->entries + mid * O65_SYMMAP_ENTRY_SIZE;
+        entry_key = (((uint64_t)o65_read_uint16(entry + 8)) << 40) |
+                    (((uint64_t)(entry[10])) << 32) |
+                    o65_read_uint32(entry);
+        if (entry_key <= key)
+            left = mid + 1;
+        else
+            right = mid;
+    }
+
+    /* The symbol before that one contains the address if it is in
+     * the same image and segment */
+    if (left == 0)
+        return 0;
+    o65_symmap_get(map, left - 1, symbol);
+    return symbol->image == image && symbol->segid == segid;
+}
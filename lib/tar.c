@@ -0,0 +1,353 @@
+/*
+ * Copyright (C) 2023 Southern Storm Software, Pty Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "o65tar.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Size of a block in a tar archive */
+#define O65_TAR_BLOCK 512
+
+/* Offsets and sizes of the fields in a ustar header block */
+#define O65_TAR_NAME        0
+#define O65_TAR_NAME_LEN    100
+#define O65_TAR_SIZE        124
+#define O65_TAR_SIZE_LEN    12
+#define O65_TAR_CHKSUM      148
+#define O65_TAR_CHKSUM_LEN  8
+#define O65_TAR_TYPEFLAG    156
+#define O65_TAR_MAGIC       257
+#define O65_TAR_PREFIX      345
+#define O65_TAR_PREFIX_LEN  155
+
+/* Member types that need special handling */
+#define O65_TAR_TYPE_FILE       '0'     /**< Regular file */
+#define O65_TAR_TYPE_OLD_FILE   '\0'    /**< Regular file, old format */
+#define O65_TAR_TYPE_CONTIG     '7'     /**< Contiguous file */
+#define O65_TAR_TYPE_PAX        'x'     /**< pax header for the next member */
+#define O65_TAR_TYPE_GNU_NAME   'L'     /**< GNU long name for next member */
+
+void o65_tar_init(o65_tar_t *tar, FILE *file)
+{
+    memset(tar, 0, sizeof(o65_tar_t));
+    tar->file = file;
+}
+
+void o65_tar_free(o65_tar_t *tar)
+{
+    free(tar->data);
+    tar->data = NULL;
+    tar->max_size = 0;
+}
+
+/**
+ * @brief Reads bytes from a tar archive.
+ *
+ * @param[in,out] tar The reader.
+ * @param[out] buf Buffer to read into, or NULL to discard the bytes.
+ * @param[in] size Number of bytes to read.
+ *
+ * @return 1 on success, or -1 for unexpected EOF or a filesystem error.
+ *
+ * Bytes are skipped by reading them rather than seeking, so that the
+ * archive can be read from a pipe.
+ */
+static int o65_tar_read(o65_tar_t *tar, uint8_t *buf, uint64_t size)
+{
+    uint8_t discard[O65_TAR_BLOCK * 8];
+    size_t len;
+    while (size > 0) {
+        len = size < sizeof(discard) ? (size_t)size : sizeof(discard);
+        if (fread(buf ? buf : discard, 1, len, tar->file) != len)
+            return -1;
+        tar->posn += len;
+        size -= len;
+        if (buf)
+            buf += len;
+    }
+    return 1;
+}
+
+/**
+ * @brief Parses a numeric field from a tar header.
+ *
+ * @param[in] field Points to the field.
+ * @param[in] len Length of the field.
+ * @param[out] value Returns the value.
+ *
+ * @return 1 if the value is valid, or 0 if it is not.
+ *
+ * Values are normally octal, but GNU tar uses base-256 with the high
+ * bit of the first byte set for values that are too large for octal.
+ */
+static int o65_tar_number(const uint8_t *field, size_t len, uint64_t *value)
+{
+    size_t posn = 0;
+    *value = 0;
+    if (field[0] & 0x80) {
+        if (field[0] & 0x40)
+            return 0; /* Negative */
+        *value = field[0] & 0x3F;
+        for (posn = 1; posn < len; ++posn) {
+            if (*value > (UINT64_MAX >> 8))
+                return 0;
+            *value = (*value << 8) | field[posn];
+        }
+        return 1;
+    }
+    while (posn < len && field[posn] == ' ')
+        ++posn;
+    while (posn < len && field[posn] >= '0' && field[posn] <= '7') {
+        *value = (*value << 3) | (uint64_t)(field[posn] - '0');
+        ++posn;
+    }
+    return posn >= len || field[posn] == ' ' || field[posn] == '\0';
+}
+
+/**
+ * @brief Checks the checksum on a tar header block.
+ *
+ * @param[in] block The header block.
+ *
+ * @return 1 if the checksum is correct, or 0 if it is not.
+ */
+static int o65_tar_checksum(const uint8_t *block)
+{
+    uint64_t expected;
+    uint32_t sum = 0;
+    size_t posn;
+    if (!o65_tar_number(block + O65_TAR_CHKSUM, O65_TAR_CHKSUM_LEN,
+                        &expected)) {
+        return 0;
+    }
+    for (posn = 0; posn < O65_TAR_BLOCK; ++posn) {
+        if (posn >= O65_TAR_CHKSUM &&
+                posn < (O65_TAR_CHKSUM + O65_TAR_CHKSUM_LEN))
+            sum += ' ';
+        else
+            sum += block[posn];
+    }
+    return sum == expected;
+}
+
+/**
+ * @brief Reads the data for a member into the reader's buffer.
+ *
+ * @param[in,out] tar The reader.
+ * @param[in] size Size of the member data.
+ *
+ * @return 1 on success, 0 if the member is too large, or -1 for
+ * unexpected EOF, a filesystem error, or out of memory.
+ *
+ * The padding up to the next block boundary is also consumed.  The
+ * buffer is always NUL-terminated for the benefit of the name parsers.
+ */
+static int o65_tar_read_data(o65_tar_t *tar, uint64_t size)
+{
+    uint64_t padded = (size + O65_TAR_BLOCK - 1) & ~((uint64_t)(O65_TAR_BLOCK - 1));
+    if (size > O65_TAR_SIZE_MAX) {
+        tar->error = "member is too large";
+        return 0;
+    }
+    if (tar->max_size <= size) {
+        size_t new_size = tar->max_size ? tar->max_size : 65536;
+        uint8_t *new_data;
+        while (new_size <= size)
+            new_size *= 2;
+        if ((new_data = realloc(tar->data, new_size)) == NULL)
+            return -1;
+        tar->data = new_data;
+        tar->max_size = new_size;
+    }
+    if (o65_tar_read(tar, tar->data, size) < 0)
+        return -1;
+    tar->data[size] = '\0';
+    return o65_tar_read(tar, NULL, padded - size);
+}
+
+/**
+ * @brief Applies the records from a pax extended header.
+ *
+ * @param[in,out] tar The reader, with the records in the data buffer.
+ * @param[in] len Length of the records.
+ * @param[out] name Set to non-zero if a "path" record was found.
+ * @param[out] have_size Set to non-zero if a "size" record was found.
+ * @param[out] size Set to the value of the "size" record.
+ *
+ * @return 1 if the records are valid, or 0 if they are not.
+ */
+static int o65_tar_pax
+    (o65_tar_t *tar, size_t len, int *name, int *have_size, uint64_t *size)
+{
+    const char *rec = (const char *)(tar->data);
+    const char *end = rec + len;
+    const char *key;
+    const char *value;
+    size_t rec_len;
+    size_t value_len;
+
+    while (rec < end) {
+        /* Each record is "LEN KEY=VALUE\n", where LEN includes itself */
+        rec_len = 0;
+        key = rec;
+        while (key < end && *key >= '0' && *key <= '9') {
+            rec_len = rec_len * 10 + (size_t)(*key - '0');
+            if (rec_len > len)
+                return 0;
+            ++key;
+        }
+        if (key >= end || *key != ' ' || rec_len > (size_t)(end - rec) ||
+                rec_len <= (size_t)(key + 1 - rec) ||
+                rec[rec_len - 1] != '\n') {
+            return 0;
+        }
+        ++key;
+        value = memchr(key, '=', (size_t)(rec + rec_len - key));
+        if (!value)
+            return 0;
+        ++value;
+        value_len = (size_t)(rec + rec_len - 1 - value);
+        if ((value - key) == 5 && !memcmp(key, "path", 4)) {
+            if (value_len >= sizeof(tar->name)) {
+                tar->error = "member name is too long";
+                return 0;
+            }
+            memcpy(tar->name, value, value_len);
+            tar->name[value_len] = '\0';
+            *name = 1;
+        } else if ((value - key) == 5 && !memcmp(key, "size", 4)) {
+            *size = 0;
+            for (; value < rec + rec_len - 1; ++value) {
+                if (*value < '0' || *value > '9' || *size > (UINT64_MAX / 10))
+                    return 0;
+                *size = *size * 10 + (uint64_t)(*value - '0');
+            }
+            *have_size = 1;
+        }
+        rec += rec_len;
+    }
+    return 1;
+}
+
+int o65_tar_next(o65_tar_t *tar, o65_tar_member_t *member)
+{
+    uint8_t block[O65_TAR_BLOCK];
+    int have_name = 0;
+    int have_size = 0;
+    uint64_t pax_size = 0;
+    uint64_t size;
+    size_t len;
+    size_t prefix_len;
+    int type;
+    int result;
+
+    memset(member, 0, sizeof(o65_tar_member_t));
+    tar->error = NULL;
+    for (;;) {
+        /* Read the next header block.  A zero block or a clean EOF
+         * marks the end of the archive. */
+        member->offset = tar->posn;
+        len = fread(block, 1, sizeof(block), tar->file);
+        if (len == 0 && !ferror(tar->file) && !have_name && !have_size)
+            return 1;
+        if (len != sizeof(block))
+            return -1;
+        tar->posn += len;
+        for (len = 0; len < sizeof(block) && block[len] == 0; ++len)
+            ; /* Do nothing */
+        if (len == sizeof(block)) {
+            if (have_name || have_size) {
+                tar->error = "missing header after extended header";
+                return 0;
+            }
+            return 1;
+        }
+        if (!o65_tar_checksum(block)) {
+            tar->error = "invalid header checksum";
+            return 0;
+        }
+        if (!o65_tar_number(block + O65_TAR_SIZE, O65_TAR_SIZE_LEN, &size)) {
+            tar->error = "invalid member size";
+            return 0;
+        }
+        type = block[O65_TAR_TYPEFLAG];
+
+        /* Extended headers apply to the member that follows them */
+        if (type == O65_TAR_TYPE_PAX || type == O65_TAR_TYPE_GNU_NAME) {
+            if ((result = o65_tar_read_data(tar, size)) <= 0)
+                return result;
+            if (type == O65_TAR_TYPE_GNU_NAME) {
+                if (strlen((const char *)(tar->data)) >= sizeof(tar->name)) {
+                    tar->error = "member name is too long";
+                    return 0;
+                }
+                strcpy(tar->name, (const char *)(tar->data));
+                have_name = 1;
+            } else if (!o65_tar_pax(tar, (size_t)size, &have_name,
+                                    &have_size, &pax_size)) {
+                if (!(tar->error))
+                    tar->error = "invalid pax extended header";
+                return 0;
+            }
+            continue;
+        }
+        if (have_size)
+            size = pax_size;
+
+        /* Skip everything that isn't a regular file */
+        if (type != O65_TAR_TYPE_FILE && type != O65_TAR_TYPE_OLD_FILE &&
+                type != O65_TAR_TYPE_CONTIG) {
+            size = (size + O65_TAR_BLOCK - 1) & ~((uint64_t)(O65_TAR_BLOCK - 1));
+            if (o65_tar_read(tar, NULL, size) < 0)
+                return -1;
+            have_name = 0;
+            have_size = 0;
+            pax_size = 0;
+            continue;
+        }
+
+        /* Construct the name from the ustar prefix and name fields */
+        if (!have_name) {
+            len = strnlen((const char *)(block + O65_TAR_NAME),
+                          O65_TAR_NAME_LEN);
+            prefix_len = 0;
+            if (!memcmp(block + O65_TAR_MAGIC, "ustar\0", 6)) {
+                prefix_len = strnlen((const char *)(block + O65_TAR_PREFIX),
+                                     O65_TAR_PREFIX_LEN);
+            }
+            if (prefix_len > 0) {
+                memcpy(tar->name, block + O65_TAR_PREFIX, prefix_len);
+                tar->name[prefix_len++] = '/';
+            }
+            memcpy(tar->name + prefix_len, block + O65_TAR_NAME, len);
+            tar->name[prefix_len + len] = '\0';
+        }
+
+        /* Read the contents of the member */
+        if ((result = o65_tar_read_data(tar, size)) <= 0)
+            return result;
+        member->name = tar->name;
+        member->data = tar->data;
+        member->size = (size_t)size;
+        return 1;
+    }
+}
@@ -0,0 +1,650 @@
+/*
+ * Copyright (C) 2023 Southern Storm Software, Pty Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "o65validate.h"
+#include "o65stats.h"
+#include <stdarg.h>
+#include <string.h>
+
+/** State of the validator while it streams through a file */
+typedef struct
+{
+    FILE *file;                     /**< File that is being validated */
+    uint64_t posn;                  /**< Current byte offset in the file */
+    uint64_t size;                  /**< Size of the file if seekable */
+    int seekable;                   /**< Non-zero if the file is seekable */
+    o65_validate_error_t *error;    /**< Error details to fill in */
+    o65_header_t header;            /**< Header of the current image */
+    o65_size_t num_externs;         /**< Number of externals in the image */
+    int prelinked;                  /**< Non-zero if offsets were given */
+    uint32_t relocs_offset;         /**< Prelinked offset of the relocs */
+    uint32_t exports_offset;        /**< Prelinked offset of the exports */
+    uint64_t segments_start;        /**< Offset of the .text segment */
+
+} o65_validator_t;
+
+/**
+ * @brief Reports a problem with the file.
+ *
+ * @param[in,out] v The validator state.
+ * @param[in] offset Offset of the problem in the file.
+ * @param[in] field Name of the field with the problem.
+ * @param[in] format printf-style format for the message.
+ *
+ * @return Always returns zero to indicate an invalid file.
+ */
+static int validate_fail
+    (o65_validator_t *v, uint64_t offset, const char *field,
+     const char *format, ...)
+{
+    va_list va;
+    if (v->error) {
+        v->error->offset = (unsigned long)offset;
+        v->error->field = field;
+        va_start(va, format);
+        vsnprintf(v->error->message, sizeof(v->error->message), format, va);
+        va_end(va);
+    }
+    return 0;
+}
+
+/**
+ * @brief Reports that a read failed.
+ *
+ * @param[in,out] v The validator state.
+ * @param[in] field Name of the field that was being read.
+ *
+ * @return 0 for unexpected EOF, or -1 for a filesystem error.
+ */
+static int validate_read_error(o65_validator_t *v, const char *field)
+{
+    if (ferror(v->file))
+        return -1;
+    return validate_fail(v, v->posn, field, "unexpected EOF");
+}
+
+/**
+ * @brief Reads bytes from the file.
+ *
+ * @param[in,out] v The validator state.
+ * @param[out] buf Buffer to read into.
+ * @param[in] size Number of bytes to read.
+ * @param[in] field Name of the field being read.
+ *
+ * @return 1 on success, 0 on unexpected EOF, or -1 on a filesystem error.
+ */
+static int validate_read
+    (o65_validator_t *v, uint8_t *buf, size_t size, const char *field)
+{
+    if (fread(buf, 1, size, v->file) != size)
+        return validate_read_error(v, field);
+    v->posn += size;
+    O65_STATS_ADD(O65_STAT_BYTES_READ, size);
+    return 1;
+}
+
+/**
+ * @brief Reads a single byte from the file.
+ *
+ * @param[in,out] v The validator state.
+ * @param[in] field Name of the field being read.
+ *
+ * @return The byte value, -2 on unexpected EOF, or -1 on a filesystem error.
+ */
+static int validate_byte(o65_validator_t *v, const char *field)
+{
+    int ch = getc(v->file);
+    if (ch == EOF)
+        return validate_read_error(v, field) < 0 ? -1 : -2;
+    ++(v->posn);
+    O65_STATS_ADD(O65_STAT_BYTES_READ, 1);
+    return ch;
+}
+
+/* Converts the return value of validate_byte() on error into 0 or -1 */
+#define VALIDATE_BYTE_RESULT(ch) ((ch) == -1 ? -1 : 0)
+
+/**
+ * @brief Skips over the contents of a segment without loading it.
+ *
+ * @param[in,out] v The validator state.
+ * @param[in] size Number of bytes to skip.
+ * @param[in] field Name of the field being skipped.
+ *
+ * @return 1 on success, 0 on unexpected EOF, or -1 on a filesystem error.
+ */
+static int validate_skip(o65_validator_t *v, o65_size_t size, const char *field)
+{
+    uint8_t buf[BUFSIZ];
+    size_t len;
+    int result;
+    if (v->seekable) {
+        if ((v->posn + size) > v->size) {
+            return validate_fail(v, v->posn, field,
+                                 "segment extends past the end of the file");
+        }
+        if (fseek(v->file, (long)size, SEEK_CUR) < 0)
+            return -1;
+        v->posn += size;
+        return 1;
+    }
+    while (size > 0) {
+        len = size < sizeof(buf) ? size : sizeof(buf);
+        if ((result = validate_read(v, buf, len, field)) <= 0)
+            return result;
+        size -= len;
+    }
+    return 1;
+}
+
+/**
+ * @brief Reads a 16-bit or 32-bit count or address value.
+ *
+ * @param[in,out] v The validator state.
+ * @param[out] value Returns the value.
+ * @param[in] field Name of the field being read.
+ *
+ * @return 1 on success, 0 on unexpected EOF, or -1 on a filesystem error.
+ */
+static int validate_count
+    (o65_validator_t *v, o65_size_t *value, const char *field)
+{
+    uint8_t buf[4];
+    int result;
+    if ((v->header.mode & O65_MODE_32BIT) == 0) {
+        result = validate_read(v, buf, 2, field);
+        *value = o65_read_uint16(buf);
+    } else {
+        result = validate_read(v, buf, 4, field);
+        *value = o65_read_uint32(buf);
+    }
+    return result;
+}
+
+/**
+ * @brief Reads a NUL-terminated symbol name and checks that it is not empty.
+ *
+ * @param[in,out] v The validator state.
+ * @param[in] field Name of the field being read.
+ *
+ * @return 1 on success, 0 if the name is invalid, or -1 on a
+ * filesystem error.
+ */
+static int validate_name(o65_validator_t *v, const char *field)
+{
+    uint64_t start = v->posn;
+    int ch;
+    while ((ch = validate_byte(v, field)) > 0) {
+        /* Skip the characters of the name */
+    }
+    if (ch < 0)
+        return VALIDATE_BYTE_RESULT(ch);
+    if (v->posn == (start + 1))
+        return validate_fail(v, start, field, "symbol name is empty");
+    return 1;
+}
+
+/**
+ * @brief Validates the header of an image.
+ *
+ * @param[in,out] v The validator state.
+ *
+ * @return 1 on success, 0 if the header is invalid, or -1 on a
+ * filesystem error.
+ */
+static int validate_header(o65_validator_t *v)
+{
+    static uint8_t const magic[6] = {
+        O65_MAGIC_1, O65_MAGIC_2, O65_MAGIC_3,
+        O65_MAGIC_4, O65_MAGIC_5, O65_MAGIC_6
+    };
+    static const char * const names[9] = {
+        "tbase", "tlen", "dbase", "dlen", "bbase", "blen",
+        "zbase", "zlen", "stack"
+    };
+    o65_header_t *header = &(v->header);
+    uint64_t start = v->posn;
+    uint8_t buf[36];
+    char cpu[O65_NAME_MAX];
+    o65_size_t fields[9];
+    uint64_t limit;
+    int width;
+    int result;
+    int index;
+
+    /* Check the magic number and version */
+    result = validate_read(v, buf, 8, "magic");
+    if (result <= 0)
+        return result;
+    for (index = 0; index < 6; ++index) {
+        if (buf[index] != magic[index]) {
+            return validate_fail(v, start + index,
+                                 index < 5 ? "magic" : "version",
+                                 index < 5 ? "invalid magic number"
+                                           : "unsupported version %d",
+                                 buf[index]);
+        }
+    }
+    header->mode = o65_read_uint16(buf + 6);
+
+    /* Check the mode word */
+    if ((header->mode & 0x010C) != 0) {
+        return validate_fail(v, start + 6, "mode",
+                             "reserved mode bits 0x%04x are set",
+                             header->mode & 0x010C);
+    }
+    if (!o65_get_cpu_name(header->mode, cpu)) {
+        return validate_fail(v, start + 6, "mode", "unknown CPU type 0x%04x",
+                             header->mode & O65_MODE_CPU_BITS);
+    }
+
+    /* Read the base addresses and sizes of the segments */
+    width = ((header->mode & O65_MODE_32BIT) == 0) ? 2 : 4;
+    result = validate_read(v, buf, width * 9, "header");
+    if (result <= 0)
+        return result;
+    for (index = 0; index < 9; ++index) {
+        if (width == 2)
+            fields[index] = o65_read_uint16(buf + index * 2);
+        else
+            fields[index] = o65_read_uint32(buf + index * 4);
+    }
+    header->tbase = fields[0];
+    header->tlen  = fields[1];
+    header->dbase = fields[2];
+    header->dlen  = fields[3];
+    header->bbase = fields[4];
+    header->blen  = fields[5];
+    header->zbase = fields[6];
+    header->zlen  = fields[7];
+    header->stack = fields[8];
+
+    /* Each segment must fit within the address space */
+    for (index = 0; index < 8; index += 2) {
+        if (index == 6 && width == 2)
+            limit = 0x100U;
+        else if (width == 2)
+            limit = 0x10000U;
+        else
+            limit = 0x100000000ULL;
+        if (((uint64_t)(fields[index])) + fields[index + 1] > limit) {
+            return validate_fail(v, start + 8 + (index + 1) * width,
+                                 names[index + 1],
+                                 "segment extends past the end of the "
+                                 "address space");
+        }
+    }
+
+    /* The simple layout flag must agree with the segment addresses */
+    if ((header->mode & O65_MODE_SIMPLE) != 0 &&
+            (header->dbase != (header->tbase + header->tlen) ||
+             header->bbase != (header->dbase + header->dlen))) {
+        return validate_fail(v, start + 6, "mode",
+                             "simple layout flag is set but the segments "
+                             "are not consecutive");
+    }
+    return 1;
+}
+
+/**
+ * @brief Validates the header options of an image.
+ *
+ * @param[in,out] v The validator state.
+ *
+ * @return 1 on success, 0 if an option is invalid, or -1 on a
+ * filesystem error.
+ */
+static int validate_options(o65_validator_t *v)
+{
+    uint8_t buf[O65_MAX_OPT_SIZE];
+    uint64_t start;
+    int len;
+    int result;
+    v->prelinked = 0;
+    for (;;) {
+        start = v->posn;
+        len = validate_byte(v, "option");
+        if (len < 0)
+            return VALIDATE_BYTE_RESULT(len);
+        if (len == 0)
+            break;
+        if (len < 2) {
+            return validate_fail(v, start, "option",
+                                 "option length %d is too short", len);
+        }
+        result = validate_read(v, buf, len - 1, "option");
+        if (result <= 0)
+            return result;
+        if (buf[0] == O65_OPT_PRELINKED) {
+            if (len != O65_PRELINKED_OPT_LEN) {
+                return validate_fail(v, start, "option",
+                                     "prelinked option length %d is invalid",
+                                     len);
+            }
+            v->prelinked = 1;
+            v->relocs_offset = o65_read_uint32(buf + 1);
+            v->exports_offset = o65_read_uint32(buf + 5);
+        }
+        O65_STATS_ADD(O65_STAT_OPTIONS, 1);
+    }
+    v->segments_start = v->posn;
+    return 1;
+}
+
+/**
+ * @brief Validates that a table starts where the prelinked option says.
+ *
+ * @param[in,out] v The validator state.
+ * @param[in] offset Offset of the table from the start of the .text
+ * segment, according to the prelinked option.
+ * @param[in] field Name of the table for error reporting.
+ *
+ * @return 1 if the offset is correct or there is no prelinked option,
+ * or 0 if the offset is incorrect.
+ */
+static int validate_prelinked
+    (o65_validator_t *v, uint32_t offset, const char *field)
+{
+    if (v->prelinked && (v->posn - v->segments_start) != offset) {
+        return validate_fail(v, v->posn, field,
+                             "prelinked offset 0x%lx should be 0x%lx",
+                             (unsigned long)offset,
+                             (unsigned long)(v->posn - v->segments_start));
+    }
+    return 1;
+}
+
+/**
+ * @brief Validates the list of external references for an image.
+ *
+ * @param[in,out] v The validator state.
+ *
+ * @return 1 on success, 0 if the list is invalid, or -1 on a
+ * filesystem error.
+ */
+static int validate_externs(o65_validator_t *v)
+{
+    uint64_t start = v->posn;
+    o65_size_t index;
+    int result;
+    result = validate_count(v, &(v->num_externs), "externs");
+    if (result <= 0)
+        return result;
+    if (v->seekable && ((uint64_t)(v->num_externs)) * 2 > (v->size - v->posn)) {
+        return validate_fail(v, start, "externs",
+                             "count %lu is larger than the rest of the file",
+                             (unsigned long)(v->num_externs));
+    }
+    for (index = 0; index < v->num_externs; ++index) {
+        result = validate_name(v, "externs");
+        if (result <= 0)
+            return result;
+    }
+    return 1;
+}
+
+/**
+ * @brief Validates the relocation table for a segment.
+ *
+ * @param[in,out] v The validator state.
+ * @param[in] size Size of the segment that the relocations apply to.
+ * @param[in] field Name of the relocation table for error reporting.
+ *
+ * @return 1 on success, 0 if the relocations are invalid, or -1 on a
+ * filesystem error.
+ */
+static int validate_relocs
+    (o65_validator_t *v, o65_size_t size, const char *field)
+{
+    uint64_t addr;
+    uint64_t start;
+    uint64_t width;
+    uint8_t buf[4];
+    int offset;
+    int type;
+    int result;
+    o65_size_t undefid;
+
+    /* Relocations actually start at the segment base - 1 */
+    addr = (uint64_t)0 - 1;
+    for (;;) {
+        /* Read the offset to the next relocation */
+        start = v->posn;
+        offset = validate_byte(v, field);
+        if (offset < 0)
+            return VALIDATE_BYTE_RESULT(offset);
+        if (offset == 0)
+            break;
+        if (offset == 255) {
+            addr += 254;
+            continue;
+        }
+        addr += offset;
+
+        /* Read and check the type and segment identifier */
+        type = validate_byte(v, field);
+        if (type < 0)
+            return VALIDATE_BYTE_RESULT(type);
+        switch (type & O65_RELOC_SEGID) {
+        case O65_SEGID_UNDEF:
+            if ((v->header.mode & O65_MODE_32BIT) == 0) {
+                result = validate_read(v, buf, 2, field);
+                undefid = o65_read_uint16(buf);
+            } else {
+                result = validate_read(v, buf, 4, field);
+                undefid = o65_read_uint32(buf);
+            }
+            if (result <= 0)
+                return result;
+            if (undefid >= v->num_externs) {
+                return validate_fail(v, start, field,
+                                     "external reference %lu is out of range",
+                                     (unsigned long)undefid);
+            }
+            break;
+
+        case O65_SEGID_TEXT:
+        case O65_SEGID_DATA:
+        case O65_SEGID_BSS:
+        case O65_SEGID_ZEROPAGE:
+            break;
+
+        default:
+            return validate_fail(v, start, field,
+                                 "invalid relocation segment ID %d",
+                                 type & O65_RELOC_SEGID);
+        }
+
+        /* Check the relocation type and read the extra bytes */
+        switch (type & O65_RELOC_TYPE) {
+        case O65_RELOC_WORD:    width = 2; break;
+        case O65_RELOC_SEGADR:  width = 3; break;
+        case O65_RELOC_LOW:     width = 1; break;
+
+        case O65_RELOC_HIGH:
+            width = 1;
+            if ((v->header.mode & O65_MODE_PAGED) == 0) {
+                result = validate_read(v, buf, 1, field);
+                if (result <= 0)
+                    return result;
+            }
+            break;
+
+        case O65_RELOC_SEG:
+            width = 1;
+            result = validate_read(v, buf, 2, field);
+            if (result <= 0)
+                return result;
+            break;
+
+        default:
+            return validate_fail(v, start, field,
+                                 "invalid relocation type 0x%02x",
+                                 type & O65_RELOC_TYPE);
+        }
+
+        /* The relocated bytes must be entirely within the segment */
+        if (addr >= size || (size - addr) < width) {
+            return validate_fail(v, start, field,
+                                 "relocation at 0x%lx is out of range",
+                                 (unsigned long)addr);
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Validates the list of exported symbols for an image.
+ *
+ * @param[in,out] v The validator state.
+ *
+ * @return 1 on success, 0 if the list is invalid, or -1 on a
+ * filesystem error.
+ */
+static int validate_exports(o65_validator_t *v)
+{
+    const o65_header_t *header = &(v->header);
+    o65_size_t num_exports;
+    o65_size_t index;
+    o65_size_t value;
+    o65_size_t base;
+    o65_size_t len;
+    uint64_t start = v->posn;
+    int segid;
+    int result;
+    result = validate_count(v, &num_exports, "exports");
+    if (result <= 0)
+        return result;
+    if (v->seekable && ((uint64_t)num_exports) * 4 > (v->size - v->posn)) {
+        return validate_fail(v, start, "exports",
+                             "count %lu is larger than the rest of the file",
+                             (unsigned long)num_exports);
+    }
+    for (index = 0; index < num_exports; ++index) {
+        start = v->posn;
+        result = validate_name(v, "exports");
+        if (result <= 0)
+            return result;
+        segid = validate_byte(v, "exports");
+        if (segid < 0)
+            return VALIDATE_BYTE_RESULT(segid);
+        result = validate_count(v, &value, "exports");
+        if (result <= 0)
+            return result;
+        switch (segid) {
+        case O65_SEGID_ABS:
+            continue;
+
+        case O65_SEGID_TEXT:
+            base = header->tbase;
+            len = header->tlen;
+            break;
+
+        case O65_SEGID_DATA:
+            base = header->dbase;
+            len = header->dlen;
+            break;
+
+        case O65_SEGID_BSS:
+            base = header->bbase;
+            len = header->blen;
+            break;
+
+        case O65_SEGID_ZEROPAGE:
+            base = header->zbase;
+            len = header->zlen;
+            break;
+
+        default:
+            return validate_fail(v, start, "exports",
+                                 "invalid export segment ID %d", segid);
+        }
+        if (value < base || (value - base) > len) {
+            return validate_fail(v, start, "exports",
+                                 "exported value 0x%lx is outside its segment",
+                                 (unsigned long)value);
+        }
+    }
+    return 1;
+}
+
+int o65_validate(FILE *file, o65_validate_error_t *error)
+{
+    o65_validator_t v;
+    long posn;
+    int result;
+
+    /* Initialize the validator state */
+    memset(&v, 0, sizeof(v));
+    v.file = file;
+    v.error = error;
+    if (error) {
+        error->offset = 0;
+        error->field = NULL;
+        error->message[0] = '\0';
+    }
+
+    /* Determine the size of the file if it is seekable, so that we can
+     * skip over segments without reading them and sanity-check counts */
+    posn = ftell(file);
+    if (posn >= 0 && fseek(file, 0, SEEK_END) == 0) {
+        long size = ftell(file);
+        if (size >= posn && fseek(file, posn, SEEK_SET) == 0) {
+            v.seekable = 1;
+            v.size = (uint64_t)(size - posn);
+        }
+    }
+    clearerr(file);
+
+    /* Validate each of the images in the chain */
+    do {
+        if ((result = validate_header(&v)) <= 0)
+            return result;
+        if ((result = validate_options(&v)) <= 0)
+            return result;
+        if ((result = validate_skip(&v, v.header.tlen, "text")) <= 0)
+            return result;
+        if ((result = validate_skip(&v, v.header.dlen, "data")) <= 0)
+            return result;
+        if ((result = validate_externs(&v)) <= 0)
+            return result;
+        if ((result = validate_prelinked
+                (&v, v.relocs_offset, "text relocs")) <= 0)
+            return result;
+        if ((result = validate_relocs(&v, v.header.tlen, "text relocs")) <= 0)
+            return result;
+        if ((result = validate_relocs(&v, v.header.dlen, "data relocs")) <= 0)
+            return result;
+        if ((result = validate_prelinked
+                (&v, v.exports_offset, "exports")) <= 0)
+            return result;
+        if ((result = validate_exports(&v)) <= 0)
+            return result;
+    } while ((v.header.mode & O65_MODE_CHAIN) != 0);
+
+    /* There should be nothing after the last image */
+    if (getc(file) != EOF)
+        return validate_fail(&v, v.posn, "file", "trailing data after the image");
+    if (ferror(file))
+        return -1;
+    return 1;
+}
@@ -0,0 +1,352 @@
+/*
+ * Copyright (C) 2023 Southern Storm Software, Pty Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "o65visit.h"
+#include "o65stats.h"
+#include <stdlib.h>
+
+/* Internal result that indicates that a callback stopped the walk */
+#define O65_WALK_STOPPED    2
+
+/* Invokes an optional callback, treating NULL as "continue" */
+#define O65_VISIT_CALL(cb, ...) \
+    ((cb) ? (cb)(__VA_ARGS__) : O65_VISIT_CONTINUE)
+
+/**
+ * @brief Skips over bytes in a ".o65" file.
+ *
+ * @param[in] file File pointer.
+ * @param[in] size Number of bytes to skip.
+ *
+ * @return 1 if the bytes were skipped, 0 if @a size is larger than the
+ * rest of the file, or -1 for unexpected EOF or a filesystem error.
+ */
+static int o65_skip_bytes(FILE *file, o65_size_t size)
+{
+    uint8_t buf[4096];
+    size_t len;
+    if (size == 0)
+        return 1;
+    if (!o65_check_remaining(file, size))
+        return 0;
+    if (fseek(file, (long)size, SEEK_CUR) == 0)
+        return 1;
+
+    /* The file is not seekable, so read and discard the data instead */
+    while (size > 0) {
+        len = (size < sizeof(buf)) ? size : sizeof(buf);
+        if (fread(buf, 1, len, file) != len)
+            return -1;
+        size -= len;
+    }
+    return 1;
+}
+
+/**
+ * @brief Visits the .text or .data segment of an image.
+ *
+ * @param[in] file File pointer.
+ * @param[in] visitor Callbacks to invoke.
+ * @param[in] ctx Context pointer for the callbacks.
+ * @param[in] header Header of the current image.
+ * @param[in] segid Identifier for the segment.
+ * @param[in] size Size of the segment.
+ *
+ * @return 1 to continue, 0 if the file is invalid, -1 for unexpected EOF
+ * or a filesystem error, or O65_WALK_STOPPED to stop the walk.
+ */
+static int o65_visit_segment
+    (FILE *file, const o65_visitor_t *visitor, void *ctx,
+     const o65_header_t *header, uint8_t segid, o65_size_t size)
+{
+    uint8_t *data;
+    int action;
+    int result;
+
+    /* Ask the visitor if it wants the data */
+    if (visitor->begin_segment)
+        action = visitor->begin_segment(ctx, header, segid, size);
+    else if (visitor->segment)
+        action = O65_VISIT_CONTINUE;
+    else
+        action = O65_VISIT_SKIP;
+    if (action == O65_VISIT_STOP)
+        return O65_WALK_STOPPED;
+    else if (action == O65_VISIT_SKIP || !(visitor->segment))
+        return o65_skip_bytes(file, size);
+
+    /* Load the data and pass it to the visitor */
+    result = o65_read_segment(file, &data, size);
+    if (result <= 0)
+        return result;
+    action = visitor->segment(ctx, header, segid, data, size);
+    free(data);
+    return (action == O65_VISIT_STOP) ? O65_WALK_STOPPED : 1;
+}
+
+/**
+ * @brief Visits the external symbol names for an image.
+ *
+ * @param[in] file File pointer.
+ * @param[in] visitor Callbacks to invoke.
+ * @param[in] ctx Context pointer for the callbacks.
+ * @param[in] header Header of the current image.
+ * @param[in] decoder Decoder for the header mode.
+ *
+ * @return 1 to continue, 0 if the file is invalid, -1 for unexpected EOF
+ * or a filesystem error, or O65_WALK_STOPPED to stop the walk.
+ */
+static int o65_visit_externs
+    (FILE *file, const o65_visitor_t *visitor, void *ctx,
+     const o65_header_t *header, const o65_decoder_t *decoder)
+{
+    o65_string_table_t table;
+    o65_size_t count;
+    o65_size_t index;
+    int action;
+    int result;
+
+    /* Read the number of externals */
+    result = decoder->read_count(file, &count);
+    if (result <= 0)
+        return result;
+    action = O65_VISIT_CALL(visitor->begin_externs, ctx, header, count);
+    if (action == O65_VISIT_STOP)
+        return O65_WALK_STOPPED;
+
+    /* The names must be read even if they are being skipped */
+    o65_string_table_init(&table);
+    result = o65_read_string_table(file, count, &table);
+    if (result > 0 && action == O65_VISIT_CONTINUE && visitor->extern_symbol) {
+        for (index = 0; index < count; ++index) {
+            if (visitor->extern_symbol(ctx, header, index,
+                                       table.names[index].name)
+                    == O65_VISIT_STOP) {
+                result = O65_WALK_STOPPED;
+                break;
+            }
+        }
+    }
+    o65_string_table_free(&table);
+    return result;
+}
+
+/**
+ * @brief Visits the relocation table for the .text or .data segment.
+ *
+ * @param[in] file File pointer.
+ * @param[in] visitor Callbacks to invoke.
+ * @param[in] ctx Context pointer for the callbacks.
+ * @param[in] header Header of the current image.
+ * @param[in] decoder Decoder for the header mode.
+ * @param[in] segid Identifier for the segment.
+ * @param[in] base Original base address of the segment.
+ *
+ * @return 1 to continue, 0 if the file is invalid, -1 for unexpected EOF
+ * or a filesystem error, or O65_WALK_STOPPED to stop the walk.
+ */
+static int o65_visit_relocs
+    (FILE *file, const o65_visitor_t *visitor, void *ctx,
+     const o65_header_t *header, const o65_decoder_t *decoder,
+     uint8_t segid, o65_size_t base)
+{
+    o65_reloc_t reloc;
+    o65_size_t addr;
+    int action;
+    int result;
+
+    action = O65_VISIT_CALL(visitor->begin_relocs, ctx, header, segid);
+    if (action == O65_VISIT_STOP)
+        return O65_WALK_STOPPED;
+    if (!(visitor->reloc))
+        action = O65_VISIT_SKIP;
+
+    /* Relocations actually start at the segment base - 1 */
+    addr = base - 1;
+    for (;;) {
+        result = decoder->read_reloc(file, &reloc);
+        if (result <= 0)
+            return result;
+        else if (reloc.offset == 0)
+            break;
+        if (reloc.offset == 255) {
+            addr += 254;
+            continue;
+        }
+        addr += reloc.offset;
+        if (action == O65_VISIT_CONTINUE) {
+            if (visitor->reloc(ctx, header, segid, addr, &reloc)
+                    == O65_VISIT_STOP) {
+                return O65_WALK_STOPPED;
+            }
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Visits the exported symbols for an image.
+ *
+ * @param[in] file File pointer.
+ * @param[in] visitor Callbacks to invoke.
+ * @param[in] ctx Context pointer for the callbacks.
+ * @param[in] header Header of the current image.
+ * @param[in] decoder Decoder for the header mode.
+ *
+ * @return 1 to continue, 0 if the file is invalid, -1 for unexpected EOF
+ * or a filesystem error, or O65_WALK_STOPPED to stop the walk.
+ */
+static int o65_visit_exports
+    (FILE *file, const o65_visitor_t *visitor, void *ctx,
+     const o65_header_t *header, const o65_decoder_t *decoder)
+{
+    o65_string_table_t table;
+    o65_size_t count;
+    o65_size_t value;
+    int action;
+    int result;
+    int segid;
+
+    /* Read the number of exports and check that it is sane */
+    result = decoder->read_count(file, &count);
+    if (result <= 0)
+        return result;
+    action = O65_VISIT_CALL(visitor->begin_exports, ctx, header, count);
+    if (action == O65_VISIT_STOP)
+        return O65_WALK_STOPPED;
+    if (!o65_check_remaining(file, count))
+        return 0;
+
+    /* Each export is a name, a segment identifier, and a value */
+    o65_string_table_init(&table);
+    for (; count > 0; --count) {
+        result = o65_read_string_table(file, 1, &table);
+        if (result <= 0)
+            break;
+        if ((segid = getc(file)) == EOF) {
+            result = -1;
+            break;
+        }
+        O65_STATS_ADD(O65_STAT_BYTES_READ, 1);
+        result = decoder->read_count(file, &value);
+        if (result <= 0)
+            break;
+        if (action == O65_VISIT_CONTINUE && visitor->export_symbol) {
+            if (visitor->export_symbol(ctx, header, table.names[0].name,
+                                       (uint8_t)segid, value)
+                    == O65_VISIT_STOP) {
+                result = O65_WALK_STOPPED;
+                break;
+            }
+        }
+    }
+    o65_string_table_free(&table);
+    return result;
+}
+
+/**
+ * @brief Visits a single image within a ".o65" file.
+ *
+ * @param[in] file File pointer.
+ * @param[in] visitor Callbacks to invoke.
+ * @param[in] ctx Context pointer for the callbacks.
+ * @param[out] header Returns the header of the image.
+ *
+ * @return 1 to continue, 0 if the file is invalid, -1 for unexpected EOF
+ * or a filesystem error, or O65_WALK_STOPPED to stop the walk.
+ */
+static int o65_visit_image
+    (FILE *file, const o65_visitor_t *visitor, void *ctx,
+     o65_header_t *header)
+{
+    const o65_decoder_t *decoder;
+    o65_option_t option;
+    int result;
+
+    /* Header */
+    result = o65_read_header(file, header);
+    if (result <= 0)
+        return result;
+    decoder = o65_get_decoder(header);
+    if (O65_VISIT_CALL(visitor->header, ctx, header) == O65_VISIT_STOP)
+        return O65_WALK_STOPPED;
+
+    /* Options */
+    for (;;) {
+        result = o65_read_option(file, &option);
+        if (result <= 0)
+            return result;
+        if (option.len == 0)
+            break;
+        if (O65_VISIT_CALL(visitor->option, ctx, header, &option)
+                == O65_VISIT_STOP) {
+            return O65_WALK_STOPPED;
+        }
+    }
+
+    /* Segments */
+    result = o65_visit_segment
+        (file, visitor, ctx, header, O65_SEGID_TEXT, header->tlen);
+    if (result != 1)
+        return result;
+    result = o65_visit_segment
+        (file, visitor, ctx, header, O65_SEGID_DATA, header->dlen);
+    if (result != 1)
+        return result;
+
+    /* Externals */
+    result = o65_visit_externs(file, visitor, ctx, header, decoder);
+    if (result != 1)
+        return result;
+
+    /* Relocations */
+    result = o65_visit_relocs
+        (file, visitor, ctx, header, decoder, O65_SEGID_TEXT, header->tbase);
+    if (result != 1)
+        return result;
+    result = o65_visit_relocs
+        (file, visitor, ctx, header, decoder, O65_SEGID_DATA, header->dbase);
+    if (result != 1)
+        return result;
+
+    /* Exports */
+    result = o65_visit_exports(file, visitor, ctx, header, decoder);
+    if (result != 1)
+        return result;
+    if (O65_VISIT_CALL(visitor->end_image, ctx, header) == O65_VISIT_STOP)
+        return O65_WALK_STOPPED;
+    return 1;
+}
+
+int o65_visit(FILE *file, const o65_visitor_t *visitor, void *ctx)
+{
+    o65_header_t header;
+    int result;
+    do {
+        result = o65_visit_image(file, visitor, ctx, &header);
+        if (result == O65_WALK_STOPPED)
+            return 1;
+        else if (result <= 0)
+            return result;
+    } while ((header.mode & O65_MODE_CHAIN) != 0);
+    return 1;
+}
@@ -21,38 +21,12 @@
  */
 
 #include "o65file.h"
+#include "o65stats.h"
 #include <string.h>
 #include <stdlib.h>
 
-void o65_write_uint16(uint8_t *buf, uint16_t value)
-{
-    buf[0] = (uint8_t)value;
-    buf[1] = (uint8_t)(value >> 8);
-}
-
-void o65_write_uint24(uint8_t *buf, uint32_t value)
-{
-    buf[0] = (uint8_t)value;
-    buf[1] = (uint8_t)(value >> 8);
-    buf[2] = (uint8_t)(value >> 16);
-}
-
-void o65_write_uint32(uint8_t *buf, uint32_t value)
-{
-    buf[0] = (uint8_t)value;
-    buf[1] = (uint8_t)(value >> 8);
-    buf[2] = (uint8_t)(value >> 16);
-    buf[3] = (uint8_t)(value >> 24);
-}
-
 int o65_write_header(FILE *file, o65_header_t *header)
 {
-    static uint8_t const magic[6] = {
-        0x01, 0x00, 0x6F, 0x36, 0x35, 0x00
-    };
-    uint8_t buf[38];
-    size_t size;
-
     /*
      * Page alignment can be specified in two different places.
      * Make sure that they are consistent.
@@ -84,11 +58,22 @@ int o65_write_header(FILE *file, o65_header_t *header)
     } else {
         header->mode &= ~O65_MODE_SIMPLE;
     }
+    return o65_write_raw_header(file, header);
+}
+
+int o65_write_raw_header(FILE *file, const o65_header_t *header)
+{
+    static uint8_t const magic[6] = {
+        0x01, 0x00, 0x6F, 0x36, 0x35, 0x00
+    };
+    uint8_t buf[38];
+    size_t size;
 
     /* Write the magic number and version information */
     if (fwrite(magic, 1, sizeof(magic), file) != sizeof(magic)) {
         return -1;
     }
+    O65_STATS_ADD(O65_STAT_BYTES_WRITTEN, sizeof(magic));
 
     /* Encode the rest of the header and write it */
     if ((header->mode & O65_MODE_32BIT) == 0) {
@@ -121,6 +106,7 @@ int o65_write_header(FILE *file, o65_header_t *header)
     if (fwrite(buf, 1, size, file) != size) {
         return -1;
     }
+    O65_STATS_ADD(O65_STAT_BYTES_WRITTEN, size);
     return 0;
 }
 
@@ -129,9 +115,11 @@ int o65_write_option(FILE *file, const o65_option_t *option)
     if (!option || option->len == 0) {
         if (putc(0, file) < 0)
             return -1;
+        O65_STATS_ADD(O65_STAT_BYTES_WRITTEN, 1);
     } else {
         if (fwrite(&(option->len), 1, option->len, file) != option->len)
             return -1;
+        O65_STATS_ADD(O65_STAT_BYTES_WRITTEN, option->len);
     }
     return 0;
 }
@@ -155,6 +143,7 @@ int o65_write_reloc
         if (putc(reloc->offset, file) < 0) {
             return -1;
         }
+        O65_STATS_ADD(O65_STAT_BYTES_WRITTEN, 1);
     } else {
         /* Encode the relocation offset, type, and parameters */
         if (putc(reloc->offset, file) < 0) {
@@ -163,6 +152,7 @@ int o65_write_reloc
         if (putc(reloc->type, file) < 0) {
             return -1;
         }
+        O65_STATS_ADD(O65_STAT_BYTES_WRITTEN, 2);
         if ((reloc->type & O65_RELOC_SEGID) == O65_SEGID_UNDEF) {
             /* Write the identifier of the external reference */
             if (o65_write_count(file, header, reloc->undefid) < 0)
@@ -175,6 +165,7 @@ int o65_write_reloc
                 if (putc(reloc->extra & 0xFF, file) < 0) {
                     return -1;
                 }
+                O65_STATS_ADD(O65_STAT_BYTES_WRITTEN, 1);
             }
             break;
 
@@ -186,6 +177,7 @@ int o65_write_reloc
             if (putc((reloc->extra >> 8) & 0xFF, file) < 0) {
                 return -1;
             }
+            O65_STATS_ADD(O65_STAT_BYTES_WRITTEN, 2);
             break;
 
         default: break;
@@ -201,10 +193,12 @@ int o65_write_count(FILE *file, const o65_header_t *header, o65_size_t count)
         o65_write_uint16(buf, count);
         if (fwrite(buf, 1, 2, file) != 2)
             return -1;
+        O65_STATS_ADD(O65_STAT_BYTES_WRITTEN, 2);
     } else {
         o65_write_uint32(buf, count);
         if (fwrite(buf, 1, 4, file) != 4)
             return -1;
+        O65_STATS_ADD(O65_STAT_BYTES_WRITTEN, 4);
     }
     return 0;
 }
@@ -217,8 +211,8 @@ int o65_write_string(FILE *file, const char *str)
     len = strlen(str) + 1;
     if (fwrite(str, 1, len, file) != len)
         return -1;
-    else
-        return 0;
+    O65_STATS_ADD(O65_STAT_BYTES_WRITTEN, len);
+    return 0;
 }
 
 int o65_write_exported_symbol
@@ -229,5 +223,20 @@ int o65_write_exported_symbol
         return -1;
     if (putc(segID, file) < 0)
         return -1;
+    O65_STATS_ADD(O65_STAT_BYTES_WRITTEN, 1);
     return o65_write_count(file, header, offset);
 }
+
+FILE *o65_fopen_output(const char *filename)
+{
+    if (!strcmp(filename, "-"))
+        return stdout;
+    return fopen(filename, "wb");
+}
+
+int o65_fclose_output(FILE *file)
+{
+    if (file == stdout)
+        return fflush(file) == 0 && !ferror(file) ? 0 : -1;
+    return fclose(file) == 0 ? 0 : -1;
+}
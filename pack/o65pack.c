@@ -0,0 +1,300 @@
+/*
+ * Copyright (C) 2023 Southern Storm Software, Pty Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "o65pack.h"
+#include "o65prefetch.h"
+#include "o65stats.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#define short_options "f:l"
+static struct option long_options[] = {
+    {"files-from",          required_argument,  0,  'f'},
+    {"list",                no_argument,        0,  'l'},
+    {"stats",               optional_argument,  0,  'S'},
+    {"trace",               optional_argument,  0,  'T'},
+    {"trace-file",          required_argument,  0,  'F'},
+    {0,                     0,                  0,    0},
+};
+
+/** Source of the names of the files to add to the pack */
+typedef struct
+{
+    FILE *list;             /**< List file to read names from, or NULL */
+    char line[BUFSIZ];      /**< Current line from the list file */
+    char **argv;            /**< Names from the command-line */
+    int argc;               /**< Number of names from the command-line */
+
+} pack_source_t;
+
+static void usage(const char *progname);
+static const char *next_filename(void *ctx);
+static int create_pack(const char *pack_file, pack_source_t *source);
+static int list_pack(const char *pack_file);
+
+int main(int argc, char *argv[])
+{
+    const char *progname = argv[0];
+    const char *list_file = 0;
+    pack_source_t source;
+    int list = 0;
+    int exit_val = 0;
+
+    /* Parse the command-line options */
+    for (;;) {
+        int opt = getopt_long(argc, argv, short_options, long_options, 0);
+        if (opt < 0)
+            break;
+        switch (opt) {
+        case 'f': list_file = optarg; break;
+        case 'l': list = 1; break;
+
+        case 'S':
+        case 'T':
+            if (!o65_stats_option
+                    (optarg, opt == 'S' ? O65_STATS_SUMMARY : O65_STATS_TRACE)) {
+                fprintf(stderr, "%s: invalid statistics format '%s'\n",
+                        progname, optarg);
+                return 1;
+            }
+            break;
+
+        case 'F': o65_stats_trace_file(optarg); break;
+
+        default:
+            usage(progname);
+            return 1;
+        }
+    }
+
+    /* List the contents of an existing pack */
+    if (list) {
+        if ((argc - optind) != 1) {
+            usage(progname);
+            return 1;
+        }
+        exit_val = !list_pack(argv[optind]);
+        o65_stats_report(stderr);
+        return exit_val;
+    }
+
+    /* Need the name of the pack and at least one file to add to it */
+    if ((argc - optind) < 1 || (!list_file && (argc - optind) < 2)) {
+        usage(progname);
+        return 1;
+    }
+
+    /* The files in the list file are added first, then the files
+     * on the command-line */
+    memset(&source, 0, sizeof(source));
+    if (list_file && (source.list = fopen(list_file, "r")) == NULL) {
+        perror(list_file);
+        return 1;
+    }
+    source.argv = argv + optind + 1;
+    source.argc = argc - optind - 1;
+    exit_val = !create_pack(argv[optind], &source);
+
+    /* Clean up and exit */
+    if (source.list)
+        fclose(source.list);
+    o65_stats_report(stderr);
+    return exit_val;
+}
+
+/**
+ * @brief Print usage information for the program.
+ *
+ * @param[in] progname Name of the program from argv[0].
+ */
+static void usage(const char *progname)
+{
+    fprintf(stderr, "Usage: %s [options] output.o65pack file1.o65 ...\n", progname);
+    fprintf(stderr, "       %s --list input.o65pack\n\n", progname);
+
+    fprintf(stderr, "Options:\n\n");
+
+    fprintf(stderr, "    --files-from LISTFILE, -f LISTFILE\n");
+    fprintf(stderr, "        File with a list of \".o65\" files to add, one per line.\n\n");
+
+    fprintf(stderr, "    --list, -l\n");
+    fprintf(stderr, "        List the members of an existing pack.\n\n");
+
+    fprintf(stderr, "    --stats[=json]\n");
+    fprintf(stderr, "        Report counters and timings on exit.\n\n");
+
+    fprintf(stderr, "    --trace[=json]\n");
+    fprintf(stderr, "        Report the time for each phase as it completes.\n\n");
+
+    fprintf(stderr, "    --trace-file TRACEFILE\n");
+    fprintf(stderr, "        Write a Chrome trace event file with the time for each phase.\n\n");
+}
+
+/**
+ * @brief Gets the name of the next file to add to the pack.
+ *
+ * @param[in,out] ctx Points to the pack_source_t for the file names.
+ *
+ * @return The name of the next file, or NULL if there are no more files.
+ */
+static const char *next_filename(void *ctx)
+{
+    pack_source_t *source = (pack_source_t *)ctx;
+    size_t len;
+
+    /* Read names from the list file, ignoring blank lines */
+    while (source->list &&
+            fgets(source->line, sizeof(source->line), source->list)) {
+        len = strlen(source->line);
+        while (len > 0 && (source->line[len - 1] == '\n' ||
+                           source->line[len - 1] == '\r'))
+            --len;
+        source->line[len] = '\0';
+        if (len != 0)
+            return source->line;
+    }
+
+    /* Then use the names from the command-line */
+    if (source->argc > 0) {
+        --(source->argc);
+        return *(source->argv)++;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Creates a pack file from a list of input files.
+ *
+ * @param[in] pack_file Name of the pack file to create.
+ * @param[in,out] source Source of the names of the input files.
+ *
+ * @return Non-zero on success, or zero on failure.
+ *
+ * Each member is named after the input file, exactly as it was given.
+ */
+static int create_pack(const char *pack_file, pack_source_t *source)
+{
+    o65_pack_builder_t builder;
+    o65_prefetch_t *prefetch;
+    o65_prefetch_file_t input;
+    uint64_t start;
+    FILE *file;
+    int ok = 1;
+
+    /* Create the pack file */
+    if ((file = fopen(pack_file, "wb")) == NULL) {
+        perror(pack_file);
+        return 0;
+    }
+    prefetch = o65_prefetch_new(0, next_filename, source);
+    if (!prefetch) {
+        fprintf(stderr, "out of memory\n");
+        fclose(file);
+        remove(pack_file);
+        return 0;
+    }
+    if (o65_pack_builder_init(&builder, file) < 0) {
+        perror(pack_file);
+        ok = 0;
+    }
+
+    /* Add the input files in the order they were given */
+    while (ok && o65_prefetch_next(prefetch, &input)) {
+        if (input.error != 0) {
+            errno = input.error;
+            perror(input.filename);
+            ok = 0;
+        } else {
+            start = O65_SPAN_BEGIN();
+            if (o65_pack_builder_add(&builder, input.filename,
+                                     input.data, input.size) < 0) {
+                perror(pack_file);
+                ok = 0;
+            }
+            O65_STATS_ADD(O65_STAT_BYTES_READ, input.size);
+            O65_STATS_ADD(O65_STAT_BYTES_WRITTEN, input.size);
+            O65_SPAN_END(O65_SPAN_WRITE, start, input.filename);
+        }
+        o65_prefetch_release(&input);
+    }
+    o65_prefetch_free(prefetch);
+
+    /* Write the index at the end of the pack */
+    if (ok) {
+        if (o65_pack_builder_finish(&builder) < 0) {
+            if (errno == EEXIST)
+                fprintf(stderr, "%s: duplicate member names\n", pack_file);
+            else
+                perror(pack_file);
+            ok = 0;
+        }
+    } else {
+        o65_pack_builder_free(&builder);
+    }
+    if (fclose(file) != 0 && ok) {
+        perror(pack_file);
+        ok = 0;
+    }
+
+    /* Don't leave a partial pack behind on error */
+    if (!ok)
+        remove(pack_file);
+    return ok;
+}
+
+/**
+ * @brief Lists the members of a pack file.
+ *
+ * @param[in] pack_file Name of the pack file.
+ *
+ * @return Non-zero on success, or zero on failure.
+ */
+static int list_pack(const char *pack_file)
+{
+    o65_pack_member_t member;
+    o65_pack_t *pack;
+    size_t index;
+    size_t count;
+    int result;
+
+    result = o65_pack_open(pack_file, &pack);
+    if (result < 0) {
+        perror(pack_file);
+        return 0;
+    } else if (result == 0) {
+        fprintf(stderr, "%s: not in pack format\n", pack_file);
+        return 0;
+    }
+    count = o65_pack_count(pack);
+    for (index = 0; index < count; ++index) {
+        o65_pack_member(pack, index, &member);
+        printf("%016llx %10lu %.*s\n",
+               (unsigned long long)(member.fingerprint),
+               (unsigned long)(member.size), (int)(member.name_len),
+               member.name);
+    }
+    o65_pack_close(pack);
+    return 1;
+}
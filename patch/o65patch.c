@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2023 Southern Storm Software, Pty Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "o65delta.h"
+#include "o65stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#define short_options "o:"
+static struct option long_options[] = {
+    {"output",              required_argument,  0,  'o'},
+    {"stats",               optional_argument,  0,  'S'},
+    {"trace",               optional_argument,  0,  'T'},
+    {"trace-file",          required_argument,  0,  'F'},
+    {0,                     0,                  0,    0},
+};
+
+static void usage(const char *progname);
+
+int main(int argc, char *argv[])
+{
+    const char *progname = argv[0];
+    const char *output = 0;
+    const char *old_filename;
+    const char *patch_filename;
+    FILE *old;
+    FILE *patch;
+    FILE *out;
+    uint64_t start;
+    int result;
+
+    /* Parse the command-line options */
+    for (;;) {
+        int opt = getopt_long(argc, argv, short_options, long_options, 0);
+        if (opt < 0)
+            break;
+        switch (opt) {
+        case 'o': output = optarg; break;
+
+        case 'S':
+        case 'T':
+            if (!o65_stats_option
+                    (optarg, opt == 'S' ? O65_STATS_SUMMARY : O65_STATS_TRACE)) {
+                fprintf(stderr, "%s: invalid statistics format '%s'\n",
+                        progname, optarg);
+                return 1;
+            }
+            break;
+
+        case 'F': o65_stats_trace_file(optarg); break;
+
+        default:
+            usage(progname);
+            return 1;
+        }
+    }
+
+    /* Need the old file, the patch, and an output filename */
+    if ((argc - optind) != 2 || !output) {
+        usage(progname);
+        return 1;
+    }
+    old_filename = argv[optind];
+    patch_filename = argv[optind + 1];
+
+    /* Open the files */
+    start = O65_SPAN_BEGIN();
+    if ((old = fopen(old_filename, "rb")) == NULL) {
+        perror(old_filename);
+        return 1;
+    }
+    if ((patch = fopen(patch_filename, "rb")) == NULL) {
+        perror(patch_filename);
+        fclose(old);
+        return 1;
+    }
+    if ((out = fopen(output, "wb")) == NULL) {
+        perror(output);
+        fclose(old);
+        fclose(patch);
+        return 1;
+    }
+
+    /* Apply the patch */
+    result = o65_delta_apply(old, patch, out);
+    if (result == 0) {
+        fprintf(stderr, "%s: invalid patch or it does not apply to %s\n",
+                patch_filename, old_filename);
+    } else if (result < 0) {
+        if (ferror(out))
+            perror(output);
+        else if (ferror(old))
+            perror(old_filename);
+        else if (ferror(patch))
+            perror(patch_filename);
+        else
+            fprintf(stderr, "%s: unexpected EOF\n", patch_filename);
+    }
+    if (fclose(out) != 0 && result > 0) {
+        perror(output);
+        result = -1;
+    }
+    fclose(old);
+    fclose(patch);
+    if (result <= 0)
+        remove(output);
+    O65_SPAN_END(O65_SPAN_FILE, start, output);
+
+    /* Clean up and exit */
+    o65_stats_report(stderr);
+    return result > 0 ? 0 : 1;
+}
+
+/**
+ * @brief Print usage information for the program.
+ *
+ * @param[in] progname Name of the program from argv[0].
+ */
+static void usage(const char *progname)
+{
+    fprintf(stderr, "Usage: %s [options] -o new.o65 old.o65 PATCHFILE\n\n", progname);
+
+    fprintf(stderr, "Options:\n\n");
+
+    fprintf(stderr, "    --output new.o65, -o new.o65\n");
+    fprintf(stderr, "        Write the patched file to new.o65.\n\n");
+
+    fprintf(stderr, "    --stats[=json]\n");
+    fprintf(stderr, "        Report counters and timings on exit.\n\n");
+
+    fprintf(stderr, "    --trace[=json]\n");
+    fprintf(stderr, "        Report the time for each phase as it completes.\n\n");
+
+    fprintf(stderr, "    --trace-file TRACEFILE\n");
+    fprintf(stderr, "        Write a Chrome trace event file with the time for each phase.\n\n");
+
+    fprintf(stderr, "The patch is created with o65delta.\n");
+}
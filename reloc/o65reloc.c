@@ -21,19 +21,30 @@
  */
 
 #include "o65file.h"
+#include "o65pack.h"
+#include "o65prefetch.h"
+#include "o65stats.h"
+#include "o65tar.h"
+#include "o65validate.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 #include <getopt.h>
 
-#define short_options "t:d:b:z:i:"
+#define short_options "t:d:b:z:i:B:A:"
 static struct option long_options[] = {
     {"text-address",        required_argument,  0,  't'},
     {"data-address",        required_argument,  0,  'd'},
     {"bss-address",         required_argument,  0,  'b'},
     {"zeropage-address",    required_argument,  0,  'z'},
     {"imports",             required_argument,  0,  'i'},
+    {"batch",               required_argument,  0,  'B'},
+    {"tar",                 required_argument,  0,  'A'},
+    {"strict",              no_argument,        0,  'X'},
+    {"stats",               optional_argument,  0,  'S'},
+    {"trace",               optional_argument,  0,  'T'},
+    {"trace-file",          required_argument,  0,  'F'},
     {0,                     0,                  0,    0},
 };
 
@@ -108,26 +119,54 @@ typedef struct
     /** List of imported symbols to resolve external references */
     import_info_t *imports;
 
+    /** Non-zero to validate the entire input file before loading it */
+    int strict;
+
 } reloc_info_t;
 
+/** Pack file that input files were most recently loaded from */
+static o65_pack_t *packs = 0;
+
+/** Line from a batch file whose input comes from a tar archive */
+typedef struct
+{
+    reloc_info_t info;      /**< Relocation options for the line */
+    char *files[3];         /**< Input and output filenames */
+    unsigned long line;     /**< Line number in the batch file */
+    int done;               /**< Non-zero once the input has been found */
+
+} batch_entry_t;
+
+/** Largest image that can be loaded; i.e. the 24-bit 65816 address space */
+#define RELOC_MAX_IMAGE_SIZE 0x1000000U
+
 static void usage(const char *progname);
 static void file_error(FILE *file, const char *filename);
 static int load(reloc_info_t *info, FILE *file, const char *filename);
 static int load_imports(reloc_info_t *info, const char *filename);
 static void free_imports(reloc_info_t *info);
+static int relocate_file
+    (const reloc_info_t *defaults, const char *input_file,
+     const char *output_file, const char *data_output_file);
+static int relocate_stream
+    (const reloc_info_t *defaults, FILE *infile, const char *input_file,
+     const char *output_file, const char *data_output_file,
+     uint64_t file_start);
+static int relocate_batch
+    (const reloc_info_t *defaults, const char *filename, const char *tar_file);
+static int relocate_entries(batch_entry_t *entries, size_t num_entries);
+static int relocate_tar
+    (const char *tar_file, batch_entry_t *entries, size_t num_entries);
 
 int main(int argc, char *argv[])
 {
     const char *progname = argv[0];
-    const char *input_file = 0;
-    const char *output_file = 0;
-    const char *data_output_file = 0;
     const char *imports_file = 0;
+    const char *batch_file = 0;
+    const char *tar_file = 0;
     reloc_info_t info = {
         .alignment = 1
     };
-    FILE *infile;
-    FILE *outfile;
     int result;
 
     /* Parse the command-line options */
@@ -161,6 +200,21 @@ int main(int argc, char *argv[])
             break;
 
         case 'i': imports_file = optarg; break;
+        case 'B': batch_file = optarg; break;
+        case 'A': tar_file = optarg; break;
+        case 'X': info.strict = 1; break;
+
+        case 'S':
+        case 'T':
+            if (!o65_stats_option
+                    (optarg, opt == 'S' ? O65_STATS_SUMMARY : O65_STATS_TRACE)) {
+                fprintf(stderr, "%s: invalid statistics format '%s'\n",
+                        progname, optarg);
+                return 1;
+            }
+            break;
+
+        case 'F': o65_stats_trace_file(optarg); break;
 
         default:
             usage(progname);
@@ -168,15 +222,14 @@ int main(int argc, char *argv[])
         }
     }
 
-    /* Need two or three filenames */
-    if ((argc - optind) < 2) {
+    /* Need two or three filenames, unless we are in batch mode */
+    if (!batch_file && (argc - optind) < 2) {
         usage(progname);
         return 1;
     }
-    input_file = argv[optind];
-    output_file = argv[optind + 1];
-    if ((argc - optind) >= 3) {
-        data_output_file = argv[optind + 2];
+    if (tar_file && !batch_file) {
+        fprintf(stderr, "%s: --tar can only be used with --batch\n", progname);
+        return 1;
     }
 
     /* Load the imports file */
@@ -186,78 +239,20 @@ int main(int argc, char *argv[])
             return 1;
     }
 
-    /* Open the input .o65 file and read the header */
-    if ((infile = fopen(input_file, "rb")) == NULL) {
-        perror(input_file);
-        return 1;
-    }
-    result = o65_read_header(infile, &info.header);
-    if (result < 0) {
-        perror(input_file);
-        fclose(infile);
-        free_imports(&info);
-        return 1;
-    } else if (result == 0) {
-        fprintf(stderr, "%s: not in .o65 format\n", input_file);
-        fclose(infile);
-        free_imports(&info);
-        return 1;
-    }
-
-    /* Load the input file */
-    result = load(&info, infile, input_file);
-    if (result < 0)
-        file_error(infile, input_file);
-    else if (result == 0)
-        fprintf(stderr, "%s: file is invalid\n", input_file);
-
-    /* Write the relocated data to the output file(s) */
-    if (result > 0) {
-        if ((outfile = fopen(output_file, "wb")) == NULL) {
-            perror(output_file);
-            result = -1;
-        } else {
-            if (fwrite(info.text_segment, 1, info.text_size, outfile)
-                    != info.text_size) {
-                perror(output_file);
-                result = -1;
-                fclose(outfile);
-            } else if (!data_output_file) {
-                /* Write the .data segment to the same file as .text */
-                if (fwrite(info.data_segment, 1, info.data_plus_bss_size, outfile)
-                        != info.data_plus_bss_size) {
-                    perror(output_file);
-                    result = -1;
-                }
-                fclose(outfile);
-            } else {
-                /* Write the .data segment to a different file */
-                fclose(outfile);
-                if ((outfile = fopen(data_output_file, "wb")) == NULL) {
-                    perror(data_output_file);
-                    result = -1;
-                } else {
-                    if (fwrite(info.data_segment, 1, info.data_plus_bss_size, outfile)
-                            != info.data_plus_bss_size) {
-                        perror(data_output_file);
-                        result = -1;
-                    }
-                    fclose(outfile);
-                }
-            }
-        }
+    /* Relocate the file, or all of the files in the batch */
+    if (batch_file) {
+        result = relocate_batch(&info, batch_file, tar_file);
+    } else {
+        result = relocate_file
+            (&info, argv[optind], argv[optind + 1],
+             (argc - optind) >= 3 ? argv[optind + 2] : NULL);
     }
 
     /* Clean up and exit */
-    if (info.text_segment)
-        free(info.text_segment);
-    if (info.data_segment)
-        free(info.data_segment);
-    if (info.externs)
-        free(info.externs);
     free_imports(&info);
-    fclose(infile);
-    return (result <= 0) ? 1 : 0;
+    o65_pack_close(packs);
+    o65_stats_report(stderr);
+    return result ? 0 : 1;
 }
 
 /**
@@ -267,7 +262,10 @@ int main(int argc, char *argv[])
  */
 static void usage(const char *progname)
 {
-    fprintf(stderr, "Usage: %s [options] input.o65 output.bin [data-output.bin]\n\n", progname);
+    fprintf(stderr, "Usage: %s [options] input.o65 output.bin [data-output.bin]\n", progname);
+    fprintf(stderr, "       %s [options] --batch BATCHFILE\n\n", progname);
+
+    fprintf(stderr, "Use \"-\" for standard input or standard output.\n\n");
 
     fprintf(stderr, "    --text-address ADDRESS, -t ADDRESS\n");
     fprintf(stderr, "        Address to load the text segment to on the target system.\n");
@@ -286,6 +284,24 @@ static void usage(const char *progname)
 
     fprintf(stderr, "    --imports IMPFILE, -i IMPFILE\n");
     fprintf(stderr, "        File with a list of import addresses to resolve externals.\n\n");
+
+    fprintf(stderr, "    --batch BATCHFILE, -B BATCHFILE\n");
+    fprintf(stderr, "        File with a list of images to relocate, one per line.\n\n");
+
+    fprintf(stderr, "    --tar ARCHIVE\n");
+    fprintf(stderr, "        Read the input files in the batch from a tar archive.\n\n");
+
+    fprintf(stderr, "    --strict\n");
+    fprintf(stderr, "        Validate the entire input file before loading it.\n\n");
+
+    fprintf(stderr, "    --stats[=json]\n");
+    fprintf(stderr, "        Report counters and timings on exit.\n\n");
+
+    fprintf(stderr, "    --trace[=json]\n");
+    fprintf(stderr, "        Report the time for each phase as it completes.\n\n");
+
+    fprintf(stderr, "    --trace-file TRACEFILE\n");
+    fprintf(stderr, "        Write a Chrome trace event file with the time for each phase.\n\n");
 }
 
 /**
@@ -303,6 +319,21 @@ static void file_error(FILE *file, const char *filename)
     fclose(file);
 }
 
+/**
+ * @brief Report an error at a specific offset in the input file.
+ *
+ * @param[in] file The file pointer.
+ * @param[in] filename Name of the file.
+ * @param[in] field Name of the field with the error.
+ * @param[in] message The error message.
+ */
+static void field_error
+    (FILE *file, const char *filename, const char *field, const char *message)
+{
+    fprintf(stderr, "%s:0x%lx: %s: %s\n",
+            filename, (unsigned long)ftell(file), field, message);
+}
+
 /**
  * @brief Aligns a size value.
  *
@@ -374,7 +405,7 @@ static int layout_image(reloc_info_t *info)
  */
 static int resolve_extern(reloc_info_t *info, FILE *file, const char *filename)
 {
-    char name[O65_STRING_MAX];
+    o65_string_table_t names;
     o65_size_t index;
     import_info_t *import;
     int result;
@@ -389,24 +420,32 @@ static int resolve_extern(reloc_info_t *info, FILE *file, const char *filename)
     if (info->num_externs == 0)
         return 1;
 
+    /* Load the names of the externals in a single block.  Every name
+     * needs at least one byte, so the count is checked for sanity before
+     * any memory is allocated based on it */
+    o65_string_table_init(&names);
+    result = o65_read_string_table(file, info->num_externs, &names);
+    if (result == 0) {
+        field_error(file, filename, "externs",
+                    "count is larger than the rest of the file");
+    }
+    if (result <= 0) {
+        o65_string_table_free(&names);
+        return result;
+    }
+
     /* Allocate a table to hold the resolved addresses */
     info->externs = calloc(info->num_externs, sizeof(o65_size_t));
-    if (!(info->externs))
+    if (!(info->externs)) {
+        o65_string_table_free(&names);
         return -1;
+    }
 
-    /* Load the names of the externals and resolve them */
+    /* Resolve the names of the externals */
     ok = 1;
     for (index = 0; index < info->num_externs; ++index) {
-        /* Read the next string from the file */
-        result = o65_read_string(file, name, sizeof(name));
-        if (result < 0) {
-            break;
-        } else if (result == 0) {
-            fprintf(stderr, "%s: warning: symbol name '%s' was truncated\n",
-                    filename, name);
-        }
-
         /* Find the name in the imports list */
+        const char *name = names.names[index].name;
         import = info->imports;
         while (import != NULL) {
             if (!strcmp(import->name, name))
@@ -415,12 +454,14 @@ static int resolve_extern(reloc_info_t *info, FILE *file, const char *filename)
         }
         if (import != NULL) {
             info->externs[index] = import->value;
+            O65_STATS_ADD(O65_STAT_EXTERNS_RESOLVED, 1);
         } else {
             fprintf(stderr, "%s: unresolved external reference '%s'\n",
                     filename, name);
             ok = 0;
         }
     }
+    o65_string_table_free(&names);
     return ok;
 }
 
@@ -440,6 +481,7 @@ static int relocate_segment
     (reloc_info_t *info, FILE *file, const char *filename,
      uint8_t *data, o65_size_t size)
 {
+    const o65_decoder_t *decoder = o65_get_decoder(&(info->header));
     o65_reloc_t reloc;
     o65_size_t addr;
     o65_size_t adjust;
@@ -452,7 +494,7 @@ static int relocate_segment
     /* Read and apply all relocations for the segment */
     for (;;) {
         /* Read the next relocation entry */
-        result = o65_read_reloc(file, &(info->header), &reloc);
+        result = decoder->read_reloc(file, &reloc);
         if (result <= 0)
             return result;
         else if (reloc.offset == 0)
@@ -556,6 +598,52 @@ static int relocate_segment
     return 1;
 }
 
+/**
+ * @brief Skips the relocation tables of a prelinked image in O(1).
+ *
+ * @param[in] info Relocation information for the file.
+ * @param[in] file File to load from.
+ * @param[in] segments_start Offset of the .text segment in @a file,
+ * or -1 if the file is not seekable.
+ * @param[in] option The prelinked option from the header.
+ *
+ * @return Non-zero if the relocation tables were skipped, or zero if
+ * they need to be processed the slow way.
+ *
+ * Relocation does nothing if every segment is loaded at its base address
+ * and there are no external references to resolve.  The option tells us
+ * where the exports start, so we seek there instead of decoding the
+ * tables.  If the option does not match where we are in the file, then
+ * it is stale and is ignored.
+ */
+static int skip_prelinked
+    (const reloc_info_t *info, FILE *file, long segments_start,
+     const o65_option_t *option)
+{
+    long posn;
+    if (option->len != O65_PRELINKED_OPT_LEN || segments_start < 0)
+        return 0;
+    if (info->num_externs != 0 ||
+            info->text_address != info->header.tbase ||
+            info->data_address != info->header.dbase ||
+            info->bss_address != info->header.bbase ||
+            info->zeropage_address != info->header.zbase) {
+        return 0;
+    }
+    posn = ftell(file);
+    if (posn < 0 || (unsigned long)(posn - segments_start) !=
+                        (unsigned long)o65_read_uint32(option->data)) {
+        return 0;
+    }
+    if (fseek(file, segments_start + o65_read_uint32(option->data + 4),
+              SEEK_SET) < 0) {
+        clearerr(file);
+        return 0;
+    }
+    O65_STATS_ADD(O65_STAT_PRELINKED, 1);
+    return 1;
+}
+
 /**
  * @brief Load the input file and relocate it.
  *
@@ -569,16 +657,26 @@ static int relocate_segment
 static int load(reloc_info_t *info, FILE *file, const char *filename)
 {
     o65_option_t option;
+    o65_option_t prelinked;
+    long segments_start;
+    uint64_t start;
     int result;
 
-    /* Skip any header options that are present */
+    /* Skip any header options that are present, except for the
+     * prelinked option which we need later */
+    start = O65_SPAN_BEGIN();
+    memset(&prelinked, 0, sizeof(prelinked));
     for (;;) {
         result = o65_read_option(file, &option);
         if (result <= 0)
             return result;
         if (option.len == 0)
             break;
+        if (option.type == O65_OPT_PRELINKED)
+            prelinked = option;
     }
+    segments_start = ftell(file);
+    O65_SPAN_END(O65_SPAN_OPTIONS, start, filename);
 
     /* Must be an executable, not an object file, to be able to relocate it */
     if (info->header.mode & O65_MODE_OBJ) {
@@ -624,11 +722,26 @@ static int load(reloc_info_t *info, FILE *file, const char *filename)
         return 0;
     }
 
+    /* Check the declared segment sizes before allocating memory for them */
+    if (!o65_check_remaining
+            (file, ((uint64_t)(info->header.tlen)) + info->header.dlen)) {
+        field_error(file, filename, "tlen",
+                    "segments extend past the end of the file");
+        return 0;
+    }
+    if ((info->header.mode & O65_MODE_BSSZERO) != 0 &&
+            info->header.blen > RELOC_MAX_IMAGE_SIZE) {
+        field_error(file, filename, "blen",
+                    "segment is larger than the address space");
+        return 0;
+    }
+
     /* Lay out the segments into their final locations */
     if (!layout_image(info))
         return -1;
 
     /* Load the contents of the .text and .data segments from the file */
+    start = O65_SPAN_BEGIN();
     if (info->header.tlen) {
         if (fread(info->text_segment, 1, info->header.tlen, file)
                 != info->header.tlen) {
@@ -641,11 +754,23 @@ static int load(reloc_info_t *info, FILE *file, const char *filename)
             return -1;
         }
     }
+    O65_STATS_ADD(O65_STAT_BYTES_READ, info->header.tlen + info->header.dlen);
+    O65_SPAN_END(O65_SPAN_SEGMENTS, start, filename);
 
     /* Load and resolve the external references list */
+    start = O65_SPAN_BEGIN();
     result = resolve_extern(info, file, filename);
     if (result <= 0)
         return result;
+    O65_SPAN_END(O65_SPAN_EXTERNS, start, filename);
+
+    /* If the image is being loaded at its preferred address, then
+     * relocation would not change anything and can be skipped */
+    start = O65_SPAN_BEGIN();
+    if (skip_prelinked(info, file, segments_start, &prelinked)) {
+        O65_SPAN_END(O65_SPAN_RELOCS, start, filename);
+        return 1;
+    }
 
     /* Relocate the .text segment */
     result = relocate_segment
@@ -658,6 +783,7 @@ static int load(reloc_info_t *info, FILE *file, const char *filename)
         (info, file, filename, info->data_segment, info->data_size);
     if (result <= 0)
         return result;
+    O65_SPAN_END(O65_SPAN_RELOCS, start, filename);
 
     /* The rest of the file contains exported symbols from this image.
      * Ignore because we cannot encode exported symbols in ".bin" format. */
@@ -693,7 +819,7 @@ static int load_imports(reloc_info_t *info, const char *filename)
     while (fgets(buf, sizeof(buf), file)) {
         /* Strip whitespace from the end of the line */
         len = strlen(buf);
-        while (len > 0 && isspace(buf[len - 1]))
+        while (len > 0 && isspace((unsigned char)(buf[len - 1])))
             --len;
         buf[len] = '\0';
 
@@ -703,7 +829,7 @@ static int load_imports(reloc_info_t *info, const char *filename)
 
         /* Split the line into name and value */
         posn = 0;
-        while (buf[posn] != '\0' && !isspace(buf[posn]))
+        while (buf[posn] != '\0' && !isspace((unsigned char)(buf[posn])))
             ++posn;
         if (buf[posn] == '\0')
             continue; /* No value present; ignore this line */
@@ -739,3 +865,546 @@ static void free_imports(reloc_info_t *info)
     }
     info->imports = NULL;
 }
+
+/**
+ * @brief Validates an entire input file and then rewinds it.
+ *
+ * @param[in] file The file pointer.
+ * @param[in] filename Name of the file, for error reporting.
+ *
+ * @return Non-zero if the file is valid, or zero if it is not.
+ */
+static int validate_file(FILE *file, const char *filename)
+{
+    o65_validate_error_t error;
+    int result = o65_validate(file, &error);
+    if (result < 0) {
+        perror(filename);
+        return 0;
+    } else if (result == 0) {
+        fprintf(stderr, "%s:0x%lx: %s: %s\n", filename,
+                error.offset, error.field, error.message);
+        return 0;
+    }
+    if (fseek(file, 0, SEEK_SET) < 0) {
+        perror(filename);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Relocates a single input file and writes the output file(s).
+ *
+ * @param[in] defaults Default relocation options from the command-line.
+ * @param[in] input_file Name of the input ".o65" file.
+ * @param[in] output_file Name of the output ".bin" file.
+ * @param[in] data_output_file Name of the output file for the .data segment,
+ * or NULL to write .data to @a output_file after the .text segment.
+ *
+ * @return Non-zero on success, or zero on failure.
+ */
+static int relocate_file
+    (const reloc_info_t *defaults, const char *input_file,
+     const char *output_file, const char *data_output_file)
+{
+    FILE *infile;
+    uint8_t *buffer = NULL;
+    uint64_t file_start;
+    uint64_t start;
+    int result;
+
+    /* Open the input .o65 file, which may be standard input */
+    file_start = O65_SPAN_BEGIN();
+    start = file_start;
+    if (!strcmp(input_file, "-"))
+        infile = o65_fopen_input(input_file, &buffer);
+    else
+        infile = o65_pack_fopen(input_file, &packs);
+    if (!infile) {
+        perror(input_file);
+        return 0;
+    }
+    O65_SPAN_END(O65_SPAN_OPEN, start, input_file);
+    result = relocate_stream(defaults, infile, input_file, output_file,
+                             data_output_file, file_start);
+    free(buffer);
+    return result;
+}
+
+/**
+ * @brief Relocates an input file that is already open.
+ *
+ * @param[in] defaults Default relocation options from the command-line.
+ * @param[in] infile The input file, which is closed on exit.
+ * @param[in] input_file Name of the input ".o65" file.
+ * @param[in] output_file Name of the output ".bin" file.
+ * @param[in] data_output_file Name of the output file for the .data segment,
+ * or NULL to write .data to @a output_file after the .text segment.
+ * @param[in] file_start Time that processing of the input file started.
+ *
+ * @return Non-zero on success, or zero on failure.
+ */
+static int relocate_stream
+    (const reloc_info_t *defaults, FILE *infile, const char *input_file,
+     const char *output_file, const char *data_output_file,
+     uint64_t file_start)
+{
+    reloc_info_t info = *defaults;
+    FILE *outfile;
+    uint64_t start;
+    int written;
+    int result;
+
+    /* Validate the input if requested, and then read the header */
+    if (info.strict && !validate_file(infile, input_file)) {
+        fclose(infile);
+        return 0;
+    }
+    start = O65_SPAN_BEGIN();
+    result = o65_read_header(infile, &info.header);
+    O65_SPAN_END(O65_SPAN_HEADER, start, input_file);
+    if (result < 0) {
+        perror(input_file);
+        fclose(infile);
+        return 0;
+    } else if (result == 0) {
+        fprintf(stderr, "%s: not in .o65 format\n", input_file);
+        fclose(infile);
+        return 0;
+    }
+
+    /* Load the input file */
+    result = load(&info, infile, input_file);
+    if (result < 0) {
+        file_error(infile, input_file);
+        infile = NULL;
+    } else if (result == 0) {
+        fprintf(stderr, "%s: file is invalid\n", input_file);
+    }
+
+    /* Write the relocated data to the output file(s) */
+    start = O65_SPAN_BEGIN();
+    if (result > 0) {
+        if ((outfile = o65_fopen_output(output_file)) == NULL) {
+            perror(output_file);
+            result = -1;
+        } else {
+            if (fwrite(info.text_segment, 1, info.text_size, outfile)
+                    != info.text_size) {
+                perror(output_file);
+                result = -1;
+                o65_fclose_output(outfile);
+            } else if (!data_output_file) {
+                /* Write the .data segment to the same file as .text */
+                written = fwrite(info.data_segment, 1,
+                                 info.data_plus_bss_size, outfile)
+                            == info.data_plus_bss_size;
+                if (o65_fclose_output(outfile) < 0 || !written) {
+                    perror(output_file);
+                    result = -1;
+                }
+            } else {
+                /* Write the .data segment to a different file */
+                if (o65_fclose_output(outfile) < 0) {
+                    perror(output_file);
+                    result = -1;
+                } else if ((outfile = o65_fopen_output(data_output_file))
+                               == NULL) {
+                    perror(data_output_file);
+                    result = -1;
+                } else {
+                    written = fwrite(info.data_segment, 1,
+                                     info.data_plus_bss_size, outfile)
+                                == info.data_plus_bss_size;
+                    if (o65_fclose_output(outfile) < 0 || !written) {
+                        perror(data_output_file);
+                        result = -1;
+                    }
+                }
+            }
+        }
+    }
+
+    if (result > 0) {
+        O65_STATS_ADD(O65_STAT_BYTES_WRITTEN,
+                      info.text_size + info.data_plus_bss_size);
+        O65_SPAN_END(O65_SPAN_WRITE, start, output_file);
+    }
+
+    /* Clean up */
+    if (info.text_segment)
+        free(info.text_segment);
+    if (info.data_segment)
+        free(info.data_segment);
+    if (info.externs)
+        free(info.externs);
+    if (infile)
+        fclose(infile);
+    O65_SPAN_END(O65_SPAN_FILE, file_start, input_file);
+    return result > 0;
+}
+
+/** Maximum number of whitespace-separated fields on a batch file line */
+#define BATCH_MAX_FIELDS 8
+
+/**
+ * @brief Relocates all of the images that are listed in a batch file.
+ *
+ * @param[in] defaults Default relocation options from the command-line.
+ * @param[in] filename Name of the batch file.
+ *
+ * @return Non-zero if all images were relocated, or zero on failure.
+ *
+ * Each line of the batch file has the form:
+ *
+ *     input.o65 output.bin [data-output.bin] [text=ADDR] [data=ADDR]
+ *         [bss=ADDR] [zp=ADDR]
+ *
+ * The "name=ADDR" fields override the command-line load addresses
+ * for that line only.  Blank lines and lines starting with '#' are ignored.
+ *
+ * The lines are collected first and then the input files are loaded
+ * with the prefetcher, so that many of them are being read at once.
+ *
+ * If @a tar_file is not NULL, then the input files are members of the
+ * tar archive instead.  The archive is read once from start to finish,
+ * relocating each member that is named in the batch as it goes past.
+ */
+static int relocate_batch
+    (const reloc_info_t *defaults, const char *filename, const char *tar_file)
+{
+    batch_entry_t *entries = NULL;
+    size_t num_entries = 0;
+    size_t max_entries = 0;
+    char buf[BUFSIZ];
+    char *fields[BATCH_MAX_FIELDS];
+    const char *files[3];
+    reloc_info_t info;
+    FILE *file;
+    char *value;
+    char *next;
+    int num_fields;
+    int num_files;
+    int index;
+    int ok = 1;
+    int line_ok;
+    unsigned long line = 0;
+
+    /* Open the batch file */
+    if ((file = fopen(filename, "r")) == NULL) {
+        perror(filename);
+        return 0;
+    }
+
+    /* Process the lines of the batch file one at a time */
+    while (fgets(buf, sizeof(buf), file)) {
+        ++line;
+
+        /* Split the line into whitespace-separated fields */
+        num_fields = 0;
+        next = buf;
+        while (num_fields < BATCH_MAX_FIELDS) {
+            while (*next != '\0' && isspace((unsigned char)(*next)))
+                ++next;
+            if (*next == '\0' || *next == '#')
+                break;
+            fields[num_fields++] = next;
+            while (*next != '\0' && !isspace((unsigned char)(*next)))
+                ++next;
+            if (*next != '\0')
+                *next++ = '\0';
+        }
+        if (num_fields == 0)
+            continue;
+        while (*next != '\0' && isspace((unsigned char)(*next)))
+            ++next;
+        if (*next != '\0' && *next != '#') {
+            fprintf(stderr, "%s:%lu: too many fields in batch line\n",
+                    filename, line);
+            ok = 0;
+            continue;
+        }
+
+        /* Separate the filenames from the address overrides */
+        info = *defaults;
+        num_files = 0;
+        line_ok = 1;
+        for (index = 0; index < num_fields; ++index) {
+            value = strchr(fields[index], '=');
+            if (!value) {
+                if (num_files < 3) {
+                    files[num_files++] = fields[index];
+                } else {
+                    line_ok = 0;
+                }
+                continue;
+            }
+            *value++ = '\0';
+            if (!strcmp(fields[index], "text")) {
+                info.load_text_address = strtoul(value, NULL, 0);
+                if (info.load_text_address == 0U)
+                    line_ok = 0;
+            } else if (!strcmp(fields[index], "data")) {
+                info.load_data_address = strtoul(value, NULL, 0);
+            } else if (!strcmp(fields[index], "bss")) {
+                info.load_bss_address = strtoul(value, NULL, 0);
+            } else if (!strcmp(fields[index], "zp")) {
+                info.zeropage_address = strtoul(value, NULL, 0);
+                if (info.zeropage_address >= 256U)
+                    line_ok = 0;
+            } else {
+                line_ok = 0;
+            }
+        }
+        if (num_files < 2)
+            line_ok = 0;
+        if (!line_ok) {
+            fprintf(stderr, "%s:%lu: invalid batch line\n", filename, line);
+            ok = 0;
+            continue;
+        }
+
+        /* Remember the line until all of the lines have been read */
+        if (num_entries >= max_entries) {
+            size_t new_max = max_entries ? max_entries * 2 : 64;
+            batch_entry_t *new_entries =
+                realloc(entries, new_max * sizeof(batch_entry_t));
+            if (!new_entries) {
+                fprintf(stderr, "out of memory\n");
+                ok = 0;
+                break;
+            }
+            entries = new_entries;
+            max_entries = new_max;
+        }
+        memset(&(entries[num_entries]), 0, sizeof(batch_entry_t));
+        entries[num_entries].info = info;
+        entries[num_entries].line = line;
+        line_ok = 1;
+        for (index = 0; index < num_files; ++index) {
+            if ((entries[num_entries].files[index] = strdup(files[index]))
+                    == NULL) {
+                line_ok = 0;
+            }
+        }
+        ++num_entries;
+        if (!line_ok) {
+            fprintf(stderr, "out of memory\n");
+            ok = 0;
+            break;
+        }
+    }
+    fclose(file);
+
+    /* Relocate the images from the input files or the tar archive */
+    if (ok) {
+        if (tar_file)
+            ok = relocate_tar(tar_file, entries, num_entries);
+        else
+            ok = relocate_entries(entries, num_entries);
+    }
+
+    /* Done */
+    for (; num_entries > 0; --num_entries) {
+        for (index = 0; index < 3; ++index)
+            free(entries[num_entries - 1].files[index]);
+    }
+    free(entries);
+    return ok;
+}
+
+/** Batch entries whose input files are being prefetched */
+typedef struct
+{
+    batch_entry_t *entries; /**< The batch entries */
+    size_t num_entries;     /**< Number of batch entries */
+    size_t next;            /**< Index of the next entry to prefetch */
+
+} batch_source_t;
+
+/**
+ * @brief Gets the name of the next input file to prefetch.
+ *
+ * @param[in,out] ctx Points to the batch_source_t for the entries.
+ *
+ * @return The name of the next input file, or NULL if there are no more.
+ */
+static const char *next_batch_input(void *ctx)
+{
+    batch_source_t *source = (batch_source_t *)ctx;
+    if (source->next >= source->num_entries)
+        return NULL;
+    return source->entries[(source->next)++].files[0];
+}
+
+/**
+ * @brief Relocates batch entries whose inputs are separate files.
+ *
+ * @param[in,out] entries The batch entries.
+ * @param[in] num_entries Number of batch entries.
+ *
+ * @return Non-zero if all images were relocated, or zero on failure.
+ *
+ * The prefetcher returns the files in the same order as the entries.
+ * Inputs that it cannot load, such as standard input or a member of a
+ * pack file, are opened in the usual way instead.
+ */
+static int relocate_entries(batch_entry_t *entries, size_t num_entries)
+{
+    batch_source_t source = { entries, num_entries, 0 };
+    o65_prefetch_t *prefetch;
+    o65_prefetch_file_t input;
+    batch_entry_t *entry = entries;
+    uint64_t file_start;
+    FILE *infile;
+    int ok = 1;
+
+    prefetch = o65_prefetch_new(0, next_batch_input, &source);
+    if (!prefetch) {
+        fprintf(stderr, "out of memory\n");
+        return 0;
+    }
+    while (o65_prefetch_next(prefetch, &input)) {
+        file_start = O65_SPAN_BEGIN();
+        if (input.error != 0 || input.size == 0) {
+            if (!relocate_file(&(entry->info), entry->files[0],
+                               entry->files[1], entry->files[2])) {
+                ok = 0;
+            }
+        } else if ((infile = fmemopen(input.data, input.size, "rb"))
+                       == NULL) {
+            perror(entry->files[0]);
+            ok = 0;
+        } else if (!relocate_stream(&(entry->info), infile, entry->files[0],
+                                    entry->files[1], entry->files[2],
+                                    file_start)) {
+            ok = 0;
+        }
+        o65_prefetch_release(&input);
+        ++entry;
+    }
+    o65_prefetch_free(prefetch);
+    return ok;
+}
+
+/**
+ * @brief Compares two batch entries by input filename and line number.
+ *
+ * @param[in] e1 Points to the first entry.
+ * @param[in] e2 Points to the second entry.
+ *
+ * @return Less than, equal to, or greater than zero.
+ */
+static int compare_batch_entries(const void *e1, const void *e2)
+{
+    const batch_entry_t *entry1 = (const batch_entry_t *)e1;
+    const batch_entry_t *entry2 = (const batch_entry_t *)e2;
+    int cmp = strcmp(entry1->files[0], entry2->files[0]);
+    if (cmp != 0)
+        return cmp;
+    return entry1->line < entry2->line ? -1 : (entry1->line > entry2->line);
+}
+
+/**
+ * @brief Relocates batch entries whose inputs come from a tar archive.
+ *
+ * @param[in] tar_file Name of the tar archive.
+ * @param[in,out] entries The batch entries, which are sorted on exit.
+ * @param[in] num_entries Number of batch entries.
+ *
+ * @return Non-zero if all images were relocated, or zero on failure.
+ */
+static int relocate_tar
+    (const char *tar_file, batch_entry_t *entries, size_t num_entries)
+{
+    o65_tar_member_t member;
+    o65_tar_t tar;
+    batch_entry_t *entry;
+    batch_entry_t *end = entries + num_entries;
+    uint64_t file_start;
+    FILE *archive;
+    FILE *infile;
+    size_t index;
+    size_t left;
+    size_t right;
+    int result;
+    int complete = 0;
+    int ok = 1;
+
+    /* Sort the entries so that the members can be looked up quickly */
+    if (num_entries == 0)
+        return 1;
+    qsort(entries, num_entries, sizeof(batch_entry_t), compare_batch_entries);
+
+    /* Read the archive, relocating the members as they go past */
+    if (!strcmp(tar_file, "-")) {
+        archive = stdin;
+    } else if ((archive = fopen(tar_file, "rb")) == NULL) {
+        perror(tar_file);
+        return 0;
+    }
+    o65_tar_init(&tar, archive);
+    for (;;) {
+        file_start = O65_SPAN_BEGIN();
+        result = o65_tar_next(&tar, &member);
+        if (result < 0) {
+            if (feof(archive))
+                fprintf(stderr, "%s: unexpected EOF\n", tar_file);
+            else
+                perror(tar_file);
+            ok = 0;
+            break;
+        } else if (result == 0) {
+            fprintf(stderr, "%s:0x%lx: %s\n", tar_file,
+                    (unsigned long)(member.offset), tar.error);
+            ok = 0;
+            break;
+        } else if (!member.name) {
+            complete = 1;
+            break;
+        }
+
+        /* Find the first batch line for this member, if any */
+        left = 0;
+        right = num_entries;
+        while (left < right) {
+            index = left + (right - left) / 2;
+            if (strcmp(entries[index].files[0], member.name) < 0)
+                left = index + 1;
+            else
+                right = index;
+        }
+
+        /* Relocate the member once for each line that names it */
+        for (entry = entries + left;
+                entry < end && !strcmp(entry->files[0], member.name);
+                ++entry) {
+            if (entry->done)
+                continue; /* Duplicate member in the archive */
+            entry->done = 1;
+            infile = fmemopen((void *)(member.data), member.size, "rb");
+            if (!infile) {
+                perror(member.name);
+                ok = 0;
+            } else if (!relocate_stream(&(entry->info), infile, member.name,
+                                        entry->files[1], entry->files[2],
+                                        file_start)) {
+                ok = 0;
+            }
+        }
+    }
+    o65_tar_free(&tar);
+    if (archive != stdin)
+        fclose(archive);
+
+    /* Report the inputs that were not found in the archive */
+    for (entry = entries; complete && entry < end; ++entry) {
+        if (!entry->done) {
+            fprintf(stderr, "%s: not found in %s\n", entry->files[0],
+                    tar_file);
+            ok = 0;
+        }
+    }
+    return ok;
+}
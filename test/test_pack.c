@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2023 Southern Storm Software, Pty Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Regression tests for the pack file reader.  Each test builds a valid
+ * pack, damages its trailer, and checks that o65_pack_open() rejects it
+ * rather than trusting the offsets and sizes in the file.
+ */
+
+#include "o65pack.h"
+#include "o65file.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/** Name of the temporary pack file */
+static char pack_filename[64];
+
+/** Number of tests that failed */
+static int failures = 0;
+
+/**
+ * @brief Writes a valid pack with a single member to the temporary file.
+ *
+ * @return The size of the pack file, or zero on error.
+ */
+static long write_pack(void)
+{
+    static uint8_t const member[4] = {0x01, 0x00, 'o', '6'};
+    o65_pack_builder_t builder;
+    FILE *file;
+    long size;
+    int fd;
+
+    strcpy(pack_filename, "/tmp/o65packtestXXXXXX");
+    if ((fd = mkstemp(pack_filename)) < 0 ||
+            (file = fdopen(fd, "w+b")) == NULL) {
+        perror("mkstemp");
+        return 0;
+    }
+    if (o65_pack_builder_init(&builder, file) < 0 ||
+            o65_pack_builder_add
+                (&builder, "a.o65", member, sizeof(member)) < 0 ||
+            o65_pack_builder_finish(&builder) < 0) {
+        perror(pack_filename);
+        fclose(file);
+        return 0;
+    }
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    fclose(file);
+    return size;
+}
+
+/**
+ * @brief Overwrites the trailer of the temporary pack file.
+ *
+ * @param[in] size Size of the pack file.
+ * @param[in] index_offset Offset of the index to write to the trailer.
+ * @param[in] count Number of members to write to the trailer.
+ * @param[in] names_size Size of the names to write to the trailer.
+ */
+static void write_trailer
+    (long size, uint64_t index_offset, uint32_t count, uint32_t names_size)
+{
+    uint8_t trailer[16];
+    FILE *file;
+    o65_write_uint32(trailer, (uint32_t)index_offset);
+    o65_write_uint32(trailer + 4, (uint32_t)(index_offset >> 32));
+    o65_write_uint32(trailer + 8, count);
+    o65_write_uint32(trailer + 12, names_size);
+    if ((file = fopen(pack_filename, "r+b")) == NULL ||
+            fseek(file, size - O65_PACK_TRAILER_SIZE, SEEK_SET) < 0 ||
+            fwrite(trailer, 1, sizeof(trailer), file) != sizeof(trailer)) {
+        perror(pack_filename);
+        exit(1);
+    }
+    fclose(file);
+}
+
+/**
+ * @brief Checks the result of opening the temporary pack file.
+ *
+ * @param[in] name Name of the test.
+ * @param[in] expected The expected return value from o65_pack_open().
+ */
+static void check_open(const char *name, int expected)
+{
+    o65_pack_t *pack = NULL;
+    int result = o65_pack_open(pack_filename, &pack);
+    if (result != expected) {
+        printf("%s: o65_pack_open returned %d, expected %d\n",
+               name, result, expected);
+        ++failures;
+    } else {
+        printf("%s: ok\n", name);
+    }
+    o65_pack_close(pack);
+}
+
+int main(void)
+{
+    long size = write_pack();
+    uint64_t wrapped;
+    if (!size)
+        return 1;
+    check_open("valid pack", 1);
+
+    /* The index offset, index size, and names size add up to the size of
+     * the file modulo 2^64, but the index offset is far out of bounds */
+    wrapped = (uint64_t)size - O65_PACK_TRAILER_SIZE -
+              200 * O65_PACK_ENTRY_SIZE - 0xFFFFFFFFU;
+    write_trailer(size, wrapped, 200, 0xFFFFFFFFU);
+    check_open("wrapped index offset", 0);
+
+    /* Index offset within the file, but the names run past the trailer */
+    write_trailer(size, O65_PACK_HEADER_SIZE, 0, 0xFFFFFFFFU);
+    check_open("oversized names", 0);
+
+    /* Index that runs past the trailer */
+    write_trailer(size, size - O65_PACK_TRAILER_SIZE, 1, 0);
+    check_open("oversized index", 0);
+
+    unlink(pack_filename);
+    return failures != 0;
+}
@@ -0,0 +1,323 @@
+/*
+ * Copyright (C) 2023 Southern Storm Software, Pty Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "o65visit.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#define short_options "s:e:o:i:"
+static struct option long_options[] = {
+    {"start-address",       required_argument,  0,  's'},
+    {"end-address",         required_argument,  0,  'e'},
+    {"output",              required_argument,  0,  'o'},
+    {"imports",             required_argument,  0,  'i'},
+    {0,                     0,                  0,    0},
+};
+
+/** Name of the external reference for the shared imaginary registers */
+#define IMAG_REGS_NAME "__IMAG_REGS"
+
+/** Number of bytes of zero page that are used by the imaginary registers */
+#define IMAG_REGS_SIZE 32
+
+/** Information about a module that needs zero page space */
+typedef struct
+{
+    /** Name of the input ".o65" file */
+    const char *filename;
+
+    /** Size of the module's zero page segment */
+    o65_size_t zlen;
+
+    /** Non-zero if the module refers to the shared imaginary registers */
+    int hosted;
+
+    /** Zero page address that was allocated to the module */
+    o65_size_t zp_address;
+
+} module_info_t;
+
+static void usage(const char *progname);
+static int scan_module(module_info_t *module);
+static void write_batch_line(FILE *file, const module_info_t *module);
+
+int main(int argc, char *argv[])
+{
+    const char *progname = argv[0];
+    const char *output_file = 0;
+    const char *imports_file = 0;
+    o65_size_t start_address = 0;
+    o65_size_t end_address = 0x100;
+    o65_size_t next_address;
+    o65_size_t imag_regs = 0;
+    module_info_t *modules;
+    int num_modules;
+    int index;
+    int any_hosted = 0;
+    FILE *outfile;
+
+    /* Parse the command-line options */
+    for (;;) {
+        int opt = getopt_long(argc, argv, short_options, long_options, 0);
+        if (opt < 0)
+            break;
+        switch (opt) {
+        case 's':
+            start_address = strtoul(optarg, NULL, 0);
+            break;
+
+        case 'e':
+            end_address = strtoul(optarg, NULL, 0);
+            break;
+
+        case 'o': output_file = optarg; break;
+        case 'i': imports_file = optarg; break;
+
+        default:
+            usage(progname);
+            return 1;
+        }
+    }
+    if (start_address >= end_address || end_address > 0x100) {
+        fprintf(stderr, "%s: invalid zero page range 0x%lx to 0x%lx\n",
+                progname, (unsigned long)start_address,
+                (unsigned long)end_address);
+        return 1;
+    }
+
+    /* Need at least one input file */
+    if ((argc - optind) < 1) {
+        usage(progname);
+        return 1;
+    }
+    num_modules = argc - optind;
+    modules = calloc(num_modules, sizeof(module_info_t));
+    if (!modules) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    /* Scan the headers and externals of all modules */
+    for (index = 0; index < num_modules; ++index) {
+        modules[index].filename = argv[optind + index];
+        if (!scan_module(&(modules[index]))) {
+            free(modules);
+            return 1;
+        }
+        any_hosted |= modules[index].hosted;
+    }
+
+    /* The imaginary registers are shared between all hosted modules,
+     * so they are allocated once at the start of the range.  Every other
+     * module gets its own non-overlapping slice of what is left. */
+    next_address = start_address;
+    if (any_hosted) {
+        imag_regs = next_address;
+        next_address += IMAG_REGS_SIZE;
+    }
+    for (index = 0; index < num_modules; ++index) {
+        modules[index].zp_address = next_address;
+        next_address += modules[index].zlen;
+    }
+    if (next_address > end_address) {
+        fprintf(stderr, "%s: out of zero page; need %lu bytes but only %lu are available\n",
+                progname, (unsigned long)(next_address - start_address),
+                (unsigned long)(end_address - start_address));
+        free(modules);
+        return 1;
+    }
+
+    /* Write the batch relocation list */
+    if (output_file) {
+        if ((outfile = fopen(output_file, "w")) == NULL) {
+            perror(output_file);
+            free(modules);
+            return 1;
+        }
+    } else {
+        outfile = stdout;
+    }
+    fprintf(outfile, "# zero page 0x%02lx-0x%02lx: %lu of %lu bytes used\n",
+            (unsigned long)start_address, (unsigned long)end_address - 1,
+            (unsigned long)(next_address - start_address),
+            (unsigned long)(end_address - start_address));
+    if (any_hosted) {
+        fprintf(outfile, "# %s = 0x%02lx\n", IMAG_REGS_NAME,
+                (unsigned long)imag_regs);
+    }
+    for (index = 0; index < num_modules; ++index) {
+        write_batch_line(outfile, &(modules[index]));
+    }
+    if (output_file)
+        fclose(outfile);
+
+    /* Write the address of the imaginary registers to the imports file */
+    if (imports_file) {
+        if ((outfile = fopen(imports_file, "w")) == NULL) {
+            perror(imports_file);
+            free(modules);
+            return 1;
+        }
+        if (any_hosted) {
+            fprintf(outfile, "%s 0x%02lx\n", IMAG_REGS_NAME,
+                    (unsigned long)imag_regs);
+        }
+        fclose(outfile);
+    }
+
+    /* Clean up and exit */
+    free(modules);
+    return 0;
+}
+
+/**
+ * @brief Print usage information for the program.
+ *
+ * @param[in] progname Name of the program from argv[0].
+ */
+static void usage(const char *progname)
+{
+    fprintf(stderr, "Usage: %s [options] input1.o65 ...\n\n", progname);
+
+    fprintf(stderr, "    --start-address ADDRESS, -s ADDRESS\n");
+    fprintf(stderr, "        First zero page address that may be allocated; default is 0.\n\n");
+
+    fprintf(stderr, "    --end-address ADDRESS, -e ADDRESS\n");
+    fprintf(stderr, "        Address just past the last zero page address that may be\n");
+    fprintf(stderr, "        allocated; default is 0x100.\n\n");
+
+    fprintf(stderr, "    --output BATCHFILE, -o BATCHFILE\n");
+    fprintf(stderr, "        Write the batch relocation list to BATCHFILE instead\n");
+    fprintf(stderr, "        of standard output.\n\n");
+
+    fprintf(stderr, "    --imports IMPFILE, -i IMPFILE\n");
+    fprintf(stderr, "        Write the address of the shared imaginary registers\n");
+    fprintf(stderr, "        to an imports file for o65reloc.\n\n");
+}
+
+/**
+ * @brief Records the size of the zero page segment for a module.
+ */
+static int scan_header(void *ctx, const o65_header_t *header)
+{
+    module_info_t *module = (module_info_t *)ctx;
+    module->zlen = header->zlen;
+    return O65_VISIT_CONTINUE;
+}
+
+/**
+ * @brief Looks for a reference to the shared imaginary registers.
+ */
+static int scan_extern
+    (void *ctx, const o65_header_t *header, o65_size_t index, const char *name)
+{
+    module_info_t *module = (module_info_t *)ctx;
+    (void)header;
+    (void)index;
+    if (!strcmp(name, IMAG_REGS_NAME)) {
+        module->hosted = 1;
+        return O65_VISIT_STOP;
+    }
+    return O65_VISIT_CONTINUE;
+}
+
+/**
+ * @brief Stops the scan once the externals have been seen.
+ */
+static int scan_stop(void *ctx, const o65_header_t *header, uint8_t segid)
+{
+    (void)ctx;
+    (void)header;
+    (void)segid;
+    return O65_VISIT_STOP;
+}
+
+/**
+ * @brief Scans the header and external references of a module.
+ *
+ * @param[in,out] module Information about the module.
+ *
+ * @return Non-zero if the module was scanned, or zero on error.
+ *
+ * Only the first image is scanned if the file contains chained images,
+ * which matches the behaviour of o65reloc.
+ */
+static int scan_module(module_info_t *module)
+{
+    o65_visitor_t visitor;
+    FILE *file;
+    int result;
+
+    /* We only need the header and the externals, so the segments are
+     * skipped and the walk stops before the relocation tables */
+    memset(&visitor, 0, sizeof(visitor));
+    visitor.header = scan_header;
+    visitor.extern_symbol = scan_extern;
+    visitor.begin_relocs = scan_stop;
+
+    /* Open the file and scan it */
+    if ((file = fopen(module->filename, "rb")) == NULL) {
+        perror(module->filename);
+        return 0;
+    }
+    result = o65_visit(file, &visitor, module);
+    if (result == 0) {
+        fprintf(stderr, "%s: not in .o65 format\n", module->filename);
+        fclose(file);
+        return 0;
+    } else if (result < 0) {
+        if (feof(file))
+            fprintf(stderr, "%s: unexpected EOF\n", module->filename);
+        else
+            perror(module->filename);
+        fclose(file);
+        return 0;
+    }
+    fclose(file);
+    return 1;
+}
+
+/**
+ * @brief Writes the o65reloc batch line for a module.
+ *
+ * @param[in] file The batch file to write to.
+ * @param[in] module Information about the module.
+ *
+ * The output filename is the input filename with ".o65" replaced
+ * with ".bin", or with ".bin" appended if there is no ".o65" suffix.
+ */
+static void write_batch_line(FILE *file, const module_info_t *module)
+{
+    size_t len = strlen(module->filename);
+    if (len > 4 && !strcmp(module->filename + len - 4, ".o65")) {
+        fprintf(file, "%s %.*s.bin", module->filename,
+                (int)(len - 4), module->filename);
+    } else {
+        fprintf(file, "%s %s.bin", module->filename, module->filename);
+    }
+    if (module->zlen != 0) {
+        fprintf(file, " zp=0x%02lx", (unsigned long)(module->zp_address));
+    }
+    fprintf(file, "\n");
+}